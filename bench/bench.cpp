@@ -0,0 +1,282 @@
+// 微基准：./rn_bench [用例名...]，不给名字时运行全部。
+// 每个用例同时校验结果并对耗时做宽松的上限检查，只为发现数量级上的退化，绝对数值以输出为准
+
+#include "../tests/harness.h"
+
+namespace
+{
+	std::vector<std::string> make_host_ids(std::size_t count)
+	{
+		std::vector<std::string> host_ids;
+		host_ids.reserve(count);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			// 与真实 host_id 一样是 24 位十六进制
+			std::ostringstream oss;
+			oss << "5b687ad9" << std::hex << std::setw(16) << std::setfill('0') << (0xc39aaf0001200000ull + i * 7919);
+			host_ids.push_back(oss.str());
+		}
+		return host_ids;
+	}
+
+	// 改动前每次轮询的准备过程：转义 host_id、用字符串流拼 URL、重新设置超时与输出缓冲
+	void legacy_prepare_request(CURL* curl, const std::string& base_url, const std::string& host_id, std::string& body, std::string& headers)
+	{
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+		body.clear();
+		headers.clear();
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &headers);
+
+		char* escaped_host_id = curl_easy_escape(curl, host_id.c_str(), 0);
+		std::ostringstream url_stream;
+		url_stream << base_url << "?host_id=" << escaped_host_id;
+		curl_free(escaped_host_id);
+		const auto url = url_stream.str();
+		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	}
+}
+
+// user-026：逐次拼装请求与加载配置时预先生成请求模板的对比，不发出网络请求
+RN_TEST(url_template)
+{
+	constexpr std::size_t host_count = 5000;
+	const std::string base_url = "https://live-mall.xiaohongshu.com/api/sns/red/livemall/app/dynamic/host/info";
+	const auto host_ids = make_host_ids(host_count);
+
+	Config config;
+	config.request.base_url = base_url;
+	config.request.headers = { { "user-agent", "bench" }, { "referer", "https://app.xhs.cn/" } };
+	std::vector<std::string> request_urls;
+	request_urls.reserve(host_count);
+	for (const auto& host_id : host_ids)
+	{
+		request_urls.push_back(build_request_url(base_url, host_id));
+	}
+	const auto build_ns = rn_harness::nanoseconds_per_op(host_count, [&](std::size_t i)
+		{
+			rn_harness::keep(build_request_url(base_url, host_ids[i]));
+		});
+
+	CURL* legacy = curl_easy_init();
+	RN_CHECK(legacy != nullptr);
+	std::string body;
+	std::string headers;
+	constexpr std::size_t polls = 200000;
+	const auto legacy_ns = rn_harness::nanoseconds_per_op(polls, [&](std::size_t i)
+		{
+			legacy_prepare_request(legacy, base_url, host_ids[i % host_count], body, headers);
+		});
+	curl_easy_cleanup(legacy);
+
+	CurlHttpClient client(config);
+	const auto template_ns = rn_harness::nanoseconds_per_op(polls, [&](std::size_t i)
+		{
+			rn_harness::keep(client.prepare_request(request_urls[i % host_count]));
+		});
+
+	// 两种方式生成的 URL 必须一致
+	CURL* escaper = curl_easy_init();
+	for (std::size_t i = 0; i < host_count; i += 97)
+	{
+		char* escaped = curl_easy_escape(escaper, host_ids[i].c_str(), 0);
+		RN_CHECK_EQ(request_urls[i], base_url + "?host_id=" + escaped);
+		curl_free(escaped);
+	}
+	RN_CHECK_EQ(build_request_url(base_url, "a b/c"), base_url + "?host_id=a%20b%2Fc");
+	curl_easy_cleanup(escaper);
+
+	rn_harness::report("build template (per host, once at load)", build_ns);
+	rn_harness::report("per-poll prepare, legacy", legacy_ns);
+	rn_harness::report("per-poll prepare, precomputed template", template_ns);
+	RN_CHECK(template_ns < legacy_ns);
+}
+
+namespace
+{
+	struct WheelRun
+	{
+		double schedule_ns = 0;
+		double expire_ns = 0;
+		std::size_t expirations = 0;
+	};
+
+	// 模拟 host_count 个主播轮询一小时：初次登记后每个刻度推进一次，到期的主播按 30~90 秒后重新登记
+	WheelRun run_timer_wheel(std::size_t host_count)
+	{
+		using clock = TimerWheel::clock;
+		constexpr auto tick = std::chrono::milliseconds(250);
+		const auto start = clock::now();
+		std::minstd_rand rng(42);
+		std::uniform_int_distribution<int> first_delay_ms(0, 60000);
+		std::uniform_int_distribution<int> interval_ms(30000, 90000);
+
+		TimerWheel wheel(host_count, tick, start);
+		std::vector<clock::time_point> due_at(host_count);
+		WheelRun run;
+
+		const auto schedule_started = std::chrono::steady_clock::now();
+		for (std::size_t id = 0; id < host_count; ++id)
+		{
+			due_at[id] = start + std::chrono::milliseconds(first_delay_ms(rng));
+			wheel.schedule(id, due_at[id]);
+		}
+		run.schedule_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - schedule_started).count() / host_count;
+
+		std::vector<std::size_t> expired;
+		const auto ticks = std::chrono::hours(1) / tick;
+		const auto expire_started = std::chrono::steady_clock::now();
+		for (std::int64_t t = 1; t <= ticks; ++t)
+		{
+			const auto now = start + tick * t;
+			expired.clear();
+			wheel.advance(now, expired);
+			for (const auto id : expired)
+			{
+				// 不能提前触发，也不能晚于一个刻度
+				if (due_at[id] > now || now - due_at[id] >= tick)
+				{
+					rn_harness::fail_check(__FILE__, __LINE__, "主播 " + std::to_string(id) + " 的到期时间不在当前刻度内");
+				}
+				due_at[id] = now + std::chrono::milliseconds(interval_ms(rng));
+				wheel.schedule(id, due_at[id]);
+			}
+			run.expirations += expired.size();
+		}
+		run.expire_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - expire_started).count() / run.expirations;
+		return run;
+	}
+
+	// 改动前的做法：每次醒来扫描全部主播的截止时间，模拟中同样每个刻度醒来一次
+	double run_linear_scan(std::size_t host_count, std::size_t& expirations)
+	{
+		using clock = std::chrono::steady_clock;
+		constexpr auto tick = std::chrono::milliseconds(250);
+		const auto start = clock::now();
+		std::minstd_rand rng(42);
+		std::uniform_int_distribution<int> first_delay_ms(0, 60000);
+		std::uniform_int_distribution<int> interval_ms(30000, 90000);
+
+		std::vector<clock::time_point> next_poll_at(host_count);
+		for (auto& due : next_poll_at)
+		{
+			due = start + std::chrono::milliseconds(first_delay_ms(rng));
+		}
+
+		expirations = 0;
+		const auto ticks = std::chrono::hours(1) / tick;
+		const auto started = clock::now();
+		for (std::int64_t t = 1; t <= ticks; ++t)
+		{
+			const auto now = start + tick * t;
+			for (std::size_t id = 0; id < host_count; ++id)
+			{
+				if (now < next_poll_at[id])
+				{
+					continue;
+				}
+				next_poll_at[id] = now + std::chrono::milliseconds(interval_ms(rng));
+				++expirations;
+			}
+			rn_harness::keep(*std::min_element(next_poll_at.begin(), next_poll_at.end()));
+		}
+		return std::chrono::duration<double, std::nano>(clock::now() - started).count() / expirations;
+	}
+}
+
+// user-033：时间轮的登记与到期在 1k 与 10k 主播下的单次耗时应基本不变，并与逐个扫描截止时间的做法对比
+RN_TEST(timer_wheel)
+{
+	const auto small = run_timer_wheel(1000);
+	const auto large = run_timer_wheel(10000);
+	std::size_t scan_expirations = 0;
+	const auto scan_ns = run_linear_scan(10000, scan_expirations);
+
+	rn_harness::report("wheel schedule, 1k hosts", small.schedule_ns);
+	rn_harness::report("wheel schedule, 10k hosts", large.schedule_ns);
+	rn_harness::report("wheel expire + reschedule, 1k hosts", small.expire_ns);
+	rn_harness::report("wheel expire + reschedule, 10k hosts", large.expire_ns);
+	rn_harness::report("linear scan per expiration, 10k hosts", scan_ns);
+
+	// 一小时内每个主播至少轮询 40 次
+	RN_CHECK(large.expirations >= 10000 * 40);
+	// O(1)：主播数增加 10 倍时单次耗时不应随之线性增长（1k 时空刻度摊销更多，留出余量）
+	RN_CHECK(large.schedule_ns < small.schedule_ns * 4 + 50);
+	RN_CHECK(large.expire_ns < small.expire_ns * 4 + 50);
+	RN_CHECK(large.expire_ns < scan_ns);
+}
+
+namespace
+{
+	// 一轮轮询的区间结构：根区间下嵌套三个子区间，与 handle_poll_result 等处的埋点深度相当
+	void traced_poll(std::size_t i, const std::string& host_id)
+	{
+		TraceSpan poll("poll_round");
+		{
+			TraceSpan request("perform_batch");
+			rn_harness::keep(i);
+		}
+		{
+			TraceSpan handle("handle_poll_result", host_id);
+			TraceSpan parse("extract_room_id");
+			rn_harness::keep(i);
+		}
+	}
+}
+
+// user-041：追踪埋点的开销。关闭时每个区间只读取一次原子变量；开启时对比完整记录与按轮次采样
+RN_TEST(trace_overhead)
+{
+	constexpr std::size_t polls = 40000;
+	constexpr double spans_per_poll = 4;
+	const std::string host_id = make_host_ids(1).front();
+	RN_CHECK(!Tracer::instance().enabled());
+
+	const auto disabled_ns = rn_harness::nanoseconds_per_op(polls, [&](std::size_t i)
+		{
+			TraceSampleScope sample;
+			traced_poll(i, host_id);
+		});
+
+	const auto output = fs::temp_directory_path() / ("rn_bench_trace_" + std::to_string(::getpid()) + ".json");
+	TracingConfig config;
+	config.enabled = true;
+	config.output = output;
+	config.sample_percent = 5;
+	// 缓冲区容纳全部事件，避免测到的是丢弃路径
+	config.buffer_events = 1 << 18;
+	Tracer::instance().configure(config);
+	RN_CHECK(Tracer::instance().enabled());
+
+	const auto recorded_ns = rn_harness::nanoseconds_per_op(polls, [&](std::size_t i)
+		{
+			traced_poll(i, host_id);
+		});
+	const auto sampled_ns = rn_harness::nanoseconds_per_op(polls, [&](std::size_t i)
+		{
+			TraceSampleScope sample;
+			traced_poll(i, host_id);
+		});
+
+	Tracer::instance().shutdown();
+	const auto trace_size = fs::file_size(output);
+	fs::remove(output);
+
+	rn_harness::report("per span, tracing disabled", disabled_ns / spans_per_poll);
+	rn_harness::report("per span, enabled, every poll recorded", recorded_ns / spans_per_poll);
+	rn_harness::report("per span, enabled, 5% of polls sampled", sampled_ns / spans_per_poll);
+
+	// 导出的文件中应包含记录下来的区间
+	RN_CHECK(trace_size > polls * 4 * 20);
+	// 关闭时几乎没有开销；采样后的平均开销应明显低于完整记录
+	RN_CHECK(disabled_ns / spans_per_poll < 20);
+	RN_CHECK(sampled_ns < recorded_ns);
+}
+
+int main(int argc, char* argv[])
+{
+	curl_global_init(CURL_GLOBAL_DEFAULT);
+	const int result = rn_harness::run_test_cases(argc, argv);
+	curl_global_cleanup();
+	return result;
+}
@@ -0,0 +1,80 @@
+"""user-042：每路录制一个线程与 I/O 运行时（io_uring，不可用时为 epoll）的对比。
+
+同时录制若干路替身直播流，采样线程数、常驻内存与 CPU 时间，并确认两种方式录下的数据量相当。
+用法：python3 io_runtime.py <rednote_rtmp_download 路径>
+"""
+
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+import standin  # noqa: E402
+
+STREAMS = 8
+STREAM_KBPS = 2000
+RECORD_SECONDS = 8
+HOSTS = ["io%02d" % index for index in range(1, STREAMS + 1)]
+
+
+def measure(binary, backend):
+    with standin.StandInServer(live_hosts=HOSTS, stream_kbps=STREAM_KBPS) as server:
+        config = standin.merge_config(standin.base_config(server, HOSTS), {"io": {"backend": backend}})
+        with standin.Recorder(binary, config) as recorder:
+            if not standin.wait_until(lambda: len(server.first_stream_byte_at) == STREAMS, 20):
+                raise RuntimeError("直播流未在预期时间内全部开始录制\n" + recorder.log_text())
+
+            cpu_start = recorder.cpu_seconds()
+            bytes_start = recorder.recorded_bytes()
+            peak_threads = 0
+            peak_rss_kb = 0
+            deadline = time.monotonic() + RECORD_SECONDS
+            while time.monotonic() < deadline:
+                peak_threads = max(peak_threads, recorder.threads())
+                peak_rss_kb = max(peak_rss_kb, recorder.rss_kb())
+                time.sleep(0.2)
+            cpu = recorder.cpu_seconds() - cpu_start
+            recorded_mb = (recorder.recorded_bytes() - bytes_start) / (1024 * 1024)
+
+            runtime = recorder.log_records("I/O 运行时已启动")
+            recorder.stop()
+
+    return {
+        "backend": runtime[0].get("backend") if runtime else "threads",
+        "threads": peak_threads,
+        "rss_mb": peak_rss_kb / 1024,
+        "cpu_ms_per_mb": cpu * 1000 / recorded_mb if recorded_mb else float("inf"),
+        "recorded_mb": recorded_mb,
+    }
+
+
+def main():
+    binary = sys.argv[1]
+    print("[ RUN  ] io_runtime")
+    threads = measure(binary, "threads")
+    runtime = measure(binary, "auto")
+    for label, result in (("threads", threads), (runtime["backend"], runtime)):
+        standin.report("%d streams, %s: peak threads" % (STREAMS, label), result["threads"], "")
+        standin.report("%d streams, %s: peak RSS" % (STREAMS, label), result["rss_mb"], "MB")
+        standin.report("%d streams, %s: CPU per recorded MB" % (STREAMS, label), result["cpu_ms_per_mb"], "ms")
+
+    failures = []
+    expected_mb = STREAMS * STREAM_KBPS * RECORD_SECONDS / 8 / 1024
+    for label, result in (("threads", threads), ("runtime", runtime)):
+        # 替身服务的发送节奏有抖动，只要求录到大部分数据
+        if result["recorded_mb"] < expected_mb * 0.6:
+            failures.append("%s 只录到 %.1f MB，预期约 %.1f MB" % (label, result["recorded_mb"], expected_mb))
+    # 运行时在同一个线程上处理全部录制，线程数不应随录制路数增长
+    if runtime["threads"] + STREAMS // 2 > threads["threads"]:
+        failures.append("I/O 运行时的线程数没有少于每路一个线程的方式")
+
+    for failure in failures:
+        print("[ FAIL ] io_runtime: " + failure)
+    if failures:
+        return 1
+    print("[  OK  ] io_runtime")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,59 @@
+"""user-035：检测到开播到收到第一段直播流数据的耗时，对比开启与关闭 CDN 连接预热。
+
+替身 CDN 为每条新连接加上 connect_delay 的建连耗时。预热打开时，录制应复用预热好的连接，
+省下这段等待。用法：python3 ttfb_prewarm.py <rednote_rtmp_download 路径>
+"""
+
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "tests"))
+import standin  # noqa: E402
+
+CONNECT_DELAY = 0.4
+HOSTS = ["ttfb%02d" % index for index in range(1, 3)]
+
+
+def measure(binary, prewarm):
+    with standin.StandInServer(live_hosts=HOSTS, live_after=3.0, connect_delay=CONNECT_DELAY) as server:
+        config = standin.merge_config(standin.base_config(server, HOSTS), {
+            # 当前时刻即为可能的开播时间，使预热在启动后立即生效
+            "likely_broadcast_times": [time.strftime("%H:%M")],
+            "prewarm": {"enabled": prewarm, "connections": len(HOSTS), "refresh_seconds": 5},
+        })
+        with standin.Recorder(binary, config) as recorder:
+            if not standin.wait_until(lambda: len(server.first_stream_byte_at) == len(HOSTS), 20):
+                raise RuntimeError("直播流未在预期时间内开始录制\n" + recorder.log_text())
+            recorder.stop()
+            first_byte_logs = recorder.log_records("录制首字节耗时")
+
+        ttfb = [server.first_stream_byte_at[room] - server.first_live_at[room] for room in server.first_stream_byte_at]
+        return sum(ttfb) / len(ttfb) * 1000, first_byte_logs
+
+
+def main():
+    binary = sys.argv[1]
+    print("[ RUN  ] ttfb_prewarm")
+    cold_ms, _ = measure(binary, False)
+    warm_ms, warm_logs = measure(binary, True)
+    standin.report("detect -> first byte, no prewarm", cold_ms, "ms")
+    standin.report("detect -> first byte, prewarm", warm_ms, "ms")
+
+    failures = []
+    if not any(record.get("warm") == "true" for record in warm_logs):
+        failures.append("预热打开时录制没有复用预热连接")
+    # 预热省下的应接近一次建连耗时，留出一半余量
+    if warm_ms > cold_ms - CONNECT_DELAY * 1000 / 2:
+        failures.append("预热后的首字节耗时没有明显缩短")
+
+    for failure in failures:
+        print("[ FAIL ] ttfb_prewarm: " + failure)
+    if failures:
+        return 1
+    print("[  OK  ] ttfb_prewarm")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -6,17 +6,31 @@
 
 #include <curl/curl.h>
 #include <nlohmann/json.hpp>
+#include <zstd.h>
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cerrno>
 #include <chrono>
 #include <cctype>
+#include <condition_variable>
+#include <coroutine>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <initializer_list>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <random>
 #include <ctime>
 #include <sstream>
 #include <stdexcept>
@@ -24,14 +38,48 @@
 #include <string_view>
 #include <system_error>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
 #ifdef _WIN32
 #define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #include <Windows.h>
+#include <psapi.h>
+#pragma comment(lib, "Ws2_32.lib")
+#pragma comment(lib, "Psapi.lib")
 #endif
 #ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 #endif
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <malloc.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
 
 namespace fs = std::filesystem;
 using json = nlohmann::json;
@@ -42,24 +90,118 @@ struct HeaderConfig
 	std::string value;
 };
 
+enum class RecorderKind
+{
+	rtmpdump,
+	ffmpeg,
+	custom,
+};
+
+struct HostConfig
+{
+	std::string host_id;
+	// 加载配置时由状态接口预先拼接好的请求 URL，轮询时直接复用
+	std::string request_url;
+	// 数值越大越优先获得下行带宽
+	int priority = 0;
+	bool prefer_orig = false;
+	// 为空时使用 programs 中的默认录制器
+	std::optional<RecorderKind> recorder;
+	std::string command_template;
+};
+
+struct EndpointRateConfig
+{
+	// 与轮询端点名称一致，例如 host/info、overview/list
+	std::string name;
+	int per_minute = 0;
+	int burst = 1;
+};
+
+// 令牌桶限流与服务端信号退避
+struct RateLimitConfig
+{
+	// 全局每分钟请求数，0 表示不限
+	int global_per_minute = 0;
+	int global_burst = 20;
+	std::vector<EndpointRateConfig> endpoints;
+	// 收到 429、5xx 或风控状态码后的退避区间，按 decorrelated jitter 在两者之间增长
+	int backoff_base_seconds = 5;
+	int backoff_max_seconds = 900;
+};
+
 struct RequestConfig
 {
 	std::string base_url;
+	// 主播直播历史接口，为空时根据 base_url 推导
+	std::string overview_list_url;
 	std::vector<HeaderConfig> headers;
 	long timeout_seconds = 30;
+	// 启动时按页拉取直播历史用于推断开播时间，0 表示不拉取
+	int history_pages = 3;
+	int history_page_size = 7;
+	int history_refresh_hours = 24;
+	// 同一批次内并发发出的轮询请求数
+	int poll_batch_size = 16;
+	// 根据近期延迟收紧超时，并在请求超过 p95 时补发一次对冲请求
+	bool adaptive_timeout = true;
+	bool hedge_requests = true;
+	RateLimitConfig rate_limit;
+	// 不构建 DOM、直接扫描状态响应原文，由低内存模式打开
+	bool scan_raw_status = false;
+};
+
+enum class StorageTier
+{
+	// 高速暂存盘，录制完成后迁移到 bulk
+	scratch,
+	bulk,
+};
+
+struct OutputRootConfig
+{
+	fs::path path;
+	StorageTier tier = StorageTier::bulk;
+	// 剩余空间低于该值时不再在此目录开始新的录制
+	std::uint64_t min_free_bytes = 1024ull * 1024 * 1024;
 };
 
 struct DownloadConfig
 {
 	std::string base_stream_url = "rtmp://live.xhscdn.com/live/";
-	fs::path downloads_root = fs::path{ "downloads" };
+	std::vector<OutputRootConfig> output_roots = { OutputRootConfig{ fs::path{ "downloads" } } };
+	bool migrate_finished = true;
+	// 为每个录制写出带 BLAKE3 哈希的清单，并在迁移时校验副本
+	bool integrity_manifest = true;
 	std::string filename_suffix = "_rtmp";
 };
 
+struct RecordingConfig
+{
+	// 所有录制的总下行带宽上限，0 表示不限制
+	int max_ingress_kbps = 0;
+	int max_concurrent_recordings = 0;
+	int standard_stream_kbps = 2500;
+	int orig_stream_kbps = 6000;
+	bool prefer_orig = false;
+	std::string orig_stream_url_template = "https://live-source-play-hw.xhscdn.com/live/{room_id}_orig.flv";
+};
+
 struct ProgramConfig
 {
 	std::vector<fs::path> rtmpdump_search_paths = { fs::path{ "C:/Program Files/RTMPDump/rtmpdump.exe" } };
 	fs::path rtmpdump_exe;
+	// 不含路径时从 PATH 中查找
+	fs::path ffmpeg_exe = "ffmpeg";
+	RecorderKind recorder = RecorderKind::rtmpdump;
+	// custom 录制器的命令模板，支持 {url}、{output}、{room_id}、{host_id} 占位符
+	std::string command_template;
+	// 录制进程连续这么多秒既没有进度输出也没有写入文件时将被终止
+	int stall_timeout_seconds = 60;
+	// 单次录制的最长时长，0 表示不限
+	int max_duration_minutes = 0;
+	// rtmpdump/ffmpeg 输出到标准输出，由本进程整理 FLV 标签后直接写入最终文件（仅 Linux）
+	bool pipe_output = false;
 };
 
 struct TestModeConfig
@@ -80,17 +222,146 @@ struct PollingConfig
 	int accelerate_offset_minutes = 0;
 	int accelerated_wait_seconds = 60;
 	int normal_wait_seconds = 300;
+	// 轮询间隔的随机抖动幅度（百分比），避免大量主播在同一时刻集中请求
+	int jitter_percent = 10;
+};
+
+enum class LogLevel
+{
+	debug = 0,
+	info = 1,
+	warn = 2,
+	error = 3,
+};
+
+struct LoggingConfig
+{
+	LogLevel level = LogLevel::info;
+	bool console = true;
+	// 为空表示不写日志文件
+	fs::path file;
+	std::uint64_t max_file_bytes = 50ull * 1024 * 1024;
+	int max_files = 5;
+};
+
+struct TracingConfig
+{
+	bool enabled = false;
+	fs::path output = "trace.json";
+	// 按轮次采样高频的轮询流程，0~100；录制启动流程总是完整记录
+	int sample_percent = 5;
+	// 每个线程缓冲区可容纳的事件数，向上取整为 2 的幂
+	int buffer_events = 16384;
+	int flush_seconds = 5;
+	std::uint64_t max_file_bytes = 64ull * 1024 * 1024;
+};
+
+enum class IoBackendKind
+{
+	// 优先 io_uring，内核不支持时退回 epoll
+	automatic,
+	io_uring,
+	epoll,
+	// 不启用 I/O 运行时，每路录制一个线程
+	threads,
+};
+
+// 仅 Linux 下生效，其他平台始终每路录制一个线程
+struct IoConfig
+{
+	IoBackendKind backend = IoBackendKind::automatic;
+	int queue_depth = 256;
+	// 异步写盘时攒满一块才提交
+	int write_block_kb = 256;
+	// 单路录制在途写入超过此值时暂停接收，直到磁盘跟上
+	int max_pending_write_mb = 8;
+};
+
+// 定期把运行状态写成快照，重启后据此恢复轮询节奏并续写未完成的录制
+struct StateConfig
+{
+	bool enabled = false;
+	fs::path path = "state.json";
+	int interval_seconds = 10;
+	// 快照早于此时长时不再续写，录制按新文件开始
+	int resume_window_seconds = 300;
+};
+
+struct RelayConfig
+{
+	bool enabled = false;
+	std::string listen_address = "127.0.0.1";
+	int port = 8936;
+	// 每个录制通道保留的最大缓冲，读者落后超过这个范围会被断开
+	std::size_t buffer_bytes = 8ull * 1024 * 1024;
+	int max_readers = 16;
+};
+
+struct PrewarmConfig
+{
+	bool enabled = true;
+	// 距离可能的开播时间多少分钟内开始预热
+	int lead_minutes = 10;
+	// 每个 HTTP CDN 源站保持的预热连接数
+	int connections = 2;
+	int refresh_seconds = 20;
+};
+
+// 录制期间并行抓取直播间消息；接口地址未在文档中给出，需要自行配置
+struct ChatConfig
+{
+	bool enabled = false;
+	// 必须包含 {room_id}，可选 {host_id} 与 {cursor}
+	std::string url_template;
+	int poll_interval_ms = 1000;
+	// 以下均为 JSON Pointer：消息数组与翻页游标相对于响应，其余字段相对于单条消息
+	std::string messages_pointer = "/data/messages";
+	std::string cursor_pointer = "/data/cursor";
+	std::string id_pointer = "/id";
+	std::string type_pointer = "/type";
+	std::string user_pointer = "/user/nickname";
+	std::string text_pointer = "/content";
+	std::string value_pointer = "/count";
+	std::string time_pointer = "/timestamp";
+	// 满足任一条件即压缩写出一个数据块
+	int block_messages = 4096;
+	int flush_seconds = 5;
+	int compression_level = 3;
+};
+
+// 低内存模式：响应与录制缓冲区都有上限，关闭调试输出，面向同时监控大量主播的小内存设备
+struct FootprintConfig
+{
+	bool low = false;
+	// 单个 HTTP 响应体的上限，超过即中止该请求；0 表示不限制
+	int max_response_kb = 0;
+	// 管道录制的读缓冲与写盘前的攒批大小
+	int recording_buffer_kb = 1024;
+	// 进程常驻内存超过此值时告警并尝试归还空闲内存；0 表示不检查
+	int rss_ceiling_mb = 0;
+	int report_interval_seconds = 600;
 };
 
 struct Config
 {
-	std::string host_id;
+	std::vector<HostConfig> hosts;
 	RequestConfig request;
 	DownloadConfig download;
+	RecordingConfig recording;
 	ProgramConfig programs;
 	TestModeConfig test_mode;
 	PollingConfig polling;
+	LoggingConfig logging;
+	TracingConfig tracing;
+	IoConfig io;
+	StateConfig state;
+	RelayConfig relay;
+	PrewarmConfig prewarm;
+	ChatConfig chat;
+	FootprintConfig footprint;
 	bool http_debug_enabled = false;
+	// 同一主播两次调试输出之间的最小间隔
+	int http_debug_min_interval_seconds = 60;
 };
 
 namespace
@@ -463,6 +734,8 @@ namespace
 			"normal_wait_seconds",
 			polling.normal_wait_seconds);
 
+		polling.jitter_percent = std::clamp(parse_int_field(config_json, "poll_jitter_percent", polling.jitter_percent), 0, 50);
+
 		return polling;
 	}
 
@@ -479,25 +752,33 @@ namespace
 		return tm;
 	}
 
-	bool is_within_accelerated_window(const PollingConfig& polling, int current_minutes)
+	// 距离最近一个可能开播时间的分钟数（跨午夜取较短的一侧），没有配置时返回 nullopt
+	std::optional<int> minutes_to_nearest_start(const PollingConfig& polling, int current_minutes)
 	{
-		if (polling.possible_start_times.empty() || polling.accelerate_offset_minutes <= 0)
-		{
-			return false;
-		}
-
 		constexpr int minutes_per_day = 24 * 60;
+		std::optional<int> nearest;
 		for (const auto& start_time : polling.possible_start_times)
 		{
 			const int diff = std::abs(current_minutes - start_time.minutes_since_midnight);
 			const int wrapped_diff = std::min(diff, minutes_per_day - diff);
-			if (wrapped_diff <= polling.accelerate_offset_minutes)
+			if (!nearest || wrapped_diff < *nearest)
 			{
-				return true;
+				nearest = wrapped_diff;
 			}
 		}
 
-		return false;
+		return nearest;
+	}
+
+	bool is_within_accelerated_window(const PollingConfig& polling, int current_minutes)
+	{
+		if (polling.accelerate_offset_minutes <= 0)
+		{
+			return false;
+		}
+
+		const auto nearest = minutes_to_nearest_start(polling, current_minutes);
+		return nearest && *nearest <= polling.accelerate_offset_minutes;
 	}
 
 	int determine_wait_seconds(const PollingConfig& polling)
@@ -515,562 +796,11192 @@ namespace
 		return normal_wait;
 	}
 
-	std::string current_timestamp_string()
+	std::tm local_tm_from(std::chrono::system_clock::time_point time_point)
 	{
-		const std::tm tm = current_local_tm();
-		std::ostringstream oss;
-		oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-		return oss.str();
+		const auto time = std::chrono::system_clock::to_time_t(time_point);
+		std::tm tm{};
+#ifdef _WIN32
+		localtime_s(&tm, &time);
+#else
+		localtime_r(&time, &tm);
+#endif
+		return tm;
 	}
 
-	RequestConfig parse_request(const json& request_json)
+	const char* log_level_name(LogLevel level)
 	{
-		RequestConfig request;
-		request.base_url = request_json.at("base_url").get<std::string>();
-		if (request_json.contains("timeout_seconds"))
+		switch (level)
 		{
-			request.timeout_seconds = request_json.at("timeout_seconds").get<long>();
+		case LogLevel::debug:
+			return "DEBUG";
+		case LogLevel::info:
+			return "INFO";
+		case LogLevel::warn:
+			return "WARN";
+		case LogLevel::error:
+			return "ERROR";
 		}
+		return "INFO";
+	}
 
-		if (request_json.contains("headers"))
-		{
-			const auto& headers_json = request_json.at("headers");
-			if (!headers_json.is_object())
-			{
-				throw std::runtime_error("配置文件中的 headers 字段必须是对象");
-			}
+	// 各子系统自行登记的缓冲区占用，用于内存报告；只统计主要的可增长缓冲，不追踪每一次分配
+	enum class MemorySubsystem
+	{
+		poll_responses,
+		recording_buffers,
+		relay,
+		chat,
+		logging,
+		tracing,
+	};
 
-			for (const auto& [name, value_json] : headers_json.items())
-			{
-				HeaderConfig header;
-				header.name = name;
-				header.value = value_json.get<std::string>();
-				request.headers.push_back(std::move(header));
-			}
-		}
+	constexpr std::size_t memory_subsystem_count = 6;
 
-		return request;
+	const char* memory_subsystem_name(MemorySubsystem subsystem)
+	{
+		switch (subsystem)
+		{
+		case MemorySubsystem::poll_responses:
+			return "poll_responses";
+		case MemorySubsystem::recording_buffers:
+			return "recording_buffers";
+		case MemorySubsystem::relay:
+			return "relay";
+		case MemorySubsystem::chat:
+			return "chat";
+		case MemorySubsystem::logging:
+			return "logging";
+		case MemorySubsystem::tracing:
+			return "tracing";
+		}
+		return "unknown";
 	}
 
-	ProgramConfig parse_programs(const json& programs_json)
+	class MemoryLedger
 	{
-		if (!programs_json.is_object())
+	public:
+		static MemoryLedger& instance()
 		{
-			throw std::runtime_error("配置文件中的 programs 字段必须是对象");
+			static MemoryLedger ledger;
+			return ledger;
 		}
 
-		ProgramConfig programs;
-		if (const auto it = programs_json.find("rtmpdump_exe"); it != programs_json.end())
+		void add(MemorySubsystem subsystem, std::int64_t delta)
 		{
-			if (it->is_string())
-			{
-				programs.rtmpdump_search_paths.insert(
-					programs.rtmpdump_search_paths.begin(),
-					fs::path{ it->get<std::string>() });
-			}
-			else if (it->is_array())
-			{
-				std::vector<fs::path> configured_paths;
-				configured_paths.reserve(it->size());
-				for (const auto& value : *it)
-				{
-					if (!value.is_string())
-					{
-						throw std::runtime_error(
-							"配置文件中的 rtmpdump_exe 数组必须只包含字符串");
-					}
-					configured_paths.emplace_back(value.get<std::string>());
-				}
-
-				programs.rtmpdump_search_paths.insert(
-					programs.rtmpdump_search_paths.begin(),
-					configured_paths.begin(),
-					configured_paths.end());
-			}
-			else
+			auto& counter = counters_[static_cast<std::size_t>(subsystem)];
+			const auto current = counter.current.fetch_add(delta, std::memory_order_relaxed) + delta;
+			auto peak = counter.peak.load(std::memory_order_relaxed);
+			while (current > peak && !counter.peak.compare_exchange_weak(peak, current, std::memory_order_relaxed))
 			{
-				throw std::runtime_error("配置文件中的 rtmpdump_exe 字段必须是字符串或字符串数组");
 			}
 		}
 
-		return programs;
-	}
-
-	TestModeConfig parse_test_mode(const json& test_mode_json)
-	{
-		if (!test_mode_json.is_object())
+		std::int64_t current(MemorySubsystem subsystem) const
 		{
-			throw std::runtime_error("配置文件中的 test_mode 字段必须是对象");
+			return counters_[static_cast<std::size_t>(subsystem)].current.load(std::memory_order_relaxed);
 		}
 
-		TestModeConfig test_mode;
-		if (const auto it = test_mode_json.find("enabled"); it != test_mode_json.end())
+		std::int64_t peak(MemorySubsystem subsystem) const
 		{
-			test_mode.enabled = it->get<bool>();
+			return counters_[static_cast<std::size_t>(subsystem)].peak.load(std::memory_order_relaxed);
 		}
-		if (const auto it = test_mode_json.find("fake_room_id"); it != test_mode_json.end())
+
+	private:
+		struct Counter
 		{
-			test_mode.fake_room_id = it->get<std::string>();
-		}
+			std::atomic<std::int64_t> current{ 0 };
+			std::atomic<std::int64_t> peak{ 0 };
+		};
 
-		return test_mode;
-	}
+		std::array<Counter, memory_subsystem_count> counters_;
+	};
 
-	Config parse_config(const fs::path& path)
+	// 持有者登记自己当前占用的字节数，析构时自动注销
+	class MemoryCharge
 	{
-		const auto file_content = read_file(path);
-		auto config_json = json::parse(file_content);
-
-		Config config;
-		config.host_id = config_json.at("host_id").get<std::string>();
-		config.request = parse_request(config_json.at("request"));
-		config.polling = parse_polling_config(config_json);
-		if (const auto it = config_json.find("programs"); it != config_json.end())
+	public:
+		explicit MemoryCharge(MemorySubsystem subsystem)
+			: subsystem_(subsystem)
 		{
-			config.programs = parse_programs(*it);
 		}
-		config.programs.rtmpdump_exe = locate_rtmpdump_executable(config.programs);
-		if (const auto it = config_json.find("test_mode"); it != config_json.end())
+
+		~MemoryCharge()
 		{
-			config.test_mode = parse_test_mode(*it);
+			set(0);
 		}
-		if (const auto it = config_json.find("http_debug"); it != config_json.end())
+
+		MemoryCharge(const MemoryCharge&) = delete;
+		MemoryCharge& operator=(const MemoryCharge&) = delete;
+
+		void set(std::size_t bytes)
 		{
-			if (!it->is_boolean())
+			const auto delta = static_cast<std::int64_t>(bytes) - static_cast<std::int64_t>(bytes_);
+			if (delta != 0)
 			{
-				throw std::runtime_error("配置文件中的 http_debug 字段必须是布尔值");
+				bytes_ = bytes;
+				MemoryLedger::instance().add(subsystem_, delta);
 			}
-			config.http_debug_enabled = it->get<bool>();
 		}
-		return config;
-	}
 
-	size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+	private:
+		MemorySubsystem subsystem_;
+		std::size_t bytes_ = 0;
+	};
+
+	struct ProcessMemory
 	{
-		auto* stream = static_cast<std::string*>(userdata);
-		const auto count = size * nmemb;
-		stream->append(ptr, count);
-		return count;
-	}
+		std::uint64_t rss_bytes = 0;
+		std::uint64_t peak_rss_bytes = 0;
+	};
 
-	size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+	ProcessMemory read_process_memory()
 	{
-		auto* stream = static_cast<std::string*>(userdata);
-		const auto count = size * nitems;
-		stream->append(buffer, count);
-		return count;
+		ProcessMemory memory;
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters{};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			memory.rss_bytes = counters.WorkingSetSize;
+			memory.peak_rss_bytes = counters.PeakWorkingSetSize;
+		}
+#elif defined(__linux__)
+		std::ifstream status("/proc/self/status");
+		std::string line;
+		while (std::getline(status, line))
+		{
+			const auto read_kb = [&line](std::string_view prefix, std::uint64_t& out)
+				{
+					if (line.rfind(prefix, 0) == 0)
+					{
+						out = std::strtoull(line.c_str() + prefix.size(), nullptr, 10) * 1024;
+					}
+				};
+			read_kb("VmRSS:", memory.rss_bytes);
+			read_kb("VmHWM:", memory.peak_rss_bytes);
+		}
+#endif
+		return memory;
 	}
 
-	struct HttpResponse
+	// 把分配器缓存的空闲页归还系统，只在常驻内存超过上限时调用
+	void release_free_memory()
 	{
-		std::string body;
-		std::string headers;
-	};
+#if defined(__GLIBC__)
+		malloc_trim(0);
+#endif
+	}
 
-	class CurlHttpClient
+	struct LogField
 	{
-	public:
-		explicit CurlHttpClient(const Config& config)
+		LogField(std::string_view field_key, std::string field_value)
+			: key(field_key), value(std::move(field_value))
 		{
-			curl_ = curl_easy_init();
-			if (!curl_)
-			{
-				throw std::runtime_error("无法初始化 libcurl");
-			}
-
-			// 配置基础选项，只需设置一次
-			curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_callback);
-			curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, header_callback);
-			curl_easy_setopt(curl_, CURLOPT_ACCEPT_ENCODING, "");
-#ifdef CURLOPT_TCP_KEEPALIVE
-			curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
-#endif
-#ifdef CURLOPT_TCP_KEEPIDLE
-			curl_easy_setopt(curl_, CURLOPT_TCP_KEEPIDLE, 60L);
-#endif
-#ifdef CURLOPT_TCP_KEEPINTVL
-			curl_easy_setopt(curl_, CURLOPT_TCP_KEEPINTVL, 60L);
-#endif
-			curl_easy_setopt(curl_, CURLOPT_FORBID_REUSE, 0L);
-			curl_easy_setopt(curl_, CURLOPT_FRESH_CONNECT, 0L);
+		}
 
-			apply_timeout(config.request.timeout_seconds);
+		LogField(std::string_view field_key, const char* field_value)
+			: key(field_key), value(field_value ? field_value : "")
+		{
+		}
 
-			for (const auto& header : config.request.headers)
-			{
-				std::ostringstream header_stream;
-				header_stream << header.name << ": " << header.value;
-				headers_ = curl_slist_append(headers_, header_stream.str().c_str());
-			}
+		LogField(std::string_view field_key, std::string_view field_value)
+			: key(field_key), value(field_value)
+		{
+		}
 
-			if (headers_)
-			{
-				curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers_);
-			}
+		LogField(std::string_view field_key, const fs::path& field_value)
+			: key(field_key), value(field_value.string())
+		{
 		}
 
-		~CurlHttpClient()
+		template <typename T, typename = std::enable_if_t<std::is_arithmetic_v<T>>>
+		LogField(std::string_view field_key, T field_value)
+			: key(field_key)
 		{
-			if (headers_)
+			if constexpr (std::is_same_v<T, bool>)
 			{
-				curl_slist_free_all(headers_);
+				value = field_value ? "true" : "false";
 			}
-
-			if (curl_)
+			else if constexpr (std::is_floating_point_v<T>)
 			{
-				curl_easy_cleanup(curl_);
+				std::ostringstream oss;
+				oss << std::fixed << std::setprecision(1) << field_value;
+				value = oss.str();
 			}
-		}
-
-		HttpResponse perform_request(const Config& config)
+			else
+			{
+				value = std::to_string(field_value);
+			}
+		}
+
+		// 字段名只允许使用字符串字面量，记录中直接保存视图
+		std::string_view key;
+		std::string value;
+	};
+
+	// 异步日志：调用线程只做一次节点分配和无锁入队，格式化与写入都在后台线程完成
+	class Logger
+	{
+	public:
+		static Logger& instance()
+		{
+			static Logger logger;
+			return logger;
+		}
+
+		Logger(const Logger&) = delete;
+		Logger& operator=(const Logger&) = delete;
+
+		void configure(const LoggingConfig& config)
 		{
-			if (!curl_)
 			{
-				throw std::runtime_error("libcurl 会话尚未初始化");
+				std::lock_guard<std::mutex> lock(sink_mutex_);
+				config_ = config;
+				file_.close();
+				file_size_ = 0;
+				if (!config_.file.empty())
+				{
+					open_log_file_locked();
+				}
 			}
+			min_level_.store(static_cast<int>(config.level), std::memory_order_relaxed);
+		}
 
-			apply_timeout(config.request.timeout_seconds);
+		bool enabled(LogLevel level) const
+		{
+			return static_cast<int>(level) >= min_level_.load(std::memory_order_relaxed);
+		}
 
-			std::string response;
-			std::string response_headers;
-			curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response);
-			curl_easy_setopt(curl_, CURLOPT_HEADERDATA, &response_headers);
+		void log(LogLevel level, std::string message, std::initializer_list<LogField> fields)
+		{
+			if (!enabled(level))
+			{
+				return;
+			}
 
-			char* escaped_host_id = curl_easy_escape(curl_, config.host_id.c_str(), 0);
-			if (!escaped_host_id)
+			auto* node = new Node;
+			node->record.time = std::chrono::system_clock::now();
+			node->record.level = level;
+			node->record.message = std::move(message);
+			node->record.fields.reserve(fields.size());
+			node->record.bytes = sizeof(Node) + node->record.message.size() + fields.size() * sizeof(node->record.fields[0]);
+			for (const auto& field : fields)
 			{
-				throw std::runtime_error("无法对 host_id 进行 URL 编码");
+				node->record.fields.emplace_back(field.key, field.value);
+				node->record.bytes += field.value.size();
 			}
 
-			std::ostringstream url_stream;
-			url_stream << config.request.base_url << "?host_id=" << escaped_host_id;
-			curl_free(escaped_host_id);
+			// 先登记再检查 stopping_：shutdown 看到计数为零之后，后来的生产者一定会看到 stopping_
+			producers_.fetch_add(1, std::memory_order_seq_cst);
+			if (stopping_.load(std::memory_order_seq_cst))
+			{
+				producers_.fetch_sub(1, std::memory_order_release);
+				std::lock_guard<std::mutex> lock(sink_mutex_);
+				write_locked(node->record);
+				flush_locked();
+				delete node;
+				return;
+			}
 
-			const auto url = url_stream.str();
-			curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+			MemoryLedger::instance().add(MemorySubsystem::logging, static_cast<std::int64_t>(node->record.bytes));
+			// Vyukov MPSC 队列：生产者只交换 head 指针
+			Node* previous = head_.exchange(node, std::memory_order_seq_cst);
+			previous->next.store(node, std::memory_order_release);
+			producers_.fetch_sub(1, std::memory_order_release);
 
-			const auto res = curl_easy_perform(curl_);
-			if (res != CURLE_OK)
+			if (!sink_waiting_.load(std::memory_order_seq_cst))
 			{
-				std::ostringstream error;
-				error << "HTTP 请求失败: " << curl_easy_strerror(res);
-				throw std::runtime_error(error.str());
+				return;
 			}
+			wakeup_.fetch_add(1, std::memory_order_release);
+			wakeup_.notify_one();
+		}
 
-			long status_code = 0;
-			curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &status_code);
-			if (status_code != 200)
+		// 写出队列中所有日志并停止后台线程，之后的日志直接同步写出
+		void shutdown()
+		{
+			if (stopping_.exchange(true))
+			{
+				return;
+			}
+			wakeup_.fetch_add(1, std::memory_order_release);
+			wakeup_.notify_one();
+			if (sink_thread_.joinable())
 			{
-				std::ostringstream error;
-				error << "HTTP 响应状态码异常: " << status_code;
-				throw std::runtime_error(error.str());
+				sink_thread_.join();
 			}
 
-			return HttpResponse{ std::move(response), std::move(response_headers) };
+			// 越过 stopping_ 检查的生产者可能在后台线程最后一次取队列之后才入队，或者尚未链接 next；
+			// 此时只剩这里在取队列，等它们完成并全部写出
+			while (producers_.load(std::memory_order_acquire) > 0 || !queue_empty())
+			{
+				if (drain() == 0)
+				{
+					std::this_thread::yield();
+				}
+			}
 		}
 
 	private:
-		void apply_timeout(long timeout_seconds)
+		struct Record
+		{
+			std::chrono::system_clock::time_point time;
+			LogLevel level = LogLevel::info;
+			std::string message;
+			std::vector<std::pair<std::string_view, std::string>> fields;
+			// 入队时登记的近似占用，写出后注销
+			std::size_t bytes = 0;
+		};
+
+		struct Node
+		{
+			std::atomic<Node*> next{ nullptr };
+			Record record;
+		};
+
+		Logger()
 		{
-			curl_easy_setopt(curl_, CURLOPT_TIMEOUT, timeout_seconds);
+			// 先构造账本，保证其析构晚于日志线程退出
+			MemoryLedger::instance();
+			head_.store(&stub_);
+			tail_ = &stub_;
+			sink_thread_ = std::thread([this]()
+				{
+					run_sink();
+				});
 		}
 
-		CURL* curl_ = nullptr;
-		curl_slist* headers_ = nullptr;
-	};
+		~Logger()
+		{
+			shutdown();
+		}
 
-	std::optional<std::string> extract_room_id(const json& root)
-	{
-		const auto dumped = root.dump();
-		const std::string target = "room_id";
-		std::vector<std::string> room_ids;
+		// 只在唯一的消费者上调用：后台线程，或其退出后的 shutdown
+		bool queue_empty() const
+		{
+			return tail_ == &stub_ && head_.load(std::memory_order_seq_cst) == &stub_;
+		}
 
-		std::size_t search_pos = 0;
-		while (true)
+		// 只在唯一的消费者上调用：后台线程，或其退出后的 shutdown
+		Node* pop()
 		{
-			const auto found = dumped.find(target, search_pos);
-			if (found == std::string::npos)
+			Node* tail = tail_;
+			Node* next = tail->next.load(std::memory_order_acquire);
+			if (tail == &stub_)
 			{
-				break;
+				if (!next)
+				{
+					return nullptr;
+				}
+				tail_ = next;
+				tail = next;
+				next = next->next.load(std::memory_order_acquire);
 			}
 
-			auto digit_pos = found + target.size();
-			while (digit_pos < dumped.size() && !std::isdigit(static_cast<unsigned char>(dumped[digit_pos])))
+			if (next)
 			{
-				++digit_pos;
+				tail_ = next;
+				return tail;
 			}
 
-			if (digit_pos >= dumped.size())
+			if (tail != head_.load(std::memory_order_acquire))
 			{
-				break;
+				// 生产者已交换 head 但尚未链接 next，稍后再取
+				return nullptr;
 			}
 
-			auto end_pos = digit_pos;
-			while (end_pos < dumped.size() && std::isdigit(static_cast<unsigned char>(dumped[end_pos])))
+			stub_.next.store(nullptr, std::memory_order_relaxed);
+			Node* previous = head_.exchange(&stub_, std::memory_order_acq_rel);
+			previous->next.store(&stub_, std::memory_order_release);
+
+			next = tail->next.load(std::memory_order_acquire);
+			if (next)
 			{
-				++end_pos;
+				tail_ = next;
+				return tail;
 			}
+			return nullptr;
+		}
 
-			if (end_pos > digit_pos)
+		std::size_t drain()
+		{
+			std::size_t count = 0;
+			std::lock_guard<std::mutex> lock(sink_mutex_);
+			while (Node* node = pop())
 			{
-				room_ids.emplace_back(dumped.substr(digit_pos, end_pos - digit_pos));
+				write_locked(node->record);
+				MemoryLedger::instance().add(MemorySubsystem::logging, -static_cast<std::int64_t>(node->record.bytes));
+				delete node;
+				++count;
 			}
+			if (count > 0)
+			{
+				flush_locked();
+			}
+			return count;
+		}
 
-			search_pos = end_pos;
+		void flush_locked()
+		{
+			std::cout.flush();
+			if (file_.is_open())
+			{
+				file_.flush();
+			}
 		}
 
-		if (!room_ids.empty())
+		void run_sink()
 		{
-			std::cout << "提取到的 room_id 列表: ";
-			for (std::size_t i = 0; i < room_ids.size(); ++i)
+			while (true)
 			{
-				if (i > 0)
+				const auto observed = wakeup_.load(std::memory_order_acquire);
+				if (drain() > 0)
 				{
-					std::cout << ", ";
+					continue;
+				}
+
+				if (stopping_.load(std::memory_order_acquire))
+				{
+					// 最后再取一次，防止与 shutdown 同时入队的日志丢失
+					while (drain() > 0)
+					{
+					}
+					return;
 				}
-				std::cout << room_ids[i];
-			}
-			std::cout << '\n';
 
-			return room_ids.front();
+				sink_waiting_.store(true, std::memory_order_seq_cst);
+				// 只有 tail 与 head 都停在 stub 上时队列才真正为空；生产者正在链接节点时继续轮询
+				if (queue_empty())
+				{
+					wakeup_.wait(observed, std::memory_order_acquire);
+				}
+				sink_waiting_.store(false, std::memory_order_relaxed);
+			}
 		}
 
-		std::cout << "未在响应中发现 room_id\n";
-		return std::nullopt;
-	}
+		void write_locked(const Record& record)
+		{
+			const std::tm tm = local_tm_from(record.time);
+			const auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(record.time.time_since_epoch()).count() % 1000;
+
+			// 每行都要格式化时间，用 strftime 写入栈上缓冲，不为此构造字符串流
+			char time_text[32];
+			const auto time_size = std::strftime(time_text, sizeof(time_text), "%Y-%m-%d %H:%M:%S", &tm);
+			line_.clear();
+			line_.append(time_text, time_size);
+			line_.push_back('.');
+			line_.push_back(static_cast<char>('0' + millis / 100));
+			line_.push_back(static_cast<char>('0' + millis / 10 % 10));
+			line_.push_back(static_cast<char>('0' + millis % 10));
+			line_.push_back(' ');
+			line_.append(log_level_name(record.level));
+			line_.push_back(' ');
+			line_.append(record.message);
+			for (const auto& [key, value] : record.fields)
+			{
+				line_.push_back(' ');
+				line_.append(key);
+				line_.push_back('=');
+				const bool needs_quotes = value.empty() || value.find_first_of(" \t\r\n\"") != std::string::npos;
+				if (needs_quotes)
+				{
+					line_.push_back('"');
+					for (const auto ch : value)
+					{
+						if (ch == '\r')
+						{
+							continue;
+						}
+						if (ch == '"' || ch == '\\')
+						{
+							line_.push_back('\\');
+						}
+						line_.push_back(ch == '\n' ? ' ' : ch);
+					}
+					line_.push_back('"');
+				}
+				else
+				{
+					line_.append(value);
+				}
+			}
+			line_.push_back('\n');
 
-	std::string today_folder_name()
-	{
-		const std::tm tm = current_local_tm();
-		std::ostringstream oss;
-		oss << std::put_time(&tm, "%Y%m%d");
-		return oss.str();
-	}
+			if (config_.console)
+			{
+				auto& stream = record.level >= LogLevel::warn ? std::cerr : std::cout;
+				stream.write(line_.data(), static_cast<std::streamsize>(line_.size()));
+			}
 
-	fs::path prepare_download_path(const DownloadConfig& download_config, std::string_view room_id)
-	{
-		fs::path download_dir = fs::absolute(download_config.downloads_root) / today_folder_name();
-		fs::create_directories(download_dir);
+			if (file_.is_open())
+			{
+				if (file_size_ + line_.size() > config_.max_file_bytes)
+				{
+					rotate_locked();
+				}
+				file_.write(line_.data(), static_cast<std::streamsize>(line_.size()));
+				file_size_ += line_.size();
+			}
+		}
 
-		std::string filename = std::string(room_id) + download_config.filename_suffix + ".flv";
-		fs::path candidate = download_dir / filename;
+		void open_log_file_locked()
+		{
+			std::error_code ec;
+			if (config_.file.has_parent_path())
+			{
+				fs::create_directories(config_.file.parent_path(), ec);
+			}
+			file_.open(config_.file, std::ios::binary | std::ios::app);
+			file_size_ = fs::exists(config_.file, ec) ? fs::file_size(config_.file, ec) : 0;
+			if (!file_)
+			{
+				std::cerr << "无法打开日志文件: " << config_.file.string() << '\n';
+			}
+		}
 
-		int counter = 1;
-		while (fs::exists(candidate))
+		// app.log -> app.log.1 -> ... -> app.log.N，超出数量的最旧文件被删除
+		void rotate_locked()
 		{
-			std::ostringstream oss;
-			oss << room_id << download_config.filename_suffix << '_' << counter << ".flv";
-			candidate = download_dir / oss.str();
-			++counter;
+			file_.close();
+			std::error_code ec;
+			const auto numbered = [this](int index)
+				{
+					fs::path path = config_.file;
+					path += '.';
+					path += std::to_string(index);
+					return path;
+				};
+
+			fs::remove(numbered(config_.max_files), ec);
+			for (int index = config_.max_files - 1; index >= 1; --index)
+			{
+				if (fs::exists(numbered(index), ec))
+				{
+					fs::rename(numbered(index), numbered(index + 1), ec);
+				}
+			}
+			if (config_.max_files > 0)
+			{
+				fs::rename(config_.file, numbered(1), ec);
+			}
+			else
+			{
+				fs::remove(config_.file, ec);
+			}
+
+			file_.clear();
+			file_.open(config_.file, std::ios::binary | std::ios::trunc);
+			file_size_ = 0;
 		}
 
-		return candidate;
-	}
+		std::atomic<Node*> head_{ nullptr };
+		Node* tail_ = nullptr;
+		Node stub_;
+		std::atomic<int> min_level_{ static_cast<int>(LogLevel::info) };
+		std::atomic<bool> sink_waiting_{ false };
+		std::atomic<std::uint32_t> wakeup_{ 0 };
+		std::atomic<bool> stopping_{ false };
+		// 已越过 stopping_ 检查、尚未完成入队的生产者数
+		std::atomic<int> producers_{ 0 };
+
+		// 只在后台线程与 configure 之间使用，生产者从不获取
+		std::mutex sink_mutex_;
+		LoggingConfig config_;
+		std::ofstream file_;
+		std::uint64_t file_size_ = 0;
+		std::string line_;
+		std::thread sink_thread_;
+	};
 
-	std::string quote_argument(const std::string& arg)
+	// 退出 main 前把队列中的日志全部写出
+	class LoggerShutdownGuard
 	{
-		std::ostringstream oss;
-		oss << '"';
-		for (const auto ch : arg)
+	public:
+		LoggerShutdownGuard() = default;
+		LoggerShutdownGuard(const LoggerShutdownGuard&) = delete;
+		LoggerShutdownGuard& operator=(const LoggerShutdownGuard&) = delete;
+
+		~LoggerShutdownGuard()
 		{
-			if (ch == '"')
-			{
-				oss << '\\';
-			}
-			oss << ch;
+			Logger::instance().shutdown();
 		}
-		oss << '"';
-		return oss.str();
+	};
+
+	void log_message(LogLevel level, std::string message, std::initializer_list<LogField> fields = {})
+	{
+		Logger::instance().log(level, std::move(message), fields);
 	}
 
-	std::string quote_argument(const fs::path& path)
+	void log_debug(std::string message, std::initializer_list<LogField> fields = {})
 	{
-		return quote_argument(path.string());
+		log_message(LogLevel::debug, std::move(message), fields);
 	}
 
-	std::string build_rtmpdump_command(const ProgramConfig& program_config, const std::string& stream_url, const fs::path& output_path)
+	void log_info(std::string message, std::initializer_list<LogField> fields = {})
 	{
-		std::ostringstream command;
-		command << quote_argument(program_config.rtmpdump_exe);
-		command << " -r " << quote_argument(stream_url);
-		command << " -o " << quote_argument(output_path);
-		command << " --live";
-		return command.str();
+		log_message(LogLevel::info, std::move(message), fields);
 	}
 
-	std::string build_rtmp_url(const Config& config, const std::string& room_id)
+	void log_warn(std::string message, std::initializer_list<LogField> fields = {})
 	{
-		std::ostringstream oss;
-		oss << config.download.base_stream_url;
-		if (!config.download.base_stream_url.empty() && config.download.base_stream_url.back() != '/')
-		{
-			oss << '/';
-		}
-		oss << room_id;
-		return oss.str();
+		log_message(LogLevel::warn, std::move(message), fields);
 	}
 
-#ifdef _WIN32
-	std::wstring widen_utf8(std::string_view input)
+	void log_error(std::string message, std::initializer_list<LogField> fields = {})
 	{
-		if (input.empty())
+		log_message(LogLevel::error, std::move(message), fields);
+	}
+
+	// 在主循环中定期输出各子系统登记的占用与进程常驻内存；配置了上限时更频繁地检查，超过后尝试归还空闲内存
+	class MemoryReporter
+	{
+	public:
+		explicit MemoryReporter(const FootprintConfig& config)
+			: config_(config), next_report_(std::chrono::steady_clock::now() + std::chrono::seconds(config.report_interval_seconds))
 		{
-			return {};
 		}
 
-		const int required = MultiByteToWideChar(CP_UTF8, 0, input.data(), static_cast<int>(input.size()), nullptr, 0);
-		if (required <= 0)
+		void poll()
 		{
-			throw std::runtime_error("无法将字符串从 UTF-8 转换为 UTF-16");
+			const auto now = std::chrono::steady_clock::now();
+			if (config_.rss_ceiling_mb > 0 && now >= next_check_)
+			{
+				next_check_ = now + check_interval;
+				check_ceiling();
+			}
+			if (now >= next_report_)
+			{
+				next_report_ = now + std::chrono::seconds(config_.report_interval_seconds);
+				report();
+			}
 		}
 
-		std::wstring buffer(static_cast<std::size_t>(required), L'\0');
-		const int converted = MultiByteToWideChar(CP_UTF8, 0, input.data(), static_cast<int>(input.size()), buffer.data(), required);
-		if (converted != required)
+		void report() const
 		{
-			throw std::runtime_error("转换为 UTF-16 时发生未知错误");
+			const auto& ledger = MemoryLedger::instance();
+			for (std::size_t i = 0; i < memory_subsystem_count; ++i)
+			{
+				const auto subsystem = static_cast<MemorySubsystem>(i);
+				if (ledger.peak(subsystem) == 0)
+				{
+					continue;
+				}
+				log_info("子系统内存占用", {
+					{ "subsystem", memory_subsystem_name(subsystem) },
+					{ "current_kb", ledger.current(subsystem) / 1024 },
+					{ "peak_kb", ledger.peak(subsystem) / 1024 } });
+			}
+
+			const auto memory = read_process_memory();
+			log_info("进程内存占用", {
+				{ "rss_kb", memory.rss_bytes / 1024 },
+				{ "peak_rss_kb", memory.peak_rss_bytes / 1024 },
+				{ "ceiling_mb", config_.rss_ceiling_mb },
+				{ "low_footprint", config_.low } });
 		}
 
-		return buffer;
-	}
+	private:
+		static constexpr auto check_interval = std::chrono::seconds(10);
 
-	std::string narrow_utf8(std::wstring_view input)
-	{
-		if (input.empty())
+		void check_ceiling()
 		{
-			return {};
+			const auto ceiling = static_cast<std::uint64_t>(config_.rss_ceiling_mb) * 1024 * 1024;
+			const auto before = read_process_memory().rss_bytes;
+			if (before <= ceiling)
+			{
+				over_ceiling_ = false;
+				return;
+			}
+
+			release_free_memory();
+			const auto after = read_process_memory().rss_bytes;
+			// 只在刚越过上限时告警并附上各子系统占用，持续超出时不重复刷屏
+			if (!over_ceiling_)
+			{
+				log_warn("进程常驻内存超过上限", {
+					{ "rss_kb", before / 1024 },
+					{ "after_trim_kb", after / 1024 },
+					{ "ceiling_mb", config_.rss_ceiling_mb } });
+				report();
+			}
+			over_ceiling_ = after > ceiling;
 		}
 
-		const int required = WideCharToMultiByte(CP_UTF8, 0, input.data(), static_cast<int>(input.size()), nullptr, 0, nullptr, nullptr);
-		if (required <= 0)
+		const FootprintConfig& config_;
+		std::chrono::steady_clock::time_point next_report_;
+		std::chrono::steady_clock::time_point next_check_;
+		bool over_ceiling_ = false;
+	};
+
+	// 流水线区间追踪：每个线程写自己的环形缓冲区，热路径上没有锁，写满时丢弃新事件；
+	// 后台线程定期取出事件，以 Chrome trace（JSON 数组格式，末尾的 ] 可以省略）追加到文件，可直接在 chrome://tracing 或 Perfetto 中打开
+	class Tracer
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		static Tracer& instance()
 		{
-			return {};
+			static Tracer tracer;
+			return tracer;
 		}
 
-		std::string buffer(static_cast<std::size_t>(required), '\0');
-		const int converted = WideCharToMultiByte(CP_UTF8, 0, input.data(), static_cast<int>(input.size()), buffer.data(), required, nullptr, nullptr);
-		if (converted != required)
+		Tracer(const Tracer&) = delete;
+		Tracer& operator=(const Tracer&) = delete;
+
+		void configure(const TracingConfig& config)
 		{
-			return {};
-		}
+			if (!config.enabled || enabled_.load(std::memory_order_relaxed))
+			{
+				return;
+			}
 
-		return buffer;
-	}
+			config_ = config;
+			capacity_ = 1;
+			while (capacity_ < static_cast<std::size_t>(config.buffer_events))
+			{
+				capacity_ <<= 1;
+			}
+			open_output();
+			enabled_.store(true, std::memory_order_release);
+			exporter_ = std::thread([this]()
+				{
+					export_loop();
+				});
+		}
 
-	std::string format_windows_error(DWORD error)
-	{
-		if (error == 0)
+		// 写出所有缓冲的事件并结束 JSON 数组
+		void shutdown()
 		{
-			return {};
+			if (!enabled_.exchange(false))
+			{
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stopping_ = true;
+			}
+			cv_.notify_all();
+			if (exporter_.joinable())
+			{
+				exporter_.join();
+			}
+			output_ << "\n]\n";
+			output_.close();
 		}
 
-		LPWSTR buffer = nullptr;
-		const DWORD length = FormatMessageW(
-			FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
-			nullptr,
-			error,
-			0,
-			reinterpret_cast<LPWSTR>(&buffer),
-			0,
-			nullptr);
+		bool enabled() const
+		{
+			return enabled_.load(std::memory_order_relaxed);
+		}
 
-		if (length == 0 || buffer == nullptr)
+		// 当前线程是否应记录区间：未启用或处于未被采样的轮询中时返回 false
+		bool should_record() const
 		{
-			return {};
+			return enabled() && suppressed_depth() == 0;
 		}
 
-		std::wstring_view message(buffer, length);
-		std::string result = narrow_utf8(message);
-		LocalFree(buffer);
+		bool sample()
+		{
+			// xorshift64，每个线程独立的状态
+			thread_local std::uint64_t state = (std::hash<std::thread::id>{}(std::this_thread::get_id()) ^ static_cast<std::uint64_t>(clock::now().time_since_epoch().count())) | 1;
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			return state % 100 < static_cast<std::uint64_t>(config_.sample_percent);
+		}
 
-		while (!result.empty() && (result.back() == '\r' || result.back() == '\n'))
+		static int& suppressed_depth()
 		{
-			result.pop_back();
+			thread_local int depth = 0;
+			return depth;
 		}
 
+		void record(const char* name, clock::time_point start, clock::time_point end, std::string_view detail = {})
+		{
+			if (!enabled())
+			{
+				return;
+			}
+
+			auto& buffer = local_buffer();
+			const auto head = buffer.head.load(std::memory_order_relaxed);
+			if (head - buffer.tail.load(std::memory_order_acquire) >= capacity_)
+			{
+				buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			auto& event = buffer.events[head & (capacity_ - 1)];
+			event.name = name;
+			event.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch_).count();
+			event.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+			event.detail_size = static_cast<std::uint8_t>(std::min(detail.size(), sizeof(event.detail)));
+			std::memcpy(event.detail, detail.data(), event.detail_size);
+			buffer.head.store(head + 1, std::memory_order_release);
+		}
+
+		// 在导出的追踪中显示的线程名，应在线程记录第一个区间前设置
+		void set_thread_name(std::string name)
+		{
+			if (!enabled())
+			{
+				return;
+			}
+			auto& buffer = local_buffer();
+			std::lock_guard<std::mutex> lock(mutex_);
+			buffer.name = std::move(name);
+			buffer.name_written = false;
+		}
+
+	private:
+		Tracer()
+		{
+			MemoryLedger::instance();
+		}
+
+		~Tracer()
+		{
+			shutdown();
+		}
+
+		struct Event
+		{
+			const char* name = nullptr;
+			std::int64_t start_ns = 0;
+			std::int64_t duration_ns = 0;
+			char detail[40] = {};
+			std::uint8_t detail_size = 0;
+		};
+
+		struct ThreadBuffer
+		{
+			std::vector<Event> events;
+			std::atomic<std::uint64_t> head{ 0 };
+			std::atomic<std::uint64_t> tail{ 0 };
+			std::atomic<std::uint64_t> dropped{ 0 };
+			std::atomic<bool> retired{ false };
+			std::uint32_t tid = 0;
+			std::string name;
+			bool name_written = false;
+			MemoryCharge memory{ MemorySubsystem::tracing };
+		};
+
+		// 线程退出时只标记缓冲区，由导出线程取完剩余事件后释放
+		struct BufferHandle
+		{
+			ThreadBuffer* buffer = nullptr;
+
+			~BufferHandle()
+			{
+				if (buffer)
+				{
+					buffer->retired.store(true, std::memory_order_release);
+				}
+			}
+		};
+
+		ThreadBuffer& local_buffer()
+		{
+			thread_local BufferHandle handle;
+			if (!handle.buffer)
+			{
+				auto buffer = std::make_unique<ThreadBuffer>();
+				buffer->events.resize(capacity_);
+				buffer->memory.set(capacity_ * sizeof(Event));
+				std::lock_guard<std::mutex> lock(mutex_);
+				buffer->tid = ++next_tid_;
+				buffer->name = "thread-" + std::to_string(buffer->tid);
+				handle.buffer = buffer.get();
+				buffers_.push_back(std::move(buffer));
+			}
+			return *handle.buffer;
+		}
+
+		void open_output()
+		{
+			if (config_.output.has_parent_path())
+			{
+				std::error_code ec;
+				fs::create_directories(config_.output.parent_path(), ec);
+			}
+			output_.open(config_.output, std::ios::binary | std::ios::trunc);
+			if (!output_)
+			{
+				throw std::runtime_error("无法创建追踪文件: " + config_.output.string());
+			}
+			output_ << "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"rednote_rtmp_download\"}}";
+			output_bytes_ = 0;
+			for (auto& buffer : buffers_)
+			{
+				buffer->name_written = false;
+			}
+		}
+
+		void export_loop()
+		{
+			std::string out;
+			while (true)
+			{
+				bool stopping = false;
+				{
+					std::unique_lock<std::mutex> lock(mutex_);
+					cv_.wait_for(lock, std::chrono::seconds(config_.flush_seconds), [this]()
+						{
+							return stopping_;
+						});
+					stopping = stopping_;
+
+					for (auto it = buffers_.begin(); it != buffers_.end();)
+					{
+						auto& buffer = **it;
+						// 先读 retired 再取事件，保证线程退出前写入的事件都已被取走
+						const bool retired = buffer.retired.load(std::memory_order_acquire);
+						drain(buffer, out);
+						it = retired ? buffers_.erase(it) : std::next(it);
+					}
+				}
+
+				if (!out.empty())
+				{
+					output_ << out;
+					output_.flush();
+					output_bytes_ += out.size();
+					out.clear();
+					if (output_bytes_ >= config_.max_file_bytes)
+					{
+						rotate();
+					}
+				}
+				if (stopping)
+				{
+					return;
+				}
+			}
+		}
+
+		void drain(ThreadBuffer& buffer, std::string& out)
+		{
+			if (!buffer.name_written)
+			{
+				out.append(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":").append(std::to_string(buffer.tid));
+				out.append(",\"args\":{\"name\":").append(json(buffer.name).dump(-1, ' ', false, json::error_handler_t::replace)).append("}}");
+				buffer.name_written = true;
+			}
+
+			const auto tail = buffer.tail.load(std::memory_order_relaxed);
+			const auto head = buffer.head.load(std::memory_order_acquire);
+			char number[64];
+			for (auto index = tail; index != head; ++index)
+			{
+				const auto& event = buffer.events[index & (capacity_ - 1)];
+				out.append(",\n{\"name\":\"").append(event.name).append("\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":").append(std::to_string(buffer.tid));
+				std::snprintf(number, sizeof(number), ",\"ts\":%.3f,\"dur\":%.3f", event.start_ns / 1000.0, event.duration_ns / 1000.0);
+				out.append(number);
+				if (event.detail_size > 0)
+				{
+					out.append(",\"args\":{\"detail\":")
+						.append(json(std::string(event.detail, event.detail_size)).dump(-1, ' ', false, json::error_handler_t::replace))
+						.append("}");
+				}
+				out.push_back('}');
+			}
+			buffer.tail.store(head, std::memory_order_release);
+
+			if (const auto dropped = buffer.dropped.exchange(0, std::memory_order_relaxed); dropped > 0)
+			{
+				log_warn("追踪缓冲区已满，部分区间被丢弃", { { "thread", buffer.name }, { "dropped", dropped } });
+			}
+		}
+
+		// 超过大小上限时结束当前文件并改名为 .1，保留最近两份
+		void rotate()
+		{
+			output_ << "\n]\n";
+			output_.close();
+			fs::path previous = config_.output;
+			previous += ".1";
+			std::error_code ec;
+			fs::rename(config_.output, previous, ec);
+			std::lock_guard<std::mutex> lock(mutex_);
+			try
+			{
+				open_output();
+			}
+			catch (const std::exception& ex)
+			{
+				log_error("追踪文件轮转失败", { { "error", ex.what() } });
+			}
+		}
+
+		TracingConfig config_;
+		std::atomic<bool> enabled_{ false };
+		std::size_t capacity_ = 0;
+		const clock::time_point epoch_ = clock::now();
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		bool stopping_ = false;
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+		std::uint32_t next_tid_ = 0;
+		std::ofstream output_;
+		std::uint64_t output_bytes_ = 0;
+		std::thread exporter_;
+	};
+
+	class TracerShutdownGuard
+	{
+	public:
+		TracerShutdownGuard() = default;
+		TracerShutdownGuard(const TracerShutdownGuard&) = delete;
+		TracerShutdownGuard& operator=(const TracerShutdownGuard&) = delete;
+
+		~TracerShutdownGuard()
+		{
+			Tracer::instance().shutdown();
+		}
+	};
+
+	// 记录从构造到析构的区间；未启用追踪时只读取一次原子变量。detail 须在区间结束前保持有效
+	class TraceSpan
+	{
+	public:
+		explicit TraceSpan(const char* name, std::string_view detail = {})
+		{
+			if (Tracer::instance().should_record())
+			{
+				name_ = name;
+				detail_ = detail;
+				start_ = Tracer::clock::now();
+			}
+		}
+
+		TraceSpan(const TraceSpan&) = delete;
+		TraceSpan& operator=(const TraceSpan&) = delete;
+
+		~TraceSpan()
+		{
+			if (name_)
+			{
+				Tracer::instance().record(name_, start_, Tracer::clock::now(), detail_);
+			}
+		}
+
+	private:
+		const char* name_ = nullptr;
+		std::string_view detail_;
+		Tracer::clock::time_point start_;
+	};
+
+	// 高频的根操作（每轮轮询）按 sample_percent 采样，未被采样时其中的区间全部跳过；
+	// 录制启动等低频流程不经过采样，总是完整记录
+	class TraceSampleScope
+	{
+	public:
+		TraceSampleScope()
+			: suppressed_(Tracer::instance().enabled() && !Tracer::instance().sample())
+		{
+			if (suppressed_)
+			{
+				++Tracer::suppressed_depth();
+			}
+		}
+
+		TraceSampleScope(const TraceSampleScope&) = delete;
+		TraceSampleScope& operator=(const TraceSampleScope&) = delete;
+
+		~TraceSampleScope()
+		{
+			if (suppressed_)
+			{
+				--Tracer::suppressed_depth();
+			}
+		}
+
+	private:
+		bool suppressed_ = false;
+	};
+
+	RateLimitConfig parse_rate_limit(json& rate_limit_json)
+	{
+		if (!rate_limit_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 rate_limit 字段必须是对象");
+		}
+
+		// 负数多半是写错了配置，直接报错而不是悄悄当作 0
+		const auto parse_non_negative = [](json& object, const std::string& path, std::string_view key, int default_value)
+		{
+			const int value = parse_int_field(object, key, default_value);
+			if (value < 0)
+			{
+				throw std::runtime_error("配置文件中的 " + path + std::string(key) + " 必须是非负整数");
+			}
+			return value;
+		};
+
+		RateLimitConfig rate_limit;
+		rate_limit.global_per_minute = parse_non_negative(rate_limit_json, "rate_limit.", "global_per_minute", rate_limit.global_per_minute);
+		rate_limit.global_burst = std::max(1, parse_non_negative(rate_limit_json, "rate_limit.", "global_burst", rate_limit.global_burst));
+		rate_limit.backoff_base_seconds = std::max(1, parse_non_negative(rate_limit_json, "rate_limit.", "backoff_base_seconds", rate_limit.backoff_base_seconds));
+		rate_limit.backoff_max_seconds = std::max(rate_limit.backoff_base_seconds, parse_non_negative(rate_limit_json, "rate_limit.", "backoff_max_seconds", rate_limit.backoff_max_seconds));
+		if (const auto it = rate_limit_json.find("endpoints"); it != rate_limit_json.end())
+		{
+			if (!it->is_object())
+			{
+				throw std::runtime_error("配置文件中的 rate_limit.endpoints 字段必须是对象");
+			}
+			for (auto& [name, endpoint_json] : it->items())
+			{
+				if (!endpoint_json.is_object())
+				{
+					throw std::runtime_error("配置文件中的 rate_limit.endpoints." + name + " 必须是对象");
+				}
+				EndpointRateConfig endpoint;
+				endpoint.name = name;
+				const std::string path = "rate_limit.endpoints." + name + ".";
+				endpoint.per_minute = parse_non_negative(endpoint_json, path, "per_minute", endpoint.per_minute);
+				endpoint.burst = std::max(1, parse_non_negative(endpoint_json, path, "burst", endpoint.burst));
+				rate_limit.endpoints.push_back(std::move(endpoint));
+			}
+		}
+		return rate_limit;
+	}
+
+	RequestConfig parse_request(json& request_json)
+	{
+		RequestConfig request;
+		request.base_url = request_json.at("base_url").get<std::string>();
+		if (request_json.contains("timeout_seconds"))
+		{
+			request.timeout_seconds = request_json.at("timeout_seconds").get<long>();
+		}
+		if (const auto it = request_json.find("overview_list_url"); it != request_json.end())
+		{
+			if (!it->is_string())
+			{
+				throw std::runtime_error("配置文件中的 overview_list_url 字段必须是字符串");
+			}
+			request.overview_list_url = it->get<std::string>();
+		}
+		request.history_pages = std::max(0, parse_int_field(request_json, "history_pages", request.history_pages));
+		request.history_page_size = std::max(1, parse_int_field(request_json, "history_page_size", request.history_page_size));
+		request.history_refresh_hours = std::max(1, parse_int_field(request_json, "history_refresh_hours", request.history_refresh_hours));
+		request.poll_batch_size = std::clamp(parse_int_field(request_json, "poll_batch_size", request.poll_batch_size), 1, 256);
+		if (const auto it = request_json.find("adaptive_timeout"); it != request_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 adaptive_timeout 字段必须是布尔值");
+			}
+			request.adaptive_timeout = it->get<bool>();
+		}
+		if (const auto it = request_json.find("hedge_requests"); it != request_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 hedge_requests 字段必须是布尔值");
+			}
+			request.hedge_requests = it->get<bool>();
+		}
+		if (const auto it = request_json.find("rate_limit"); it != request_json.end())
+		{
+			request.rate_limit = parse_rate_limit(*it);
+		}
+
+		if (request_json.contains("headers"))
+		{
+			const auto& headers_json = request_json.at("headers");
+			if (!headers_json.is_object())
+			{
+				throw std::runtime_error("配置文件中的 headers 字段必须是对象");
+			}
+
+			for (const auto& [name, value_json] : headers_json.items())
+			{
+				HeaderConfig header;
+				header.name = name;
+				header.value = value_json.get<std::string>();
+				request.headers.push_back(std::move(header));
+			}
+		}
+
+		return request;
+	}
+
+	std::string url_encode_component(std::string_view input)
+	{
+		static constexpr char hex_digits[] = "0123456789ABCDEF";
+
+		std::string encoded;
+		encoded.reserve(input.size() * 3);
+		for (const auto ch : input)
+		{
+			const unsigned char byte = static_cast<unsigned char>(ch);
+			if (std::isalnum(byte) || byte == '-' || byte == '.' || byte == '_' || byte == '~')
+			{
+				encoded.push_back(ch);
+				continue;
+			}
+
+			encoded.push_back('%');
+			encoded.push_back(hex_digits[byte >> 4]);
+			encoded.push_back(hex_digits[byte & 0x0F]);
+		}
+
+		return encoded;
+	}
+
+	std::string build_request_url(std::string_view base_url, std::string_view host_id)
+	{
+		const std::string escaped_host_id = url_encode_component(host_id);
+
+		std::string url;
+		url.reserve(base_url.size() + escaped_host_id.size() + 9);
+		url.append(base_url);
+		url.append("?host_id=");
+		url.append(escaped_host_id);
+		return url;
+	}
+
+	// 按出现顺序查找文本中 room_id 之后的数字，有多个时取第一个
+	std::optional<std::string> find_room_id(std::string_view dumped)
+	{
+		constexpr std::string_view target = "room_id";
+		std::vector<std::string_view> room_ids;
+
+		std::size_t search_pos = 0;
+		while (true)
+		{
+			const auto found = dumped.find(target, search_pos);
+			if (found == std::string::npos)
+			{
+				break;
+			}
+
+			auto digit_pos = found + target.size();
+			while (digit_pos < dumped.size() && !std::isdigit(static_cast<unsigned char>(dumped[digit_pos])))
+			{
+				++digit_pos;
+			}
+
+			if (digit_pos >= dumped.size())
+			{
+				break;
+			}
+
+			auto end_pos = digit_pos;
+			while (end_pos < dumped.size() && std::isdigit(static_cast<unsigned char>(dumped[end_pos])))
+			{
+				++end_pos;
+			}
+
+			if (end_pos > digit_pos)
+			{
+				room_ids.push_back(dumped.substr(digit_pos, end_pos - digit_pos));
+			}
+
+			search_pos = end_pos;
+		}
+
+		if (!room_ids.empty())
+		{
+			std::string joined;
+			for (std::size_t i = 0; i < room_ids.size(); ++i)
+			{
+				if (i > 0)
+				{
+					joined.push_back(',');
+				}
+				joined.append(room_ids[i]);
+			}
+			log_debug("提取到 room_id 列表", { { "room_ids", joined } });
+
+			return std::string(room_ids.front());
+		}
+
+		log_debug("未在响应中发现 room_id");
+		return std::nullopt;
+	}
+
+	// 默认解析为 DOM 后在按键名排序的序列化结果中查找，响应含多个 room_id 时据此确定取哪一个。
+	// scan_raw（低内存模式）时直接扫描响应原文，不构建 DOM，先用 json::accept 做一次不分配节点的校验，
+	// 避免把错误页面当成“没有直播间”；此时按原文顺序取第一个，多个 room_id 时结果可能与默认方式不同
+	std::optional<std::string> extract_room_id(std::string_view body, bool scan_raw)
+	{
+		TraceSpan span("extract_room_id");
+		if (scan_raw)
+		{
+			if (!json::accept(body))
+			{
+				throw std::runtime_error("响应不是有效的 JSON");
+			}
+			return find_room_id(body);
+		}
+
+		json root;
+		{
+			TraceSpan parse_span("json_parse");
+			root = json::parse(body);
+		}
+		return find_room_id(root.dump());
+	}
+
+	struct BroadcastRecord
+	{
+		std::string room_id;
+		std::chrono::system_clock::time_point started_at;
+	};
+
+	struct HistoryPage
+	{
+		std::vector<BroadcastRecord> records;
+		int total_count = 0;
+	};
+
+	// 轮询接口抽象：不同接口的 URL 形式和响应结构各不相同，未提供的能力调用时抛出 logic_error
+	class PollEndpoint
+	{
+	public:
+		virtual ~PollEndpoint() = default;
+
+		virtual std::string_view name() const = 0;
+
+		virtual std::string build_status_url(std::string_view) const
+		{
+			throw std::logic_error("该接口不提供直播状态");
+		}
+
+		// 传入响应原文，由各接口决定是否需要完整解析
+		virtual std::optional<std::string> parse_status(std::string_view) const
+		{
+			throw std::logic_error("该接口不提供直播状态");
+		}
+
+		virtual std::string build_history_url(std::string_view, int, int) const
+		{
+			throw std::logic_error("该接口不提供直播历史");
+		}
+
+		virtual HistoryPage parse_history(const json&) const
+		{
+			throw std::logic_error("该接口不提供直播历史");
+		}
+	};
+
+	// /dynamic/host/info：单个主播的当前状态，直播中时响应里带有 room_id
+	class HostInfoEndpoint final : public PollEndpoint
+	{
+	public:
+		HostInfoEndpoint(std::string base_url, bool scan_raw)
+			: base_url_(std::move(base_url)), scan_raw_(scan_raw)
+		{
+		}
+
+		std::string_view name() const override
+		{
+			return "host/info";
+		}
+
+		std::string build_status_url(std::string_view host_id) const override
+		{
+			return build_request_url(base_url_, host_id);
+		}
+
+		std::optional<std::string> parse_status(std::string_view body) const override
+		{
+			return extract_room_id(body, scan_raw_);
+		}
+
+	private:
+		std::string base_url_;
+		bool scan_raw_ = false;
+	};
+
+	// /dynamic/overview/list：主播的历史直播列表，分页返回，不代表当前是否在播
+	class OverviewListEndpoint final : public PollEndpoint
+	{
+	public:
+		explicit OverviewListEndpoint(std::string base_url)
+			: base_url_(std::move(base_url))
+		{
+		}
+
+		std::string_view name() const override
+		{
+			return "overview/list";
+		}
+
+		std::string build_history_url(std::string_view host_id, int page, int page_size) const override
+		{
+			std::string url = build_request_url(base_url_, host_id);
+			url.append("&page=").append(std::to_string(page));
+			url.append("&page_size=").append(std::to_string(page_size));
+			return url;
+		}
+
+		HistoryPage parse_history(const json& root) const override
+		{
+			HistoryPage page;
+			const auto data_it = root.find("data");
+			if (data_it == root.end() || !data_it->is_object())
+			{
+				return page;
+			}
+
+			if (const auto it = data_it->find("total_count"); it != data_it->end() && it->is_number_integer())
+			{
+				page.total_count = it->get<int>();
+			}
+
+			const auto list_it = data_it->find("live_dynamic_room_list");
+			if (list_it == data_it->end() || !list_it->is_array())
+			{
+				return page;
+			}
+
+			for (const auto& item : *list_it)
+			{
+				const auto room_it = item.find("room_id");
+				const auto timestamp_it = item.find("timestamp");
+				if (room_it == item.end() || timestamp_it == item.end() || !timestamp_it->is_number())
+				{
+					continue;
+				}
+
+				BroadcastRecord record;
+				record.room_id = room_it->is_string() ? room_it->get<std::string>() : room_it->dump();
+				record.started_at = std::chrono::system_clock::time_point(
+					std::chrono::duration_cast<std::chrono::system_clock::duration>(
+						std::chrono::milliseconds(timestamp_it->get<long long>())));
+				page.records.push_back(std::move(record));
+			}
+
+			return page;
+		}
+
+	private:
+		std::string base_url_;
+	};
+
+	std::string derive_overview_list_url(const RequestConfig& request)
+	{
+		if (!request.overview_list_url.empty())
+		{
+			return request.overview_list_url;
+		}
+
+		constexpr std::string_view host_info_suffix = "host/info";
+		const std::string_view base_url = request.base_url;
+		if (base_url.size() >= host_info_suffix.size() && base_url.substr(base_url.size() - host_info_suffix.size()) == host_info_suffix)
+		{
+			return std::string(base_url.substr(0, base_url.size() - host_info_suffix.size())) + "overview/list";
+		}
+
+		return {};
+	}
+
+	class PollEndpointSet
+	{
+	public:
+		explicit PollEndpointSet(const RequestConfig& request)
+			: status_(request.base_url, request.scan_raw_status)
+		{
+			if (auto overview_url = derive_overview_list_url(request); !overview_url.empty())
+			{
+				history_.emplace(std::move(overview_url));
+			}
+		}
+
+		// 直播状态只能来自 host/info：overview/list 只返回分页的历史直播列表，不带当前是否在播（见 docs/ 中的抓包记录），
+		// 因此每个主播每轮仍要单独请求 host/info，历史接口只用于预测开播时间
+		const PollEndpoint& status_endpoint() const
+		{
+			return status_;
+		}
+
+		const PollEndpoint* history_endpoint() const
+		{
+			return history_ ? &*history_ : nullptr;
+		}
+
+	private:
+		HostInfoEndpoint status_;
+		std::optional<OverviewListEndpoint> history_;
+	};
+
+	RecorderKind parse_recorder_kind(const json& value, const char* field)
+	{
+		const std::string name = value.is_string() ? value.get<std::string>() : std::string{};
+		if (equals_ignore_case(name, "rtmpdump"))
+		{
+			return RecorderKind::rtmpdump;
+		}
+		if (equals_ignore_case(name, "ffmpeg"))
+		{
+			return RecorderKind::ffmpeg;
+		}
+		if (equals_ignore_case(name, "custom"))
+		{
+			return RecorderKind::custom;
+		}
+		throw std::runtime_error(std::string("配置文件中的 ") + field + " 只能是 rtmpdump、ffmpeg 或 custom");
+	}
+
+	HostConfig parse_host_entry(const json& entry_json, const RecordingConfig& recording)
+	{
+		HostConfig host;
+		host.prefer_orig = recording.prefer_orig;
+		if (entry_json.is_string())
+		{
+			host.host_id = entry_json.get<std::string>();
+			return host;
+		}
+
+		if (!entry_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 host_id 数组必须只包含字符串或对象");
+		}
+
+		const auto id_it = entry_json.find("host_id");
+		if (id_it == entry_json.end() || !id_it->is_string())
+		{
+			throw std::runtime_error("配置文件中的主播对象必须包含字符串类型的 host_id");
+		}
+		host.host_id = id_it->get<std::string>();
+
+		if (const auto it = entry_json.find("priority"); it != entry_json.end())
+		{
+			if (!it->is_number_integer())
+			{
+				throw std::runtime_error("配置文件中主播的 priority 字段必须是整数");
+			}
+			host.priority = it->get<int>();
+		}
+		if (const auto it = entry_json.find("prefer_orig"); it != entry_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中主播的 prefer_orig 字段必须是布尔值");
+			}
+			host.prefer_orig = it->get<bool>();
+		}
+		if (const auto it = entry_json.find("recorder"); it != entry_json.end())
+		{
+			host.recorder = parse_recorder_kind(*it, "主播的 recorder 字段");
+		}
+		if (const auto it = entry_json.find("command"); it != entry_json.end())
+		{
+			if (!it->is_string())
+			{
+				throw std::runtime_error("配置文件中主播的 command 字段必须是字符串");
+			}
+			host.command_template = it->get<std::string>();
+		}
+
+		return host;
+	}
+
+	std::vector<HostConfig> parse_hosts(const json& host_id_json, const RequestConfig& request, const RecordingConfig& recording)
+	{
+		std::vector<HostConfig> entries;
+		if (host_id_json.is_string())
+		{
+			entries.push_back(parse_host_entry(host_id_json, recording));
+		}
+		else if (host_id_json.is_array())
+		{
+			entries.reserve(host_id_json.size());
+			for (const auto& value : host_id_json)
+			{
+				entries.push_back(parse_host_entry(value, recording));
+			}
+		}
+		else
+		{
+			throw std::runtime_error("配置文件中的 host_id 字段必须是字符串或数组");
+		}
+
+		const PollEndpointSet endpoints(request);
+		const auto& status_endpoint = endpoints.status_endpoint();
+
+		std::vector<HostConfig> hosts;
+		hosts.reserve(entries.size());
+		for (auto& entry : entries)
+		{
+			std::string host_id = trim_copy(entry.host_id);
+			if (host_id.empty())
+			{
+				continue;
+			}
+
+			const bool duplicated = std::any_of(hosts.begin(), hosts.end(), [&](const HostConfig& existing)
+				{
+					return existing.host_id == host_id;
+				});
+			if (duplicated)
+			{
+				continue;
+			}
+
+			entry.request_url = status_endpoint.build_status_url(host_id);
+			entry.host_id = std::move(host_id);
+			hosts.push_back(std::move(entry));
+		}
+
+		if (hosts.empty())
+		{
+			throw std::runtime_error("配置文件中的 host_id 不能为空");
+		}
+
+		return hosts;
+	}
+
+	ProgramConfig parse_programs(json& programs_json)
+	{
+		if (!programs_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 programs 字段必须是对象");
+		}
+
+		ProgramConfig programs;
+		if (const auto it = programs_json.find("rtmpdump_exe"); it != programs_json.end())
+		{
+			if (it->is_string())
+			{
+				programs.rtmpdump_search_paths.insert(
+					programs.rtmpdump_search_paths.begin(),
+					fs::path{ it->get<std::string>() });
+			}
+			else if (it->is_array())
+			{
+				std::vector<fs::path> configured_paths;
+				configured_paths.reserve(it->size());
+				for (const auto& value : *it)
+				{
+					if (!value.is_string())
+					{
+						throw std::runtime_error(
+							"配置文件中的 rtmpdump_exe 数组必须只包含字符串");
+					}
+					configured_paths.emplace_back(value.get<std::string>());
+				}
+
+				programs.rtmpdump_search_paths.insert(
+					programs.rtmpdump_search_paths.begin(),
+					configured_paths.begin(),
+					configured_paths.end());
+			}
+			else
+			{
+				throw std::runtime_error("配置文件中的 rtmpdump_exe 字段必须是字符串或字符串数组");
+			}
+		}
+		if (const auto it = programs_json.find("ffmpeg_exe"); it != programs_json.end())
+		{
+			if (!it->is_string())
+			{
+				throw std::runtime_error("配置文件中的 ffmpeg_exe 字段必须是字符串");
+			}
+			programs.ffmpeg_exe = fs::path{ it->get<std::string>() };
+		}
+		if (const auto it = programs_json.find("recorder"); it != programs_json.end())
+		{
+			programs.recorder = parse_recorder_kind(*it, "programs.recorder 字段");
+		}
+		if (const auto it = programs_json.find("command_template"); it != programs_json.end())
+		{
+			if (!it->is_string())
+			{
+				throw std::runtime_error("配置文件中的 command_template 字段必须是字符串");
+			}
+			programs.command_template = it->get<std::string>();
+		}
+		if (const auto it = programs_json.find("pipe_output"); it != programs_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 pipe_output 字段必须是布尔值");
+			}
+			programs.pipe_output = it->get<bool>();
+		}
+		programs.stall_timeout_seconds = std::max(0, parse_int_field(programs_json, "stall_timeout_seconds", programs.stall_timeout_seconds));
+		programs.max_duration_minutes = std::max(0, parse_int_field(programs_json, "max_duration_minutes", programs.max_duration_minutes));
+
+		return programs;
+	}
+
+	OutputRootConfig parse_output_root(const json& root_json)
+	{
+		OutputRootConfig root;
+		if (root_json.is_string())
+		{
+			root.path = fs::path{ root_json.get<std::string>() };
+			return root;
+		}
+
+		if (!root_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 output_roots 条目必须是字符串或对象");
+		}
+
+		const auto path_it = root_json.find("path");
+		if (path_it == root_json.end() || !path_it->is_string())
+		{
+			throw std::runtime_error("配置文件中的 output_roots 条目必须包含字符串类型的 path");
+		}
+		root.path = fs::path{ path_it->get<std::string>() };
+
+		if (const auto it = root_json.find("tier"); it != root_json.end())
+		{
+			const std::string tier = it->is_string() ? it->get<std::string>() : std::string{};
+			if (equals_ignore_case(tier, "scratch"))
+			{
+				root.tier = StorageTier::scratch;
+			}
+			else if (equals_ignore_case(tier, "bulk"))
+			{
+				root.tier = StorageTier::bulk;
+			}
+			else
+			{
+				throw std::runtime_error("配置文件中的 output_roots.tier 只能是 scratch 或 bulk");
+			}
+		}
+
+		if (const auto it = root_json.find("min_free_mb"); it != root_json.end())
+		{
+			if (!it->is_number_integer() || it->get<long long>() < 0)
+			{
+				throw std::runtime_error("配置文件中的 output_roots.min_free_mb 必须是非负整数");
+			}
+			root.min_free_bytes = static_cast<std::uint64_t>(it->get<long long>()) * 1024 * 1024;
+		}
+
+		return root;
+	}
+
+	DownloadConfig parse_download(const json& download_json)
+	{
+		if (!download_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 download 字段必须是对象");
+		}
+
+		DownloadConfig download;
+		if (const auto it = download_json.find("base_stream_url"); it != download_json.end())
+		{
+			if (!it->is_string() || it->get<std::string>().empty())
+			{
+				throw std::runtime_error("配置文件中的 download.base_stream_url 字段必须是非空字符串");
+			}
+			download.base_stream_url = it->get<std::string>();
+		}
+		if (const auto it = download_json.find("output_roots"); it != download_json.end())
+		{
+			if (!it->is_array() || it->empty())
+			{
+				throw std::runtime_error("配置文件中的 output_roots 字段必须是非空数组");
+			}
+
+			download.output_roots.clear();
+			for (const auto& value : *it)
+			{
+				download.output_roots.push_back(parse_output_root(value));
+			}
+		}
+		if (const auto it = download_json.find("migrate_finished"); it != download_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 download.migrate_finished 字段必须是布尔值");
+			}
+			download.migrate_finished = it->get<bool>();
+		}
+		if (const auto it = download_json.find("integrity_manifest"); it != download_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 download.integrity_manifest 字段必须是布尔值");
+			}
+			download.integrity_manifest = it->get<bool>();
+		}
+
+		return download;
+	}
+
+	RecordingConfig parse_recording(json& recording_json)
+	{
+		if (!recording_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 recording 字段必须是对象");
+		}
+
+		RecordingConfig recording;
+		recording.max_ingress_kbps = std::max(0, parse_int_field(recording_json, "max_ingress_kbps", recording.max_ingress_kbps));
+		recording.max_concurrent_recordings = std::max(0, parse_int_field(recording_json, "max_concurrent_recordings", recording.max_concurrent_recordings));
+		recording.standard_stream_kbps = std::max(1, parse_int_field(recording_json, "standard_stream_kbps", recording.standard_stream_kbps));
+		recording.orig_stream_kbps = std::max(1, parse_int_field(recording_json, "orig_stream_kbps", recording.orig_stream_kbps));
+
+		if (const auto it = recording_json.find("prefer_orig"); it != recording_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 recording.prefer_orig 字段必须是布尔值");
+			}
+			recording.prefer_orig = it->get<bool>();
+		}
+		if (const auto it = recording_json.find("orig_stream_url_template"); it != recording_json.end())
+		{
+			if (!it->is_string())
+			{
+				throw std::runtime_error("配置文件中的 recording.orig_stream_url_template 字段必须是字符串");
+			}
+			recording.orig_stream_url_template = it->get<std::string>();
+		}
+
+		return recording;
+	}
+
+	LoggingConfig parse_logging(json& logging_json)
+	{
+		if (!logging_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 logging 字段必须是对象");
+		}
+
+		LoggingConfig logging;
+		if (const auto it = logging_json.find("level"); it != logging_json.end())
+		{
+			const std::string level = it->is_string() ? it->get<std::string>() : std::string{};
+			if (equals_ignore_case(level, "debug"))
+			{
+				logging.level = LogLevel::debug;
+			}
+			else if (equals_ignore_case(level, "info"))
+			{
+				logging.level = LogLevel::info;
+			}
+			else if (equals_ignore_case(level, "warn"))
+			{
+				logging.level = LogLevel::warn;
+			}
+			else if (equals_ignore_case(level, "error"))
+			{
+				logging.level = LogLevel::error;
+			}
+			else
+			{
+				throw std::runtime_error("配置文件中的 logging.level 只能是 debug、info、warn 或 error");
+			}
+		}
+		if (const auto it = logging_json.find("console"); it != logging_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 logging.console 字段必须是布尔值");
+			}
+			logging.console = it->get<bool>();
+		}
+		if (const auto it = logging_json.find("file"); it != logging_json.end())
+		{
+			if (!it->is_string())
+			{
+				throw std::runtime_error("配置文件中的 logging.file 字段必须是字符串");
+			}
+			logging.file = fs::path{ it->get<std::string>() };
+		}
+
+		const int max_file_mb = parse_int_field(logging_json, "max_file_mb", static_cast<int>(logging.max_file_bytes / (1024 * 1024)));
+		logging.max_file_bytes = static_cast<std::uint64_t>(std::max(1, max_file_mb)) * 1024 * 1024;
+		logging.max_files = std::max(0, parse_int_field(logging_json, "max_files", logging.max_files));
+		return logging;
+	}
+
+	TracingConfig parse_tracing(json& tracing_json)
+	{
+		if (!tracing_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 tracing 字段必须是对象");
+		}
+
+		TracingConfig tracing;
+		if (const auto it = tracing_json.find("enabled"); it != tracing_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 tracing.enabled 字段必须是布尔值");
+			}
+			tracing.enabled = it->get<bool>();
+		}
+		if (const auto it = tracing_json.find("output"); it != tracing_json.end())
+		{
+			if (!it->is_string() || it->get<std::string>().empty())
+			{
+				throw std::runtime_error("配置文件中的 tracing.output 字段必须是非空字符串");
+			}
+			tracing.output = fs::path{ it->get<std::string>() };
+		}
+
+		tracing.sample_percent = std::clamp(parse_int_field(tracing_json, "sample_percent", tracing.sample_percent), 0, 100);
+		tracing.buffer_events = std::clamp(parse_int_field(tracing_json, "buffer_events", tracing.buffer_events), 256, 1 << 20);
+		tracing.flush_seconds = std::max(1, parse_int_field(tracing_json, "flush_seconds", tracing.flush_seconds));
+		const int max_file_mb = parse_int_field(tracing_json, "max_file_mb", static_cast<int>(tracing.max_file_bytes / (1024 * 1024)));
+		tracing.max_file_bytes = static_cast<std::uint64_t>(std::max(1, max_file_mb)) * 1024 * 1024;
+		return tracing;
+	}
+
+	IoConfig parse_io(json& io_json)
+	{
+		if (!io_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 io 字段必须是对象");
+		}
+
+		IoConfig io;
+		if (const auto it = io_json.find("backend"); it != io_json.end())
+		{
+			const std::string backend = it->is_string() ? it->get<std::string>() : std::string{};
+			if (equals_ignore_case(backend, "auto"))
+			{
+				io.backend = IoBackendKind::automatic;
+			}
+			else if (equals_ignore_case(backend, "io_uring"))
+			{
+				io.backend = IoBackendKind::io_uring;
+			}
+			else if (equals_ignore_case(backend, "epoll"))
+			{
+				io.backend = IoBackendKind::epoll;
+			}
+			else if (equals_ignore_case(backend, "threads"))
+			{
+				io.backend = IoBackendKind::threads;
+			}
+			else
+			{
+				throw std::runtime_error("配置文件中的 io.backend 只能是 auto、io_uring、epoll 或 threads");
+			}
+		}
+
+		io.queue_depth = std::clamp(parse_int_field(io_json, "queue_depth", io.queue_depth), 16, 4096);
+		io.write_block_kb = std::clamp(parse_int_field(io_json, "write_block_kb", io.write_block_kb), 16, 16 * 1024);
+		// 至少容纳两块，保证一块在写时另一块可以继续攒数据
+		io.max_pending_write_mb = std::max(parse_int_field(io_json, "max_pending_write_mb", io.max_pending_write_mb), (io.write_block_kb * 2 + 1023) / 1024);
+		return io;
+	}
+
+	StateConfig parse_state(json& state_json)
+	{
+		if (!state_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 state 字段必须是对象");
+		}
+
+		StateConfig state;
+		if (const auto it = state_json.find("enabled"); it != state_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 state.enabled 字段必须是布尔值");
+			}
+			state.enabled = it->get<bool>();
+		}
+		if (const auto it = state_json.find("path"); it != state_json.end())
+		{
+			if (!it->is_string() || it->get<std::string>().empty())
+			{
+				throw std::runtime_error("配置文件中的 state.path 字段必须是非空字符串");
+			}
+			state.path = fs::path{ it->get<std::string>() };
+		}
+
+		state.interval_seconds = std::max(1, parse_int_field(state_json, "interval_seconds", state.interval_seconds));
+		state.resume_window_seconds = std::max(0, parse_int_field(state_json, "resume_window_seconds", state.resume_window_seconds));
+		return state;
+	}
+
+	FootprintConfig parse_footprint(json& footprint_json)
+	{
+		if (!footprint_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 footprint 字段必须是对象");
+		}
+
+		FootprintConfig footprint;
+		if (const auto it = footprint_json.find("mode"); it != footprint_json.end())
+		{
+			const std::string mode = it->is_string() ? it->get<std::string>() : std::string{};
+			if (equals_ignore_case(mode, "low"))
+			{
+				footprint.low = true;
+			}
+			else if (!equals_ignore_case(mode, "normal"))
+			{
+				throw std::runtime_error("配置文件中的 footprint.mode 只能是 normal 或 low");
+			}
+		}
+
+		// 低内存模式下未显式配置的上限取较小的默认值
+		if (footprint.low)
+		{
+			footprint.max_response_kb = 256;
+			footprint.recording_buffer_kb = 256;
+		}
+		footprint.max_response_kb = std::max(0, parse_int_field(footprint_json, "max_response_kb", footprint.max_response_kb));
+		footprint.recording_buffer_kb = std::clamp(parse_int_field(footprint_json, "recording_buffer_kb", footprint.recording_buffer_kb), 16, 16 * 1024);
+		footprint.rss_ceiling_mb = std::max(0, parse_int_field(footprint_json, "rss_ceiling_mb", footprint.rss_ceiling_mb));
+		footprint.report_interval_seconds = std::max(10, parse_int_field(footprint_json, "report_interval_seconds", footprint.report_interval_seconds));
+		return footprint;
+	}
+
+	// 低内存模式收紧其他模块的缓冲区，放在所有字段解析完成之后
+	void apply_low_footprint(Config& config)
+	{
+		config.http_debug_enabled = false;
+		config.request.scan_raw_status = true;
+		config.logging.level = std::max(config.logging.level, LogLevel::info);
+		config.io.write_block_kb = std::min(config.io.write_block_kb, 64);
+		config.io.max_pending_write_mb = std::min(config.io.max_pending_write_mb, 1);
+		config.relay.buffer_bytes = std::min<std::size_t>(config.relay.buffer_bytes, 2ull * 1024 * 1024);
+		config.chat.block_messages = std::min(config.chat.block_messages, 1024);
+	}
+
+	RelayConfig parse_relay(json& relay_json)
+	{
+		if (!relay_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 relay 字段必须是对象");
+		}
+
+		RelayConfig relay;
+		if (const auto it = relay_json.find("enabled"); it != relay_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 relay.enabled 字段必须是布尔值");
+			}
+			relay.enabled = it->get<bool>();
+		}
+		if (const auto it = relay_json.find("listen_address"); it != relay_json.end())
+		{
+			if (!it->is_string())
+			{
+				throw std::runtime_error("配置文件中的 relay.listen_address 字段必须是字符串");
+			}
+			relay.listen_address = it->get<std::string>();
+		}
+
+		relay.port = parse_int_field(relay_json, "port", relay.port);
+		if (relay.port <= 0 || relay.port > 65535)
+		{
+			throw std::runtime_error("配置文件中的 relay.port 必须在 1 到 65535 之间");
+		}
+		const int buffer_kb = parse_int_field(relay_json, "buffer_kb", static_cast<int>(relay.buffer_bytes / 1024));
+		relay.buffer_bytes = static_cast<std::size_t>(std::max(256, buffer_kb)) * 1024;
+		relay.max_readers = std::max(1, parse_int_field(relay_json, "max_readers", relay.max_readers));
+		return relay;
+	}
+
+	PrewarmConfig parse_prewarm(json& prewarm_json)
+	{
+		if (!prewarm_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 prewarm 字段必须是对象");
+		}
+
+		PrewarmConfig prewarm;
+		if (const auto it = prewarm_json.find("enabled"); it != prewarm_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 prewarm.enabled 字段必须是布尔值");
+			}
+			prewarm.enabled = it->get<bool>();
+		}
+
+		prewarm.lead_minutes = std::max(0, parse_int_field(prewarm_json, "lead_minutes", prewarm.lead_minutes));
+		prewarm.connections = std::clamp(parse_int_field(prewarm_json, "connections", prewarm.connections), 1, 8);
+		prewarm.refresh_seconds = std::max(5, parse_int_field(prewarm_json, "refresh_seconds", prewarm.refresh_seconds));
+		return prewarm;
+	}
+
+	ChatConfig parse_chat(json& chat_json)
+	{
+		if (!chat_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 chat 字段必须是对象");
+		}
+
+		ChatConfig chat;
+		if (const auto it = chat_json.find("enabled"); it != chat_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 chat.enabled 字段必须是布尔值");
+			}
+			chat.enabled = it->get<bool>();
+		}
+
+		const auto parse_string = [&](const json& object, const char* key, std::string& target, const char* label)
+			{
+				if (const auto it = object.find(key); it != object.end())
+				{
+					if (!it->is_string())
+					{
+						throw std::runtime_error(std::string("配置文件中的 ") + label + " 字段必须是字符串");
+					}
+					target = it->get<std::string>();
+				}
+			};
+		parse_string(chat_json, "url_template", chat.url_template, "chat.url_template");
+		parse_string(chat_json, "messages_pointer", chat.messages_pointer, "chat.messages_pointer");
+		parse_string(chat_json, "cursor_pointer", chat.cursor_pointer, "chat.cursor_pointer");
+		if (const auto it = chat_json.find("fields"); it != chat_json.end())
+		{
+			if (!it->is_object())
+			{
+				throw std::runtime_error("配置文件中的 chat.fields 字段必须是对象");
+			}
+			parse_string(*it, "id", chat.id_pointer, "chat.fields.id");
+			parse_string(*it, "type", chat.type_pointer, "chat.fields.type");
+			parse_string(*it, "user", chat.user_pointer, "chat.fields.user");
+			parse_string(*it, "text", chat.text_pointer, "chat.fields.text");
+			parse_string(*it, "value", chat.value_pointer, "chat.fields.value");
+			parse_string(*it, "time", chat.time_pointer, "chat.fields.time");
+		}
+
+		// JSON Pointer 写错时在启动阶段就报告，而不是每条消息都失败
+		for (const auto* pointer : { &chat.messages_pointer, &chat.cursor_pointer, &chat.id_pointer, &chat.type_pointer,
+			&chat.user_pointer, &chat.text_pointer, &chat.value_pointer, &chat.time_pointer })
+		{
+			try
+			{
+				json::json_pointer{ *pointer };
+			}
+			catch (const std::exception&)
+			{
+				throw std::runtime_error("配置文件中的 chat JSON Pointer 无效: " + *pointer);
+			}
+		}
+
+		if (chat.enabled && chat.url_template.find("{room_id}") == std::string::npos)
+		{
+			throw std::runtime_error("启用 chat 时 url_template 必须包含 {room_id}");
+		}
+
+		chat.poll_interval_ms = std::max(200, parse_int_field(chat_json, "poll_interval_ms", chat.poll_interval_ms));
+		chat.block_messages = std::clamp(parse_int_field(chat_json, "block_messages", chat.block_messages), 64, 65536);
+		chat.flush_seconds = std::max(1, parse_int_field(chat_json, "flush_seconds", chat.flush_seconds));
+		chat.compression_level = std::clamp(parse_int_field(chat_json, "compression_level", chat.compression_level), 1, 19);
+		return chat;
+	}
+
+	TestModeConfig parse_test_mode(const json& test_mode_json)
+	{
+		if (!test_mode_json.is_object())
+		{
+			throw std::runtime_error("配置文件中的 test_mode 字段必须是对象");
+		}
+
+		TestModeConfig test_mode;
+		if (const auto it = test_mode_json.find("enabled"); it != test_mode_json.end())
+		{
+			test_mode.enabled = it->get<bool>();
+		}
+		if (const auto it = test_mode_json.find("fake_room_id"); it != test_mode_json.end())
+		{
+			test_mode.fake_room_id = it->get<std::string>();
+		}
+
+		return test_mode;
+	}
+
+	Config parse_config(const fs::path& path)
+	{
+		const auto file_content = read_file(path);
+		auto config_json = json::parse(file_content);
+
+		Config config;
+		config.request = parse_request(config_json.at("request"));
+		if (const auto it = config_json.find("download"); it != config_json.end())
+		{
+			config.download = parse_download(*it);
+		}
+		if (const auto it = config_json.find("recording"); it != config_json.end())
+		{
+			config.recording = parse_recording(*it);
+		}
+		config.hosts = parse_hosts(config_json.at("host_id"), config.request, config.recording);
+		config.polling = parse_polling_config(config_json);
+		if (const auto it = config_json.find("programs"); it != config_json.end())
+		{
+			config.programs = parse_programs(*it);
+		}
+		// 只有实际用到 rtmpdump 时才要求能找到它
+		const bool uses_rtmpdump = config.programs.recorder == RecorderKind::rtmpdump
+			|| std::any_of(config.hosts.begin(), config.hosts.end(), [](const HostConfig& host)
+				{
+					return host.recorder == RecorderKind::rtmpdump;
+				});
+		if (uses_rtmpdump)
+		{
+			config.programs.rtmpdump_exe = locate_rtmpdump_executable(config.programs);
+		}
+		if (const auto it = config_json.find("test_mode"); it != config_json.end())
+		{
+			config.test_mode = parse_test_mode(*it);
+		}
+		if (const auto it = config_json.find("logging"); it != config_json.end())
+		{
+			config.logging = parse_logging(*it);
+		}
+		if (const auto it = config_json.find("tracing"); it != config_json.end())
+		{
+			config.tracing = parse_tracing(*it);
+		}
+		if (const auto it = config_json.find("io"); it != config_json.end())
+		{
+			config.io = parse_io(*it);
+		}
+		if (const auto it = config_json.find("state"); it != config_json.end())
+		{
+			config.state = parse_state(*it);
+		}
+		if (const auto it = config_json.find("relay"); it != config_json.end())
+		{
+			config.relay = parse_relay(*it);
+		}
+		if (const auto it = config_json.find("prewarm"); it != config_json.end())
+		{
+			config.prewarm = parse_prewarm(*it);
+		}
+		if (const auto it = config_json.find("chat"); it != config_json.end())
+		{
+			config.chat = parse_chat(*it);
+		}
+		if (const auto it = config_json.find("http_debug"); it != config_json.end())
+		{
+			if (!it->is_boolean())
+			{
+				throw std::runtime_error("配置文件中的 http_debug 字段必须是布尔值");
+			}
+			config.http_debug_enabled = it->get<bool>();
+		}
+		config.http_debug_min_interval_seconds = std::max(0, parse_int_field(
+			config_json,
+			"http_debug_min_interval_seconds",
+			config.http_debug_min_interval_seconds));
+		if (const auto it = config_json.find("footprint"); it != config_json.end())
+		{
+			config.footprint = parse_footprint(*it);
+		}
+		if (config.footprint.low)
+		{
+			apply_low_footprint(config);
+		}
+		return config;
+	}
+
+	size_t header_callback(char* buffer, size_t size, size_t nitems, void* userdata)
+	{
+		auto* stream = static_cast<std::string*>(userdata);
+		const auto count = size * nitems;
+		stream->append(buffer, count);
+		return count;
+	}
+
+	struct HttpResponse
+	{
+		long status_code = 0;
+		std::string body;
+		std::string headers;
+		// 非 0 时响应体超过该长度即中止传输，缓冲区容量也不会超过它
+		std::size_t body_limit = 0;
+	};
+
+	size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+	{
+		auto* response = static_cast<HttpResponse*>(userdata);
+		const auto count = size * nmemb;
+		auto& body = response->body;
+		if (response->body_limit > 0)
+		{
+			if (body.size() + count > response->body_limit)
+			{
+				return 0;
+			}
+			if (body.size() + count > body.capacity())
+			{
+				body.reserve(std::min(response->body_limit, std::max(body.size() + count, body.capacity() * 2)));
+			}
+		}
+		body.append(ptr, count);
+		return count;
+	}
+
+	std::string describe_curl_failure(CURLcode res, const HttpResponse& response)
+	{
+		if (res == CURLE_WRITE_ERROR && response.body_limit > 0)
+		{
+			return "HTTP 响应超过 " + std::to_string(response.body_limit / 1024) + " KB 上限";
+		}
+		return std::string("HTTP 请求失败: ") + curl_easy_strerror(res);
+	}
+
+	struct CurlSlistDeleter
+	{
+		void operator()(curl_slist* list) const
+		{
+			curl_slist_free_all(list);
+		}
+	};
+
+	using CurlSlistHandle = std::unique_ptr<curl_slist, CurlSlistDeleter>;
+
+	// 记录某个接口最近若干次请求的延迟，用于推导自适应超时与对冲请求的触发时机
+	class LatencyTracker
+	{
+	public:
+		explicit LatencyTracker(std::string name)
+			: name_(std::move(name))
+		{
+		}
+
+		void record(std::chrono::milliseconds latency)
+		{
+			samples_[next_] = static_cast<std::uint32_t>(std::clamp<std::int64_t>(latency.count(), 0, std::numeric_limits<std::uint32_t>::max()));
+			next_ = (next_ + 1) % samples_.size();
+			count_ = std::min(count_ + 1, samples_.size());
+
+			// 不必每个样本都重新排序，攒够一批再更新分位数
+			if (++since_update_ >= update_every || count_ == min_samples)
+			{
+				since_update_ = 0;
+				std::array<std::uint32_t, window> sorted{};
+				std::copy_n(samples_.begin(), count_, sorted.begin());
+				std::sort(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(count_));
+				p50_ = std::chrono::milliseconds(sorted[count_ / 2]);
+				p95_ = std::chrono::milliseconds(sorted[std::min(count_ - 1, count_ * 95 / 100)]);
+			}
+		}
+
+		bool ready() const
+		{
+			return count_ >= min_samples;
+		}
+
+		// 超时取 p95 的数倍，上限为配置中的固定超时
+		std::chrono::milliseconds timeout(std::chrono::milliseconds configured) const
+		{
+			if (!ready())
+			{
+				return configured;
+			}
+			return std::clamp<std::chrono::milliseconds>(p95_ * 4, min_timeout, configured);
+		}
+
+		std::optional<std::chrono::milliseconds> hedge_delay() const
+		{
+			if (!ready())
+			{
+				return std::nullopt;
+			}
+			return std::max<std::chrono::milliseconds>(p95_, min_hedge_delay);
+		}
+
+		// 对冲请求最多占总请求数的十分之一，避免在接口整体变慢时把负载翻倍
+		bool try_acquire_hedge()
+		{
+			if ((hedges_ + 1) * 10 > requests_)
+			{
+				return false;
+			}
+			++hedges_;
+			return true;
+		}
+
+		void note_request()
+		{
+			++requests_;
+		}
+
+		void note_hedge_win()
+		{
+			++hedge_wins_;
+		}
+
+		void report_if_due()
+		{
+			const auto now = std::chrono::steady_clock::now();
+			if (now - last_report_ < report_interval || requests_ == 0)
+			{
+				return;
+			}
+			last_report_ = now;
+
+			log_info("接口延迟统计", {
+				{ "endpoint", name_ },
+				{ "requests", requests_ },
+				{ "p50_ms", static_cast<std::int64_t>(p50_.count()) },
+				{ "p95_ms", static_cast<std::int64_t>(p95_.count()) },
+				{ "hedges", hedges_ },
+				{ "hedge_wins", hedge_wins_ } });
+		}
+
+	private:
+		static constexpr std::size_t window = 256;
+		static constexpr std::size_t min_samples = 20;
+		static constexpr std::size_t update_every = 16;
+		static constexpr auto min_timeout = std::chrono::milliseconds(2000);
+		static constexpr auto min_hedge_delay = std::chrono::milliseconds(50);
+		static constexpr auto report_interval = std::chrono::minutes(10);
+
+		std::string name_;
+		std::array<std::uint32_t, window> samples_{};
+		std::size_t next_ = 0;
+		std::size_t count_ = 0;
+		std::size_t since_update_ = 0;
+		std::chrono::milliseconds p50_{ 0 };
+		std::chrono::milliseconds p95_{ 0 };
+		std::uint64_t requests_ = 0;
+		std::uint64_t hedges_ = 0;
+		std::uint64_t hedge_wins_ = 0;
+		std::chrono::steady_clock::time_point last_report_ = std::chrono::steady_clock::now();
+	};
+
+	// 非 200/304 的响应，保留状态码与响应头供限流判断
+	class HttpStatusError : public std::runtime_error
+	{
+	public:
+		HttpStatusError(long status_code, std::string headers)
+			: std::runtime_error("HTTP 响应状态码异常: " + std::to_string(status_code)), status_code_(status_code), headers_(std::move(headers))
+		{
+		}
+
+		long status_code() const
+		{
+			return status_code_;
+		}
+
+		const std::string& headers() const
+		{
+			return headers_;
+		}
+
+	private:
+		long status_code_ = 0;
+		std::string headers_;
+	};
+
+	class CurlHttpClient
+	{
+	public:
+		explicit CurlHttpClient(const Config& config, MemorySubsystem subsystem = MemorySubsystem::poll_responses)
+			: timeout_(std::chrono::seconds(config.request.timeout_seconds)),
+			adaptive_timeout_(config.request.adaptive_timeout),
+			hedge_requests_(config.request.hedge_requests),
+			body_limit_(static_cast<std::size_t>(config.footprint.max_response_kb) * 1024),
+			response_memory_(subsystem),
+			batch_memory_(subsystem)
+		{
+			curl_ = curl_easy_init();
+			if (!curl_)
+			{
+				throw std::runtime_error("无法初始化 libcurl");
+			}
+
+			// 配置基础选项，只需设置一次
+			curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, write_callback);
+			curl_easy_setopt(curl_, CURLOPT_HEADERFUNCTION, header_callback);
+			curl_easy_setopt(curl_, CURLOPT_ACCEPT_ENCODING, "");
+#ifdef CURLOPT_TCP_KEEPALIVE
+			curl_easy_setopt(curl_, CURLOPT_TCP_KEEPALIVE, 1L);
+#endif
+#ifdef CURLOPT_TCP_KEEPIDLE
+			curl_easy_setopt(curl_, CURLOPT_TCP_KEEPIDLE, 60L);
+#endif
+#ifdef CURLOPT_TCP_KEEPINTVL
+			curl_easy_setopt(curl_, CURLOPT_TCP_KEEPINTVL, 60L);
+#endif
+			curl_easy_setopt(curl_, CURLOPT_FORBID_REUSE, 0L);
+			curl_easy_setopt(curl_, CURLOPT_FRESH_CONNECT, 0L);
+
+			// 超时在会话生命周期内保持不变，不必每次请求重新设置
+			curl_easy_setopt(curl_, CURLOPT_TIMEOUT, config.request.timeout_seconds);
+			curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response_);
+			curl_easy_setopt(curl_, CURLOPT_HEADERDATA, &response_.headers);
+
+			std::string header_line;
+			for (const auto& header : config.request.headers)
+			{
+				header_line.clear();
+				header_line.append(header.name).append(": ").append(header.value);
+				headers_ = curl_slist_append(headers_, header_line.c_str());
+			}
+
+			if (headers_)
+			{
+				curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers_);
+			}
+		}
+
+		~CurlHttpClient()
+		{
+			for (auto* handle : batch_handles_)
+			{
+				curl_easy_cleanup(handle);
+			}
+			for (auto* handle : hedge_handles_)
+			{
+				curl_easy_cleanup(handle);
+			}
+
+			if (multi_)
+			{
+				curl_multi_cleanup(multi_);
+			}
+
+			if (headers_)
+			{
+				curl_slist_free_all(headers_);
+			}
+
+			if (curl_)
+			{
+				curl_easy_cleanup(curl_);
+			}
+		}
+
+		CurlHttpClient(const CurlHttpClient&) = delete;
+		CurlHttpClient& operator=(const CurlHttpClient&) = delete;
+
+		const curl_slist* base_headers() const
+		{
+			return headers_;
+		}
+
+		// 返回的响应引用在下一次 perform_request 之前有效，缓冲区在多次轮询间复用。
+		// request_headers 非空时替换默认请求头（用于携带条件请求头），304 视为成功返回。
+		const HttpResponse& perform_request(const std::string& url, const curl_slist* request_headers = nullptr)
+		{
+			TraceSpan span("perform_request");
+			return finish_request(curl_easy_perform(prepare_request(url, request_headers)));
+		}
+
+		// 异步执行时由调用方把返回的句柄交给 curl multi，传输结束后以其结果调用 finish_request
+		CURL* prepare_request(const std::string& url, const curl_slist* request_headers = nullptr)
+		{
+			if (!curl_)
+			{
+				throw std::runtime_error("libcurl 会话尚未初始化");
+			}
+
+			response_.status_code = 0;
+			response_.body.clear();
+			response_.headers.clear();
+			response_.body_limit = body_limit_;
+			curl_easy_setopt(curl_, CURLOPT_URL, url.c_str());
+			curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, request_headers ? request_headers : headers_);
+			return curl_;
+		}
+
+		const HttpResponse& finish_request(CURLcode res)
+		{
+			response_memory_.set(response_.body.capacity() + response_.headers.capacity());
+			if (res != CURLE_OK)
+			{
+				throw std::runtime_error(describe_curl_failure(res, response_));
+			}
+
+			long status_code = 0;
+			curl_easy_getinfo(curl_, CURLINFO_RESPONSE_CODE, &status_code);
+			if (status_code != 200 && status_code != 304)
+			{
+				throw HttpStatusError(status_code, response_.headers);
+			}
+
+			response_.status_code = status_code;
+			return response_;
+		}
+
+		struct BatchRequest
+		{
+			const std::string* url = nullptr;
+			const curl_slist* headers = nullptr;
+		};
+
+		struct BatchResult
+		{
+			HttpResponse response;
+			// 为空表示请求成功
+			std::string error;
+		};
+
+		// 通过 curl multi 并发执行一批请求，results 与 requests 一一对应，其缓冲区在多次批量间复用。
+		// 批次内的句柄共享 multi 的连接池，保持与单请求相同的长连接复用。
+		// 提供 latency 时按其统计调整超时；请求超过 p95 仍未返回时在新连接上补发一次，先成功者胜出，另一个被取消。
+		void perform_batch(const std::vector<BatchRequest>& requests, std::vector<BatchResult>& results, LatencyTracker* latency = nullptr)
+		{
+			TraceSpan span("perform_batch");
+			if (!curl_)
+			{
+				throw std::runtime_error("libcurl 会话尚未初始化");
+			}
+
+			if (!multi_)
+			{
+				multi_ = curl_multi_init();
+				if (!multi_)
+				{
+					throw std::runtime_error("无法初始化 libcurl multi 会话");
+				}
+			}
+
+			ensure_handles(batch_handles_, requests.size(), false);
+			results.resize(requests.size());
+			slots_.resize(requests.size());
+			hedge_responses_.resize(requests.size());
+
+			const auto timeout = latency && adaptive_timeout_ ? latency->timeout(timeout_) : timeout_;
+			const auto hedge_delay = latency && hedge_requests_ ? latency->hedge_delay() : std::nullopt;
+			const auto started = std::chrono::steady_clock::now();
+
+			for (std::size_t i = 0; i < requests.size(); ++i)
+			{
+				auto& result = results[i];
+				result.response.status_code = 0;
+				result.response.body.clear();
+				result.response.headers.clear();
+				result.error.clear();
+
+				auto& slot = slots_[i];
+				slot.primary = batch_handles_[i];
+				slot.hedge = nullptr;
+				slot.primary_running = true;
+				slot.hedge_running = false;
+				slot.timed_out = false;
+				slot.done = false;
+
+				prepare_handle(slot.primary, requests[i], result.response, slot, timeout);
+				curl_multi_add_handle(multi_, slot.primary);
+				if (latency)
+				{
+					latency->note_request();
+				}
+			}
+
+			std::size_t pending = requests.size();
+			std::size_t hedges_started = 0;
+			while (pending > 0)
+			{
+				int running = 0;
+				const auto code = curl_multi_perform(multi_, &running);
+				if (code != CURLM_OK)
+				{
+					detach_all(requests.size());
+					throw std::runtime_error(std::string("HTTP 批量请求失败: ") + curl_multi_strerror(code));
+				}
+
+				int remaining = 0;
+				while (CURLMsg* message = curl_multi_info_read(multi_, &remaining))
+				{
+					if (message->msg != CURLMSG_DONE)
+					{
+						continue;
+					}
+
+					char* slot_tag = nullptr;
+					curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &slot_tag);
+					auto& slot = *reinterpret_cast<BatchSlot*>(slot_tag);
+					const auto index = static_cast<std::size_t>(&slot - slots_.data());
+					auto& result = results[index];
+					const bool is_hedge = message->easy_handle == slot.hedge;
+					(is_hedge ? slot.hedge_running : slot.primary_running) = false;
+					if (slot.done)
+					{
+						continue;
+					}
+
+					auto& response = is_hedge ? hedge_responses_[index] : result.response;
+					std::string error;
+					long status_code = 0;
+					if (message->data.result != CURLE_OK)
+					{
+						error = describe_curl_failure(message->data.result, response);
+						slot.timed_out = slot.timed_out || message->data.result == CURLE_OPERATION_TIMEDOUT;
+					}
+					else
+					{
+						curl_easy_getinfo(message->easy_handle, CURLINFO_RESPONSE_CODE, &status_code);
+						response.status_code = status_code;
+						if (status_code != 200 && status_code != 304)
+						{
+							error = "HTTP 响应状态码异常: " + std::to_string(status_code);
+						}
+					}
+
+					const bool succeeded = error.empty();
+					if (succeeded)
+					{
+						// 主请求先失败、对冲请求随后成功时，之前记下的错误不再适用
+						result.error.clear();
+						if (is_hedge)
+						{
+							std::swap(result.response, response);
+							if (latency)
+							{
+								latency->note_hedge_win();
+							}
+						}
+					}
+					else if (!is_hedge || (!slot.primary_running && result.error.empty()))
+					{
+						// 主请求仍在进行时对冲请求的失败不影响结果
+						result.error = std::move(error);
+					}
+
+					// 一方成功或双方都失败时本请求结束，仍在进行的另一方被取消
+					if (succeeded || (!slot.primary_running && !slot.hedge_running))
+					{
+						slot.done = true;
+						--pending;
+						detach(slot);
+
+						// 延迟从原始请求发出时算起；超时也计入样本，否则窗口里只剩较快的成功请求，自适应超时会偏低
+						if (latency && (succeeded || slot.timed_out))
+						{
+							latency->record(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started));
+						}
+					}
+				}
+
+				if (pending == 0)
+				{
+					break;
+				}
+
+				auto wait = std::chrono::milliseconds(1000);
+				if (hedge_delay)
+				{
+					const auto now = std::chrono::steady_clock::now();
+					const auto hedge_at = started + *hedge_delay;
+					if (now >= hedge_at)
+					{
+						for (std::size_t i = 0; i < requests.size(); ++i)
+						{
+							auto& slot = slots_[i];
+							if (slot.done || slot.hedge || !slot.primary_running || !latency->try_acquire_hedge())
+							{
+								continue;
+							}
+
+							ensure_handles(hedge_handles_, hedges_started + 1, true);
+							auto& hedge_response = hedge_responses_[i];
+							hedge_response.status_code = 0;
+							hedge_response.body.clear();
+							hedge_response.headers.clear();
+
+							slot.hedge = hedge_handles_[hedges_started++];
+							slot.hedge_running = true;
+							prepare_handle(slot.hedge, requests[i], hedge_response, slot, timeout);
+							curl_multi_add_handle(multi_, slot.hedge);
+						}
+					}
+					else
+					{
+						wait = std::min(wait, std::chrono::duration_cast<std::chrono::milliseconds>(hedge_at - now) + std::chrono::milliseconds(1));
+					}
+				}
+
+				curl_multi_wait(multi_, nullptr, 0, static_cast<int>(wait.count()), nullptr);
+			}
+
+			std::size_t buffered = 0;
+			for (const auto& response : hedge_responses_)
+			{
+				buffered += response.body.capacity() + response.headers.capacity();
+			}
+			for (const auto& result : results)
+			{
+				buffered += result.response.body.capacity() + result.response.headers.capacity();
+			}
+			batch_memory_.set(buffered);
+		}
+
+	private:
+		CURL* curl_ = nullptr;
+		curl_slist* headers_ = nullptr;
+		HttpResponse response_;
+		struct BatchSlot
+		{
+			CURL* primary = nullptr;
+			CURL* hedge = nullptr;
+			bool primary_running = false;
+			bool hedge_running = false;
+			bool timed_out = false;
+			bool done = false;
+		};
+
+		void ensure_handles(std::vector<CURL*>& handles, std::size_t count, bool fresh_connect)
+		{
+			while (handles.size() < count)
+			{
+				CURL* handle = curl_easy_duphandle(curl_);
+				if (!handle)
+				{
+					throw std::runtime_error("无法初始化 libcurl");
+				}
+				// 对冲请求必须走新连接，避免排在同一条慢连接之后
+				curl_easy_setopt(handle, CURLOPT_FRESH_CONNECT, fresh_connect ? 1L : 0L);
+				handles.push_back(handle);
+			}
+		}
+
+		void prepare_handle(CURL* handle, const BatchRequest& request, HttpResponse& response, BatchSlot& slot, std::chrono::milliseconds timeout)
+		{
+			curl_easy_setopt(handle, CURLOPT_URL, request.url->c_str());
+			curl_easy_setopt(handle, CURLOPT_HTTPHEADER, request.headers ? request.headers : headers_);
+			response.body_limit = body_limit_;
+			curl_easy_setopt(handle, CURLOPT_WRITEDATA, &response);
+			curl_easy_setopt(handle, CURLOPT_HEADERDATA, &response.headers);
+			curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, static_cast<long>(timeout.count()));
+			// 完成时通过私有数据找到对应的槽位
+			curl_easy_setopt(handle, CURLOPT_PRIVATE, &slot);
+		}
+
+		void detach(BatchSlot& slot)
+		{
+			curl_multi_remove_handle(multi_, slot.primary);
+			if (slot.hedge)
+			{
+				curl_multi_remove_handle(multi_, slot.hedge);
+			}
+			slot.primary_running = false;
+			slot.hedge_running = false;
+		}
+
+		void detach_all(std::size_t count)
+		{
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				if (!slots_[i].done)
+				{
+					detach(slots_[i]);
+				}
+			}
+		}
+
+		std::chrono::milliseconds timeout_;
+		bool adaptive_timeout_ = true;
+		bool hedge_requests_ = true;
+		CURLM* multi_ = nullptr;
+		std::vector<CURL*> batch_handles_;
+		std::vector<CURL*> hedge_handles_;
+		std::vector<BatchSlot> slots_;
+		std::vector<HttpResponse> hedge_responses_;
+		std::size_t body_limit_ = 0;
+		// 单次请求与批量请求的缓冲区分别登记
+		MemoryCharge response_memory_;
+		MemoryCharge batch_memory_;
+	};
+
+	std::uint64_t fingerprint_bytes(std::string_view data)
+	{
+		// FNV-1a 64 位
+		std::uint64_t hash = 14695981039346656037ull;
+		for (const auto ch : data)
+		{
+			hash ^= static_cast<unsigned char>(ch);
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	// 从原始响应头中取出最后一个响应块里指定字段的值（字段名不区分大小写）
+	std::string find_response_header(std::string_view headers, std::string_view name)
+	{
+		std::string value;
+		std::size_t line_start = 0;
+		while (line_start < headers.size())
+		{
+			auto line_end = headers.find('\n', line_start);
+			if (line_end == std::string_view::npos)
+			{
+				line_end = headers.size();
+			}
+
+			const auto line = headers.substr(line_start, line_end - line_start);
+			line_start = line_end + 1;
+
+			if (line.rfind("HTTP/", 0) == 0)
+			{
+				value.clear();
+				continue;
+			}
+
+			const auto colon = line.find(':');
+			if (colon == std::string_view::npos || !equals_ignore_case(trim_copy(line.substr(0, colon)), name))
+			{
+				continue;
+			}
+
+			value = trim_copy(line.substr(colon + 1));
+		}
+
+		return value;
+	}
+
+	// 429、5xx 以及小红书风控常用的 461/471 视为服务端要求降速
+	bool is_throttle_status(long status_code)
+	{
+		return status_code == 429 || status_code == 461 || status_code == 471 || (status_code >= 500 && status_code <= 599);
+	}
+
+	// Retry-After 可以是秒数或 HTTP 日期
+	std::optional<std::chrono::seconds> parse_retry_after(const std::string& value)
+	{
+		if (value.empty())
+		{
+			return std::nullopt;
+		}
+		if (std::all_of(value.begin(), value.end(), [](char ch)
+			{
+				return std::isdigit(static_cast<unsigned char>(ch)) != 0;
+			}))
+		{
+			return std::chrono::seconds(std::stoll(value.substr(0, 9)));
+		}
+
+		const auto at = curl_getdate(value.c_str(), nullptr);
+		if (at < 0)
+		{
+			return std::nullopt;
+		}
+		const auto delta = std::chrono::system_clock::from_time_t(at) - std::chrono::system_clock::now();
+		return std::max(std::chrono::seconds(0), std::chrono::duration_cast<std::chrono::seconds>(delta));
+	}
+
+	// 接口请求预算：全局与各端点各一个令牌桶，请求须同时从两者取得令牌。
+	// 端点返回限流信号后暂停该端点：优先遵循 Retry-After，否则按 decorrelated jitter 退避，成功一次即复位。
+	// 只在主线程上使用
+	class RequestBudget
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		explicit RequestBudget(const RateLimitConfig& config)
+			: config_(config), rng_(std::random_device{}())
+		{
+			const auto now = clock::now();
+			if (config.global_per_minute > 0)
+			{
+				global_.emplace(config.global_per_minute, config.global_burst, now);
+			}
+			for (const auto& endpoint : config.endpoints)
+			{
+				if (endpoint.per_minute > 0)
+				{
+					endpoints_[endpoint.name].bucket.emplace(endpoint.per_minute, endpoint.burst, now);
+				}
+			}
+		}
+
+		// 令牌不足或端点处于退避中时返回 false，且不消耗任何令牌。
+		// background 请求（如拉取直播历史）只在全局桶剩余过半时放行，把预算留给状态轮询。
+		// 预留量不超过 capacity - 1，桶装满时后台请求总能放行，global_burst 为 1 时不再永远拿不到令牌
+		bool try_acquire(std::string_view endpoint, bool background = false, clock::time_point now = clock::now())
+		{
+			auto& state = endpoint_state(endpoint);
+			const double global_reserve = background && global_ ? std::min(global_->capacity / 2.0, global_->capacity - 1.0) : 0.0;
+			if (now < state.blocked_until
+				|| (state.bucket && !state.bucket->available(now, 0.0))
+				|| (global_ && !global_->available(now, global_reserve)))
+			{
+				++state.denied;
+				return false;
+			}
+
+			if (state.bucket)
+			{
+				state.bucket->take();
+			}
+			if (global_)
+			{
+				global_->take();
+			}
+			++state.granted;
+			return true;
+		}
+
+		// 下一次可能取得令牌的时间，用于决定主循环的等待时长
+		clock::time_point next_available(std::string_view endpoint, clock::time_point now = clock::now())
+		{
+			auto& state = endpoint_state(endpoint);
+			auto at = std::max(now, state.blocked_until);
+			if (state.bucket)
+			{
+				at = std::max(at, state.bucket->ready_at(now));
+			}
+			if (global_)
+			{
+				at = std::max(at, global_->ready_at(now));
+			}
+			return at;
+		}
+
+		// status 为 0 表示传输层失败，不影响退避状态。now 参数只供测试推进时间
+		void record(std::string_view endpoint, long status_code, std::string_view headers, clock::time_point now = clock::now())
+		{
+			auto& state = endpoint_state(endpoint);
+			if (status_code == 200 || status_code == 304)
+			{
+				state.backoff = std::chrono::milliseconds(0);
+				return;
+			}
+			if (!is_throttle_status(status_code))
+			{
+				return;
+			}
+
+			++state.throttled;
+			std::optional<std::chrono::seconds> retry_after;
+			try
+			{
+				retry_after = parse_retry_after(find_response_header(headers, "retry-after"));
+			}
+			catch (const std::exception&)
+			{
+			}
+
+			// 同一批次中的多个限流响应只让退避增长一次，Retry-After 仍可延长暂停
+			if (now >= state.blocked_until)
+			{
+				const auto base = std::chrono::milliseconds(std::chrono::seconds(config_.backoff_base_seconds));
+				const auto cap = std::chrono::milliseconds(std::chrono::seconds(config_.backoff_max_seconds));
+				const auto upper = std::max(base, state.backoff * 3);
+				std::uniform_int_distribution<std::int64_t> sleep(base.count(), upper.count());
+				state.backoff = std::min(cap, std::chrono::milliseconds(sleep(rng_)));
+				state.blocked_until = now + state.backoff;
+			}
+			if (retry_after)
+			{
+				state.blocked_until = std::max(state.blocked_until, now + *retry_after);
+			}
+
+			log_warn("接口要求降速，暂停请求", {
+				{ "endpoint", endpoint },
+				{ "status", status_code },
+				{ "retry_after", retry_after ? retry_after->count() : -1 },
+				{ "pause_ms", std::chrono::duration_cast<std::chrono::milliseconds>(state.blocked_until - now).count() } });
+		}
+
+		void report_if_due()
+		{
+			const auto now = clock::now();
+			if (now - last_report_ < report_interval)
+			{
+				return;
+			}
+			last_report_ = now;
+
+			for (auto& [name, state] : endpoints_)
+			{
+				if (state.granted == 0 && state.denied == 0 && state.throttled == 0)
+				{
+					continue;
+				}
+				log_info("请求预算统计", {
+					{ "endpoint", name },
+					{ "granted", state.granted },
+					{ "denied", state.denied },
+					{ "throttled", state.throttled },
+					{ "backoff_ms", state.backoff.count() } });
+				state.granted = 0;
+				state.denied = 0;
+				state.throttled = 0;
+			}
+		}
+
+	private:
+		class TokenBucket
+		{
+		public:
+			TokenBucket(int per_minute, int burst, clock::time_point now)
+				: capacity(burst), rate_per_second_(per_minute / 60.0), tokens_(burst), updated_(now)
+			{
+			}
+
+			// 除 reserve 之外至少还有一个令牌
+			bool available(clock::time_point now, double reserve)
+			{
+				refill(now);
+				return tokens_ >= 1.0 + reserve;
+			}
+
+			void take()
+			{
+				tokens_ -= 1.0;
+			}
+
+			clock::time_point ready_at(clock::time_point now)
+			{
+				refill(now);
+				if (tokens_ >= 1.0)
+				{
+					return now;
+				}
+				return now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>((1.0 - tokens_) / rate_per_second_));
+			}
+
+			const double capacity;
+
+		private:
+			void refill(clock::time_point now)
+			{
+				const auto elapsed = std::chrono::duration<double>(now - updated_).count();
+				tokens_ = std::min(capacity, tokens_ + elapsed * rate_per_second_);
+				updated_ = now;
+			}
+
+			double rate_per_second_;
+			double tokens_;
+			clock::time_point updated_;
+		};
+
+		struct EndpointState
+		{
+			std::optional<TokenBucket> bucket;
+			clock::time_point blocked_until;
+			std::chrono::milliseconds backoff{ 0 };
+			std::uint64_t granted = 0;
+			std::uint64_t denied = 0;
+			std::uint64_t throttled = 0;
+		};
+
+		static constexpr auto report_interval = std::chrono::minutes(10);
+
+		EndpointState& endpoint_state(std::string_view endpoint)
+		{
+			if (const auto it = endpoints_.find(endpoint); it != endpoints_.end())
+			{
+				return it->second;
+			}
+			return endpoints_.emplace(std::string(endpoint), EndpointState{}).first->second;
+		}
+
+		const RateLimitConfig& config_;
+		std::optional<TokenBucket> global_;
+		std::map<std::string, EndpointState, std::less<>> endpoints_;
+		std::mt19937 rng_;
+		clock::time_point last_report_ = clock::now();
+	};
+
+	// 运行状态快照。时间点一律记为系统时钟的毫秒数，steady_clock 在重启后不可比较
+	struct HostStateSnapshot
+	{
+		std::string host_id;
+		// 以下为轮询缓存：上次解析出的直播状态与条件请求校验值
+		bool has_result = false;
+		std::optional<std::string> room_id;
+		std::uint64_t fingerprint = 0;
+		std::size_t body_size = 0;
+		std::string etag;
+		std::string last_modified;
+		std::int64_t next_poll_ms = 0;
+		// 包括从直播历史中学到的开播时间
+		std::vector<std::string> start_times;
+	};
+
+	struct RecordingStateSnapshot
+	{
+		std::string host_id;
+		std::string room_id;
+		bool orig = false;
+		fs::path path;
+		std::uint64_t bytes = 0;
+	};
+
+	struct RuntimeSnapshot
+	{
+		std::int64_t written_at_ms = 0;
+		std::int64_t history_refreshed_at_ms = 0;
+		std::vector<HostStateSnapshot> hosts;
+		std::vector<RecordingStateSnapshot> recordings;
+	};
+
+	std::int64_t epoch_ms(std::chrono::system_clock::time_point time_point)
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(time_point.time_since_epoch()).count();
+	}
+
+	std::chrono::system_clock::time_point from_epoch_ms(std::int64_t ms)
+	{
+		return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(ms)));
+	}
+
+	// 快照写成单行 JSON；先写临时文件并落盘再改名替换，任何时刻中断都保留一份完整的快照
+	void write_runtime_snapshot(const fs::path& path, const RuntimeSnapshot& snapshot)
+	{
+		json hosts = json::array();
+		for (const auto& host : snapshot.hosts)
+		{
+			json host_json = {
+				{ "host_id", host.host_id },
+				{ "next_poll_ms", host.next_poll_ms },
+				{ "start_times", host.start_times },
+			};
+			if (host.has_result)
+			{
+				host_json["room_id"] = host.room_id ? json(*host.room_id) : json(nullptr);
+				host_json["fingerprint"] = host.fingerprint;
+				host_json["body_size"] = host.body_size;
+				host_json["etag"] = host.etag;
+				host_json["last_modified"] = host.last_modified;
+			}
+			hosts.push_back(std::move(host_json));
+		}
+
+		json recordings = json::array();
+		for (const auto& recording : snapshot.recordings)
+		{
+			recordings.push_back({
+				{ "host_id", recording.host_id },
+				{ "room_id", recording.room_id },
+				{ "orig", recording.orig },
+				{ "path", recording.path.string() },
+				{ "bytes", recording.bytes },
+			});
+		}
+
+		const json snapshot_json = {
+			{ "version", 1 },
+			{ "written_at_ms", snapshot.written_at_ms },
+			{ "history_refreshed_at_ms", snapshot.history_refreshed_at_ms },
+			{ "hosts", std::move(hosts) },
+			{ "recordings", std::move(recordings) },
+		};
+		const auto text = snapshot_json.dump(-1, ' ', false, json::error_handler_t::replace);
+
+		if (path.has_parent_path())
+		{
+			fs::create_directories(path.parent_path());
+		}
+		fs::path temporary = path;
+		temporary += ".part";
+#ifdef _WIN32
+		const HANDLE file = CreateFileW(temporary.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			throw std::runtime_error("无法创建状态快照: " + temporary.string());
+		}
+		DWORD written = 0;
+		const bool ok = WriteFile(file, text.data(), static_cast<DWORD>(text.size()), &written, nullptr) && written == text.size() && FlushFileBuffers(file);
+		CloseHandle(file);
+#else
+		const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0)
+		{
+			throw std::runtime_error("无法创建状态快照: " + temporary.string() + ": " + std::strerror(errno));
+		}
+		std::size_t offset = 0;
+		while (offset < text.size())
+		{
+			const auto written = ::write(fd, text.data() + offset, text.size() - offset);
+			if (written < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (written <= 0)
+			{
+				break;
+			}
+			offset += static_cast<std::size_t>(written);
+		}
+		const bool ok = offset == text.size() && ::fsync(fd) == 0;
+		::close(fd);
+#endif
+		if (!ok)
+		{
+			std::error_code ec;
+			fs::remove(temporary, ec);
+			throw std::runtime_error("写入状态快照失败: " + temporary.string());
+		}
+		fs::rename(temporary, path);
+	}
+
+	std::optional<RuntimeSnapshot> read_runtime_snapshot(const fs::path& path)
+	{
+		std::ifstream input(path, std::ios::binary);
+		if (!input)
+		{
+			return std::nullopt;
+		}
+
+		try
+		{
+			const auto snapshot_json = json::parse(input);
+			if (snapshot_json.value("version", 0) != 1)
+			{
+				log_warn("状态快照版本不受支持，忽略", { { "path", path } });
+				return std::nullopt;
+			}
+
+			RuntimeSnapshot snapshot;
+			snapshot.written_at_ms = snapshot_json.value("written_at_ms", std::int64_t{ 0 });
+			snapshot.history_refreshed_at_ms = snapshot_json.value("history_refreshed_at_ms", std::int64_t{ 0 });
+			for (const auto& host_json : snapshot_json.at("hosts"))
+			{
+				HostStateSnapshot host;
+				host.host_id = host_json.at("host_id").get<std::string>();
+				host.next_poll_ms = host_json.value("next_poll_ms", std::int64_t{ 0 });
+				host.start_times = host_json.value("start_times", std::vector<std::string>{});
+				if (const auto it = host_json.find("room_id"); it != host_json.end())
+				{
+					host.has_result = true;
+					if (it->is_string())
+					{
+						host.room_id = it->get<std::string>();
+					}
+					host.fingerprint = host_json.value("fingerprint", std::uint64_t{ 0 });
+					host.body_size = host_json.value("body_size", std::size_t{ 0 });
+					host.etag = host_json.value("etag", "");
+					host.last_modified = host_json.value("last_modified", "");
+				}
+				snapshot.hosts.push_back(std::move(host));
+			}
+			for (const auto& recording_json : snapshot_json.at("recordings"))
+			{
+				RecordingStateSnapshot recording;
+				recording.host_id = recording_json.at("host_id").get<std::string>();
+				recording.room_id = recording_json.at("room_id").get<std::string>();
+				recording.orig = recording_json.value("orig", false);
+				recording.path = fs::path{ recording_json.at("path").get<std::string>() };
+				recording.bytes = recording_json.value("bytes", std::uint64_t{ 0 });
+				snapshot.recordings.push_back(std::move(recording));
+			}
+			return snapshot;
+		}
+		catch (const std::exception& ex)
+		{
+			log_warn("状态快照无法解析，忽略", { { "path", path }, { "error", ex.what() } });
+			return std::nullopt;
+		}
+	}
+
+	// 按主播缓存上一次轮询结果：响应未变化（304 或正文指纹相同）时跳过 JSON 解析和日志
+	class PollResultCache
+	{
+	public:
+		struct Lookup
+		{
+			bool unchanged = false;
+			std::optional<std::string> room_id;
+			// 响应正文的指纹，解析成功后随 store 一并记录
+			std::uint64_t fingerprint = 0;
+		};
+
+		PollResultCache(const Config& config, const curl_slist* base_headers)
+			: config_(config), base_headers_(base_headers), states_(config.hosts.size())
+		{
+		}
+
+		// 需要携带条件请求头时返回专用的请求头列表，否则返回 nullptr 使用默认请求头
+		const curl_slist* request_headers(std::size_t host_index) const
+		{
+			return states_[host_index].conditional_headers.get();
+		}
+
+		Lookup lookup(std::size_t host_index, const HttpResponse& response)
+		{
+			auto& state = states_[host_index];
+			++total_polls_;
+
+			if (response.status_code == 304)
+			{
+				if (state.has_result)
+				{
+					++not_modified_hits_;
+					return Lookup{ true, state.room_id };
+				}
+
+				// 没有可复用的结果时放弃条件请求，下一次重新获取完整响应
+				state.etag.clear();
+				state.last_modified.clear();
+				state.conditional_headers.reset();
+				return Lookup{};
+			}
+
+			update_validators(state, response.headers);
+
+			const auto fingerprint = fingerprint_bytes(response.body);
+			if (state.has_result && state.body_size == response.body.size() && state.fingerprint == fingerprint)
+			{
+				++fingerprint_hits_;
+				return Lookup{ true, state.room_id };
+			}
+
+			return Lookup{ false, std::nullopt, fingerprint };
+		}
+
+		// 仅在正文解析成功后调用：解析失败的响应不能成为后续比较的基准
+		void store(std::size_t host_index, const HttpResponse& response, const Lookup& lookup, const std::optional<std::string>& room_id)
+		{
+			auto& state = states_[host_index];
+			state.fingerprint = lookup.fingerprint;
+			state.body_size = response.body.size();
+			state.room_id = room_id;
+			state.has_result = true;
+			++parsed_;
+		}
+
+		void snapshot(std::size_t host_index, HostStateSnapshot& snapshot) const
+		{
+			const auto& state = states_[host_index];
+			snapshot.has_result = state.has_result;
+			snapshot.room_id = state.room_id;
+			snapshot.fingerprint = state.fingerprint;
+			snapshot.body_size = state.body_size;
+			snapshot.etag = state.etag;
+			snapshot.last_modified = state.last_modified;
+		}
+
+		// 恢复上次的结果与校验值，重启后的第一次轮询即可命中 304 或响应指纹
+		void restore(std::size_t host_index, const HostStateSnapshot& snapshot)
+		{
+			auto& state = states_[host_index];
+			state.has_result = snapshot.has_result;
+			state.room_id = snapshot.room_id;
+			state.fingerprint = snapshot.fingerprint;
+			state.body_size = snapshot.body_size;
+			set_validators(state, snapshot.etag, snapshot.last_modified);
+		}
+
+		// 调试输出仅在响应变化时触发，并按主播限制输出频率
+		void debug_dump(std::size_t host_index, const HttpResponse& response)
+		{
+			if (!config_.http_debug_enabled)
+			{
+				return;
+			}
+
+			auto& state = states_[host_index];
+			const auto now = std::chrono::steady_clock::now();
+			const auto interval = std::chrono::seconds(config_.http_debug_min_interval_seconds);
+			if (state.last_debug_dump != std::chrono::steady_clock::time_point{} && now - state.last_debug_dump < interval)
+			{
+				++state.suppressed_debug_dumps;
+				return;
+			}
+
+			log_info("主播响应发生变化", {
+				{ "host", config_.hosts[host_index].host_id },
+				{ "suppressed", state.suppressed_debug_dumps },
+				{ "status", response.status_code },
+				{ "headers", response.headers },
+				{ "body", response.body } });
+			state.last_debug_dump = now;
+			state.suppressed_debug_dumps = 0;
+		}
+
+		void report_if_due()
+		{
+			const auto now = std::chrono::steady_clock::now();
+			if (now - last_report_ < report_interval || total_polls_ == 0)
+			{
+				return;
+			}
+			last_report_ = now;
+
+			const auto hits = not_modified_hits_ + fingerprint_hits_;
+			log_info("轮询缓存统计", {
+				{ "polls", total_polls_ },
+				{ "hits", hits },
+				{ "not_modified", not_modified_hits_ },
+				{ "fingerprint_hits", fingerprint_hits_ },
+				{ "parsed", parsed_ },
+				{ "hit_rate_pct", static_cast<double>(hits) * 100.0 / static_cast<double>(total_polls_) } });
+		}
+
+	private:
+		struct HostPollState
+		{
+			bool has_result = false;
+			std::optional<std::string> room_id;
+			std::uint64_t fingerprint = 0;
+			std::size_t body_size = 0;
+			std::string etag;
+			std::string last_modified;
+			CurlSlistHandle conditional_headers;
+			std::chrono::steady_clock::time_point last_debug_dump;
+			std::uint64_t suppressed_debug_dumps = 0;
+		};
+
+		static constexpr auto report_interval = std::chrono::minutes(10);
+
+		void update_validators(HostPollState& state, std::string_view headers)
+		{
+			set_validators(state, find_response_header(headers, "etag"), find_response_header(headers, "last-modified"));
+		}
+
+		void set_validators(HostPollState& state, std::string etag, std::string last_modified)
+		{
+			if (etag == state.etag && last_modified == state.last_modified)
+			{
+				return;
+			}
+
+			state.etag = std::move(etag);
+			state.last_modified = std::move(last_modified);
+			state.conditional_headers.reset();
+			if (state.etag.empty() && state.last_modified.empty())
+			{
+				return;
+			}
+
+			// 复制默认请求头并追加条件请求头，只在校验值变化时重建
+			curl_slist* list = nullptr;
+			for (auto* item = base_headers_; item; item = item->next)
+			{
+				list = curl_slist_append(list, item->data);
+			}
+			if (!state.etag.empty())
+			{
+				list = curl_slist_append(list, ("If-None-Match: " + state.etag).c_str());
+			}
+			if (!state.last_modified.empty())
+			{
+				list = curl_slist_append(list, ("If-Modified-Since: " + state.last_modified).c_str());
+			}
+			state.conditional_headers.reset(list);
+		}
+
+		const Config& config_;
+		const curl_slist* base_headers_ = nullptr;
+		std::vector<HostPollState> states_;
+		std::uint64_t total_polls_ = 0;
+		std::uint64_t not_modified_hits_ = 0;
+		std::uint64_t fingerprint_hits_ = 0;
+		std::uint64_t parsed_ = 0;
+		std::chrono::steady_clock::time_point last_report_ = std::chrono::steady_clock::now();
+	};
+
+	// 分层时间轮：每层 64 个槽位，登记、取消与到期均为 O(1)，高层槽位在低层转满一圈时向下级联
+	class TimerWheel
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+
+		TimerWheel(std::size_t capacity, clock::duration tick, clock::time_point start)
+			: tick_(tick), start_(start), nodes_(capacity)
+		{
+			slots_.fill(npos);
+		}
+
+		void schedule(std::size_t id, clock::time_point when)
+		{
+			cancel(id);
+
+			const auto elapsed = std::max<clock::duration>(when - start_, clock::duration::zero());
+			auto deadline = static_cast<std::uint64_t>((elapsed + tick_ - clock::duration(1)) / tick_);
+			// 已经过期的任务安排到下一个刻度，保证本刻度内不会重复触发
+			deadline = std::max(deadline, current_tick_ + 1);
+			deadline = std::min(deadline, current_tick_ + max_span - 1);
+			nodes_[id].deadline = deadline;
+			insert(static_cast<std::uint32_t>(id));
+		}
+
+		void cancel(std::size_t id)
+		{
+			auto& node = nodes_[id];
+			if (node.slot == npos)
+			{
+				return;
+			}
+
+			if (node.prev != npos)
+			{
+				nodes_[node.prev].next = node.next;
+			}
+			else
+			{
+				slots_[node.slot] = node.next;
+			}
+			if (node.next != npos)
+			{
+				nodes_[node.next].prev = node.prev;
+			}
+			node.prev = npos;
+			node.next = npos;
+			node.slot = npos;
+		}
+
+		// 推进到 now，并把到期的任务追加到 expired
+		void advance(clock::time_point now, std::vector<std::size_t>& expired)
+		{
+			if (now < start_)
+			{
+				return;
+			}
+
+			const auto target = static_cast<std::uint64_t>((now - start_) / tick_);
+			while (current_tick_ < target)
+			{
+				++current_tick_;
+
+				int top_level = 0;
+				while (top_level + 1 < levels && (current_tick_ & ((std::uint64_t{ 1 } << (slot_bits * (top_level + 1))) - 1)) == 0)
+				{
+					++top_level;
+				}
+				for (int level = top_level; level > 0; --level)
+				{
+					cascade(level, static_cast<std::uint32_t>((current_tick_ >> (slot_bits * level)) & slot_mask));
+				}
+
+				auto& head = slots_[current_tick_ & slot_mask];
+				for (auto id = head; id != npos;)
+				{
+					auto& node = nodes_[id];
+					const auto next = node.next;
+					node.prev = npos;
+					node.next = npos;
+					node.slot = npos;
+					expired.push_back(id);
+					id = next;
+				}
+				head = npos;
+			}
+		}
+
+		// 下一次可能有任务到期的时间点；最底层为空时返回下一次级联的时间
+		clock::time_point next_expiry() const
+		{
+			const auto boundary = (current_tick_ | slot_mask) + 1;
+			for (auto tick = current_tick_ + 1; tick < boundary; ++tick)
+			{
+				if (slots_[tick & slot_mask] != npos)
+				{
+					return start_ + tick_ * tick;
+				}
+			}
+			return start_ + tick_ * boundary;
+		}
+
+	private:
+		static constexpr std::uint32_t npos = std::numeric_limits<std::uint32_t>::max();
+		static constexpr int slot_bits = 6;
+		static constexpr std::uint64_t slot_mask = (1u << slot_bits) - 1;
+		static constexpr int levels = 4;
+		static constexpr std::uint64_t max_span = std::uint64_t{ 1 } << (slot_bits * levels);
+
+		struct Node
+		{
+			std::uint64_t deadline = 0;
+			std::uint32_t prev = npos;
+			std::uint32_t next = npos;
+			std::uint32_t slot = npos;
+		};
+
+		void insert(std::uint32_t id)
+		{
+			auto& node = nodes_[id];
+			const auto delta = node.deadline > current_tick_ ? node.deadline - current_tick_ : 0;
+
+			int level = 0;
+			while (level + 1 < levels && delta >= (std::uint64_t{ 1 } << (slot_bits * (level + 1))))
+			{
+				++level;
+			}
+
+			const auto slot = static_cast<std::uint32_t>(level * (slot_mask + 1) + ((node.deadline >> (slot_bits * level)) & slot_mask));
+			node.slot = slot;
+			node.prev = npos;
+			node.next = slots_[slot];
+			if (node.next != npos)
+			{
+				nodes_[node.next].prev = id;
+			}
+			slots_[slot] = id;
+		}
+
+		void cascade(int level, std::uint32_t index)
+		{
+			auto& head = slots_[level * (slot_mask + 1) + index];
+			auto id = head;
+			head = npos;
+			while (id != npos)
+			{
+				const auto next = nodes_[id].next;
+				insert(id);
+				id = next;
+			}
+		}
+
+		clock::duration tick_;
+		clock::time_point start_;
+		std::uint64_t current_tick_ = 0;
+		std::vector<Node> nodes_;
+		std::array<std::uint32_t, levels * (slot_mask + 1)> slots_{};
+	};
+
+	// 每个主播独立的轮询节奏：在全局 likely_broadcast_times 之外，加入从直播历史中推断出的开播时间
+	class ScheduleModel
+	{
+	public:
+		explicit ScheduleModel(const Config& config)
+			: host_polling_(config.hosts.size(), config.polling), rng_(std::random_device{}())
+		{
+		}
+
+		const PollingConfig& polling(std::size_t host_index) const
+		{
+			return host_polling_[host_index];
+		}
+
+		int wait_seconds(std::size_t host_index) const
+		{
+			return determine_wait_seconds(host_polling_[host_index]);
+		}
+
+		// 在当前间隔基础上叠加随机抖动
+		std::chrono::milliseconds next_poll_delay(std::size_t host_index)
+		{
+			const double jitter = host_polling_[host_index].jitter_percent / 100.0;
+			std::uniform_real_distribution<double> factor(1.0 - jitter, 1.0 + jitter);
+			return std::chrono::milliseconds(static_cast<std::int64_t>(wait_seconds(host_index) * 1000.0 * factor(rng_)));
+		}
+
+		// 启动时把首次轮询分散在抖动窗口内，而不是全部集中在同一时刻
+		std::chrono::milliseconds initial_poll_delay(std::size_t host_index)
+		{
+			const double window = wait_seconds(host_index) * 1000.0 * host_polling_[host_index].jitter_percent / 100.0;
+			std::uniform_real_distribution<double> offset(0.0, window);
+			return std::chrono::milliseconds(static_cast<std::int64_t>(offset(rng_)));
+		}
+
+		// 将历史开播时刻聚类为若干个典型开播时间，替换该主播之前学到的结果
+		std::size_t learn(std::size_t host_index, const std::vector<BroadcastRecord>& records, const PollingConfig& base)
+		{
+			constexpr int cluster_span_minutes = 30;
+
+			std::vector<int> minutes;
+			minutes.reserve(records.size());
+			for (const auto& record : records)
+			{
+				const std::tm tm = local_tm_from(record.started_at);
+				minutes.push_back(tm.tm_hour * 60 + tm.tm_min);
+			}
+			std::sort(minutes.begin(), minutes.end());
+
+			auto& polling = host_polling_[host_index];
+			polling = base;
+
+			std::size_t cluster_start = 0;
+			std::size_t learned = 0;
+			for (std::size_t i = 1; i <= minutes.size(); ++i)
+			{
+				if (i < minutes.size() && minutes[i] - minutes[cluster_start] <= cluster_span_minutes)
+				{
+					continue;
+				}
+
+				// 取聚类的中位数作为该时段的典型开播时间
+				const int representative = minutes[cluster_start + (i - cluster_start) / 2];
+				// 按跨午夜的环形距离比较，23:50 与 00:10 视为同一时段
+				const auto nearest = minutes_to_nearest_start(polling, representative);
+				const bool covered = nearest && *nearest <= cluster_span_minutes;
+				if (!covered)
+				{
+					std::ostringstream label;
+					label << std::setw(2) << std::setfill('0') << representative / 60 << ':' << std::setw(2) << std::setfill('0') << representative % 60;
+					polling.possible_start_times.push_back(PossibleStartTime{ label.str(), representative });
+					++learned;
+				}
+				cluster_start = i;
+			}
+
+			return learned;
+		}
+
+		// 恢复快照中的开播时间（含学到的部分），重启后无需立即重新拉取直播历史
+		void restore(std::size_t host_index, const std::vector<std::string>& start_times, const PollingConfig& base)
+		{
+			auto& polling = host_polling_[host_index];
+			polling = base;
+			for (const auto& label : start_times)
+			{
+				const int minutes = parse_time_string_to_minutes(label);
+				const bool covered = std::any_of(polling.possible_start_times.begin(), polling.possible_start_times.end(), [&](const PossibleStartTime& existing)
+					{
+						return existing.minutes_since_midnight == minutes;
+					});
+				if (!covered)
+				{
+					polling.possible_start_times.push_back(PossibleStartTime{ label, minutes });
+				}
+			}
+		}
+
+	private:
+		std::vector<PollingConfig> host_polling_;
+		std::mt19937 rng_;
+	};
+
+	// 按页拉取每个主播的直播历史并据此更新轮询节奏。
+	// 历史请求从预算中按后台优先级取令牌，取不到时停在 next_host 并返回 false，下次从该主播继续
+	bool seed_schedule_from_history(const Config& config, const PollEndpointSet& endpoints, CurlHttpClient& http_client, ScheduleModel& schedule,
+		RequestBudget& budget, std::size_t& next_host)
+	{
+		const PollEndpoint* history = endpoints.history_endpoint();
+		if (!history || config.request.history_pages <= 0)
+		{
+			return true;
+		}
+
+		for (; next_host < config.hosts.size(); ++next_host)
+		{
+			const auto host_index = next_host;
+			const auto& host = config.hosts[host_index];
+			std::vector<BroadcastRecord> records;
+			int requests = 0;
+			try
+			{
+				for (int page = 1; page <= config.request.history_pages; ++page)
+				{
+					// 已拿到部分页时先用这些记录学习，不为单个主播占住预算
+					if (!budget.try_acquire(history->name(), true))
+					{
+						if (requests == 0)
+						{
+							return false;
+						}
+						break;
+					}
+
+					const auto url = history->build_history_url(host.host_id, page, config.request.history_page_size);
+					const HttpResponse* response = nullptr;
+					try
+					{
+						response = &http_client.perform_request(url);
+					}
+					catch (const HttpStatusError& ex)
+					{
+						budget.record(history->name(), ex.status_code(), ex.headers());
+						throw;
+					}
+					budget.record(history->name(), response->status_code, response->headers);
+					++requests;
+
+					const auto page_result = history->parse_history(json::parse(response->body));
+					records.insert(records.end(), page_result.records.begin(), page_result.records.end());
+					if (page_result.records.empty() || static_cast<int>(records.size()) >= page_result.total_count)
+					{
+						break;
+					}
+				}
+			}
+			catch (const std::exception& ex)
+			{
+				// 保留该主播之前学到的开播时间，不用不完整的历史覆盖
+				log_warn("拉取直播历史失败", { { "host", host.host_id }, { "endpoint", history->name() }, { "error", ex.what() } });
+				continue;
+			}
+
+			const auto learned = schedule.learn(host_index, records, config.polling);
+			std::string start_times;
+			for (const auto& start_time : schedule.polling(host_index).possible_start_times)
+			{
+				if (!start_times.empty())
+				{
+					start_times.push_back(',');
+				}
+				start_times.append(start_time.original);
+			}
+			log_info("根据直播历史更新开播时间", {
+				{ "host", host.host_id },
+				{ "records", records.size() },
+				{ "requests", requests },
+				{ "learned", learned },
+				{ "start_times", start_times } });
+		}
+		return true;
+	}
+
+	std::string today_folder_name()
+	{
+		const std::tm tm = current_local_tm();
+		std::ostringstream oss;
+		oss << std::put_time(&tm, "%Y%m%d");
+		return oss.str();
+	}
+
+	// is_reserved 接收相对于 root 的路径，用于排除其他存储目录中已存在或正在写入的同名录制
+	fs::path prepare_download_path(const fs::path& root, const DownloadConfig& download_config, std::string_view room_id,
+		const std::function<bool(const fs::path&)>& is_reserved = {})
+	{
+		TraceSpan span("prepare_download_path", room_id);
+		const fs::path date_folder = today_folder_name();
+		fs::path download_dir = root / date_folder;
+		{
+			TraceSpan mkdir_span("create_directories");
+			fs::create_directories(download_dir);
+		}
+
+		std::string filename = std::string(room_id) + download_config.filename_suffix + ".flv";
+		fs::path candidate = download_dir / filename;
+
+		int counter = 1;
+		while (fs::exists(candidate) || (is_reserved && is_reserved(date_folder / candidate.filename())))
+		{
+			std::ostringstream oss;
+			oss << room_id << download_config.filename_suffix << '_' << counter << ".flv";
+			candidate = download_dir / oss.str();
+			++counter;
+		}
+
+		return candidate;
+	}
+
+	std::string quote_argument(const std::string& arg)
+	{
+		std::ostringstream oss;
+		oss << '"';
+		for (const auto ch : arg)
+		{
+			if (ch == '"')
+			{
+				oss << '\\';
+			}
+			oss << ch;
+		}
+		oss << '"';
+		return oss.str();
+	}
+
+	std::string build_rtmp_url(const Config& config, const std::string& room_id)
+	{
+		std::ostringstream oss;
+		oss << config.download.base_stream_url;
+		if (!config.download.base_stream_url.empty() && config.download.base_stream_url.back() != '/')
+		{
+			oss << '/';
+		}
+		oss << room_id;
+		return oss.str();
+	}
+
+#ifdef _WIN32
+	std::wstring widen_utf8(std::string_view input)
+	{
+		if (input.empty())
+		{
+			return {};
+		}
+
+		const int required = MultiByteToWideChar(CP_UTF8, 0, input.data(), static_cast<int>(input.size()), nullptr, 0);
+		if (required <= 0)
+		{
+			throw std::runtime_error("无法将字符串从 UTF-8 转换为 UTF-16");
+		}
+
+		std::wstring buffer(static_cast<std::size_t>(required), L'\0');
+		const int converted = MultiByteToWideChar(CP_UTF8, 0, input.data(), static_cast<int>(input.size()), buffer.data(), required);
+		if (converted != required)
+		{
+			throw std::runtime_error("转换为 UTF-16 时发生未知错误");
+		}
+
+		return buffer;
+	}
+
+	std::string narrow_utf8(std::wstring_view input)
+	{
+		if (input.empty())
+		{
+			return {};
+		}
+
+		const int required = WideCharToMultiByte(CP_UTF8, 0, input.data(), static_cast<int>(input.size()), nullptr, 0, nullptr, nullptr);
+		if (required <= 0)
+		{
+			return {};
+		}
+
+		std::string buffer(static_cast<std::size_t>(required), '\0');
+		const int converted = WideCharToMultiByte(CP_UTF8, 0, input.data(), static_cast<int>(input.size()), buffer.data(), required, nullptr, nullptr);
+		if (converted != required)
+		{
+			return {};
+		}
+
+		return buffer;
+	}
+
+	std::string format_windows_error(DWORD error)
+	{
+		if (error == 0)
+		{
+			return {};
+		}
+
+		LPWSTR buffer = nullptr;
+		const DWORD length = FormatMessageW(
+			FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+			nullptr,
+			error,
+			0,
+			reinterpret_cast<LPWSTR>(&buffer),
+			0,
+			nullptr);
+
+		if (length == 0 || buffer == nullptr)
+		{
+			return {};
+		}
+
+		std::wstring_view message(buffer, length);
+		std::string result = narrow_utf8(message);
+		LocalFree(buffer);
+
+		while (!result.empty() && (result.back() == '\r' || result.back() == '\n'))
+		{
+			result.pop_back();
+		}
+
+		return result;
+	}
+#endif
+
+	std::string path_to_utf8(const fs::path& path)
+	{
+#ifdef _WIN32
+		return narrow_utf8(path.wstring());
+#else
+		return path.string();
+#endif
+	}
+
+	const char* recorder_kind_name(RecorderKind kind)
+	{
+		switch (kind)
+		{
+		case RecorderKind::ffmpeg:
+			return "ffmpeg";
+		case RecorderKind::custom:
+			return "custom";
+		default:
+			return "rtmpdump";
+		}
+	}
+
+	std::string format_command(const std::vector<std::string>& argv)
+	{
+		std::string command;
+		for (const auto& arg : argv)
+		{
+			if (!command.empty())
+			{
+				command.push_back(' ');
+			}
+			command += quote_argument(arg);
+		}
+		return command;
+	}
+
+	std::vector<std::string> build_rtmpdump_command(const ProgramConfig& program_config, const std::string& stream_url, const fs::path& output_path)
+	{
+		return { path_to_utf8(program_config.rtmpdump_exe), "-r", stream_url, "-o", path_to_utf8(output_path), "--live" };
+	}
+
+	// -progress 输出机器可读的键值对进度，由父进程增量解析；输出到标准输出时进度改走 stderr
+	std::vector<std::string> build_ffmpeg_command(const ProgramConfig& program_config, const std::string& stream_url, const fs::path& output_path)
+	{
+		const bool to_stdout = output_path == "-";
+		return {
+			path_to_utf8(program_config.ffmpeg_exe),
+			"-hide_banner", "-nostdin", "-loglevel", "warning",
+			"-progress", to_stdout ? "pipe:2" : "pipe:1",
+			"-i", stream_url,
+			"-c", "copy", "-f", "flv",
+			to_stdout ? std::string("pipe:1") : path_to_utf8(output_path),
+		};
+	}
+
+	// 按空白拆分命令模板（支持单双引号），逐个参数替换占位符，不经过 shell
+	std::vector<std::string> build_custom_command(std::string_view command_template, const std::string& stream_url, const fs::path& output_path, const std::string& room_id, const std::string& host_id)
+	{
+		std::vector<std::string> argv;
+		std::string current;
+		bool in_argument = false;
+		char quote = 0;
+		for (const char ch : command_template)
+		{
+			if (quote)
+			{
+				if (ch == quote)
+				{
+					quote = 0;
+				}
+				else
+				{
+					current.push_back(ch);
+				}
+			}
+			else if (ch == '"' || ch == '\'')
+			{
+				quote = ch;
+				in_argument = true;
+			}
+			else if (std::isspace(static_cast<unsigned char>(ch)))
+			{
+				if (in_argument)
+				{
+					argv.push_back(std::move(current));
+					current.clear();
+					in_argument = false;
+				}
+			}
+			else
+			{
+				current.push_back(ch);
+				in_argument = true;
+			}
+		}
+		if (quote)
+		{
+			throw std::runtime_error("录制命令模板中的引号没有闭合");
+		}
+		if (in_argument)
+		{
+			argv.push_back(std::move(current));
+		}
+		if (argv.empty())
+		{
+			throw std::runtime_error("custom 录制器的命令模板为空");
+		}
+
+		const std::pair<std::string_view, std::string> replacements[] = {
+			{ "{url}", stream_url },
+			{ "{output}", path_to_utf8(output_path) },
+			{ "{room_id}", room_id },
+			{ "{host_id}", host_id },
+		};
+		for (auto& arg : argv)
+		{
+			for (const auto& [placeholder, value] : replacements)
+			{
+				for (auto pos = arg.find(placeholder); pos != std::string::npos; pos = arg.find(placeholder, pos + value.size()))
+				{
+					arg.replace(pos, placeholder.size(), value);
+				}
+			}
+		}
+		return argv;
+	}
+
+	// 录制线程与调度线程之间共享的状态，只通过原子变量交互
+	struct CaptureControl
+	{
+		std::atomic<bool> stop_requested{ false };
+		std::atomic<bool> finished{ false };
+		std::atomic<std::uint64_t> bytes_written{ 0 };
+	};
+
+	// 只读映射整个文件，修复与校验工具直接在映射上处理，避免把数 GB 的录制读入内存
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const fs::path& path)
+		{
+#ifdef _WIN32
+			file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file_ == INVALID_HANDLE_VALUE)
+			{
+				throw std::runtime_error("无法打开文件: " + path.string());
+			}
+			LARGE_INTEGER size{};
+			if (!GetFileSizeEx(file_, &size))
+			{
+				CloseHandle(file_);
+				throw std::runtime_error("无法获取文件大小: " + path.string());
+			}
+			size_ = static_cast<std::size_t>(size.QuadPart);
+			if (size_ > 0)
+			{
+				mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				const void* view = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+				if (!view)
+				{
+					if (mapping_)
+					{
+						CloseHandle(mapping_);
+					}
+					CloseHandle(file_);
+					throw std::runtime_error("无法映射文件: " + path.string());
+				}
+				data_ = static_cast<const unsigned char*>(view);
+			}
+#else
+			const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+			{
+				throw std::runtime_error("无法打开文件: " + path.string() + ": " + std::strerror(errno));
+			}
+			struct stat info {};
+			if (::fstat(fd, &info) != 0)
+			{
+				::close(fd);
+				throw std::runtime_error("无法获取文件大小: " + path.string());
+			}
+			size_ = static_cast<std::size_t>(info.st_size);
+			if (size_ > 0)
+			{
+				void* view = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (view == MAP_FAILED)
+				{
+					::close(fd);
+					throw std::runtime_error("无法映射文件: " + path.string() + ": " + std::strerror(errno));
+				}
+				::madvise(view, size_, MADV_SEQUENTIAL);
+				data_ = static_cast<const unsigned char*>(view);
+			}
+			::close(fd);
+#endif
+		}
+
+		~MappedFile()
+		{
+#ifdef _WIN32
+			if (data_)
+			{
+				UnmapViewOfFile(data_);
+			}
+			if (mapping_)
+			{
+				CloseHandle(mapping_);
+			}
+			CloseHandle(file_);
+#else
+			if (data_)
+			{
+				::munmap(const_cast<unsigned char*>(data_), size_);
+			}
+#endif
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const unsigned char* data() const
+		{
+			return data_;
+		}
+
+		std::size_t size() const
+		{
+			return size_;
+		}
+
+	private:
+		const unsigned char* data_ = nullptr;
+		std::size_t size_ = 0;
+#ifdef _WIN32
+		HANDLE file_ = INVALID_HANDLE_VALUE;
+		HANDLE mapping_ = nullptr;
+#endif
+	};
+
+	// BLAKE3 树哈希：输入按 1 KiB 分块，块的链值两两合并成二叉树，因此可以边写边算，也可以多块并行压缩。
+	// x86 上连续的完整分块每 4 个一组用 SSE2 并行压缩，其余情况走标量实现，两者结果一致
+	class Blake3Hasher
+	{
+	public:
+		static constexpr std::size_t digest_size = 32;
+		using Digest = std::array<std::uint8_t, digest_size>;
+
+		void update(const void* data, std::size_t size)
+		{
+			const auto* input = static_cast<const std::uint8_t*>(data);
+			while (size > 0)
+			{
+				if (chunk_length() == chunk_len)
+				{
+					std::array<std::uint32_t, 8> cv{};
+					chaining_value(chunk_output(), cv.data());
+					push_chunk(cv.data());
+				}
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+				// 只并行处理确定不是最后一块的完整分块，最后一块需要留到 finalize 决定是否作为根节点
+				while (chunk_length() == 0 && size > 4 * chunk_len)
+				{
+					std::uint32_t cvs[4][8];
+					compress_chunks4(input, chunk_counter_, cvs);
+					for (const auto& cv : cvs)
+					{
+						push_chunk(cv);
+					}
+					input += 4 * chunk_len;
+					size -= 4 * chunk_len;
+				}
+#endif
+
+				if (block_length_ == block_len)
+				{
+					std::uint32_t out[16];
+					compress(chunk_cv_.data(), block_.data(), chunk_counter_, block_len, chunk_flags(), out);
+					std::copy(out, out + 8, chunk_cv_.begin());
+					++blocks_compressed_;
+					block_length_ = 0;
+					block_.fill(0);
+				}
+
+				const auto take = std::min(block_len - block_length_, size);
+				std::memcpy(block_.data() + block_length_, input, take);
+				block_length_ += take;
+				input += take;
+				size -= take;
+			}
+		}
+
+		Digest finalize() const
+		{
+			Output output = chunk_output();
+			for (auto it = cv_stack_.rbegin(); it != cv_stack_.rend(); ++it)
+			{
+				std::uint32_t right[8];
+				chaining_value(output, right);
+				output = parent_output(it->data(), right);
+			}
+
+			std::uint32_t out[16];
+			compress(output.cv.data(), output.block.data(), 0, output.block_length, output.flags | flag_root, out);
+			Digest digest{};
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				for (std::size_t byte = 0; byte < 4; ++byte)
+				{
+					digest[i * 4 + byte] = static_cast<std::uint8_t>(out[i] >> (8 * byte));
+				}
+			}
+			return digest;
+		}
+
+		static std::string to_hex(const Digest& digest)
+		{
+			static constexpr char digits[] = "0123456789abcdef";
+			std::string hex;
+			hex.reserve(digest.size() * 2);
+			for (const auto byte : digest)
+			{
+				hex.push_back(digits[byte >> 4]);
+				hex.push_back(digits[byte & 0x0F]);
+			}
+			return hex;
+		}
+
+	private:
+		static constexpr std::size_t block_len = 64;
+		static constexpr std::size_t chunk_len = 1024;
+		static constexpr std::uint32_t flag_chunk_start = 1;
+		static constexpr std::uint32_t flag_chunk_end = 2;
+		static constexpr std::uint32_t flag_parent = 4;
+		static constexpr std::uint32_t flag_root = 8;
+		static constexpr std::uint32_t iv[8] = { 0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19 };
+		// 每一轮使用的消息字下标，即对上一轮反复应用 BLAKE3 的消息置换
+		static constexpr std::uint8_t schedule[7][16] = {
+			{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+			{ 2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8 },
+			{ 3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1 },
+			{ 10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6 },
+			{ 12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4 },
+			{ 9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7 },
+			{ 11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13 },
+		};
+
+		struct Output
+		{
+			std::array<std::uint32_t, 8> cv{};
+			std::array<std::uint8_t, block_len> block{};
+			std::uint64_t counter = 0;
+			std::uint32_t block_length = 0;
+			std::uint32_t flags = 0;
+		};
+
+		static std::uint32_t rotr(std::uint32_t value, int bits)
+		{
+			return (value >> bits) | (value << (32 - bits));
+		}
+
+		static std::uint32_t load_le32(const std::uint8_t* data)
+		{
+			return static_cast<std::uint32_t>(data[0]) | (static_cast<std::uint32_t>(data[1]) << 8)
+				| (static_cast<std::uint32_t>(data[2]) << 16) | (static_cast<std::uint32_t>(data[3]) << 24);
+		}
+
+		static void g(std::uint32_t* v, int a, int b, int c, int d, std::uint32_t x, std::uint32_t y)
+		{
+			v[a] = v[a] + v[b] + x;
+			v[d] = rotr(v[d] ^ v[a], 16);
+			v[c] = v[c] + v[d];
+			v[b] = rotr(v[b] ^ v[c], 12);
+			v[a] = v[a] + v[b] + y;
+			v[d] = rotr(v[d] ^ v[a], 8);
+			v[c] = v[c] + v[d];
+			v[b] = rotr(v[b] ^ v[c], 7);
+		}
+
+		static void compress(const std::uint32_t* cv, const std::uint8_t* block, std::uint64_t counter, std::uint32_t block_length, std::uint32_t flags, std::uint32_t* out)
+		{
+			std::uint32_t m[16];
+			for (std::size_t i = 0; i < 16; ++i)
+			{
+				m[i] = load_le32(block + i * 4);
+			}
+
+			std::uint32_t v[16] = {
+				cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+				iv[0], iv[1], iv[2], iv[3],
+				static_cast<std::uint32_t>(counter), static_cast<std::uint32_t>(counter >> 32), block_length, flags,
+			};
+			for (const auto& s : schedule)
+			{
+				g(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+				g(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+				g(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+				g(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+				g(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+				g(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+				g(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+				g(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+			}
+
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				out[i] = v[i] ^ v[i + 8];
+				out[i + 8] = v[i + 8] ^ cv[i];
+			}
+		}
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		template <int Bits>
+		static __m128i rotr4(__m128i value)
+		{
+			return _mm_or_si128(_mm_srli_epi32(value, Bits), _mm_slli_epi32(value, 32 - Bits));
+		}
+
+		static void g4(__m128i* v, int a, int b, int c, int d, __m128i x, __m128i y)
+		{
+			v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), x);
+			v[d] = rotr4<16>(_mm_xor_si128(v[d], v[a]));
+			v[c] = _mm_add_epi32(v[c], v[d]);
+			v[b] = rotr4<12>(_mm_xor_si128(v[b], v[c]));
+			v[a] = _mm_add_epi32(_mm_add_epi32(v[a], v[b]), y);
+			v[d] = rotr4<8>(_mm_xor_si128(v[d], v[a]));
+			v[c] = _mm_add_epi32(v[c], v[d]);
+			v[b] = rotr4<7>(_mm_xor_si128(v[b], v[c]));
+		}
+
+		static void transpose4(__m128i* rows)
+		{
+			const __m128i t0 = _mm_unpacklo_epi32(rows[0], rows[1]);
+			const __m128i t1 = _mm_unpacklo_epi32(rows[2], rows[3]);
+			const __m128i t2 = _mm_unpackhi_epi32(rows[0], rows[1]);
+			const __m128i t3 = _mm_unpackhi_epi32(rows[2], rows[3]);
+			rows[0] = _mm_unpacklo_epi64(t0, t1);
+			rows[1] = _mm_unpackhi_epi64(t0, t1);
+			rows[2] = _mm_unpacklo_epi64(t2, t3);
+			rows[3] = _mm_unpackhi_epi64(t2, t3);
+		}
+
+		// 同时压缩 4 个连续的完整分块，每个 SIMD 通道对应一个分块
+		static void compress_chunks4(const std::uint8_t* input, std::uint64_t counter, std::uint32_t cvs[4][8])
+		{
+			__m128i h[8];
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				h[i] = _mm_set1_epi32(static_cast<int>(iv[i]));
+			}
+			const __m128i counter_low = _mm_set_epi32(static_cast<int>(counter + 3), static_cast<int>(counter + 2), static_cast<int>(counter + 1), static_cast<int>(counter));
+			const __m128i counter_high = _mm_set_epi32(static_cast<int>((counter + 3) >> 32), static_cast<int>((counter + 2) >> 32), static_cast<int>((counter + 1) >> 32), static_cast<int>(counter >> 32));
+
+			for (std::size_t block = 0; block < chunk_len / block_len; ++block)
+			{
+				__m128i m[16];
+				for (std::size_t quad = 0; quad < 4; ++quad)
+				{
+					for (std::size_t lane = 0; lane < 4; ++lane)
+					{
+						m[quad * 4 + lane] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + lane * chunk_len + block * block_len + quad * 16));
+					}
+					transpose4(m + quad * 4);
+				}
+
+				const std::uint32_t flags = (block == 0 ? flag_chunk_start : 0) | (block + 1 == chunk_len / block_len ? flag_chunk_end : 0);
+				__m128i v[16] = {
+					h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+					_mm_set1_epi32(static_cast<int>(iv[0])), _mm_set1_epi32(static_cast<int>(iv[1])),
+					_mm_set1_epi32(static_cast<int>(iv[2])), _mm_set1_epi32(static_cast<int>(iv[3])),
+					counter_low, counter_high, _mm_set1_epi32(static_cast<int>(block_len)), _mm_set1_epi32(static_cast<int>(flags)),
+				};
+				for (const auto& s : schedule)
+				{
+					g4(v, 0, 4, 8, 12, m[s[0]], m[s[1]]);
+					g4(v, 1, 5, 9, 13, m[s[2]], m[s[3]]);
+					g4(v, 2, 6, 10, 14, m[s[4]], m[s[5]]);
+					g4(v, 3, 7, 11, 15, m[s[6]], m[s[7]]);
+					g4(v, 0, 5, 10, 15, m[s[8]], m[s[9]]);
+					g4(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+					g4(v, 2, 7, 8, 13, m[s[12]], m[s[13]]);
+					g4(v, 3, 4, 9, 14, m[s[14]], m[s[15]]);
+				}
+				for (std::size_t i = 0; i < 8; ++i)
+				{
+					h[i] = _mm_xor_si128(v[i], v[i + 8]);
+				}
+			}
+
+			transpose4(h);
+			transpose4(h + 4);
+			for (std::size_t lane = 0; lane < 4; ++lane)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(cvs[lane]), h[lane]);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(cvs[lane] + 4), h[lane + 4]);
+			}
+		}
+#endif
+
+		static void chaining_value(const Output& output, std::uint32_t* cv)
+		{
+			std::uint32_t out[16];
+			compress(output.cv.data(), output.block.data(), output.counter, output.block_length, output.flags, out);
+			std::copy(out, out + 8, cv);
+		}
+
+		static Output parent_output(const std::uint32_t* left, const std::uint32_t* right)
+		{
+			Output output;
+			std::copy(iv, iv + 8, output.cv.begin());
+			for (std::size_t i = 0; i < 8; ++i)
+			{
+				for (std::size_t byte = 0; byte < 4; ++byte)
+				{
+					output.block[i * 4 + byte] = static_cast<std::uint8_t>(left[i] >> (8 * byte));
+					output.block[32 + i * 4 + byte] = static_cast<std::uint8_t>(right[i] >> (8 * byte));
+				}
+			}
+			output.block_length = block_len;
+			output.flags = flag_parent;
+			return output;
+		}
+
+		std::size_t chunk_length() const
+		{
+			return blocks_compressed_ * block_len + block_length_;
+		}
+
+		std::uint32_t chunk_flags() const
+		{
+			return blocks_compressed_ == 0 ? flag_chunk_start : 0;
+		}
+
+		Output chunk_output() const
+		{
+			Output output;
+			output.cv = chunk_cv_;
+			output.block = block_;
+			output.counter = chunk_counter_;
+			output.block_length = static_cast<std::uint32_t>(block_length_);
+			output.flags = chunk_flags() | flag_chunk_end;
+			return output;
+		}
+
+		// 完成一个分块：已完成分块数的二进制末尾有几个 0，就与栈顶合并几次
+		void push_chunk(const std::uint32_t* chunk_cv)
+		{
+			std::array<std::uint32_t, 8> cv{};
+			std::copy(chunk_cv, chunk_cv + 8, cv.begin());
+			for (auto total = ++chunk_counter_; (total & 1) == 0; total >>= 1)
+			{
+				chaining_value(parent_output(cv_stack_.back().data(), cv.data()), cv.data());
+				cv_stack_.pop_back();
+			}
+			cv_stack_.push_back(cv);
+
+			std::copy(iv, iv + 8, chunk_cv_.begin());
+			block_.fill(0);
+			block_length_ = 0;
+			blocks_compressed_ = 0;
+		}
+
+		std::array<std::uint32_t, 8> chunk_cv_ = { iv[0], iv[1], iv[2], iv[3], iv[4], iv[5], iv[6], iv[7] };
+		std::array<std::uint8_t, block_len> block_{};
+		std::size_t block_length_ = 0;
+		std::size_t blocks_compressed_ = 0;
+		std::uint64_t chunk_counter_ = 0;
+		std::vector<std::array<std::uint32_t, 8>> cv_stack_;
+	};
+
+	Blake3Hasher::Digest hash_file(const fs::path& path)
+	{
+		const MappedFile mapped(path);
+		Blake3Hasher hasher;
+		hasher.update(mapped.data(), mapped.size());
+		return hasher.finalize();
+	}
+
+	// 续写录制时先把已有内容计入哈希，清单仍覆盖整个文件
+	void hash_existing_file(Blake3Hasher& hasher, const fs::path& path)
+	{
+		const MappedFile mapped(path);
+		hasher.update(mapped.data(), mapped.size());
+	}
+
+	std::string format_manifest_time(std::chrono::system_clock::time_point time_point)
+	{
+		const std::tm tm = local_tm_from(time_point);
+		std::ostringstream oss;
+		oss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%S%z");
+		return oss.str();
+	}
+
+	// 录制清单与录制文件同名、追加 .json 后缀，记录录制来源与 BLAKE3 哈希，迁移时随文件一起移动
+	struct RecordingManifest
+	{
+		std::string host_id;
+		std::string room_id;
+		std::string started_at;
+		std::string finished_at;
+		std::uint64_t bytes = 0;
+		std::string blake3;
+	};
+
+	fs::path manifest_path_for(const fs::path& recording)
+	{
+		fs::path path = recording;
+		path += ".json";
+		return path;
+	}
+
+	// 录制期间抓取的直播间消息
+	fs::path chat_path_for(const fs::path& recording)
+	{
+		fs::path path = recording;
+		path += ".chat";
+		return path;
+	}
+
+	void write_recording_manifest(const fs::path& recording, const RecordingManifest& manifest)
+	{
+		const json manifest_json = {
+			{ "host_id", manifest.host_id },
+			{ "room_id", manifest.room_id },
+			{ "started_at", manifest.started_at },
+			{ "finished_at", manifest.finished_at },
+			{ "bytes", manifest.bytes },
+			{ "blake3", manifest.blake3 },
+		};
+
+		// 先写临时文件再改名，避免中途退出留下半个清单
+		const auto path = manifest_path_for(recording);
+		fs::path temporary = path;
+		temporary += ".part";
+		{
+			std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+			output << manifest_json.dump(2) << '\n';
+			if (!output)
+			{
+				throw std::runtime_error("无法写入录制清单: " + temporary.string());
+			}
+		}
+		fs::rename(temporary, path);
+	}
+
+	std::optional<RecordingManifest> read_recording_manifest(const fs::path& recording)
+	{
+		std::ifstream input(manifest_path_for(recording), std::ios::binary);
+		if (!input)
+		{
+			return std::nullopt;
+		}
+
+		try
+		{
+			const auto manifest_json = json::parse(input);
+			RecordingManifest manifest;
+			manifest.host_id = manifest_json.value("host_id", "");
+			manifest.room_id = manifest_json.value("room_id", "");
+			manifest.started_at = manifest_json.value("started_at", "");
+			manifest.finished_at = manifest_json.value("finished_at", "");
+			manifest.bytes = manifest_json.value("bytes", std::uint64_t{ 0 });
+			manifest.blake3 = manifest_json.value("blake3", "");
+			return manifest;
+		}
+		catch (const std::exception& ex)
+		{
+			log_warn("录制清单无法解析，将重新计算哈希", { { "path", manifest_path_for(recording) }, { "error", ex.what() } });
+			return std::nullopt;
+		}
+	}
+
+	// 在内核中完成文件复制，避免迁移大文件时在用户态来回拷贝
+	void copy_file_in_kernel(const fs::path& source, const fs::path& destination)
+	{
+#ifdef _WIN32
+		if (!CopyFileExW(source.c_str(), destination.c_str(), nullptr, nullptr, nullptr, 0))
+		{
+			throw std::runtime_error("复制文件失败: " + format_windows_error(GetLastError()));
+		}
+#else
+		const int input = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+		if (input < 0)
+		{
+			throw std::system_error(errno, std::generic_category(), "无法打开迁移源文件");
+		}
+
+		const int output = ::open(destination.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (output < 0)
+		{
+			const int error = errno;
+			::close(input);
+			throw std::system_error(error, std::generic_category(), "无法创建迁移目标文件");
+		}
+
+		struct stat source_stat{};
+		if (::fstat(input, &source_stat) != 0)
+		{
+			const int error = errno;
+			::close(input);
+			::close(output);
+			throw std::system_error(error, std::generic_category(), "无法读取迁移源文件大小");
+		}
+		auto remaining = static_cast<std::uint64_t>(source_stat.st_size);
+		constexpr std::size_t chunk_size = 64 * 1024 * 1024;
+
+		int error = 0;
+#ifdef __linux__
+		bool use_copy_file_range = true;
+		off_t offset = 0;
+		while (remaining > 0)
+		{
+			const auto chunk = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, chunk_size));
+			ssize_t copied = -1;
+			if (use_copy_file_range)
+			{
+				copied = ::copy_file_range(input, nullptr, output, nullptr, chunk, 0);
+				if (copied < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP))
+				{
+					// 跨文件系统或内核不支持时退回 sendfile
+					use_copy_file_range = false;
+					offset = ::lseek(input, 0, SEEK_CUR);
+					continue;
+				}
+			}
+			else
+			{
+				copied = ::sendfile(output, input, &offset, chunk);
+			}
+
+			if (copied < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				error = errno;
+				break;
+			}
+			if (copied == 0)
+			{
+				break;
+			}
+			remaining -= static_cast<std::uint64_t>(copied);
+		}
+#else
+		std::vector<char> buffer(1024 * 1024);
+		while (remaining > 0)
+		{
+			const ssize_t read_count = ::read(input, buffer.data(), buffer.size());
+			if (read_count < 0 && errno == EINTR)
+			{
+				continue;
+			}
+			if (read_count <= 0)
+			{
+				error = read_count < 0 ? errno : 0;
+				break;
+			}
+
+			ssize_t written_total = 0;
+			while (written_total < read_count)
+			{
+				const ssize_t written = ::write(output, buffer.data() + written_total, static_cast<std::size_t>(read_count - written_total));
+				if (written < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				if (written < 0)
+				{
+					error = errno;
+					break;
+				}
+				written_total += written;
+			}
+			if (error != 0)
+			{
+				break;
+			}
+			remaining -= static_cast<std::uint64_t>(read_count);
+		}
+#endif
+
+		if (error == 0 && ::fsync(output) != 0)
+		{
+			error = errno;
+		}
+		::close(input);
+		::close(output);
+
+		if (error != 0)
+		{
+			throw std::system_error(error, std::generic_category(), "迁移文件时复制失败");
+		}
+#endif
+	}
+
+	// 管理多个输出根目录：按剩余空间和写入负载选择新录制的位置，并把 scratch 上已完成的录制迁移到 bulk
+	class StorageManager
+	{
+	public:
+		class Placement
+		{
+		public:
+			Placement() = default;
+			Placement(StorageManager* owner, fs::path path, std::size_t root_index, const CaptureControl* control)
+				: owner_(owner), path_(std::move(path)), root_index_(root_index), control_(control)
+			{
+			}
+
+			Placement(Placement&& other) noexcept
+				: owner_(std::exchange(other.owner_, nullptr)), path_(std::move(other.path_)), root_index_(other.root_index_), control_(other.control_)
+			{
+			}
+
+			Placement& operator=(Placement&&) = delete;
+			Placement(const Placement&) = delete;
+			Placement& operator=(const Placement&) = delete;
+
+			~Placement()
+			{
+				if (owner_)
+				{
+					owner_->release(*this);
+				}
+			}
+
+			const fs::path& path() const
+			{
+				return path_;
+			}
+
+		private:
+			friend class StorageManager;
+
+			StorageManager* owner_ = nullptr;
+			fs::path path_;
+			std::size_t root_index_ = 0;
+			const CaptureControl* control_ = nullptr;
+		};
+
+		// held 为等待续写的录制，启动时不把它们当作残留文件迁移走
+		explicit StorageManager(const DownloadConfig& download_config, std::vector<fs::path> held = {})
+			: download_config_(download_config), held_paths_(std::move(held))
+		{
+			for (const auto& root_config : download_config.output_roots)
+			{
+				RootState root;
+				root.config = root_config;
+				root.absolute_path = make_absolute_path(root_config.path);
+				roots_.push_back(std::move(root));
+			}
+
+			const bool has_scratch = std::any_of(roots_.begin(), roots_.end(), [](const RootState& root)
+				{
+					return root.config.tier == StorageTier::scratch;
+				});
+			const bool has_bulk = std::any_of(roots_.begin(), roots_.end(), [](const RootState& root)
+				{
+					return root.config.tier == StorageTier::bulk;
+				});
+
+			if (download_config.migrate_finished && has_scratch && has_bulk)
+			{
+				enqueue_leftover_recordings();
+				migration_thread_ = std::thread([this]()
+					{
+						migration_loop();
+					});
+			}
+		}
+
+		StorageManager(const StorageManager&) = delete;
+		StorageManager& operator=(const StorageManager&) = delete;
+
+		~StorageManager()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stopping_ = true;
+			}
+			migration_cv_.notify_all();
+			if (migration_thread_.joinable())
+			{
+				migration_thread_.join();
+			}
+		}
+
+		Placement place_recording(std::string_view room_id, const CaptureControl* control)
+		{
+			TraceSpan span("place_recording", room_id);
+			std::lock_guard<std::mutex> lock(mutex_);
+			refresh_metrics_locked();
+
+			const auto root_index = select_root_locked();
+			auto& root = roots_[root_index];
+
+			const auto is_reserved = [this](const fs::path& relative)
+				{
+					for (const auto& state : roots_)
+					{
+						const auto full_path = state.absolute_path / relative;
+						if (std::find(state.active_paths.begin(), state.active_paths.end(), full_path) != state.active_paths.end())
+						{
+							return true;
+						}
+
+						std::error_code ec;
+						if (fs::exists(full_path, ec))
+						{
+							return true;
+						}
+					}
+					return false;
+				};
+
+			auto path = prepare_download_path(root.absolute_path, download_config_, room_id, is_reserved);
+			root.active_paths.push_back(path);
+			root.writers.push_back(control);
+
+			log_info("选择录制存储目录", {
+				{ "root", root.absolute_path },
+				{ "free_mb", root.free_bytes / (1024 * 1024) },
+				{ "write_kbps", root.write_kbps },
+				{ "path", path } });
+
+			return Placement(this, std::move(path), root_index, control);
+		}
+
+		// 接管等待续写的录制文件；文件不在任何输出目录下时返回 nullopt
+		std::optional<Placement> resume_recording(const fs::path& path, const CaptureControl* control)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (const auto it = std::find(held_paths_.begin(), held_paths_.end(), path); it != held_paths_.end())
+			{
+				held_paths_.erase(it);
+			}
+
+			const auto root_index = root_containing_locked(path);
+			if (!root_index)
+			{
+				return std::nullopt;
+			}
+			auto& root = roots_[*root_index];
+			root.active_paths.push_back(path);
+			root.writers.push_back(control);
+			log_info("续写录制文件", { { "root", root.absolute_path }, { "path", path } });
+
+			std::optional<Placement> placement;
+			placement.emplace(this, path, *root_index, control);
+			return placement;
+		}
+
+		// 放弃续写：录制已结束，按普通的已完成录制处理
+		void release_held(const fs::path& path)
+		{
+			bool enqueue = false;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				const auto it = std::find(held_paths_.begin(), held_paths_.end(), path);
+				if (it == held_paths_.end())
+				{
+					return;
+				}
+				held_paths_.erase(it);
+
+				const auto root_index = root_containing_locked(path);
+				if (root_index && migration_thread_.joinable() && roots_[*root_index].config.tier == StorageTier::scratch)
+				{
+					migration_queue_.push_back(MigrationJob{ path, *root_index, {}, 0 });
+					enqueue = true;
+				}
+			}
+
+			if (enqueue)
+			{
+				migration_cv_.notify_one();
+			}
+		}
+
+		// 正在写入 control 对应录制的文件路径，供状态快照记录
+		std::optional<fs::path> active_path(const CaptureControl* control)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (const auto& root : roots_)
+			{
+				for (std::size_t i = 0; i < root.writers.size(); ++i)
+				{
+					if (root.writers[i] == control)
+					{
+						return root.active_paths[i];
+					}
+				}
+			}
+			return std::nullopt;
+		}
+
+	private:
+		struct RootState
+		{
+			OutputRootConfig config;
+			fs::path absolute_path;
+			std::uint64_t free_bytes = 0;
+			std::chrono::steady_clock::time_point space_checked_at;
+			// 正在此目录写入的录制及其字节计数
+			std::vector<const CaptureControl*> writers;
+			std::vector<fs::path> active_paths;
+			std::uint64_t finished_bytes = 0;
+			std::uint64_t last_total_bytes = 0;
+			std::chrono::steady_clock::time_point throughput_sampled_at;
+			double write_kbps = 0.0;
+		};
+
+		struct MigrationJob
+		{
+			fs::path source;
+			std::size_t root_index = 0;
+			// 暂时没有可用的 bulk 目录时推迟到此时再试
+			std::chrono::steady_clock::time_point not_before;
+			int deferrals = 0;
+		};
+
+		static constexpr auto space_refresh_interval = std::chrono::seconds(5);
+		static constexpr auto migration_retry_delay = std::chrono::minutes(5);
+
+		void refresh_metrics_locked()
+		{
+			const auto now = std::chrono::steady_clock::now();
+			for (auto& root : roots_)
+			{
+				if (root.space_checked_at == std::chrono::steady_clock::time_point{} || now - root.space_checked_at >= space_refresh_interval)
+				{
+					std::error_code ec;
+					fs::create_directories(root.absolute_path, ec);
+					const auto info = fs::space(root.absolute_path, ec);
+					root.free_bytes = ec ? 0 : info.available;
+					root.space_checked_at = now;
+				}
+
+				std::uint64_t total = root.finished_bytes;
+				for (const auto* writer : root.writers)
+				{
+					if (writer)
+					{
+						total += writer->bytes_written.load(std::memory_order_relaxed);
+					}
+				}
+
+				const auto elapsed = std::chrono::duration<double>(now - root.throughput_sampled_at).count();
+				if (root.throughput_sampled_at != std::chrono::steady_clock::time_point{} && elapsed > 0.0)
+				{
+					const double instant_kbps = static_cast<double>(total - std::min(total, root.last_total_bytes)) * 8.0 / 1000.0 / elapsed;
+					root.write_kbps = root.write_kbps * 0.5 + instant_kbps * 0.5;
+				}
+				root.last_total_bytes = total;
+				root.throughput_sampled_at = now;
+			}
+		}
+
+		std::optional<std::size_t> root_containing_locked(const fs::path& path) const
+		{
+			for (std::size_t i = 0; i < roots_.size(); ++i)
+			{
+				const auto relative = path.lexically_relative(roots_[i].absolute_path);
+				if (!relative.empty() && *relative.begin() != "..")
+				{
+					return i;
+				}
+			}
+			return std::nullopt;
+		}
+
+		std::size_t select_root_locked() const
+		{
+			// 优先 scratch，其次 bulk；同一层级内选择写入负载最低、剩余空间最多的目录
+			for (const auto tier : { StorageTier::scratch, StorageTier::bulk })
+			{
+				std::optional<std::size_t> best;
+				for (std::size_t i = 0; i < roots_.size(); ++i)
+				{
+					const auto& root = roots_[i];
+					if (root.config.tier != tier || root.free_bytes <= root.config.min_free_bytes)
+					{
+						continue;
+					}
+
+					if (!best)
+					{
+						best = i;
+						continue;
+					}
+
+					const auto& current = roots_[*best];
+					const auto load = root.write_kbps + static_cast<double>(root.writers.size());
+					const auto current_load = current.write_kbps + static_cast<double>(current.writers.size());
+					if (load < current_load || (load == current_load && root.free_bytes > current.free_bytes))
+					{
+						best = i;
+					}
+				}
+
+				if (best)
+				{
+					return *best;
+				}
+			}
+
+			// 所有目录都低于阈值时仍选择剩余空间最多的目录，由录制自身报告写入失败
+			std::size_t fallback = 0;
+			for (std::size_t i = 1; i < roots_.size(); ++i)
+			{
+				if (roots_[i].free_bytes > roots_[fallback].free_bytes)
+				{
+					fallback = i;
+				}
+			}
+			log_warn("所有输出目录的剩余空间均低于配置阈值，使用剩余空间最多的目录", { { "root", roots_[fallback].absolute_path } });
+			return fallback;
+		}
+
+		void release(const Placement& placement)
+		{
+			bool enqueue = false;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				auto& root = roots_[placement.root_index_];
+				if (placement.control_)
+				{
+					root.finished_bytes += placement.control_->bytes_written.load(std::memory_order_relaxed);
+				}
+
+				if (const auto it = std::find(root.writers.begin(), root.writers.end(), placement.control_); it != root.writers.end())
+				{
+					root.writers.erase(it);
+				}
+				if (const auto it = std::find(root.active_paths.begin(), root.active_paths.end(), placement.path_); it != root.active_paths.end())
+				{
+					root.active_paths.erase(it);
+				}
+
+				if (migration_thread_.joinable() && root.config.tier == StorageTier::scratch)
+				{
+					migration_queue_.push_back(MigrationJob{ placement.path_, placement.root_index_, {}, 0 });
+					enqueue = true;
+				}
+			}
+
+			if (enqueue)
+			{
+				migration_cv_.notify_one();
+			}
+		}
+
+		// 启动时 scratch 上残留的录制都已结束，一并加入迁移队列
+		void enqueue_leftover_recordings()
+		{
+			for (std::size_t i = 0; i < roots_.size(); ++i)
+			{
+				if (roots_[i].config.tier != StorageTier::scratch)
+				{
+					continue;
+				}
+
+				std::error_code ec;
+				fs::recursive_directory_iterator it(roots_[i].absolute_path, fs::directory_options::skip_permission_denied, ec);
+				for (const fs::recursive_directory_iterator end; !ec && it != end; it.increment(ec))
+				{
+					std::error_code status_ec;
+					if (it->is_regular_file(status_ec) && it->path().extension() == ".flv"
+						&& std::find(held_paths_.begin(), held_paths_.end(), it->path()) == held_paths_.end())
+					{
+						migration_queue_.push_back(MigrationJob{ it->path(), i, {}, 0 });
+					}
+				}
+			}
+		}
+
+		std::optional<std::size_t> select_bulk_root_locked(std::uint64_t required_bytes)
+		{
+			refresh_metrics_locked();
+			std::optional<std::size_t> best;
+			for (std::size_t i = 0; i < roots_.size(); ++i)
+			{
+				const auto& root = roots_[i];
+				if (root.config.tier != StorageTier::bulk || root.free_bytes < required_bytes + root.config.min_free_bytes)
+				{
+					continue;
+				}
+				if (!best || root.free_bytes > roots_[*best].free_bytes)
+				{
+					best = i;
+				}
+			}
+			return best;
+		}
+
+		void migration_loop()
+		{
+			while (true)
+			{
+				MigrationJob job;
+				std::optional<std::size_t> target_index;
+				{
+					std::unique_lock<std::mutex> lock(mutex_);
+					migration_cv_.wait(lock, [this]()
+						{
+							return stopping_ || !migration_queue_.empty();
+						});
+					if (stopping_)
+					{
+						return;
+					}
+
+					// 只取已到重试时间的任务；全部都在推迟中时等到最早的一个，期间有新任务或停止时重新检查
+					const auto now = std::chrono::steady_clock::now();
+					const auto ready = std::find_if(migration_queue_.begin(), migration_queue_.end(), [now](const MigrationJob& queued)
+						{
+							return queued.not_before <= now;
+						});
+					if (ready == migration_queue_.end())
+					{
+						const auto earliest = std::min_element(migration_queue_.begin(), migration_queue_.end(), [](const MigrationJob& lhs, const MigrationJob& rhs)
+							{
+								return lhs.not_before < rhs.not_before;
+							});
+						migration_cv_.wait_until(lock, earliest->not_before);
+						continue;
+					}
+					job = std::move(*ready);
+					migration_queue_.erase(ready);
+
+					std::error_code ec;
+					const auto size = fs::file_size(job.source, ec);
+					if (ec)
+					{
+						continue;
+					}
+
+					target_index = select_bulk_root_locked(size);
+					if (!target_index)
+					{
+						// 只在第一次推迟时告警，之后按间隔静默重试
+						if (job.deferrals == 0)
+						{
+							log_warn("没有剩余空间足够的 bulk 目录，稍后重试迁移", {
+								{ "path", job.source },
+								{ "retry_seconds", std::chrono::duration_cast<std::chrono::seconds>(migration_retry_delay).count() } });
+						}
+						++job.deferrals;
+						job.not_before = std::chrono::steady_clock::now() + migration_retry_delay;
+						migration_queue_.push_back(std::move(job));
+						continue;
+					}
+				}
+
+				migrate(job, roots_[*target_index].absolute_path);
+			}
+		}
+
+		void migrate(const MigrationJob& job, const fs::path& target_root)
+		{
+			try
+			{
+				std::error_code ec;
+				auto relative = fs::relative(job.source, roots_[job.root_index].absolute_path, ec);
+				if (ec || relative.empty())
+				{
+					relative = job.source.filename();
+				}
+
+				fs::path destination = target_root / relative;
+				fs::create_directories(destination.parent_path());
+				for (int counter = 1; fs::exists(destination); ++counter)
+				{
+					std::ostringstream oss;
+					oss << job.source.stem().string() << "_migrated_" << counter << job.source.extension().string();
+					destination = destination.parent_path() / oss.str();
+				}
+
+				fs::path temporary = destination;
+				temporary += ".part";
+
+				const auto started = std::chrono::steady_clock::now();
+				// 没有清单的录制（例如上次异常退出时残留的文件）先在源文件上补算哈希
+				std::optional<RecordingManifest> manifest;
+				if (download_config_.integrity_manifest)
+				{
+					manifest = read_recording_manifest(job.source);
+					if (!manifest || manifest->blake3.empty())
+					{
+						manifest.emplace();
+						manifest->bytes = fs::file_size(job.source);
+						manifest->blake3 = Blake3Hasher::to_hex(hash_file(job.source));
+					}
+				}
+
+				copy_file_in_kernel(job.source, temporary);
+
+				if (fs::file_size(temporary) != fs::file_size(job.source))
+				{
+					fs::remove(temporary, ec);
+					throw std::runtime_error("迁移后文件大小不一致");
+				}
+				if (manifest && Blake3Hasher::to_hex(hash_file(temporary)) != manifest->blake3)
+				{
+					fs::remove(temporary, ec);
+					throw std::runtime_error("迁移后文件哈希与清单不一致");
+				}
+
+				fs::rename(temporary, destination);
+				if (manifest)
+				{
+					write_recording_manifest(destination, *manifest);
+					fs::remove(manifest_path_for(job.source), ec);
+				}
+				if (const auto chat_source = chat_path_for(job.source); fs::exists(chat_source, ec))
+				{
+					fs::path chat_temporary = chat_path_for(destination);
+					chat_temporary += ".part";
+					copy_file_in_kernel(chat_source, chat_temporary);
+					fs::rename(chat_temporary, chat_path_for(destination));
+					fs::remove(chat_source, ec);
+				}
+				fs::remove(job.source);
+
+				const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+				log_info("已迁移录制", {
+					{ "from", job.source },
+					{ "to", destination },
+					{ "size_mb", fs::file_size(destination) / (1024 * 1024) },
+					{ "verified", manifest.has_value() },
+					{ "seconds", seconds } });
+			}
+			catch (const std::exception& ex)
+			{
+				log_error("迁移录制失败", { { "path", job.source }, { "error", ex.what() } });
+			}
+		}
+
+		const DownloadConfig& download_config_;
+		std::vector<RootState> roots_;
+		std::mutex mutex_;
+		std::condition_variable migration_cv_;
+		std::deque<MigrationJob> migration_queue_;
+		std::vector<fs::path> held_paths_;
+		bool stopping_ = false;
+		std::thread migration_thread_;
+	};
+
+	constexpr std::uint8_t flv_tag_audio = 8;
+	constexpr std::uint8_t flv_tag_video = 9;
+	constexpr std::uint8_t flv_tag_script = 18;
+	constexpr std::size_t flv_header_size = 9;
+	constexpr std::size_t flv_tag_header_size = 11;
+
+	struct FlvTag
+	{
+		std::uint8_t type = 0;
+		std::uint32_t timestamp = 0;
+		std::string payload;
+	};
+
+	std::uint32_t read_be24(const unsigned char* data)
+	{
+		return (static_cast<std::uint32_t>(data[0]) << 16) | (static_cast<std::uint32_t>(data[1]) << 8) | data[2];
+	}
+
+	std::uint32_t read_be32(const unsigned char* data)
+	{
+		return (static_cast<std::uint32_t>(data[0]) << 24) | read_be24(data + 1);
+	}
+
+	void append_be24(std::string& out, std::uint32_t value)
+	{
+		out.push_back(static_cast<char>((value >> 16) & 0xFF));
+		out.push_back(static_cast<char>((value >> 8) & 0xFF));
+		out.push_back(static_cast<char>(value & 0xFF));
+	}
+
+	void append_be32(std::string& out, std::uint32_t value)
+	{
+		out.push_back(static_cast<char>((value >> 24) & 0xFF));
+		append_be24(out, value);
+	}
+
+	void append_flv_header(std::string& out, std::uint8_t flags)
+	{
+		out.append("FLV\x01", 4);
+		out.push_back(static_cast<char>(flags));
+		append_be32(out, static_cast<std::uint32_t>(flv_header_size));
+		append_be32(out, 0);
+	}
+
+	void append_flv_tag(std::string& out, std::uint8_t type, std::uint32_t timestamp, std::string_view payload)
+	{
+		out.push_back(static_cast<char>(type));
+		append_be24(out, static_cast<std::uint32_t>(payload.size()));
+		append_be24(out, timestamp & 0xFFFFFF);
+		out.push_back(static_cast<char>((timestamp >> 24) & 0xFF));
+		append_be24(out, 0);
+		out.append(payload);
+		append_be32(out, static_cast<std::uint32_t>(payload.size() + flv_tag_header_size));
+	}
+
+	// 兼容传统 FLV 与 Enhanced RTMP 的视频标签头
+	bool is_video_keyframe(std::string_view payload)
+	{
+		if (payload.empty())
+		{
+			return false;
+		}
+		const auto first = static_cast<unsigned char>(payload[0]);
+		return ((first >> 4) & 0x07) == 1;
+	}
+
+	bool is_sequence_header(std::uint8_t type, std::string_view payload)
+	{
+		if (payload.empty())
+		{
+			return false;
+		}
+
+		const auto first = static_cast<unsigned char>(payload[0]);
+		if (type == flv_tag_video)
+		{
+			if (first & 0x80)
+			{
+				// Enhanced RTMP: PacketTypeSequenceStart
+				return (first & 0x0F) == 0;
+			}
+			const auto codec = first & 0x0F;
+			return (codec == 7 || codec == 12) && payload.size() > 1 && payload[1] == 0;
+		}
+
+		if (type == flv_tag_audio)
+		{
+			return (first >> 4) == 10 && payload.size() > 1 && payload[1] == 0;
+		}
+
+		return false;
+	}
+
+	bool is_sequence_header(const FlvTag& tag)
+	{
+		return is_sequence_header(tag.type, tag.payload);
+	}
+
+	// 以首个媒体标签为零点重排时间戳，并把断线重连造成的大幅回退接续到已写出的最大时间戳之后
+	class FlvTimestampNormalizer
+	{
+	public:
+		std::uint32_t next(std::uint8_t type, std::uint32_t timestamp, bool sequence_header)
+		{
+			// 元数据与序列头通常带着 0 时间戳先于媒体数据到达，不用它们确定零点
+			if (!base_timestamp_)
+			{
+				if (type == flv_tag_script || sequence_header)
+				{
+					return static_cast<std::uint32_t>(last_timestamp_);
+				}
+				base_timestamp_ = timestamp;
+			}
+
+			auto result = static_cast<std::int64_t>(timestamp) - static_cast<std::int64_t>(*base_timestamp_) + offset_;
+			if (result < last_timestamp_ - max_backward_ms)
+			{
+				offset_ += last_timestamp_ - result;
+				result = last_timestamp_;
+				++repairs_;
+			}
+			result = std::max<std::int64_t>(result, 0);
+			last_timestamp_ = std::max(last_timestamp_, result);
+			return static_cast<std::uint32_t>(result);
+		}
+
+		std::uint32_t last_timestamp() const
+		{
+			return static_cast<std::uint32_t>(last_timestamp_);
+		}
+
+		// 续写已有文件：新流的第一个媒体标签排在 timestamp 之后一帧
+		void resume_after(std::uint32_t timestamp)
+		{
+			offset_ = static_cast<std::int64_t>(timestamp) + resume_gap_ms;
+			last_timestamp_ = timestamp;
+		}
+
+		std::uint64_t repairs() const
+		{
+			return repairs_;
+		}
+
+	private:
+		// 时间戳回退超过该值视为重新开始的流，而不是音视频交错造成的小幅抖动
+		static constexpr std::int64_t max_backward_ms = 1000;
+		static constexpr std::int64_t resume_gap_ms = 40;
+
+		std::optional<std::uint32_t> base_timestamp_;
+		std::int64_t offset_ = 0;
+		std::int64_t last_timestamp_ = 0;
+		std::uint64_t repairs_ = 0;
+	};
+
+	// 增量解析 FLV 字节流，可按任意大小分块喂入
+	class FlvStreamParser
+	{
+	public:
+		bool failed() const
+		{
+			return failed_;
+		}
+
+		std::uint8_t header_flags() const
+		{
+			return header_flags_;
+		}
+
+		template <typename OnTag>
+		void feed(const char* data, std::size_t size, OnTag&& on_tag)
+		{
+			if (failed_)
+			{
+				return;
+			}
+
+			buffer_.append(data, size);
+			const auto* bytes = reinterpret_cast<const unsigned char*>(buffer_.data());
+
+			if (!header_done_)
+			{
+				if (buffer_.size() < flv_header_size + 4)
+				{
+					return;
+				}
+				if (std::memcmp(bytes, "FLV", 3) != 0)
+				{
+					failed_ = true;
+					buffer_.clear();
+					return;
+				}
+				header_flags_ = bytes[4];
+				offset_ = std::max<std::size_t>(read_be32(bytes + 5), flv_header_size) + 4;
+				header_done_ = true;
+			}
+
+			while (buffer_.size() - offset_ >= flv_tag_header_size)
+			{
+				const auto* tag_header = bytes + offset_;
+				const std::size_t data_size = read_be24(tag_header + 1);
+				const std::size_t total = flv_tag_header_size + data_size + 4;
+				if (buffer_.size() - offset_ < total)
+				{
+					break;
+				}
+
+				FlvTag tag;
+				tag.type = tag_header[0] & 0x1F;
+				tag.timestamp = read_be24(tag_header + 4) | (static_cast<std::uint32_t>(tag_header[7]) << 24);
+				tag.payload.assign(buffer_.data() + offset_ + flv_tag_header_size, data_size);
+				offset_ += total;
+				on_tag(std::move(tag));
+			}
+
+			// 已消费的数据较多时再整体前移，避免每次都搬移缓冲区
+			if (offset_ > 0 && (offset_ >= buffer_.size() || offset_ > 1024 * 1024))
+			{
+				buffer_.erase(0, offset_);
+				offset_ = 0;
+			}
+		}
+
+	private:
+		std::string buffer_;
+		std::size_t offset_ = 0;
+		bool header_done_ = false;
+		bool failed_ = false;
+		std::uint8_t header_flags_ = 0x05;
+	};
+
+	// 续写位置：文件截断到最后一个完整标签之后的长度，以及其中最大的时间戳
+	struct FlvResumePoint
+	{
+		std::uint64_t bytes = 0;
+		std::uint32_t last_timestamp = 0;
+	};
+
+	// 逐标签重写 FLV 流并统一时间戳。续写已有文件时不再输出文件头，
+	// 并丢弃新连接开头的 onMetaData，时间戳接在文件末尾之后
+	class FlvTagRewriter
+	{
+	public:
+		explicit FlvTagRewriter(std::optional<FlvResumePoint> resume = std::nullopt)
+			: header_written_(resume.has_value()), skip_metadata_(resume.has_value())
+		{
+			if (resume)
+			{
+				timestamps_.resume_after(resume->last_timestamp);
+			}
+		}
+
+		bool failed() const
+		{
+			return parser_.failed();
+		}
+
+		// 重写后的数据追加到 out
+		void feed(const char* data, std::size_t size, std::string& out)
+		{
+			parser_.feed(data, size, [&](FlvTag tag)
+				{
+					write_tag(tag, out);
+				});
+		}
+
+		std::uint64_t tags_written() const
+		{
+			return tags_written_;
+		}
+
+		std::uint64_t timestamp_repairs() const
+		{
+			return timestamps_.repairs();
+		}
+
+	private:
+		void write_tag(const FlvTag& tag, std::string& out)
+		{
+			if (!header_written_)
+			{
+				append_flv_header(out, parser_.header_flags());
+				header_written_ = true;
+			}
+			if (skip_metadata_ && tag.type == flv_tag_script)
+			{
+				return;
+			}
+
+			const auto timestamp = timestamps_.next(tag.type, tag.timestamp, is_sequence_header(tag));
+			append_flv_tag(out, tag.type, timestamp, tag.payload);
+			++tags_written_;
+		}
+
+		FlvStreamParser parser_;
+		FlvTimestampNormalizer timestamps_;
+		bool header_written_ = false;
+		bool skip_metadata_ = false;
+		std::uint64_t tags_written_ = 0;
+	};
+
+	// 单个录制的转发通道：写入端只追加到共享环形缓冲，读者各自维护游标，跟不上的读者被丢弃
+	class RelayChannel
+	{
+	public:
+		RelayChannel(std::string host_id, std::string room_id, std::size_t capacity_bytes)
+			: host_id_(std::move(host_id)), room_id_(std::move(room_id)), capacity_bytes_(capacity_bytes)
+		{
+		}
+
+		const std::string& host_id() const
+		{
+			return host_id_;
+		}
+
+		const std::string& room_id() const
+		{
+			return room_id_;
+		}
+
+		void set_header_flags(std::uint8_t flags)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			header_flags_ = flags;
+		}
+
+		void publish(FlvTag tag)
+		{
+			auto shared = std::make_shared<const FlvTag>(std::move(tag));
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (shared->type == flv_tag_script)
+				{
+					metadata_ = shared;
+				}
+				else if (is_sequence_header(*shared))
+				{
+					(shared->type == flv_tag_video ? video_sequence_header_ : audio_sequence_header_) = shared;
+				}
+				else
+				{
+					if (shared->type == flv_tag_video && is_video_keyframe(shared->payload))
+					{
+						last_keyframe_seq_ = next_seq_;
+					}
+
+					buffered_bytes_ += shared->payload.size();
+					tags_.push_back(std::move(shared));
+					++next_seq_;
+					while (buffered_bytes_ > capacity_bytes_ && tags_.size() > 1)
+					{
+						buffered_bytes_ -= tags_.front()->payload.size();
+						tags_.pop_front();
+						++first_seq_;
+					}
+					memory_.set(buffered_bytes_);
+				}
+			}
+			cv_.notify_all();
+		}
+
+		void close()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				closed_ = true;
+			}
+			cv_.notify_all();
+		}
+
+		struct StartPoint
+		{
+			std::uint8_t header_flags = 0x05;
+			std::vector<std::shared_ptr<const FlvTag>> init_tags;
+			std::uint64_t cursor = 0;
+		};
+
+		// 新读者从最近的关键帧开始，并先收到元数据与编码序列头
+		StartPoint join()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			StartPoint start;
+			start.header_flags = header_flags_;
+			for (const auto& tag : { metadata_, video_sequence_header_, audio_sequence_header_ })
+			{
+				if (tag)
+				{
+					start.init_tags.push_back(tag);
+				}
+			}
+			start.cursor = last_keyframe_seq_ && *last_keyframe_seq_ >= first_seq_ ? *last_keyframe_seq_ : next_seq_;
+			++readers_;
+			return start;
+		}
+
+		void leave()
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			--readers_;
+		}
+
+		enum class ReadResult
+		{
+			data,
+			timeout,
+			dropped,
+			closed,
+		};
+
+		ReadResult read(std::uint64_t& cursor, std::vector<std::shared_ptr<const FlvTag>>& out, std::chrono::milliseconds timeout)
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait_for(lock, timeout, [&]()
+				{
+					return closed_ || cursor < next_seq_ || cursor < first_seq_;
+				});
+
+			if (cursor < first_seq_)
+			{
+				return ReadResult::dropped;
+			}
+			if (cursor == next_seq_)
+			{
+				return closed_ ? ReadResult::closed : ReadResult::timeout;
+			}
+
+			out.clear();
+			const auto begin = static_cast<std::size_t>(cursor - first_seq_);
+			out.insert(out.end(), tags_.begin() + static_cast<std::ptrdiff_t>(begin), tags_.end());
+			cursor = next_seq_;
+			return ReadResult::data;
+		}
+
+		json status() const
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			return json{
+				{ "host_id", host_id_ },
+				{ "room_id", room_id_ },
+				{ "readers", readers_ },
+				{ "buffered_bytes", buffered_bytes_ },
+				{ "buffered_tags", tags_.size() },
+				{ "closed", closed_ },
+			};
+		}
+
+	private:
+		const std::string host_id_;
+		const std::string room_id_;
+		const std::size_t capacity_bytes_;
+
+		mutable std::mutex mutex_;
+		std::condition_variable cv_;
+		std::deque<std::shared_ptr<const FlvTag>> tags_;
+		std::uint64_t first_seq_ = 0;
+		std::uint64_t next_seq_ = 0;
+		std::size_t buffered_bytes_ = 0;
+		MemoryCharge memory_{ MemorySubsystem::relay };
+		std::optional<std::uint64_t> last_keyframe_seq_;
+		std::shared_ptr<const FlvTag> metadata_;
+		std::shared_ptr<const FlvTag> video_sequence_header_;
+		std::shared_ptr<const FlvTag> audio_sequence_header_;
+		std::uint8_t header_flags_ = 0x05;
+		int readers_ = 0;
+		bool closed_ = false;
+	};
+
+	// 把录制线程收到的原始字节解析为 FLV 标签并推送到转发通道
+	class RelayFeeder
+	{
+	public:
+		explicit RelayFeeder(std::shared_ptr<RelayChannel> channel)
+			: channel_(std::move(channel))
+		{
+		}
+
+		void feed(const char* data, std::size_t size)
+		{
+			if (!channel_ || parser_.failed())
+			{
+				return;
+			}
+
+			parser_.feed(data, size, [this](FlvTag tag)
+				{
+					if (!flags_published_)
+					{
+						channel_->set_header_flags(parser_.header_flags());
+						flags_published_ = true;
+					}
+					channel_->publish(std::move(tag));
+				});
+		}
+
+	private:
+		std::shared_ptr<RelayChannel> channel_;
+		FlvStreamParser parser_;
+		bool flags_published_ = false;
+	};
+
+#ifdef _WIN32
+	using socket_handle = SOCKET;
+	constexpr socket_handle invalid_socket_handle = INVALID_SOCKET;
+
+	void close_socket(socket_handle socket)
+	{
+		closesocket(socket);
+	}
+#else
+	using socket_handle = int;
+	constexpr socket_handle invalid_socket_handle = -1;
+
+	void close_socket(socket_handle socket)
+	{
+		::close(socket);
+	}
+#endif
+
+	bool send_all(socket_handle socket, std::string_view data)
+	{
+		while (!data.empty())
+		{
+#ifdef _WIN32
+			const int sent = ::send(socket, data.data(), static_cast<int>(std::min<std::size_t>(data.size(), 1 << 30)), 0);
+#else
+			const auto sent = ::send(socket, data.data(), data.size(), MSG_NOSIGNAL);
+			if (sent < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			if (sent <= 0)
+			{
+				return false;
+			}
+			data.remove_prefix(static_cast<std::size_t>(sent));
+		}
+		return true;
+	}
+
+	// 本地 HTTP-FLV 转发服务：同一路 CDN 拉流可以同时供多个本地播放器或工具读取
+	class StreamRelayHub
+	{
+	public:
+		explicit StreamRelayHub(const RelayConfig& config)
+			: config_(config)
+		{
+#ifdef _WIN32
+			WSADATA wsa_data{};
+			if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+			{
+				throw std::runtime_error("无法初始化 Winsock");
+			}
+#endif
+			listen_socket_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+			if (listen_socket_ == invalid_socket_handle)
+			{
+				throw std::runtime_error("无法创建转发服务监听套接字");
+			}
+
+			const int reuse = 1;
+			::setsockopt(listen_socket_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+			sockaddr_in address{};
+			address.sin_family = AF_INET;
+			address.sin_port = htons(static_cast<std::uint16_t>(config.port));
+			if (::inet_pton(AF_INET, config.listen_address.c_str(), &address.sin_addr) != 1)
+			{
+				close_socket(listen_socket_);
+				throw std::runtime_error("转发服务监听地址无效: " + config.listen_address);
+			}
+
+			if (::bind(listen_socket_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || ::listen(listen_socket_, 16) != 0)
+			{
+				close_socket(listen_socket_);
+				throw std::runtime_error("转发服务无法监听端口 " + std::to_string(config.port));
+			}
+
+			accept_thread_ = std::thread([this]()
+				{
+					accept_loop();
+				});
+
+			log_info("本地 HTTP-FLV 转发服务已启动", { { "address", config.listen_address }, { "port", config.port } });
+		}
+
+		StreamRelayHub(const StreamRelayHub&) = delete;
+		StreamRelayHub& operator=(const StreamRelayHub&) = delete;
+
+		~StreamRelayHub()
+		{
+			stopping_.store(true);
+#ifndef _WIN32
+			// Linux 上仅 close 不会唤醒阻塞中的 accept
+			::shutdown(listen_socket_, SHUT_RDWR);
+#endif
+			close_socket(listen_socket_);
+			if (accept_thread_.joinable())
+			{
+				accept_thread_.join();
+			}
+
+			std::vector<std::shared_ptr<RelayChannel>> channels;
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				channels = channels_;
+			}
+			for (const auto& channel : channels)
+			{
+				channel->close();
+			}
+
+			std::unique_lock<std::mutex> lock(mutex_);
+			clients_cv_.wait(lock, [this]()
+				{
+					return active_clients_ == 0;
+				});
+#ifdef _WIN32
+			WSACleanup();
+#endif
+		}
+
+		std::shared_ptr<RelayChannel> open_channel(const std::string& host_id, const std::string& room_id)
+		{
+			auto channel = std::make_shared<RelayChannel>(host_id, room_id, config_.buffer_bytes);
+			std::lock_guard<std::mutex> lock(mutex_);
+			channels_.push_back(channel);
+			return channel;
+		}
+
+		void close_channel(const std::shared_ptr<RelayChannel>& channel)
+		{
+			if (!channel)
+			{
+				return;
+			}
+
+			channel->close();
+			std::lock_guard<std::mutex> lock(mutex_);
+			channels_.erase(std::remove(channels_.begin(), channels_.end(), channel), channels_.end());
+		}
+
+	private:
+		void accept_loop()
+		{
+			while (!stopping_.load())
+			{
+				const socket_handle client = ::accept(listen_socket_, nullptr, nullptr);
+				if (client == invalid_socket_handle)
+				{
+					if (stopping_.load())
+					{
+						return;
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+					continue;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					if (active_clients_ >= config_.max_readers)
+					{
+						send_all(client, "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+						close_socket(client);
+						continue;
+					}
+					++active_clients_;
+				}
+
+				std::thread([this, client]()
+					{
+						try
+						{
+							serve_client(client);
+						}
+						catch (const std::exception& ex)
+						{
+							log_warn("转发客户端处理异常", { { "error", ex.what() } });
+						}
+						close_socket(client);
+
+						std::lock_guard<std::mutex> lock(mutex_);
+						--active_clients_;
+						clients_cv_.notify_all();
+					}).detach();
+			}
+		}
+
+		std::shared_ptr<RelayChannel> find_channel(std::string_view path) const
+		{
+			const auto match = [&](std::string_view prefix, bool by_room) -> std::shared_ptr<RelayChannel>
+				{
+					if (path.rfind(prefix, 0) != 0 || path.size() <= prefix.size() + 4 || path.substr(path.size() - 4) != ".flv")
+					{
+						return nullptr;
+					}
+
+					const auto key = path.substr(prefix.size(), path.size() - prefix.size() - 4);
+					std::lock_guard<std::mutex> lock(mutex_);
+					for (auto it = channels_.rbegin(); it != channels_.rend(); ++it)
+					{
+						if ((by_room ? (*it)->room_id() : (*it)->host_id()) == key)
+						{
+							return *it;
+						}
+					}
+					return nullptr;
+				};
+
+			if (auto channel = match("/live/", true))
+			{
+				return channel;
+			}
+			return match("/host/", false);
+		}
+
+		void serve_client(socket_handle client)
+		{
+			// 发送超时用于断开卡住的读者，接收超时防止空连接占用线程
+#ifdef _WIN32
+			const DWORD socket_timeout_ms = 10000;
+			::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&socket_timeout_ms), sizeof(socket_timeout_ms));
+			::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&socket_timeout_ms), sizeof(socket_timeout_ms));
+#else
+			timeval socket_timeout{};
+			socket_timeout.tv_sec = 10;
+			::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &socket_timeout, sizeof(socket_timeout));
+			::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &socket_timeout, sizeof(socket_timeout));
+#endif
+
+			std::string request;
+			std::array<char, 1024> buffer{};
+			while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192)
+			{
+				const auto received = ::recv(client, buffer.data(), static_cast<int>(buffer.size()), 0);
+				if (received <= 0)
+				{
+					return;
+				}
+				request.append(buffer.data(), static_cast<std::size_t>(received));
+			}
+
+			const auto line_end = request.find("\r\n");
+			const std::string_view request_line = std::string_view(request).substr(0, line_end);
+			if (request_line.rfind("GET ", 0) != 0)
+			{
+				send_all(client, "HTTP/1.1 405 Method Not Allowed\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+				return;
+			}
+
+			auto path = request_line.substr(4);
+			path = path.substr(0, path.find(' '));
+			path = path.substr(0, path.find('?'));
+
+			if (path == "/" || path == "/status")
+			{
+				json channels = json::array();
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					for (const auto& channel : channels_)
+					{
+						channels.push_back(channel->status());
+					}
+				}
+				const auto body = channels.dump();
+				send_all(client, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nConnection: close\r\nContent-Length: "
+					+ std::to_string(body.size()) + "\r\n\r\n" + body);
+				return;
+			}
+
+			const auto channel = find_channel(path);
+			if (!channel)
+			{
+				send_all(client, "HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+				return;
+			}
+
+			stream_channel(client, *channel);
+		}
+
+		void stream_channel(socket_handle client, RelayChannel& channel)
+		{
+			auto start = channel.join();
+			struct LeaveGuard
+			{
+				RelayChannel& channel;
+				~LeaveGuard()
+				{
+					channel.leave();
+				}
+			} leave_guard{ channel };
+
+			log_info("转发读者已连接", { { "host", channel.host_id() }, { "room_id", channel.room_id() } });
+
+			std::string out = "HTTP/1.1 200 OK\r\nContent-Type: video/x-flv\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n";
+			append_flv_header(out, start.header_flags);
+			for (const auto& tag : start.init_tags)
+			{
+				append_flv_tag(out, tag->type, 0, tag->payload);
+			}
+			if (!send_all(client, out))
+			{
+				return;
+			}
+
+			// 以读者加入时的第一个标签为零点重写时间戳
+			std::optional<std::uint32_t> base_timestamp;
+			std::vector<std::shared_ptr<const FlvTag>> batch;
+			while (!stopping_.load())
+			{
+				const auto result = channel.read(start.cursor, batch, std::chrono::milliseconds(1000));
+				if (result == RelayChannel::ReadResult::timeout)
+				{
+					continue;
+				}
+				if (result == RelayChannel::ReadResult::dropped)
+				{
+					log_warn("转发读者跟不上直播流，已断开", { { "host", channel.host_id() }, { "room_id", channel.room_id() } });
+					return;
+				}
+				if (result == RelayChannel::ReadResult::closed)
+				{
+					return;
+				}
+
+				out.clear();
+				for (const auto& tag : batch)
+				{
+					if (!base_timestamp)
+					{
+						base_timestamp = tag->timestamp;
+					}
+					const auto timestamp = tag->timestamp >= *base_timestamp ? tag->timestamp - *base_timestamp : 0;
+					append_flv_tag(out, tag->type, timestamp, tag->payload);
+				}
+				if (!send_all(client, out))
+				{
+					return;
+				}
+			}
+		}
+
+		const RelayConfig& config_;
+		socket_handle listen_socket_ = invalid_socket_handle;
+		std::atomic<bool> stopping_{ false };
+		std::thread accept_thread_;
+
+		mutable std::mutex mutex_;
+		std::condition_variable clients_cv_;
+		std::vector<std::shared_ptr<RelayChannel>> channels_;
+		int active_clients_ = 0;
+	};
+
+	// 在录制期间登记转发通道，录制结束时自动关闭
+	class RelayPublication
+	{
+	public:
+		RelayPublication(StreamRelayHub* hub, const std::string& host_id, const std::string& room_id)
+			: hub_(hub), channel_(hub ? hub->open_channel(host_id, room_id) : nullptr), feeder_(channel_)
+		{
+		}
+
+		RelayPublication(const RelayPublication&) = delete;
+		RelayPublication& operator=(const RelayPublication&) = delete;
+
+		~RelayPublication()
+		{
+			if (hub_)
+			{
+				hub_->close_channel(channel_);
+			}
+		}
+
+		bool active() const
+		{
+			return channel_ != nullptr;
+		}
+
+		void feed(const char* data, std::size_t size)
+		{
+			feeder_.feed(data, size);
+		}
+
+	private:
+		StreamRelayHub* hub_ = nullptr;
+		std::shared_ptr<RelayChannel> channel_;
+		RelayFeeder feeder_;
+	};
+
+	// rtmpdump 直接写文件，转发时跟随读取正在增长的输出文件
+	class FileTailFeeder
+	{
+	public:
+		FileTailFeeder(RelayPublication& publication, fs::path path)
+			: publication_(publication), path_(std::move(path))
+		{
+			if (publication_.active())
+			{
+				thread_ = std::thread([this]()
+					{
+						run();
+					});
+			}
+		}
+
+		FileTailFeeder(const FileTailFeeder&) = delete;
+		FileTailFeeder& operator=(const FileTailFeeder&) = delete;
+
+		~FileTailFeeder()
+		{
+			stopping_.store(true);
+			if (thread_.joinable())
+			{
+				thread_.join();
+			}
+		}
+
+	private:
+		void run()
+		{
+			std::ifstream input;
+			std::vector<char> buffer(256 * 1024);
+			while (true)
+			{
+				const bool last_pass = stopping_.load();
+				if (!input.is_open())
+				{
+					input.open(path_, std::ios::binary);
+				}
+
+				if (input.is_open())
+				{
+					while (true)
+					{
+						input.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+						const auto count = input.gcount();
+						if (count <= 0)
+						{
+							break;
+						}
+						publication_.feed(buffer.data(), static_cast<std::size_t>(count));
+					}
+					input.clear();
+				}
+
+				if (last_pass)
+				{
+					return;
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			}
+		}
+
+		RelayPublication& publication_;
+		fs::path path_;
+		std::atomic<bool> stopping_{ false };
+		std::thread thread_;
+	};
+
+	bool is_http_stream_url(std::string_view url)
+	{
+		return url.rfind("http://", 0) == 0 || url.rfind("https://", 0) == 0;
+	}
+
+	// 从 URL 中取出 scheme://authority 部分
+	std::string url_origin(std::string_view url)
+	{
+		const auto scheme_end = url.find("://");
+		if (scheme_end == std::string_view::npos)
+		{
+			return {};
+		}
+		const auto path_start = url.find('/', scheme_end + 3);
+		return std::string(url.substr(0, path_start));
+	}
+
+	std::string url_hostname(std::string_view url)
+	{
+		const auto origin = url_origin(url);
+		if (origin.empty())
+		{
+			return {};
+		}
+		auto authority = std::string_view(origin).substr(origin.find("://") + 3);
+		authority = authority.substr(authority.find('@') == std::string_view::npos ? 0 : authority.find('@') + 1);
+		return std::string(authority.substr(0, authority.find(':')));
+	}
+
+	// 在可能的开播时间前预先解析 CDN 域名并建立连接，检测到开播后 HTTP-FLV 录制可直接复用已预热的连接。
+	// rtmpdump 是独立进程，无法接手本进程的连接，对 RTMP 源只做 DNS 预解析以填充系统解析缓存。
+	class CdnConnectionWarmer
+	{
+	public:
+		explicit CdnConnectionWarmer(const Config& config)
+			: config_(config.prewarm)
+		{
+			share_ = curl_share_init();
+			if (!share_)
+			{
+				throw std::runtime_error("无法初始化 libcurl 共享句柄");
+			}
+			curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lock_callback);
+			curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlock_callback);
+			curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+			curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+			curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+			curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+			for (const auto& url : { config.download.base_stream_url, config.recording.orig_stream_url_template })
+			{
+				if (is_http_stream_url(url))
+				{
+					if (auto origin = url_origin(url); !origin.empty())
+					{
+						http_origins_.push_back(origin + "/");
+					}
+				}
+				else if (auto host = url_hostname(url); !host.empty())
+				{
+					dns_hosts_.push_back(std::move(host));
+				}
+			}
+
+			thread_ = std::thread([this]()
+				{
+					Tracer::instance().set_thread_name("prewarm");
+					run();
+				});
+		}
+
+		CdnConnectionWarmer(const CdnConnectionWarmer&) = delete;
+		CdnConnectionWarmer& operator=(const CdnConnectionWarmer&) = delete;
+
+		~CdnConnectionWarmer()
+		{
+			{
+				std::lock_guard<std::mutex> lock(state_mutex_);
+				stopping_ = true;
+			}
+			state_cv_.notify_all();
+			if (thread_.joinable())
+			{
+				thread_.join();
+			}
+
+			for (auto* handle : handles_)
+			{
+				curl_easy_cleanup(handle);
+			}
+			curl_share_cleanup(share_);
+		}
+
+		void set_active(bool active)
+		{
+			{
+				std::lock_guard<std::mutex> lock(state_mutex_);
+				if (active_ == active)
+				{
+					return;
+				}
+				active_ = active;
+			}
+			log_info(active ? "临近开播时间，开始预热 CDN 连接" : "离开开播时间窗口，停止预热 CDN 连接");
+			state_cv_.notify_all();
+		}
+
+		// 录制句柄接入共享的 DNS 缓存、TLS 会话与连接池
+		void attach(CURL* handle)
+		{
+			curl_easy_setopt(handle, CURLOPT_SHARE, share_);
+		}
+
+		void record_first_byte(std::string_view room_id, std::chrono::milliseconds ttfb, bool reused_connection)
+		{
+			std::lock_guard<std::mutex> lock(state_mutex_);
+			auto& stats = reused_connection ? warm_stats_ : cold_stats_;
+			++stats.count;
+			stats.total += ttfb;
+
+			const auto average = [](const FirstByteStats& value)
+				{
+					return value.count ? static_cast<std::int64_t>(value.total.count() / static_cast<std::int64_t>(value.count)) : std::int64_t{ -1 };
+				};
+			log_info("录制首字节耗时", {
+				{ "room_id", room_id },
+				{ "ttfb_ms", static_cast<std::int64_t>(ttfb.count()) },
+				{ "warm", reused_connection },
+				{ "avg_warm_ms", average(warm_stats_) },
+				{ "avg_cold_ms", average(cold_stats_) } });
+		}
+
+	private:
+		struct FirstByteStats
+		{
+			std::uint64_t count = 0;
+			std::chrono::milliseconds total{ 0 };
+		};
+
+		static void lock_callback(CURL*, curl_lock_data data, curl_lock_access, void* userptr)
+		{
+			static_cast<CdnConnectionWarmer*>(userptr)->share_locks_[static_cast<std::size_t>(data) % share_lock_count].lock();
+		}
+
+		static void unlock_callback(CURL*, curl_lock_data data, void* userptr)
+		{
+			static_cast<CdnConnectionWarmer*>(userptr)->share_locks_[static_cast<std::size_t>(data) % share_lock_count].unlock();
+		}
+
+		void run()
+		{
+			std::unique_lock<std::mutex> lock(state_mutex_);
+			while (!stopping_)
+			{
+				if (active_)
+				{
+					lock.unlock();
+					warm_once();
+					lock.lock();
+					state_cv_.wait_for(lock, std::chrono::seconds(config_.refresh_seconds), [this]()
+						{
+							return stopping_;
+						});
+				}
+				else
+				{
+					state_cv_.wait(lock, [this]()
+						{
+							return stopping_ || active_;
+						});
+				}
+			}
+		}
+
+		void warm_once()
+		{
+			for (const auto& host : dns_hosts_)
+			{
+				addrinfo hints{};
+				hints.ai_socktype = SOCK_STREAM;
+				addrinfo* result = nullptr;
+				if (getaddrinfo(host.c_str(), nullptr, &hints, &result) == 0)
+				{
+					freeaddrinfo(result);
+				}
+				else
+				{
+					log_debug("CDN 域名预解析失败", { { "host", host } });
+				}
+			}
+
+			if (http_origins_.empty())
+			{
+				return;
+			}
+
+			CURLM* multi = curl_multi_init();
+			if (!multi)
+			{
+				return;
+			}
+
+			// 每个源站并发发出若干个 HEAD 请求，使共享连接池中保持相应数量的空闲长连接；
+			// 连接已存在时请求会复用它，同时起到保活作用
+			const auto count = http_origins_.size() * static_cast<std::size_t>(config_.connections);
+			while (handles_.size() < count)
+			{
+				CURL* handle = curl_easy_init();
+				if (!handle)
+				{
+					break;
+				}
+				curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+				curl_easy_setopt(handle, CURLOPT_TIMEOUT, 10L);
+				curl_easy_setopt(handle, CURLOPT_SHARE, share_);
+				handles_.push_back(handle);
+			}
+
+			for (std::size_t i = 0; i < handles_.size(); ++i)
+			{
+				curl_easy_setopt(handles_[i], CURLOPT_URL, http_origins_[i % http_origins_.size()].c_str());
+				curl_multi_add_handle(multi, handles_[i]);
+			}
+
+			int running = 0;
+			do
+			{
+				if (curl_multi_perform(multi, &running) != CURLM_OK)
+				{
+					break;
+				}
+				if (running > 0)
+				{
+					curl_multi_wait(multi, nullptr, 0, 1000, nullptr);
+				}
+			} while (running > 0);
+
+			long new_connections = 0;
+			for (auto* handle : handles_)
+			{
+				long connects = 0;
+				curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+				new_connections += connects;
+				curl_multi_remove_handle(multi, handle);
+			}
+			curl_multi_cleanup(multi);
+
+			log_debug("CDN 连接预热完成", { { "origins", http_origins_.size() }, { "new_connections", new_connections } });
+		}
+
+		static constexpr std::size_t share_lock_count = 8;
+
+		const PrewarmConfig& config_;
+		CURLSH* share_ = nullptr;
+		std::array<std::mutex, share_lock_count> share_locks_;
+		std::vector<std::string> http_origins_;
+		std::vector<std::string> dns_hosts_;
+		std::vector<CURL*> handles_;
+
+		std::mutex state_mutex_;
+		std::condition_variable state_cv_;
+		bool active_ = false;
+		bool stopping_ = false;
+		FirstByteStats warm_stats_;
+		FirstByteStats cold_stats_;
+		std::thread thread_;
+	};
+
+	// 进程内的 FLV 整理与写入：把录制进程输出的字节流切分为标签，丢弃无法识别的数据，
+	// 修正断线重连造成的时间戳回退，再以大块顺序写入最终文件，数据只落盘一次
+	class FlvRemuxWriter
+	{
+	public:
+		// 攒满 flush_threshold 字节才写盘
+		FlvRemuxWriter(const fs::path& output_path, std::size_t flush_threshold, RelayPublication* relay, std::optional<FlvResumePoint> resume = std::nullopt)
+			: flush_threshold_(flush_threshold), relay_(relay), rewriter_(resume)
+		{
+			if (resume)
+			{
+				hash_existing_file(hasher_, output_path);
+			}
+			output_.open(output_path, std::ios::binary | (resume ? std::ios::app : std::ios::trunc));
+			if (!output_)
+			{
+				throw std::runtime_error("无法创建录制文件: " + output_path.string());
+			}
+			buffer_.reserve(flush_threshold_ + 64 * 1024);
+			memory_.set(buffer_.capacity());
+		}
+
+		FlvRemuxWriter(const FlvRemuxWriter&) = delete;
+		FlvRemuxWriter& operator=(const FlvRemuxWriter&) = delete;
+
+		void feed(const char* data, std::size_t size)
+		{
+			if (relay_)
+			{
+				relay_->feed(data, size);
+			}
+
+			rewriter_.feed(data, size, buffer_);
+			if (rewriter_.failed())
+			{
+				throw std::runtime_error("录制进程输出的不是 FLV 数据");
+			}
+			if (buffer_.size() >= flush_threshold_)
+			{
+				memory_.set(buffer_.capacity());
+				flush();
+			}
+		}
+
+		void flush()
+		{
+			if (buffer_.empty())
+			{
+				return;
+			}
+			output_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+			output_.flush();
+			if (!output_)
+			{
+				throw std::runtime_error("写入录制文件失败");
+			}
+			hasher_.update(buffer_.data(), buffer_.size());
+			buffer_.clear();
+		}
+
+		std::uint64_t tags_written() const
+		{
+			return rewriter_.tags_written();
+		}
+
+		std::uint64_t timestamp_repairs() const
+		{
+			return rewriter_.timestamp_repairs();
+		}
+
+		// 哈希覆盖已经写入文件的全部字节
+		const Blake3Hasher& hasher() const
+		{
+			return hasher_;
+		}
+
+	private:
+		const std::size_t flush_threshold_;
+		std::ofstream output_;
+		RelayPublication* relay_ = nullptr;
+		FlvTagRewriter rewriter_;
+		Blake3Hasher hasher_;
+		std::string buffer_;
+		MemoryCharge memory_{ MemorySubsystem::recording_buffers };
+	};
+
+	// 候选标签头：类型字节为音频/视频/脚本，且偏移 8..10 的 StreamID 为 0
+	bool is_flv_tag_candidate(const unsigned char* data)
+	{
+		return (data[0] == flv_tag_audio || data[0] == flv_tag_video || data[0] == flv_tag_script) && data[8] == 0 && data[9] == 0 && data[10] == 0;
+	}
+
+	// 在 [begin, end) 中查找下一个候选标签头的起点，end 之后至少还要有标签头剩余的字节；
+	// x86 上每次比较 16 个位置，绝大多数载荷数据在这里就被排除，不必逐字节做完整校验
+	std::size_t find_flv_tag_candidate(const unsigned char* data, std::size_t begin, std::size_t end)
+	{
+		std::size_t pos = begin;
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		const __m128i audio = _mm_set1_epi8(static_cast<char>(flv_tag_audio));
+		const __m128i video = _mm_set1_epi8(static_cast<char>(flv_tag_video));
+		const __m128i script = _mm_set1_epi8(static_cast<char>(flv_tag_script));
+		const __m128i zero = _mm_setzero_si128();
+		for (; pos + 16 <= end; pos += 16)
+		{
+			const __m128i type = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+			const __m128i stream_id = _mm_or_si128(_mm_or_si128(
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + 8)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + 9))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos + 10)));
+			const __m128i type_match = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(type, audio), _mm_cmpeq_epi8(type, video)), _mm_cmpeq_epi8(type, script));
+			const int mask = _mm_movemask_epi8(_mm_and_si128(type_match, _mm_cmpeq_epi8(stream_id, zero)));
+			if (mask != 0)
+			{
+#ifdef _MSC_VER
+				unsigned long bit = 0;
+				_BitScanForward(&bit, static_cast<unsigned long>(mask));
+				return pos + bit;
+#else
+				return pos + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+#endif
+			}
+		}
+#endif
+		for (; pos < end; ++pos)
+		{
+			if (is_flv_tag_candidate(data + pos))
+			{
+				return pos;
+			}
+		}
+		return end;
+	}
+
+	// 映射中一个可信的标签；payload 指向映射内的数据，时间戳已经过规整
+	struct FlvIndexedTag
+	{
+		const unsigned char* payload = nullptr;
+		std::uint32_t size = 0;
+		std::uint32_t timestamp = 0;
+		std::uint8_t type = 0;
+		bool keyframe = false;
+	};
+
+	struct FlvScanResult
+	{
+		std::uint8_t header_flags = 0x05;
+		// 原文件中第一个 onMetaData 的载荷
+		std::optional<std::string_view> metadata;
+		std::vector<FlvIndexedTag> tags;
+		std::uint64_t skipped_bytes = 0;
+		std::uint64_t resyncs = 0;
+		std::uint64_t dropped_tags = 0;
+		std::uint64_t timestamp_repairs = 0;
+	};
+
+	bool is_flv_metadata(std::string_view payload)
+	{
+		return payload.size() >= 13 && payload.substr(0, 13) == std::string_view("\x02\x00\x0AonMetaData", 13);
+	}
+
+	// 扫描映射中的 FLV 数据，找出可信的标签边界。标签需同时满足类型、StreamID、长度与 PreviousTagSize 一致；
+	// 失去同步后的候选还要求紧随其后的标签同样有效且时间戳连续，以排除载荷中偶然形似标签头的数据
+	class FlvTagScanner
+	{
+	public:
+		FlvTagScanner(const unsigned char* data, std::size_t size)
+			: data_(data), size_(size)
+		{
+		}
+
+		FlvScanResult scan() const
+		{
+			FlvScanResult result;
+			std::size_t pos = 0;
+			bool synced = false;
+			if (size_ >= flv_header_size + 4 && std::memcmp(data_, "FLV", 3) == 0)
+			{
+				result.header_flags = data_[4];
+				pos = std::max<std::size_t>(read_be32(data_ + 5), flv_header_size) + 4;
+				synced = true;
+			}
+			else
+			{
+				log_warn("FLV 文件头缺失或损坏，从头搜索标签");
+			}
+
+			FlvTimestampNormalizer timestamps;
+			bool awaiting_keyframe = false;
+			// 候选搜索需要读取标签头的全部 11 字节
+			const std::size_t search_end = size_ > flv_tag_header_size ? size_ - flv_tag_header_size : 0;
+			while (pos < size_)
+			{
+				auto view = tag_at(pos);
+				if (!view || (!synced && !plausible_after_resync(pos, *view)))
+				{
+					const std::size_t next = find_flv_tag_candidate(data_, pos + 1, search_end);
+					if (synced)
+					{
+						++result.resyncs;
+						synced = false;
+						awaiting_keyframe = true;
+					}
+					result.skipped_bytes += (next < search_end ? next : size_) - pos;
+					pos = next < search_end ? next : size_;
+					continue;
+				}
+				synced = true;
+
+				const std::string_view payload(reinterpret_cast<const char*>(data_ + pos + flv_tag_header_size), view->size);
+				const bool sequence_header = is_sequence_header(view->type, payload);
+				const bool keyframe = view->type == flv_tag_video && !sequence_header && is_video_keyframe(payload);
+				const std::size_t next = pos + flv_tag_header_size + view->size + 4;
+
+				// 旧的 onMetaData 会被重建的元数据取代；失去同步后丢弃视频直到下一个关键帧，避免花屏
+				bool keep = true;
+				if (view->type == flv_tag_script && is_flv_metadata(payload))
+				{
+					if (!result.metadata)
+					{
+						result.metadata = payload;
+					}
+					keep = false;
+				}
+				else if (view->type == flv_tag_video && awaiting_keyframe && !sequence_header)
+				{
+					if (keyframe)
+					{
+						awaiting_keyframe = false;
+					}
+					else
+					{
+						++result.dropped_tags;
+						keep = false;
+					}
+				}
+
+				if (keep)
+				{
+					FlvIndexedTag tag;
+					tag.payload = data_ + pos + flv_tag_header_size;
+					tag.size = view->size;
+					tag.type = view->type;
+					tag.keyframe = keyframe;
+					tag.timestamp = timestamps.next(view->type, view->timestamp, sequence_header);
+					result.tags.push_back(tag);
+				}
+				pos = next;
+			}
+
+			result.timestamp_repairs = timestamps.repairs();
+			return result;
+		}
+
+	private:
+		static constexpr std::int64_t max_resync_backward_ms = 1000;
+		static constexpr std::int64_t max_resync_forward_ms = 60 * 1000;
+
+		struct TagView
+		{
+			std::uint8_t type = 0;
+			std::uint32_t size = 0;
+			std::uint32_t timestamp = 0;
+		};
+
+		std::optional<TagView> tag_at(std::size_t pos) const
+		{
+			if (size_ - pos < flv_tag_header_size + 4 || !is_flv_tag_candidate(data_ + pos))
+			{
+				return std::nullopt;
+			}
+			TagView view;
+			view.type = data_[pos];
+			view.size = read_be24(data_ + pos + 1);
+			view.timestamp = read_be24(data_ + pos + 4) | (static_cast<std::uint32_t>(data_[pos + 7]) << 24);
+			const std::size_t total = flv_tag_header_size + view.size + 4;
+			if (view.size == 0 || size_ - pos < total || read_be32(data_ + pos + total - 4) != view.size + flv_tag_header_size)
+			{
+				return std::nullopt;
+			}
+			return view;
+		}
+
+		bool plausible_after_resync(std::size_t pos, const TagView& view) const
+		{
+			const std::size_t next = pos + flv_tag_header_size + view.size + 4;
+			if (next == size_)
+			{
+				return true;
+			}
+			const auto following = tag_at(next);
+			if (!following)
+			{
+				return false;
+			}
+			const auto delta = static_cast<std::int64_t>(following->timestamp) - static_cast<std::int64_t>(view.timestamp);
+			return delta >= -max_resync_backward_ms && delta <= max_resync_forward_ms;
+		}
+
+		const unsigned char* data_ = nullptr;
+		std::size_t size_ = 0;
+	};
+
+	// 找到已有录制中最后一个完整标签的结尾，截掉其后的残缺数据并返回续写位置；
+	// 连文件头都没写完时截为空文件、bytes 为 0；文件不存在或不是 FLV 时返回 nullopt
+	std::optional<FlvResumePoint> prepare_flv_resume(const fs::path& path)
+	{
+		std::error_code ec;
+		if (!fs::is_regular_file(path, ec))
+		{
+			return std::nullopt;
+		}
+
+		FlvResumePoint point;
+		std::size_t original_size = 0;
+		{
+			const MappedFile mapped(path);
+			const auto* data = mapped.data();
+			original_size = mapped.size();
+			if (original_size < flv_header_size + 4)
+			{
+				if (original_size > 0)
+				{
+					fs::resize_file(path, 0);
+				}
+				return point;
+			}
+			if (std::memcmp(data, "FLV", 3) != 0)
+			{
+				return std::nullopt;
+			}
+
+			std::size_t pos = std::max<std::size_t>(read_be32(data + 5), flv_header_size) + 4;
+			if (pos > original_size)
+			{
+				return std::nullopt;
+			}
+			point.bytes = pos;
+			while (original_size - pos >= flv_tag_header_size + 4 && is_flv_tag_candidate(data + pos))
+			{
+				const std::size_t data_size = read_be24(data + pos + 1);
+				const std::size_t total = flv_tag_header_size + data_size + 4;
+				if (original_size - pos < total || read_be32(data + pos + total - 4) != data_size + flv_tag_header_size)
+				{
+					break;
+				}
+				const std::uint32_t timestamp = read_be24(data + pos + 4) | (static_cast<std::uint32_t>(data[pos + 7]) << 24);
+				point.last_timestamp = std::max(point.last_timestamp, timestamp);
+				pos += total;
+				point.bytes = pos;
+			}
+		}
+
+		if (point.bytes < original_size)
+		{
+			fs::resize_file(path, point.bytes);
+			log_info("已截掉录制末尾不完整的标签", { { "path", path }, { "dropped_bytes", original_size - point.bytes } });
+		}
+		return point;
+	}
+
+	void append_amf_string(std::string& out, std::string_view value)
+	{
+		out.push_back(static_cast<char>((value.size() >> 8) & 0xFF));
+		out.push_back(static_cast<char>(value.size() & 0xFF));
+		out.append(value);
+	}
+
+	void append_amf_number(std::string& out, double value)
+	{
+		std::uint64_t bits = 0;
+		std::memcpy(&bits, &value, sizeof(bits));
+		out.push_back(0x00);
+		append_be32(out, static_cast<std::uint32_t>(bits >> 32));
+		append_be32(out, static_cast<std::uint32_t>(bits & 0xFFFFFFFF));
+	}
+
+	// 跳过一个 AMF0 值，返回其后的偏移；无法识别时返回 nullopt
+	std::optional<std::size_t> skip_amf_value(std::string_view data, std::size_t pos, int depth = 0)
+	{
+		if (pos >= data.size() || depth > 16)
+		{
+			return std::nullopt;
+		}
+		const auto* bytes = reinterpret_cast<const unsigned char*>(data.data());
+		const auto need = [&](std::size_t count) -> std::optional<std::size_t>
+			{
+				return data.size() - pos >= count ? std::optional<std::size_t>(pos + count) : std::nullopt;
+			};
+		const auto skip_properties = [&](std::size_t at) -> std::optional<std::size_t>
+			{
+				while (data.size() - at >= 3)
+				{
+					const std::size_t key_size = (static_cast<std::size_t>(bytes[at]) << 8) | bytes[at + 1];
+					if (key_size == 0 && bytes[at + 2] == 0x09)
+					{
+						return at + 3;
+					}
+					if (data.size() - at < 2 + key_size)
+					{
+						return std::nullopt;
+					}
+					const auto value_end = skip_amf_value(data, at + 2 + key_size, depth + 1);
+					if (!value_end)
+					{
+						return std::nullopt;
+					}
+					at = *value_end;
+				}
+				return std::nullopt;
+			};
+
+		switch (bytes[pos])
+		{
+		case 0x00:
+			return need(9);
+		case 0x01:
+			return need(2);
+		case 0x02:
+			if (data.size() - pos < 3)
+			{
+				return std::nullopt;
+			}
+			return need(3 + ((static_cast<std::size_t>(bytes[pos + 1]) << 8) | bytes[pos + 2]));
+		case 0x03:
+			return skip_properties(pos + 1);
+		case 0x05:
+		case 0x06:
+			return need(1);
+		case 0x08:
+			if (data.size() - pos < 5)
+			{
+				return std::nullopt;
+			}
+			return skip_properties(pos + 5);
+		case 0x0A:
+		{
+			if (data.size() - pos < 5)
+			{
+				return std::nullopt;
+			}
+			const std::uint32_t count = read_be32(bytes + pos + 1);
+			std::size_t at = pos + 5;
+			for (std::uint32_t i = 0; i < count; ++i)
+			{
+				const auto value_end = skip_amf_value(data, at, depth + 1);
+				if (!value_end)
+				{
+					return std::nullopt;
+				}
+				at = *value_end;
+			}
+			return at;
+		}
+		case 0x0B:
+			return need(11);
+		case 0x0C:
+			if (data.size() - pos < 5)
+			{
+				return std::nullopt;
+			}
+			return need(5 + read_be32(bytes + pos + 1));
+		default:
+			return std::nullopt;
+		}
+	}
+
+	// 保留原 onMetaData 中的宽高、码率、编码等简单属性，时长、大小与关键帧相关字段由重建结果重新生成
+	std::vector<std::string_view> reusable_metadata_properties(std::string_view metadata)
+	{
+		std::vector<std::string_view> properties;
+		const auto* bytes = reinterpret_cast<const unsigned char*>(metadata.data());
+		std::size_t pos = 13;
+		if (pos >= metadata.size())
+		{
+			return properties;
+		}
+		if (bytes[pos] == 0x08)
+		{
+			pos += 5;
+		}
+		else if (bytes[pos] == 0x03)
+		{
+			pos += 1;
+		}
+		else
+		{
+			return properties;
+		}
+
+		static constexpr std::array<std::string_view, 6> regenerated = { "duration", "filesize", "lasttimestamp", "lastkeyframetimestamp", "hasKeyframes", "keyframes" };
+		while (metadata.size() - pos >= 3)
+		{
+			const std::size_t key_size = (static_cast<std::size_t>(bytes[pos]) << 8) | bytes[pos + 1];
+			if (key_size == 0 || metadata.size() - pos < 3 + key_size)
+			{
+				break;
+			}
+			const std::string_view key = metadata.substr(pos + 2, key_size);
+			const std::size_t value_pos = pos + 2 + key_size;
+			const auto value_end = skip_amf_value(metadata, value_pos);
+			if (!value_end)
+			{
+				break;
+			}
+			const auto value_type = bytes[value_pos];
+			if ((value_type == 0x00 || value_type == 0x01 || value_type == 0x02)
+				&& std::find(regenerated.begin(), regenerated.end(), key) == regenerated.end())
+			{
+				properties.push_back(metadata.substr(pos, *value_end - pos));
+			}
+			pos = *value_end;
+		}
+		return properties;
+	}
+
+	std::string build_flv_metadata(const std::vector<std::string_view>& properties, std::uint64_t file_size, std::uint32_t duration_ms,
+		const std::vector<std::uint64_t>& keyframe_positions, const std::vector<std::uint32_t>& keyframe_times)
+	{
+		std::string out;
+		out.push_back(0x02);
+		append_amf_string(out, "onMetaData");
+		out.push_back(0x08);
+		append_be32(out, static_cast<std::uint32_t>(properties.size() + 5));
+		for (const auto property : properties)
+		{
+			out.append(property);
+		}
+
+		append_amf_string(out, "duration");
+		append_amf_number(out, duration_ms / 1000.0);
+		append_amf_string(out, "filesize");
+		append_amf_number(out, static_cast<double>(file_size));
+		append_amf_string(out, "lasttimestamp");
+		append_amf_number(out, duration_ms / 1000.0);
+		append_amf_string(out, "hasKeyframes");
+		out.push_back(0x01);
+		out.push_back(keyframe_times.empty() ? 0x00 : 0x01);
+
+		append_amf_string(out, "keyframes");
+		out.push_back(0x03);
+		append_amf_string(out, "filepositions");
+		out.push_back(0x0A);
+		append_be32(out, static_cast<std::uint32_t>(keyframe_times.size()));
+		for (std::size_t i = 0; i < keyframe_times.size(); ++i)
+		{
+			append_amf_number(out, i < keyframe_positions.size() ? static_cast<double>(keyframe_positions[i]) : 0.0);
+		}
+		append_amf_string(out, "times");
+		out.push_back(0x0A);
+		append_be32(out, static_cast<std::uint32_t>(keyframe_times.size()));
+		for (const auto time : keyframe_times)
+		{
+			append_amf_number(out, time / 1000.0);
+		}
+		out.append("\x00\x00\x09", 3);
+		out.append("\x00\x00\x09", 3);
+		return out;
+	}
+
+	struct FlvWriteResult
+	{
+		std::uint64_t bytes = 0;
+		std::uint64_t keyframes = 0;
+		std::uint32_t duration_ms = 0;
+	};
+
+	// 把标签写成干净的 FLV，并在开头的 onMetaData 中重建关键帧索引（filepositions/times）
+	FlvWriteResult write_indexed_flv(const fs::path& output_path, std::uint8_t header_flags, std::optional<std::string_view> original_metadata,
+		const std::vector<FlvIndexedTag>& tags)
+	{
+		FlvWriteResult result;
+		std::vector<std::uint32_t> keyframe_times;
+		for (const auto& tag : tags)
+		{
+			result.duration_ms = std::max(result.duration_ms, tag.timestamp);
+			if (tag.keyframe)
+			{
+				keyframe_times.push_back(tag.timestamp);
+			}
+		}
+		result.keyframes = keyframe_times.size();
+
+		// 数值在 AMF0 中定长编码，先用占位值确定元数据大小，再据此计算各关键帧在输出中的位置
+		const auto properties = original_metadata ? reusable_metadata_properties(*original_metadata) : std::vector<std::string_view>{};
+		std::vector<std::uint64_t> keyframe_positions;
+		std::string metadata = build_flv_metadata(properties, 0, result.duration_ms, keyframe_positions, keyframe_times);
+		std::uint64_t position = flv_header_size + 4 + flv_tag_header_size + metadata.size() + 4;
+		keyframe_positions.reserve(keyframe_times.size());
+		for (const auto& tag : tags)
+		{
+			if (tag.keyframe)
+			{
+				keyframe_positions.push_back(position);
+			}
+			position += flv_tag_header_size + tag.size + 4;
+		}
+		metadata = build_flv_metadata(properties, position, result.duration_ms, keyframe_positions, keyframe_times);
+		result.bytes = position;
+
+		std::ofstream output(output_path, std::ios::binary | std::ios::trunc);
+		if (!output)
+		{
+			throw std::runtime_error("无法创建输出文件: " + output_path.string());
+		}
+
+		constexpr std::size_t flush_threshold = 4 * 1024 * 1024;
+		std::string buffer;
+		buffer.reserve(flush_threshold + 64 * 1024);
+		const auto flush = [&]()
+			{
+				output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+				if (!output)
+				{
+					throw std::runtime_error("写入输出文件失败: " + output_path.string());
+				}
+				buffer.clear();
+			};
+
+		append_flv_header(buffer, header_flags);
+		append_flv_tag(buffer, flv_tag_script, 0, metadata);
+		for (const auto& tag : tags)
+		{
+			append_flv_tag(buffer, tag.type, tag.timestamp, std::string_view(reinterpret_cast<const char*>(tag.payload), tag.size));
+			if (buffer.size() >= flush_threshold)
+			{
+				flush();
+			}
+		}
+		flush();
+		return result;
+	}
+
+	void ensure_distinct_output(const fs::path& input, const fs::path& output)
+	{
+		std::error_code ec;
+		if (fs::exists(output, ec) && fs::equivalent(input, output, ec))
+		{
+			throw std::runtime_error("输出文件不能与输入文件相同: " + output.string());
+		}
+	}
+
+	fs::path default_repair_output(const fs::path& input)
+	{
+		fs::path output = input;
+		output.replace_filename(input.stem().string() + ".repaired.flv");
+		return output;
+	}
+
+	// 命令行工具入口：repair <输入.flv> [输出.flv]
+	int run_flv_repair(int argc, char* argv[])
+	{
+		if (argc < 3)
+		{
+			std::cerr << "用法: " << argv[0] << " repair <输入.flv> [输出.flv]" << std::endl;
+			return 2;
+		}
+
+		const fs::path input = argv[2];
+		const fs::path output = argc > 3 ? fs::path(argv[3]) : default_repair_output(input);
+		ensure_distinct_output(input, output);
+
+		const auto started = std::chrono::steady_clock::now();
+		const MappedFile mapped(input);
+		const auto scan = FlvTagScanner(mapped.data(), mapped.size()).scan();
+		if (scan.tags.empty())
+		{
+			throw std::runtime_error("未找到任何有效的 FLV 标签");
+		}
+		const auto written = write_indexed_flv(output, scan.header_flags, scan.metadata, scan.tags);
+		const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+		log_info("FLV 修复完成", {
+			{ "input", input.string() },
+			{ "output", output.string() },
+			{ "tags", scan.tags.size() },
+			{ "keyframes", written.keyframes },
+			{ "resyncs", scan.resyncs },
+			{ "skipped_bytes", scan.skipped_bytes },
+			{ "dropped_tags", scan.dropped_tags },
+			{ "timestamp_repairs", scan.timestamp_repairs },
+			{ "duration_s", written.duration_ms / 1000.0 },
+			{ "mb_per_s", elapsed > 0 ? mapped.size() / elapsed / (1024.0 * 1024.0) : 0.0 } });
+		return 0;
+	}
+
+	// 关键帧载荷在同一路流的不同录制中逐字节相同，用其哈希在两段录制之间找共同的关键帧
+	std::uint64_t keyframe_fingerprint(const FlvIndexedTag& tag)
+	{
+		Blake3Hasher hasher;
+		hasher.update(tag.payload, tag.size);
+		const auto digest = hasher.finalize();
+		std::uint64_t fingerprint = 0;
+		std::memcpy(&fingerprint, digest.data(), sizeof(fingerprint));
+		return fingerprint;
+	}
+
+	struct FlvMergeResult
+	{
+		std::vector<FlvIndexedTag> tags;
+		// 两段录制共同覆盖的时长
+		std::uint32_t shared_ms = 0;
+		bool contained = false;
+	};
+
+	// 以共同关键帧对齐两段录制的时间轴：保留较早一段直到最后一个共同关键帧，其后接上另一段，重叠部分只保留一份。
+	// 没有共同关键帧时返回 nullopt
+	std::optional<FlvMergeResult> merge_overlapping_recordings(const std::vector<FlvIndexedTag>& first, const std::vector<FlvIndexedTag>& second)
+	{
+		std::unordered_map<std::uint64_t, std::size_t> first_keyframes;
+		for (std::size_t i = 0; i < first.size(); ++i)
+		{
+			if (first[i].keyframe)
+			{
+				first_keyframes[keyframe_fingerprint(first[i])] = i;
+			}
+		}
+
+		std::optional<std::pair<std::size_t, std::size_t>> first_match;
+		std::optional<std::pair<std::size_t, std::size_t>> last_match;
+		for (std::size_t j = 0; j < second.size(); ++j)
+		{
+			if (!second[j].keyframe)
+			{
+				continue;
+			}
+			const auto it = first_keyframes.find(keyframe_fingerprint(second[j]));
+			if (it == first_keyframes.end() || first[it->second].size != second[j].size
+				|| std::memcmp(first[it->second].payload, second[j].payload, second[j].size) != 0)
+			{
+				continue;
+			}
+			if (!first_match)
+			{
+				first_match.emplace(it->second, j);
+			}
+			last_match.emplace(it->second, j);
+		}
+		if (!first_match)
+		{
+			return std::nullopt;
+		}
+
+		// 共同关键帧之前内容更长的一段开始得更早，作为合并结果的前半部分
+		const auto lead_first = first[first_match->first].timestamp - first.front().timestamp;
+		const auto lead_second = second[first_match->second].timestamp - second.front().timestamp;
+		if (lead_second > lead_first)
+		{
+			return merge_overlapping_recordings(second, first);
+		}
+
+		const auto offset = static_cast<std::int64_t>(first[last_match->first].timestamp) - static_cast<std::int64_t>(second[last_match->second].timestamp);
+		FlvMergeResult result;
+		result.shared_ms = first[last_match->first].timestamp - first[first_match->first].timestamp;
+		if (static_cast<std::int64_t>(second.back().timestamp) + offset <= static_cast<std::int64_t>(first.back().timestamp))
+		{
+			result.contained = true;
+			result.tags = first;
+			return result;
+		}
+
+		result.tags.assign(first.begin(), first.begin() + static_cast<std::ptrdiff_t>(last_match->first));
+		result.tags.reserve(result.tags.size() + second.size() - last_match->second);
+		for (std::size_t j = last_match->second; j < second.size(); ++j)
+		{
+			auto tag = second[j];
+			tag.timestamp = static_cast<std::uint32_t>(std::max<std::int64_t>(tag.timestamp + offset, 0));
+			result.tags.push_back(tag);
+		}
 		return result;
 	}
+
+	// 命令行工具入口：dedup <输出.flv> <输入1.flv> <输入2.flv> [...]，合并同一直播间重叠的多段录制
+	int run_flv_dedup(int argc, char* argv[])
+	{
+		if (argc < 5)
+		{
+			std::cerr << "用法: " << argv[0] << " dedup <输出.flv> <输入1.flv> <输入2.flv> [...]" << std::endl;
+			return 2;
+		}
+
+		const fs::path output = argv[2];
+		std::deque<MappedFile> mapped;
+		std::vector<FlvIndexedTag> timeline;
+		std::uint8_t header_flags = 0x05;
+		std::optional<std::string_view> metadata;
+		for (int i = 3; i < argc; ++i)
+		{
+			const fs::path input = argv[i];
+			ensure_distinct_output(input, output);
+			const auto& file = mapped.emplace_back(input);
+			auto scan = FlvTagScanner(file.data(), file.size()).scan();
+			if (scan.tags.empty())
+			{
+				throw std::runtime_error("未找到任何有效的 FLV 标签: " + input.string());
+			}
+
+			if (timeline.empty())
+			{
+				header_flags = scan.header_flags;
+				metadata = scan.metadata;
+				timeline = std::move(scan.tags);
+				continue;
+			}
+
+			auto merged = merge_overlapping_recordings(timeline, scan.tags);
+			if (!merged)
+			{
+				throw std::runtime_error("与之前的录制没有共同的关键帧，无法对齐: " + input.string());
+			}
+			log_info("已对齐重叠录制", {
+				{ "input", input.string() },
+				{ "shared_s", merged->shared_ms / 1000.0 },
+				{ "contained", merged->contained } });
+			timeline = std::move(merged->tags);
+		}
+
+		const auto written = write_indexed_flv(output, header_flags, metadata, timeline);
+		log_info("重叠录制合并完成", {
+			{ "output", output.string() },
+			{ "inputs", argc - 3 },
+			{ "tags", timeline.size() },
+			{ "keyframes", written.keyframes },
+			{ "duration_s", written.duration_ms / 1000.0 } });
+		return 0;
+	}
+
+	struct RecorderProgress
+	{
+		std::uint64_t bytes = 0;
+		double media_seconds = 0.0;
+		double kbps = 0.0;
+	};
+
+	// 增量解析录制进程的输出：rtmpdump 在 stderr 以 \r 刷新 "123.456 kB / 7.89 sec" 形式的进度，
+	// ffmpeg 的 -progress 输出为 key=value 行；custom 命令两种格式都尝试
+	class RecorderOutputParser
+	{
+	public:
+		explicit RecorderOutputParser(RecorderKind kind)
+			: kind_(kind)
+		{
+		}
+
+		// 返回本次输入是否带来了新的进度
+		bool feed(std::string_view chunk, bool from_stderr)
+		{
+			auto& pending = from_stderr ? stderr_line_ : stdout_line_;
+			bool updated = false;
+			for (const char ch : chunk)
+			{
+				if (ch == '\r' || ch == '\n')
+				{
+					if (!pending.empty())
+					{
+						updated |= parse_line(pending);
+						pending.clear();
+					}
+				}
+				else if (pending.size() < max_line_length)
+				{
+					pending.push_back(ch);
+				}
+			}
+			return updated;
+		}
+
+		const RecorderProgress& progress() const
+		{
+			return progress_;
+		}
+
+		// 最近一行非进度输出，进程异常退出时用于诊断
+		const std::string& last_message() const
+		{
+			return last_message_;
+		}
+
+	private:
+		static constexpr std::size_t max_line_length = 4096;
+
+		bool parse_line(const std::string& line)
+		{
+			if (kind_ != RecorderKind::ffmpeg && parse_rtmpdump_line(line))
+			{
+				return true;
+			}
+			if (kind_ != RecorderKind::rtmpdump && is_progress_pair(line))
+			{
+				return parse_ffmpeg_pair(line);
+			}
+
+			const auto trimmed = trim_copy(line);
+			if (!trimmed.empty())
+			{
+				last_message_ = trimmed;
+			}
+			return false;
+		}
+
+		bool parse_rtmpdump_line(const std::string& line)
+		{
+			const auto kb_pos = line.find(" kB / ");
+			if (kb_pos == std::string::npos)
+			{
+				return false;
+			}
+
+			auto number_start = line.find_last_of(" \t", kb_pos == 0 ? 0 : kb_pos - 1);
+			number_start = number_start == std::string::npos ? 0 : number_start + 1;
+			char* end = nullptr;
+			const double kilobytes = std::strtod(line.c_str() + number_start, &end);
+			if (end != line.c_str() + kb_pos)
+			{
+				return false;
+			}
+
+			const char* seconds_start = line.c_str() + kb_pos + 6;
+			const double seconds = std::strtod(seconds_start, &end);
+			if (end == seconds_start)
+			{
+				return false;
+			}
+
+			progress_.bytes = static_cast<std::uint64_t>(kilobytes * 1024.0);
+			progress_.media_seconds = seconds;
+			progress_.kbps = seconds > 0.0 ? kilobytes * 1024.0 * 8.0 / 1000.0 / seconds : 0.0;
+			return true;
+		}
+
+		static bool is_progress_pair(const std::string& line)
+		{
+			const auto separator = line.find('=');
+			return separator != std::string::npos && separator > 0
+				&& std::all_of(line.begin(), line.begin() + static_cast<std::ptrdiff_t>(separator), [](char ch)
+					{
+						return std::islower(static_cast<unsigned char>(ch)) || std::isdigit(static_cast<unsigned char>(ch)) || ch == '_';
+					});
+		}
+
+		// 每组键值以 progress=continue/end 结尾，此时才算得到一次完整的进度
+		bool parse_ffmpeg_pair(const std::string& line)
+		{
+			const auto separator = line.find('=');
+			const std::string_view key(line.data(), separator);
+			const char* value = line.c_str() + separator + 1;
+			if (key == "total_size")
+			{
+				progress_.bytes = std::strtoull(value, nullptr, 10);
+			}
+			else if (key == "out_time_us" || key == "out_time_ms")
+			{
+				// 两个字段的单位实际上都是微秒
+				progress_.media_seconds = static_cast<double>(std::strtoll(value, nullptr, 10)) / 1'000'000.0;
+			}
+			else if (key == "progress")
+			{
+				if (progress_.media_seconds > 0.0)
+				{
+					progress_.kbps = static_cast<double>(progress_.bytes) * 8.0 / 1000.0 / progress_.media_seconds;
+				}
+				return true;
+			}
+			return false;
+		}
+
+		RecorderKind kind_;
+		std::string stdout_line_;
+		std::string stderr_line_;
+		RecorderProgress progress_;
+		std::string last_message_;
+	};
+
+	struct RecorderExit
+	{
+		int exit_code = 0;
+		int signal = 0;
+		// 非空表示进程被主动终止的原因
+		std::string kill_reason;
+		std::string last_message;
+	};
+
+	class ProcessSupervisor;
+	struct IoServices;
+
+#ifdef __linux__
+	// 单个 epoll 线程监管所有录制子进程：读取其输出管道、解析进度、检查停止请求与超时，并回收退出的进程。
+	// 录制线程调用 run() 后只在条件变量上等待结果。
+	class ProcessSupervisor
+	{
+	public:
+		ProcessSupervisor()
+		{
+			epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+			wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			if (epoll_fd_ < 0 || wake_fd_ < 0)
+			{
+				throw std::runtime_error("无法初始化录制进程监管器");
+			}
+
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.u64 = wake_token;
+			epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+			thread_ = std::thread([this]()
+				{
+					Tracer::instance().set_thread_name("supervisor");
+					loop();
+				});
+		}
+
+		ProcessSupervisor(const ProcessSupervisor&) = delete;
+		ProcessSupervisor& operator=(const ProcessSupervisor&) = delete;
+
+		~ProcessSupervisor()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stopping_ = true;
+			}
+			wake();
+			if (thread_.joinable())
+			{
+				thread_.join();
+			}
+			close(wake_fd_);
+			close(epoll_fd_);
+		}
+
+		struct Limits
+		{
+			std::chrono::seconds stall_timeout{ 0 };
+			std::chrono::seconds max_duration{ 0 };
+		};
+
+		// stdout_consumer 非空时由调用线程以阻塞方式读取子进程的标准输出，epoll 线程只处理 stderr
+		RecorderExit run(const std::vector<std::string>& argv, RecorderKind kind, const fs::path& output_path, const std::string& room_id, CaptureControl* control, const Limits& limits,
+			const std::function<void(int)>& stdout_consumer = {})
+		{
+			auto child = std::make_shared<Child>(kind);
+			child->room_id = room_id;
+			child->output_path = output_path;
+			child->control = control;
+			child->limits = limits;
+			child->trace_first_byte = !stdout_consumer;
+			spawn(*child, argv, static_cast<bool>(stdout_consumer));
+
+			int consumer_fd = -1;
+			if (stdout_consumer)
+			{
+				std::swap(consumer_fd, child->stdout_fd);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				if (stopping_)
+				{
+					kill(child->pid, SIGKILL);
+				}
+				adopting_.push_back(child);
+			}
+			wake();
+
+			std::exception_ptr consumer_error;
+			if (consumer_fd >= 0)
+			{
+				try
+				{
+					stdout_consumer(consumer_fd);
+				}
+				catch (...)
+				{
+					// 子进程只有在被回收后 pid 才会失效，此时发送信号是安全的
+					consumer_error = std::current_exception();
+					kill(child->pid, SIGTERM);
+				}
+				close(consumer_fd);
+			}
+
+			std::unique_lock<std::mutex> lock(mutex_);
+			done_cv_.wait(lock, [&]()
+				{
+					return child->done;
+				});
+			if (consumer_error)
+			{
+				std::rethrow_exception(consumer_error);
+			}
+			return child->result;
+		}
+
+	private:
+		static constexpr std::uint64_t wake_token = std::numeric_limits<std::uint64_t>::max();
+		static constexpr auto kill_grace = std::chrono::seconds(5);
+		static constexpr auto progress_log_interval = std::chrono::seconds(60);
+
+		struct Child
+		{
+			explicit Child(RecorderKind kind)
+				: parser(kind)
+			{
+			}
+
+			pid_t pid = -1;
+			int stdout_fd = -1;
+			int stderr_fd = -1;
+			RecorderOutputParser parser;
+			std::string room_id;
+			fs::path output_path;
+			CaptureControl* control = nullptr;
+			Limits limits;
+			std::chrono::steady_clock::time_point started;
+			std::chrono::steady_clock::time_point last_activity;
+			std::chrono::steady_clock::time_point last_progress_log;
+			std::chrono::steady_clock::time_point term_sent_at;
+			std::uint64_t last_file_size = 0;
+			// 录制进程直接写文件时，由监督线程在文件首次出现数据时记录首字节区间
+			bool trace_first_byte = false;
+			bool term_sent = false;
+			bool done = false;
+			RecorderExit result;
+		};
+
+		void wake()
+		{
+			const std::uint64_t one = 1;
+			[[maybe_unused]] const auto written = write(wake_fd_, &one, sizeof(one));
+		}
+
+		void spawn(Child& child, const std::vector<std::string>& argv, bool blocking_stdout)
+		{
+			int stdout_pipe[2] = { -1, -1 };
+			int stderr_pipe[2] = { -1, -1 };
+			if (pipe2(stdout_pipe, O_CLOEXEC) != 0 || pipe2(stderr_pipe, O_CLOEXEC) != 0)
+			{
+				for (const int fd : { stdout_pipe[0], stdout_pipe[1] })
+				{
+					if (fd >= 0)
+					{
+						close(fd);
+					}
+				}
+				throw std::runtime_error("无法为录制进程创建管道: " + std::string(std::strerror(errno)));
+			}
+
+			posix_spawn_file_actions_t actions;
+			posix_spawn_file_actions_init(&actions);
+			posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+			posix_spawn_file_actions_adddup2(&actions, stdout_pipe[1], STDOUT_FILENO);
+			posix_spawn_file_actions_adddup2(&actions, stderr_pipe[1], STDERR_FILENO);
+
+			std::vector<char*> args;
+			args.reserve(argv.size() + 1);
+			for (const auto& arg : argv)
+			{
+				args.push_back(const_cast<char*>(arg.c_str()));
+			}
+			args.push_back(nullptr);
+
+			pid_t pid = -1;
+			int error = 0;
+			{
+				TraceSpan span("spawn", child.room_id);
+				error = posix_spawnp(&pid, args[0], &actions, nullptr, args.data(), environ);
+			}
+			posix_spawn_file_actions_destroy(&actions);
+			close(stdout_pipe[1]);
+			close(stderr_pipe[1]);
+			if (error != 0)
+			{
+				close(stdout_pipe[0]);
+				close(stderr_pipe[0]);
+				throw std::runtime_error("无法启动录制进程 " + argv[0] + ": " + std::strerror(error));
+			}
+
+			if (blocking_stdout)
+			{
+				// 加大管道容量，减少录制进程因父进程来不及读取而阻塞的次数
+				fcntl(stdout_pipe[0], F_SETPIPE_SZ, 1 << 20);
+			}
+			else
+			{
+				fcntl(stdout_pipe[0], F_SETFL, fcntl(stdout_pipe[0], F_GETFL) | O_NONBLOCK);
+			}
+			fcntl(stderr_pipe[0], F_SETFL, fcntl(stderr_pipe[0], F_GETFL) | O_NONBLOCK);
+
+			child.pid = pid;
+			child.stdout_fd = stdout_pipe[0];
+			child.stderr_fd = stderr_pipe[0];
+			child.started = std::chrono::steady_clock::now();
+			child.last_activity = child.started;
+			child.last_progress_log = child.started;
+		}
+
+		void loop()
+		{
+			std::vector<std::shared_ptr<Child>> children;
+			std::array<epoll_event, 64> events{};
+			std::array<char, 64 * 1024> buffer{};
+
+			while (true)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					for (auto& child : adopting_)
+					{
+						watch(*child);
+						children.push_back(std::move(child));
+					}
+					adopting_.clear();
+					if (stopping_ && children.empty())
+					{
+						return;
+					}
+				}
+
+				const int count = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), 500);
+				for (int i = 0; i < count; ++i)
+				{
+					const auto token = events[static_cast<std::size_t>(i)].data.u64;
+					if (token == wake_token)
+					{
+						std::uint64_t value = 0;
+						[[maybe_unused]] const auto drained = read(wake_fd_, &value, sizeof(value));
+						continue;
+					}
+
+					// token 低位区分 stdout/stderr，高位是子进程的 pid
+					const auto pid = static_cast<pid_t>(token >> 1);
+					const bool is_stderr = (token & 1) != 0;
+					const auto it = std::find_if(children.begin(), children.end(), [&](const auto& child)
+						{
+							return child->pid == pid;
+						});
+					if (it != children.end())
+					{
+						drain(**it, is_stderr, buffer);
+					}
+				}
+
+				const auto now = std::chrono::steady_clock::now();
+				bool stopping = false;
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					stopping = stopping_;
+				}
+				for (auto& child : children)
+				{
+					supervise(*child, now, stopping);
+				}
+
+				bool finished = false;
+				for (auto& child : children)
+				{
+					finished |= reap(*child, buffer);
+				}
+				if (finished)
+				{
+					{
+						std::lock_guard<std::mutex> lock(mutex_);
+						children.erase(std::remove_if(children.begin(), children.end(), [](const auto& child)
+							{
+								return child->done;
+							}), children.end());
+					}
+					done_cv_.notify_all();
+				}
+			}
+		}
+
+		void watch(const Child& child)
+		{
+			for (const bool is_stderr : { false, true })
+			{
+				if ((is_stderr ? child.stderr_fd : child.stdout_fd) < 0)
+				{
+					continue;
+				}
+				epoll_event event{};
+				event.events = EPOLLIN | EPOLLRDHUP;
+				event.data.u64 = (static_cast<std::uint64_t>(child.pid) << 1) | (is_stderr ? 1u : 0u);
+				epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, is_stderr ? child.stderr_fd : child.stdout_fd, &event);
+			}
+		}
+
+		void drain(Child& child, bool is_stderr, std::array<char, 64 * 1024>& buffer)
+		{
+			int& fd = is_stderr ? child.stderr_fd : child.stdout_fd;
+			while (fd >= 0)
+			{
+				const auto received = read(fd, buffer.data(), buffer.size());
+				if (received > 0)
+				{
+					if (child.parser.feed(std::string_view(buffer.data(), static_cast<std::size_t>(received)), is_stderr))
+					{
+						child.last_activity = std::chrono::steady_clock::now();
+					}
+					continue;
+				}
+				if (received < 0 && (errno == EAGAIN || errno == EINTR))
+				{
+					return;
+				}
+
+				epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+				close(fd);
+				fd = -1;
+			}
+		}
+
+		void terminate(Child& child, std::string reason)
+		{
+			if (child.term_sent)
+			{
+				return;
+			}
+			log_warn("终止录制进程", { { "room_id", child.room_id }, { "pid", static_cast<int>(child.pid) }, { "reason", reason } });
+			kill(child.pid, SIGTERM);
+			child.term_sent = true;
+			child.term_sent_at = std::chrono::steady_clock::now();
+			child.result.kill_reason = std::move(reason);
+		}
+
+		void supervise(Child& child, std::chrono::steady_clock::time_point now, bool stopping)
+		{
+			std::error_code size_ec;
+			const auto size = fs::file_size(child.output_path, size_ec);
+			if (!size_ec && size != child.last_file_size)
+			{
+				child.last_file_size = size;
+				child.last_activity = now;
+			}
+
+			if (child.control)
+			{
+				const auto bytes = std::max<std::uint64_t>(size_ec ? 0 : size, child.parser.progress().bytes);
+				child.control->bytes_written.store(bytes, std::memory_order_relaxed);
+				if (child.trace_first_byte && bytes > 0)
+				{
+					child.trace_first_byte = false;
+					Tracer::instance().record("first_byte", child.started, now, child.room_id);
+				}
+			}
+
+			if (now - child.last_progress_log >= progress_log_interval)
+			{
+				child.last_progress_log = now;
+				const auto& progress = child.parser.progress();
+				log_info("录制进度", {
+					{ "room_id", child.room_id },
+					{ "written_kb", child.last_file_size / 1024 },
+					{ "media_seconds", progress.media_seconds },
+					{ "kbps", progress.kbps } });
+			}
+
+			if (child.term_sent)
+			{
+				if (now - child.term_sent_at >= kill_grace)
+				{
+					kill(child.pid, SIGKILL);
+				}
+				return;
+			}
+
+			if (stopping)
+			{
+				terminate(child, "程序退出");
+			}
+			else if (child.control && child.control->stop_requested.load(std::memory_order_relaxed))
+			{
+				terminate(child, "调度要求停止");
+			}
+			else if (child.limits.stall_timeout.count() > 0 && now - child.last_activity >= child.limits.stall_timeout)
+			{
+				terminate(child, "长时间没有进度");
+			}
+			else if (child.limits.max_duration.count() > 0 && now - child.started >= child.limits.max_duration)
+			{
+				terminate(child, "超过最长录制时长");
+			}
+		}
+
+		bool reap(Child& child, std::array<char, 64 * 1024>& buffer)
+		{
+			int status = 0;
+			const auto result = waitpid(child.pid, &status, WNOHANG);
+			if (result == 0)
+			{
+				return false;
+			}
+
+			// 进程已退出，读完管道中剩余的输出
+			drain(child, false, buffer);
+			drain(child, true, buffer);
+			for (int* fd : { &child.stdout_fd, &child.stderr_fd })
+			{
+				if (*fd >= 0)
+				{
+					epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, *fd, nullptr);
+					close(*fd);
+					*fd = -1;
+				}
+			}
+
+			if (result > 0 && WIFEXITED(status))
+			{
+				child.result.exit_code = WEXITSTATUS(status);
+			}
+			else if (result > 0 && WIFSIGNALED(status))
+			{
+				child.result.signal = WTERMSIG(status);
+			}
+			child.result.last_message = child.parser.last_message();
+
+			std::lock_guard<std::mutex> lock(mutex_);
+			child.done = true;
+			return true;
+		}
+
+		int epoll_fd_ = -1;
+		int wake_fd_ = -1;
+		std::mutex mutex_;
+		std::condition_variable done_cv_;
+		std::vector<std::shared_ptr<Child>> adopting_;
+		bool stopping_ = false;
+		std::thread thread_;
+	};
+#endif
+
+#ifdef __linux__
+	// I/O 运行时上的协程任务：创建后立即执行，结束时自行销毁，不向调用方返回结果
+	struct DetachedTask
+	{
+		struct promise_type
+		{
+			DetachedTask get_return_object() noexcept
+			{
+				return {};
+			}
+
+			std::suspend_never initial_suspend() noexcept
+			{
+				return {};
+			}
+
+			std::suspend_never final_suspend() noexcept
+			{
+				return {};
+			}
+
+			void return_void() noexcept
+			{
+			}
+
+			void unhandled_exception() noexcept
+			{
+				try
+				{
+					throw;
+				}
+				catch (const std::exception& ex)
+				{
+					log_error("协程任务异常退出", { { "error", ex.what() } });
+				}
+				catch (...)
+				{
+					log_error("协程任务异常退出");
+				}
+			}
+		};
+	};
+
+	// 一次待完成的 I/O 操作，完成时以结果调用 done：轮询为就绪事件掩码，写入为写入字节数，失败为 -errno
+	struct IoOperation
+	{
+		std::function<void(int)> done;
+		bool cancelled = false;
+	};
+
+	class IoPoller
+	{
+	public:
+		virtual ~IoPoller() = default;
+
+		virtual const char* name() const = 0;
+		// 一次性等待 fd 上的 EPOLLIN/EPOLLOUT，触发后需要重新注册
+		virtual void poll(IoOperation* operation, int fd, std::uint32_t events) = 0;
+		// 返回 true 表示操作已撤销、可立即释放；否则之后仍会以一次完成返回
+		virtual bool cancel(IoOperation* operation, int fd) = 0;
+		virtual void write(IoOperation* operation, int fd, const char* data, std::size_t size, std::uint64_t offset) = 0;
+		// 提交排队的操作，等待至少一个完成或超时（毫秒，-1 表示一直等待），并对每个完成调用 complete
+		virtual void wait(int timeout_ms, const std::function<void(IoOperation*, int)>& complete) = 0;
+	};
+
+	// 退路实现：套接字用 EPOLLONESHOT 等待，普通文件不支持就绪通知，写入直接同步完成
+	class EpollPoller final : public IoPoller
+	{
+	public:
+		EpollPoller()
+			: epoll_fd_(epoll_create1(EPOLL_CLOEXEC))
+		{
+			if (epoll_fd_ < 0)
+			{
+				throw std::runtime_error("无法创建 epoll 实例: " + std::string(std::strerror(errno)));
+			}
+		}
+
+		~EpollPoller() override
+		{
+			close(epoll_fd_);
+		}
+
+		EpollPoller(const EpollPoller&) = delete;
+		EpollPoller& operator=(const EpollPoller&) = delete;
+
+		const char* name() const override
+		{
+			return "epoll";
+		}
+
+		void poll(IoOperation* operation, int fd, std::uint32_t events) override
+		{
+			epoll_event event{};
+			event.events = events | EPOLLONESHOT;
+			event.data.ptr = operation;
+			// 触发过的 fd 仍留在 epoll 中，只需重新激活；已关闭并被复用的 fd 则需要重新加入
+			if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) != 0
+				&& (errno != ENOENT || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0))
+			{
+				ready_.push_back({ operation, -errno });
+			}
+		}
+
+		bool cancel(IoOperation* operation, int fd) override
+		{
+			epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+			return std::none_of(ready_.begin(), ready_.end(), [operation](const auto& entry)
+				{
+					return entry.first == operation;
+				});
+		}
+
+		void write(IoOperation* operation, int fd, const char* data, std::size_t size, std::uint64_t offset) override
+		{
+			const auto written = pwrite(fd, data, size, static_cast<off_t>(offset));
+			ready_.push_back({ operation, written < 0 ? -errno : static_cast<int>(written) });
+		}
+
+		void wait(int timeout_ms, const std::function<void(IoOperation*, int)>& complete) override
+		{
+			if (ready_.empty())
+			{
+				const int count = epoll_wait(epoll_fd_, events_.data(), static_cast<int>(events_.size()), timeout_ms);
+				for (int i = 0; i < count; ++i)
+				{
+					ready_.push_back({ static_cast<IoOperation*>(events_[i].data.ptr), static_cast<int>(events_[i].events) });
+				}
+			}
+
+			// 先全部入队再逐个取出，前面的回调撤销后面的操作时 cancel 能看到它仍在队列中
+			while (!ready_.empty())
+			{
+				const auto [operation, result] = ready_.front();
+				ready_.pop_front();
+				complete(operation, result);
+			}
+		}
+
+	private:
+		int epoll_fd_ = -1;
+		std::array<epoll_event, 128> events_{};
+		std::deque<std::pair<IoOperation*, int>> ready_;
+	};
+
+	// 直接通过系统调用使用 io_uring：一轮循环中产生的轮询与写入都排进提交队列，在等待时随同一次 io_uring_enter 提交
+	class IoUringPoller final : public IoPoller
+	{
+	public:
+		// 内核不支持 io_uring 或缺少所需特性时抛出异常，由调用方退回 epoll
+		explicit IoUringPoller(unsigned entries)
+		{
+			io_uring_params params{};
+			ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+			if (ring_fd_ < 0)
+			{
+				throw std::runtime_error("io_uring 不可用: " + std::string(std::strerror(errno)));
+			}
+			if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP))
+			{
+				close(ring_fd_);
+				throw std::runtime_error("内核的 io_uring 缺少所需特性");
+			}
+
+			ring_size_ = std::max<std::size_t>(params.sq_off.array + params.sq_entries * sizeof(std::uint32_t),
+				params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+			ring_ = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+			sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+			void* sqes = ring_ == MAP_FAILED
+				? MAP_FAILED
+				: mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+			if (sqes == MAP_FAILED)
+			{
+				const int error = errno;
+				if (ring_ != MAP_FAILED)
+				{
+					munmap(ring_, ring_size_);
+				}
+				close(ring_fd_);
+				throw std::runtime_error("无法映射 io_uring 队列: " + std::string(std::strerror(error)));
+			}
+
+			auto* base = static_cast<char*>(ring_);
+			sq_head_ = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+			sq_tail_ = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+			sq_mask_ = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+			sq_array_ = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+			sq_entries_ = params.sq_entries;
+			cq_head_ = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+			cq_tail_ = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+			cq_mask_ = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+			cqes_ = reinterpret_cast<io_uring_cqe*>(base + params.cq_off.cqes);
+			sqes_ = static_cast<io_uring_sqe*>(sqes);
+			sq_tail_local_ = *sq_tail_;
+		}
+
+		~IoUringPoller() override
+		{
+			munmap(sqes_, sqes_size_);
+			munmap(ring_, ring_size_);
+			close(ring_fd_);
+		}
+
+		IoUringPoller(const IoUringPoller&) = delete;
+		IoUringPoller& operator=(const IoUringPoller&) = delete;
+
+		const char* name() const override
+		{
+			return "io_uring";
+		}
+
+		void poll(IoOperation* operation, int fd, std::uint32_t events) override
+		{
+			auto* sqe = next_sqe();
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = fd;
+			sqe->poll32_events = events;
+			sqe->user_data = reinterpret_cast<std::uint64_t>(operation);
+		}
+
+		bool cancel(IoOperation* operation, int) override
+		{
+			// 被撤销的轮询仍会以 -ECANCELED 完成一次，撤销请求本身的完成没有 user_data，直接忽略
+			auto* sqe = next_sqe();
+			sqe->opcode = IORING_OP_POLL_REMOVE;
+			sqe->fd = -1;
+			sqe->addr = reinterpret_cast<std::uint64_t>(operation);
+			return false;
+		}
+
+		void write(IoOperation* operation, int fd, const char* data, std::size_t size, std::uint64_t offset) override
+		{
+			auto* sqe = next_sqe();
+			sqe->opcode = IORING_OP_WRITE;
+			sqe->fd = fd;
+			sqe->addr = reinterpret_cast<std::uint64_t>(data);
+			sqe->len = static_cast<std::uint32_t>(std::min<std::size_t>(size, std::numeric_limits<std::int32_t>::max()));
+			sqe->off = offset;
+			sqe->user_data = reinterpret_cast<std::uint64_t>(operation);
+		}
+
+		void wait(int timeout_ms, const std::function<void(IoOperation*, int)>& complete) override
+		{
+			__kernel_timespec timeout{};
+			io_uring_getevents_arg arg{};
+			if (timeout_ms >= 0)
+			{
+				timeout.tv_sec = timeout_ms / 1000;
+				timeout.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+				arg.ts = reinterpret_cast<std::uint64_t>(&timeout);
+			}
+			const bool completions_ready = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire) != *cq_head_;
+			const unsigned min_complete = completions_ready || timeout_ms == 0 ? 0 : 1;
+			constexpr unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+			int error = enter(true, min_complete, flags, &arg, sizeof(arg));
+			if (error == EAGAIN || error == EBUSY)
+			{
+				// 内核暂时无法接收提交（资源不足，或溢出的完成尚未取走）：操作留在队列中，
+				// 这一轮只等待并处理完成，下一轮再提交
+				error = enter(false, min_complete, flags, &arg, sizeof(arg));
+			}
+			// 超时返回 ETIME、被信号打断返回 EINTR，两者都只需继续处理已有的完成
+			if (error != 0 && error != ETIME && error != EINTR && error != EAGAIN && error != EBUSY)
+			{
+				throw std::runtime_error("io_uring_enter 失败: " + std::string(std::strerror(error)));
+			}
+
+			unsigned head = *cq_head_;
+			while (head != std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire))
+			{
+				const auto& cqe = cqes_[head & cq_mask_];
+				const auto user_data = cqe.user_data;
+				const int result = cqe.res;
+				++head;
+				// 回调中可能继续提交并进入内核，先归还完成队列的槽位
+				std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+				if (user_data != 0)
+				{
+					complete(reinterpret_cast<IoOperation*>(user_data), result);
+				}
+			}
+		}
+
+	private:
+		io_uring_sqe* next_sqe()
+		{
+			if (backlog_.empty() && ring_full())
+			{
+				// 提交队列已满，先把已排队的操作交给内核
+				enter(true, 0, 0, nullptr, 0);
+			}
+
+			// 内核没有取走任何操作时暂存在队列之外，保持与已排队操作的先后顺序，等下次提交时补进队列
+			if (!backlog_.empty() || ring_full())
+			{
+				return &backlog_.emplace_back();
+			}
+
+			auto* sqe = push_sqe();
+			std::memset(sqe, 0, sizeof(*sqe));
+			return sqe;
+		}
+
+		bool ring_full() const
+		{
+			return sq_tail_local_ - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire) >= sq_entries_;
+		}
+
+		io_uring_sqe* push_sqe()
+		{
+			const unsigned index = sq_tail_local_ & sq_mask_;
+			sq_array_[index] = index;
+			++sq_tail_local_;
+			++pending_;
+			return &sqes_[index];
+		}
+
+		void publish()
+		{
+			while (!backlog_.empty() && !ring_full())
+			{
+				*push_sqe() = backlog_.front();
+				backlog_.pop_front();
+			}
+			std::atomic_ref<unsigned>(*sq_tail_).store(sq_tail_local_, std::memory_order_release);
+		}
+
+		// 提交队列中的操作（submit 为 false 时只等待）并按需等待完成，返回 errno，成功时为 0。
+		// 内核可能只取走一部分，pending_ 只扣除实际提交的数量，其余留在队列中由下次提交
+		int enter(bool submit, unsigned min_complete, unsigned flags, const void* arg, std::size_t arg_size)
+		{
+			publish();
+			const long submitted = syscall(__NR_io_uring_enter, ring_fd_, submit ? pending_ : 0u, min_complete, flags, arg, arg_size);
+			if (submitted < 0)
+			{
+				return errno;
+			}
+			pending_ -= std::min(pending_, static_cast<unsigned>(submitted));
+			return 0;
+		}
+
+		int ring_fd_ = -1;
+		void* ring_ = nullptr;
+		std::size_t ring_size_ = 0;
+		io_uring_sqe* sqes_ = nullptr;
+		std::size_t sqes_size_ = 0;
+		unsigned* sq_head_ = nullptr;
+		unsigned* sq_tail_ = nullptr;
+		unsigned* sq_array_ = nullptr;
+		unsigned sq_mask_ = 0;
+		unsigned sq_entries_ = 0;
+		unsigned sq_tail_local_ = 0;
+		// 已放入提交队列、尚未被内核取走的操作数
+		unsigned pending_ = 0;
+		std::deque<io_uring_sqe> backlog_;
+		unsigned* cq_head_ = nullptr;
+		unsigned* cq_tail_ = nullptr;
+		unsigned cq_mask_ = 0;
+		io_uring_cqe* cqes_ = nullptr;
+	};
+
+	// 只在运行时线程上使用的一次性事件：set 后在当前调用栈上依次唤醒等待者，之后的等待立即返回
+	class AsyncSignal
+	{
+	public:
+		bool is_set() const
+		{
+			return set_;
+		}
+
+		void set()
+		{
+			if (set_)
+			{
+				return;
+			}
+			set_ = true;
+			auto waiters = std::move(waiters_);
+			waiters_.clear();
+			for (auto& [id, waiter] : waiters)
+			{
+				waiter();
+			}
+		}
+
+		std::uint64_t add_waiter(std::function<void()> waiter)
+		{
+			waiters_.emplace_back(++next_id_, std::move(waiter));
+			return next_id_;
+		}
+
+		void remove_waiter(std::uint64_t id)
+		{
+			std::erase_if(waiters_, [id](const auto& entry)
+				{
+					return entry.first == id;
+				});
+		}
+
+		class Awaiter
+		{
+		public:
+			explicit Awaiter(AsyncSignal& signal)
+				: signal_(signal)
+			{
+			}
+
+			bool await_ready() const noexcept
+			{
+				return signal_.is_set();
+			}
+
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				signal_.add_waiter([handle]()
+					{
+						handle.resume();
+					});
+			}
+
+			void await_resume() const noexcept
+			{
+			}
+
+		private:
+			AsyncSignal& signal_;
+		};
+
+		Awaiter wait()
+		{
+			return Awaiter(*this);
+		}
+
+	private:
+		bool set_ = false;
+		std::uint64_t next_id_ = 0;
+		std::vector<std::pair<std::uint64_t, std::function<void()>>> waiters_;
+	};
+
+	// 单线程 I/O 运行时：协程在这里等待套接字就绪、定时器和文件写入，一个线程即可驱动所有异步录制。
+	// 除 post 外的接口都只能在运行时线程上调用
+	class IoRuntime
+	{
+	public:
+		using clock = std::chrono::steady_clock;
+		using TimerId = std::pair<clock::time_point, std::uint64_t>;
+
+		explicit IoRuntime(const IoConfig& config)
+		{
+			if (config.backend != IoBackendKind::epoll)
+			{
+				try
+				{
+					poller_ = std::make_unique<IoUringPoller>(static_cast<unsigned>(config.queue_depth));
+				}
+				catch (const std::exception& ex)
+				{
+					if (config.backend == IoBackendKind::io_uring)
+					{
+						throw;
+					}
+					log_warn("io_uring 不可用，改用 epoll", { { "error", ex.what() } });
+				}
+			}
+			if (!poller_)
+			{
+				poller_ = std::make_unique<EpollPoller>();
+			}
+
+			wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+			if (wake_fd_ < 0)
+			{
+				throw std::runtime_error("无法创建 eventfd: " + std::string(std::strerror(errno)));
+			}
+			arm_wake();
+
+			thread_ = std::thread([this]()
+				{
+					Tracer::instance().set_thread_name("io-runtime");
+					loop();
+				});
+		}
+
+		~IoRuntime()
+		{
+			stop();
+			close(wake_fd_);
+		}
+
+		IoRuntime(const IoRuntime&) = delete;
+		IoRuntime& operator=(const IoRuntime&) = delete;
+
+		const char* backend_name() const
+		{
+			return poller_->name();
+		}
+
+		// 停止后不再执行任何任务，调用前应确保所有协程都已结束
+		void stop()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stopping_ = true;
+			}
+			wake();
+			if (thread_.joinable())
+			{
+				thread_.join();
+			}
+		}
+
+		// 可在任意线程调用，task 在运行时线程上执行
+		void post(std::function<void()> task)
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				posted_.push_back(std::move(task));
+			}
+			wake();
+		}
+
+		IoOperation* watch(int fd, std::uint32_t events, std::function<void(int)> done)
+		{
+			auto* operation = new IoOperation{ std::move(done) };
+			poller_->poll(operation, fd, events);
+			return operation;
+		}
+
+		// 撤销后 done 不会再被调用
+		void cancel(IoOperation* operation, int fd)
+		{
+			operation->cancelled = true;
+			operation->done = nullptr;
+			if (poller_->cancel(operation, fd))
+			{
+				delete operation;
+			}
+		}
+
+		// data 须保持有效直到 done 被调用；完成总是在之后的循环中回调，不会在 write 内部发生
+		void write(int fd, const char* data, std::size_t size, std::uint64_t offset, std::function<void(int)> done)
+		{
+			poller_->write(new IoOperation{ std::move(done) }, fd, data, size, offset);
+		}
+
+		TimerId add_timer(clock::time_point deadline, std::function<void()> callback)
+		{
+			const TimerId id{ deadline, ++next_timer_ };
+			timers_.emplace(id, std::move(callback));
+			return id;
+		}
+
+		void cancel_timer(const TimerId& id)
+		{
+			timers_.erase(id);
+		}
+
+		class SleepAwaiter
+		{
+		public:
+			SleepAwaiter(IoRuntime& runtime, clock::time_point deadline, AsyncSignal* interrupt)
+				: runtime_(runtime), deadline_(deadline), interrupt_(interrupt)
+			{
+			}
+
+			bool await_ready() const noexcept
+			{
+				return interrupt_ && interrupt_->is_set();
+			}
+
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				timer_ = runtime_.add_timer(deadline_, [this, handle]()
+					{
+						if (interrupt_)
+						{
+							interrupt_->remove_waiter(waiter_);
+						}
+						handle.resume();
+					});
+				if (interrupt_)
+				{
+					waiter_ = interrupt_->add_waiter([this, handle]()
+						{
+							runtime_.cancel_timer(timer_);
+							handle.resume();
+						});
+				}
+			}
+
+			void await_resume() const noexcept
+			{
+			}
+
+		private:
+			IoRuntime& runtime_;
+			clock::time_point deadline_;
+			AsyncSignal* interrupt_ = nullptr;
+			TimerId timer_;
+			std::uint64_t waiter_ = 0;
+		};
+
+		// interrupt 被置位时提前醒来
+		SleepAwaiter sleep_for(clock::duration duration, AsyncSignal* interrupt = nullptr)
+		{
+			return SleepAwaiter(*this, clock::now() + duration, interrupt);
+		}
+
+	private:
+		void wake()
+		{
+			const std::uint64_t one = 1;
+			[[maybe_unused]] const auto written = ::write(wake_fd_, &one, sizeof(one));
+		}
+
+		void arm_wake()
+		{
+			watch(wake_fd_, EPOLLIN, [this](int)
+				{
+					std::uint64_t value = 0;
+					[[maybe_unused]] const auto received = read(wake_fd_, &value, sizeof(value));
+					arm_wake();
+				});
+		}
+
+		void loop()
+		{
+			const auto complete = [](IoOperation* operation, int result)
+				{
+					const std::unique_ptr<IoOperation> owned(operation);
+					if (!operation->cancelled)
+					{
+						operation->done(result);
+					}
+				};
+
+			std::vector<std::function<void()>> posted;
+			while (true)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					if (stopping_)
+					{
+						return;
+					}
+					posted.swap(posted_);
+				}
+				for (auto& task : posted)
+				{
+					task();
+				}
+				posted.clear();
+
+				// 回调可能增删定时器，每次只取出最早的一个
+				while (!timers_.empty() && timers_.begin()->first.first <= clock::now())
+				{
+					auto node = timers_.extract(timers_.begin());
+					node.mapped()();
+				}
+
+				int timeout_ms = -1;
+				if (!timers_.empty())
+				{
+					const auto remaining = timers_.begin()->first.first - clock::now();
+					timeout_ms = static_cast<int>(std::clamp<std::int64_t>(
+						std::chrono::ceil<std::chrono::milliseconds>(remaining).count(), 0, std::numeric_limits<int>::max()));
+				}
+				poller_->wait(timeout_ms, complete);
+			}
+		}
+
+		std::unique_ptr<IoPoller> poller_;
+		int wake_fd_ = -1;
+		std::mutex mutex_;
+		std::vector<std::function<void()>> posted_;
+		bool stopping_ = false;
+		std::map<TimerId, std::function<void()>> timers_;
+		std::uint64_t next_timer_ = 0;
+		std::thread thread_;
+	};
+
+	// 通过 curl multi 的 socket 接口在运行时上驱动所有异步 HTTP 传输：套接字就绪与超时都交给运行时等待，
+	// 协程 co_await transfer(handle) 直到传输结束
+	class CurlMultiDriver
+	{
+	public:
+		explicit CurlMultiDriver(IoRuntime& runtime)
+			: runtime_(runtime), multi_(curl_multi_init())
+		{
+			if (!multi_)
+			{
+				throw std::runtime_error("无法初始化 libcurl multi 会话");
+			}
+			curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, socket_callback);
+			curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+			curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, timer_callback);
+			curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+		}
+
+		// 须在运行时停止后析构
+		~CurlMultiDriver()
+		{
+			curl_multi_cleanup(multi_);
+		}
+
+		CurlMultiDriver(const CurlMultiDriver&) = delete;
+		CurlMultiDriver& operator=(const CurlMultiDriver&) = delete;
+
+		class TransferAwaiter
+		{
+		public:
+			TransferAwaiter(CurlMultiDriver& driver, CURL* handle)
+				: driver_(driver), handle_(handle)
+			{
+			}
+
+			bool await_ready() const noexcept
+			{
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> coroutine)
+			{
+				coroutine_ = coroutine;
+				curl_easy_setopt(handle_, CURLOPT_PRIVATE, static_cast<void*>(this));
+				if (curl_multi_add_handle(driver_.multi_, handle_) != CURLM_OK)
+				{
+					result_ = CURLE_FAILED_INIT;
+					return false;
+				}
+				return true;
+			}
+
+			CURLcode await_resume() const noexcept
+			{
+				return result_;
+			}
+
+		private:
+			friend class CurlMultiDriver;
+
+			CurlMultiDriver& driver_;
+			CURL* handle_ = nullptr;
+			std::coroutine_handle<> coroutine_;
+			CURLcode result_ = CURLE_OK;
+		};
+
+		TransferAwaiter transfer(CURL* handle)
+		{
+			return TransferAwaiter(*this, handle);
+		}
+
+	private:
+		struct Watch
+		{
+			int what = 0;
+			IoOperation* operation = nullptr;
+		};
+
+		static int socket_callback(CURL*, curl_socket_t socket, int what, void* userp, void*)
+		{
+			static_cast<CurlMultiDriver*>(userp)->update_watch(socket, what);
+			return 0;
+		}
+
+		static int timer_callback(CURLM*, long timeout_ms, void* userp)
+		{
+			auto* driver = static_cast<CurlMultiDriver*>(userp);
+			driver->runtime_.cancel_timer(driver->timer_);
+			if (timeout_ms >= 0)
+			{
+				driver->timer_ = driver->runtime_.add_timer(IoRuntime::clock::now() + std::chrono::milliseconds(timeout_ms), [driver]()
+					{
+						int running = 0;
+						curl_multi_socket_action(driver->multi_, CURL_SOCKET_TIMEOUT, 0, &running);
+						driver->process_messages();
+					});
+			}
+			return 0;
+		}
+
+		void update_watch(curl_socket_t socket, int what)
+		{
+			if (what == CURL_POLL_REMOVE)
+			{
+				if (const auto it = watches_.find(socket); it != watches_.end())
+				{
+					if (it->second.operation)
+					{
+						runtime_.cancel(it->second.operation, socket);
+					}
+					watches_.erase(it);
+				}
+				return;
+			}
+
+			auto& watch = watches_[socket];
+			if (watch.operation && watch.what == what)
+			{
+				return;
+			}
+			if (watch.operation)
+			{
+				runtime_.cancel(watch.operation, socket);
+				watch.operation = nullptr;
+			}
+			watch.what = what;
+			arm(socket, watch);
+		}
+
+		void arm(curl_socket_t socket, Watch& watch)
+		{
+			std::uint32_t events = 0;
+			if (watch.what & CURL_POLL_IN)
+			{
+				events |= EPOLLIN;
+			}
+			if (watch.what & CURL_POLL_OUT)
+			{
+				events |= EPOLLOUT;
+			}
+			watch.operation = runtime_.watch(socket, events, [this, socket](int revents)
+				{
+					on_ready(socket, revents);
+				});
+		}
+
+		void on_ready(curl_socket_t socket, int revents)
+		{
+			if (const auto it = watches_.find(socket); it != watches_.end())
+			{
+				it->second.operation = nullptr;
+			}
+
+			int flags = 0;
+			if (revents < 0 || (revents & (EPOLLERR | EPOLLHUP)))
+			{
+				flags |= CURL_CSELECT_ERR;
+			}
+			if (revents > 0 && (revents & EPOLLIN))
+			{
+				flags |= CURL_CSELECT_IN;
+			}
+			if (revents > 0 && (revents & EPOLLOUT))
+			{
+				flags |= CURL_CSELECT_OUT;
+			}
+			int running = 0;
+			curl_multi_socket_action(multi_, socket, flags, &running);
+
+			// 轮询是一次性的，curl 仍在关注的套接字需要重新注册
+			if (const auto it = watches_.find(socket); it != watches_.end() && !it->second.operation)
+			{
+				arm(socket, it->second);
+			}
+			process_messages();
+		}
+
+		void process_messages()
+		{
+			std::vector<TransferAwaiter*> finished;
+			int queued = 0;
+			while (auto* message = curl_multi_info_read(multi_, &queued))
+			{
+				if (message->msg != CURLMSG_DONE)
+				{
+					continue;
+				}
+
+				char* data = nullptr;
+				curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &data);
+				auto* transfer = reinterpret_cast<TransferAwaiter*>(data);
+				transfer->result_ = message->data.result;
+				curl_multi_remove_handle(multi_, message->easy_handle);
+				finished.push_back(transfer);
+			}
+
+			for (auto* transfer : finished)
+			{
+				transfer->coroutine_.resume();
+			}
+		}
+
+		IoRuntime& runtime_;
+		CURLM* multi_ = nullptr;
+		std::unordered_map<curl_socket_t, Watch> watches_;
+		IoRuntime::TimerId timer_;
+	};
+
+	// 在运行时上按偏移量写文件：数据先攒成固定大小的块，块满后提交写入，不阻塞运行时线程。
+	// 未落盘的数据超过上限时 backlogged() 为真，调用方应暂停上游，回落到一半以下时调用 drain 回调
+	class AsyncFileWriter
+	{
+	public:
+		// append_at 非 0 时保留文件已有内容，从该偏移继续写
+		AsyncFileWriter(IoRuntime& runtime, const fs::path& path, std::size_t block_size, std::size_t max_pending, std::uint64_t append_at = 0)
+			: runtime_(runtime), block_size_(block_size), max_pending_(max_pending), offset_(append_at)
+		{
+			fd_ = open(path.c_str(), O_WRONLY | O_CREAT | (append_at > 0 ? 0 : O_TRUNC) | O_CLOEXEC, 0644);
+			if (fd_ < 0)
+			{
+				throw std::runtime_error("无法创建录制文件: " + path.string());
+			}
+			current_ = make_block();
+		}
+
+		// 提前析构时在途的写入仍会完成，块由回调持有，结果被丢弃
+		~AsyncFileWriter()
+		{
+			close(fd_);
+		}
+
+		AsyncFileWriter(const AsyncFileWriter&) = delete;
+		AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+		void set_drain_callback(std::function<void()> callback)
+		{
+			drain_ = std::move(callback);
+		}
+
+		// 写入失败后返回 false，错误信息见 error()
+		bool append(const char* data, std::size_t size)
+		{
+			if (!error_.empty())
+			{
+				return false;
+			}
+
+			pending_bytes_ += size;
+			while (size > 0)
+			{
+				const auto count = std::min(size, block_size_ - current_->size());
+				current_->insert(current_->end(), data, data + count);
+				data += count;
+				size -= count;
+				if (current_->size() == block_size_)
+				{
+					submit_current();
+				}
+			}
+			return true;
+		}
+
+		bool backlogged() const
+		{
+			return pending_bytes_ >= max_pending_;
+		}
+
+		const std::string& error() const
+		{
+			return error_;
+		}
+
+		class FlushAwaiter
+		{
+		public:
+			explicit FlushAwaiter(AsyncFileWriter& writer)
+				: writer_(writer)
+			{
+			}
+
+			bool await_ready()
+			{
+				writer_.submit_current();
+				return writer_.in_flight_ == 0;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				writer_.flush_waiter_ = handle;
+			}
+
+			bool await_resume() const noexcept
+			{
+				return writer_.error_.empty();
+			}
+
+		private:
+			AsyncFileWriter& writer_;
+		};
+
+		// 提交剩余数据并等待所有写入完成，返回是否全部成功
+		FlushAwaiter flush()
+		{
+			return FlushAwaiter(*this);
+		}
+
+	private:
+		using Block = std::vector<char>;
+
+		// 写完的块回收复用：大块内存每次新分配都要经过 mmap 和缺页，系统态开销远高于写入本身
+		std::shared_ptr<Block> make_block()
+		{
+			if (!spare_blocks_.empty())
+			{
+				auto block = std::move(spare_blocks_.back());
+				spare_blocks_.pop_back();
+				return block;
+			}
+			auto block = std::make_shared<Block>();
+			block->reserve(block_size_);
+			++blocks_allocated_;
+			memory_.set(blocks_allocated_ * block_size_);
+			return block;
+		}
+
+		void submit_current()
+		{
+			if (current_->empty())
+			{
+				return;
+			}
+			auto block = std::exchange(current_, make_block());
+			const auto offset = offset_;
+			offset_ += block->size();
+			submit(std::move(block), 0, offset);
+		}
+
+		void submit(std::shared_ptr<Block> block, std::size_t written, std::uint64_t offset)
+		{
+			++in_flight_;
+			const char* data = block->data() + written;
+			const auto size = block->size() - written;
+			runtime_.write(fd_, data, size, offset + written, [this, alive = std::weak_ptr<int>(alive_), block = std::move(block), written, offset](int result)
+				{
+					if (alive.lock())
+					{
+						on_written(block, written, offset, result);
+					}
+				});
+		}
+
+		void on_written(const std::shared_ptr<Block>& block, std::size_t written, std::uint64_t offset, int result)
+		{
+			--in_flight_;
+			const auto remaining = block->size() - written;
+			if (result <= 0)
+			{
+				if (error_.empty())
+				{
+					error_ = result == 0 ? "写入文件没有进展" : std::strerror(-result);
+				}
+				pending_bytes_ -= remaining;
+			}
+			else
+			{
+				pending_bytes_ -= static_cast<std::size_t>(result);
+				if (static_cast<std::size_t>(result) < remaining)
+				{
+					submit(block, written + static_cast<std::size_t>(result), offset);
+				}
+				else
+				{
+					block->clear();
+					spare_blocks_.push_back(block);
+				}
+			}
+
+			if (drain_ && pending_bytes_ < max_pending_ / 2)
+			{
+				drain_();
+			}
+			if (in_flight_ == 0 && flush_waiter_)
+			{
+				std::exchange(flush_waiter_, nullptr).resume();
+			}
+		}
+
+		IoRuntime& runtime_;
+		const std::size_t block_size_;
+		const std::size_t max_pending_;
+		int fd_ = -1;
+		std::shared_ptr<Block> current_;
+		std::vector<std::shared_ptr<Block>> spare_blocks_;
+		std::uint64_t offset_ = 0;
+		std::size_t pending_bytes_ = 0;
+		std::size_t in_flight_ = 0;
+		std::string error_;
+		std::function<void()> drain_;
+		std::coroutine_handle<> flush_waiter_;
+		std::size_t blocks_allocated_ = 0;
+		// 块在写入完成前由回调持有，可能晚于写入器释放，这里按分配过的块数近似
+		MemoryCharge memory_{ MemorySubsystem::recording_buffers };
+		const std::shared_ptr<int> alive_ = std::make_shared<int>(0);
+	};
+
+	// 录制协程共用的 I/O 运行时与 curl multi 驱动；析构时先停止运行时线程，再释放 curl 资源
+	struct IoServices
+	{
+		explicit IoServices(const IoConfig& config)
+			: config(config), runtime(config), curl(runtime)
+		{
+		}
+
+		~IoServices()
+		{
+			runtime.stop();
+		}
+
+		IoServices(const IoServices&) = delete;
+		IoServices& operator=(const IoServices&) = delete;
+
+		const IoConfig& config;
+		IoRuntime runtime;
+		CurlMultiDriver curl;
+	};
+#endif
+
+	struct CaptureContext
+	{
+		const Config& config;
+		StorageManager& storage;
+		StreamRelayHub* relay = nullptr;
+		CdnConnectionWarmer* warmer = nullptr;
+		// 仅 Linux 下存在，其他平台为 nullptr
+		ProcessSupervisor* supervisor = nullptr;
+		// 非空时 HTTP-FLV 录制以协程运行在 I/O 运行时上，不再独占线程
+		IoServices* io = nullptr;
+	};
+
+	struct CaptureTarget
+	{
+		std::string host_id;
+		std::string room_id;
+		std::string stream_url;
+		// 测试模式下为 nullptr
+		const HostConfig* host = nullptr;
+		// 非空时优先续写重启前未完成的录制文件
+		fs::path resume_path = {};
+	};
+
+	void append_varint(std::string& out, std::uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<char>(value));
+	}
+
+	std::optional<std::uint64_t> read_varint(std::string_view data, std::size_t& pos)
+	{
+		std::uint64_t value = 0;
+		for (int shift = 0; shift < 64 && pos < data.size(); shift += 7)
+		{
+			const auto byte = static_cast<unsigned char>(data[pos++]);
+			value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return value;
+			}
+		}
+		return std::nullopt;
+	}
+
+	std::uint64_t zigzag_encode(std::int64_t value)
+	{
+		return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+	}
+
+	std::int64_t zigzag_decode(std::uint64_t value)
+	{
+		return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+	}
+
+	// 消息文件由文件头和若干独立压缩的数据块组成，只追加写入，异常退出最多丢失最后一个未写出的块：
+	//   文件头: "RNCHAT\x01\n" | u32 长度 | JSON（直播间、录制开始时间、对应的视频文件）
+	//   数据块: "CHK1" | u32 消息数 | u32 原始长度 | u32 压缩长度 | zstd 数据
+	// 块内按列存放：相对录制开始的毫秒偏移（差分 zigzag varint）、类型与用户（块内字典编号）、
+	// 文本长度与文本内容、数值（zigzag varint），同类数据相邻使压缩率远高于逐条 JSON
+	constexpr std::string_view chat_file_magic = std::string_view("RNCHAT\x01\n", 8);
+	constexpr std::string_view chat_block_magic = "CHK1";
+	// 导出时接受的单块原始数据上限；写入时每块最多 65536 条消息，正常的块远小于此
+	constexpr std::uint32_t max_chat_block_raw_bytes = 256u * 1024 * 1024;
+
+	struct ChatMessage
+	{
+		std::int64_t offset_ms = 0;
+		std::string type;
+		std::string user;
+		std::string text;
+		std::int64_t value = 0;
+	};
+
+	class ChatBlockEncoder
+	{
+	public:
+		void add(std::int64_t offset_ms, std::string_view type, std::string_view user, std::string_view text, std::int64_t value)
+		{
+			append_varint(times_, zigzag_encode(offset_ms - last_offset_ms_));
+			last_offset_ms_ = offset_ms;
+			append_varint(types_, types_dictionary_.intern(type));
+			append_varint(users_, users_dictionary_.intern(user));
+			append_varint(text_lengths_, text.size());
+			texts_.append(text);
+			append_varint(values_, zigzag_encode(value));
+			++count_;
+		}
+
+		std::size_t size() const
+		{
+			return count_;
+		}
+
+		// 各列与字典当前占用的字节数（按容量计）
+		std::size_t memory_bytes() const
+		{
+			std::size_t bytes = 0;
+			for (const auto* column : { &times_, &types_dictionary_.encoded, &types_, &users_dictionary_.encoded, &users_, &text_lengths_, &texts_, &values_ })
+			{
+				bytes += column->capacity();
+			}
+			return bytes;
+		}
+
+		// 按列拼接为块的原始数据，并清空以便编码下一个块
+		std::string finish()
+		{
+			std::string out;
+			append_varint(out, count_);
+			for (auto* column : { &times_, &types_dictionary_.encoded, &types_, &users_dictionary_.encoded, &users_, &text_lengths_, &texts_, &values_ })
+			{
+				append_varint(out, column->size());
+				out.append(*column);
+				column->clear();
+			}
+			types_dictionary_.clear();
+			users_dictionary_.clear();
+			last_offset_ms_ = 0;
+			count_ = 0;
+			return out;
+		}
+
+	private:
+		struct Dictionary
+		{
+			std::unordered_map<std::string, std::uint32_t> indices;
+			// varint 长度加内容，按编号顺序排列
+			std::string encoded;
+
+			std::uint32_t intern(std::string_view value)
+			{
+				const auto [it, inserted] = indices.try_emplace(std::string(value), static_cast<std::uint32_t>(indices.size()));
+				if (inserted)
+				{
+					append_varint(encoded, value.size());
+					encoded.append(value);
+				}
+				return it->second;
+			}
+
+			void clear()
+			{
+				indices.clear();
+				encoded.clear();
+			}
+		};
+
+		std::string times_;
+		std::string types_;
+		std::string users_;
+		std::string text_lengths_;
+		std::string texts_;
+		std::string values_;
+		Dictionary types_dictionary_;
+		Dictionary users_dictionary_;
+		std::int64_t last_offset_ms_ = 0;
+		std::size_t count_ = 0;
+	};
+
+	std::vector<ChatMessage> decode_chat_block(std::string_view block)
+	{
+		const auto fail = []() -> std::runtime_error
+			{
+				return std::runtime_error("消息数据块格式错误");
+			};
+
+		std::size_t pos = 0;
+		const auto count = read_varint(block, pos);
+		// 每条消息在时间、类型、用户、文本长度与数值列中至少各占一个字节，据此在分配前排除损坏的消息数
+		if (!count || *count > block.size())
+		{
+			throw fail();
+		}
+		std::string_view columns[8];
+		for (auto& column : columns)
+		{
+			const auto length = read_varint(block, pos);
+			if (!length || block.size() - pos < *length)
+			{
+				throw fail();
+			}
+			column = block.substr(pos, *length);
+			pos += *length;
+		}
+
+		const auto read_dictionary = [&](std::string_view data)
+			{
+				std::vector<std::string> entries;
+				std::size_t at = 0;
+				while (at < data.size())
+				{
+					const auto length = read_varint(data, at);
+					if (!length || data.size() - at < *length)
+					{
+						throw fail();
+					}
+					entries.emplace_back(data.substr(at, *length));
+					at += *length;
+				}
+				return entries;
+			};
+		const auto types = read_dictionary(columns[1]);
+		const auto users = read_dictionary(columns[3]);
+
+		std::vector<ChatMessage> messages(*count);
+		std::size_t cursors[8] = {};
+		std::int64_t offset_ms = 0;
+		const auto next = [&](std::size_t column) -> std::uint64_t
+			{
+				const auto value = read_varint(columns[column], cursors[column]);
+				if (!value)
+				{
+					throw fail();
+				}
+				return *value;
+			};
+		for (auto& message : messages)
+		{
+			offset_ms += zigzag_decode(next(0));
+			message.offset_ms = offset_ms;
+			const auto type_index = next(2);
+			const auto user_index = next(4);
+			if (type_index >= types.size() || user_index >= users.size())
+			{
+				throw fail();
+			}
+			message.type = types[type_index];
+			message.user = users[user_index];
+			const auto text_length = next(5);
+			if (columns[6].size() - cursors[6] < text_length)
+			{
+				throw fail();
+			}
+			message.text.assign(columns[6].substr(cursors[6], text_length));
+			cursors[6] += text_length;
+			message.value = zigzag_decode(next(7));
+		}
+		return messages;
+	}
+
+	void append_le32(std::string& out, std::uint32_t value)
+	{
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			out.push_back(static_cast<char>((value >> shift) & 0xFF));
+		}
+	}
+
+	std::uint32_t read_le32(const unsigned char* data)
+	{
+		return static_cast<std::uint32_t>(data[0]) | (static_cast<std::uint32_t>(data[1]) << 8)
+			| (static_cast<std::uint32_t>(data[2]) << 16) | (static_cast<std::uint32_t>(data[3]) << 24);
+	}
+
+	struct ChatResumePoint
+	{
+		std::uint64_t bytes = 0;
+		std::chrono::system_clock::time_point started_at;
+	};
+
+	// 续写消息文件：沿用文件头中的录制开始时间，使消息偏移与续写前一致，并截掉末尾不完整的数据块
+	std::optional<ChatResumePoint> prepare_chat_resume(const fs::path& path)
+	{
+		std::error_code ec;
+		if (!fs::is_regular_file(path, ec))
+		{
+			return std::nullopt;
+		}
+
+		ChatResumePoint point;
+		std::size_t original_size = 0;
+		try
+		{
+			const MappedFile mapped(path);
+			const auto* data = mapped.data();
+			original_size = mapped.size();
+			const std::string_view content(reinterpret_cast<const char*>(data), original_size);
+			if (original_size < chat_file_magic.size() + 4 || content.substr(0, chat_file_magic.size()) != chat_file_magic)
+			{
+				return std::nullopt;
+			}
+			const std::size_t header_size = read_le32(data + chat_file_magic.size());
+			std::size_t pos = chat_file_magic.size() + 4 + header_size;
+			if (pos > original_size)
+			{
+				return std::nullopt;
+			}
+			const auto header = json::parse(content.substr(chat_file_magic.size() + 4, header_size));
+			point.started_at = from_epoch_ms(header.at("started_at_ms").get<std::int64_t>());
+
+			constexpr std::size_t frame_size = 16;
+			while (original_size - pos >= frame_size && content.substr(pos, 4) == chat_block_magic
+				&& original_size - pos - frame_size >= read_le32(data + pos + 12))
+			{
+				pos += frame_size + read_le32(data + pos + 12);
+			}
+			point.bytes = pos;
+		}
+		catch (const std::exception& ex)
+		{
+			log_warn("消息文件无法续写", { { "path", path }, { "error", ex.what() } });
+			return std::nullopt;
+		}
+
+		if (point.bytes < original_size)
+		{
+			fs::resize_file(path, point.bytes);
+		}
+		return point;
+	}
+
+	// 把单条消息中配置的字段转换为字符串；数字等非字符串值按 JSON 文本保存
+	std::string chat_field_string(const json& message, const json::json_pointer& pointer)
+	{
+		if (!message.contains(pointer))
+		{
+			return {};
+		}
+		const auto& value = message.at(pointer);
+		if (value.is_string())
+		{
+			return value.get<std::string>();
+		}
+		return value.is_null() ? std::string() : value.dump();
+	}
+
+	std::optional<std::int64_t> chat_field_integer(const json& message, const json::json_pointer& pointer)
+	{
+		if (!message.contains(pointer))
+		{
+			return std::nullopt;
+		}
+		const auto& value = message.at(pointer);
+		if (value.is_number_integer())
+		{
+			return value.get<std::int64_t>();
+		}
+		if (value.is_number())
+		{
+			return static_cast<std::int64_t>(value.get<double>());
+		}
+		if (value.is_string())
+		{
+			const auto text = value.get<std::string>();
+			char* end = nullptr;
+			const auto parsed = std::strtoll(text.c_str(), &end, 10);
+			if (!text.empty() && end && *end == '\0')
+			{
+				return parsed;
+			}
+		}
+		return std::nullopt;
+	}
+
+	// 录制期间在独立线程中轮询直播间消息，写入与视频同名的 .chat 文件。
+	// 线程以较低优先级运行，消息先在内存中按列累积，每隔数秒或积满一块才压缩写出一次，不与视频写入争抢资源
+	class ChatCapture
+	{
+	public:
+		ChatCapture(const Config& config, const CaptureTarget& target, const fs::path& video_path)
+			: config_(config), chat_(config.chat), host_id_(target.host_id), room_id_(target.room_id),
+			video_path_(video_path), resume_(!target.resume_path.empty() && target.resume_path == video_path),
+			started_at_(std::chrono::system_clock::now())
+		{
+			thread_ = std::thread([this]()
+				{
+					Tracer::instance().set_thread_name("chat-" + host_id_);
+					run();
+				});
+		}
+
+		~ChatCapture()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				stopping_ = true;
+			}
+			cv_.notify_all();
+			if (thread_.joinable())
+			{
+				thread_.join();
+			}
+		}
+
+		ChatCapture(const ChatCapture&) = delete;
+		ChatCapture& operator=(const ChatCapture&) = delete;
+
+#ifdef __linux__
+		// 在 I/O 运行时上以协程轮询，不占用线程，须在运行时线程上调用。
+		// 协程持有返回对象的一份引用；调用方用 co_await stop() 等待最后一个消息块写出，放弃等待时至少调用 request_stop()
+		static std::shared_ptr<ChatCapture> start_async(IoServices& io, const Config& config, const CaptureTarget& target, const fs::path& video_path)
+		{
+			std::shared_ptr<ChatCapture> chat(new ChatCapture(config, target, video_path, AsyncMode{}));
+			chat->run_async(chat, io);
+			return chat;
+		}
+
+		void request_stop()
+		{
+			stop_signal_.set();
+		}
+
+		AsyncSignal::Awaiter stop()
+		{
+			stop_signal_.set();
+			return finished_signal_.wait();
+		}
+#endif
+
+	private:
+		static constexpr std::size_t max_remembered_ids = 8192;
+
+		struct AsyncMode
+		{
+		};
+
+		ChatCapture(const Config& config, const CaptureTarget& target, const fs::path& video_path, AsyncMode)
+			: config_(config), chat_(config.chat), host_id_(target.host_id), room_id_(target.room_id),
+			video_path_(video_path), resume_(!target.resume_path.empty() && target.resume_path == video_path),
+			started_at_(std::chrono::system_clock::now())
+		{
+		}
+
+		void run()
+		{
+#ifdef _WIN32
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+			setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+			const auto path = chat_path_for(video_path_);
+			try
+			{
+				open_output(path);
+				CurlHttpClient client(config_, MemorySubsystem::chat);
+				auto next_flush = std::chrono::steady_clock::now() + std::chrono::seconds(chat_.flush_seconds);
+				while (true)
+				{
+					try
+					{
+						poll(client);
+						consecutive_failures_ = 0;
+					}
+					catch (const std::exception& ex)
+					{
+						report_failure(ex);
+					}
+					flush_if_due(next_flush);
+
+					std::unique_lock<std::mutex> lock(mutex_);
+					if (cv_.wait_for(lock, std::chrono::milliseconds(chat_.poll_interval_ms), [this]()
+						{
+							return stopping_;
+						}))
+					{
+						break;
+					}
+				}
+				write_block();
+			}
+			catch (const std::exception& ex)
+			{
+				log_error("直播间消息抓取异常结束", { { "room_id", room_id_ }, { "error", ex.what() } });
+			}
+			log_summary(path);
+		}
+
+#ifdef __linux__
+		// self 让对象在协程结束前保持存活
+		DetachedTask run_async([[maybe_unused]] std::shared_ptr<ChatCapture> self, IoServices& io)
+		{
+			const auto path = chat_path_for(video_path_);
+			try
+			{
+				open_output(path);
+				CurlHttpClient client(config_, MemorySubsystem::chat);
+				auto next_flush = std::chrono::steady_clock::now() + std::chrono::seconds(chat_.flush_seconds);
+				while (!stop_signal_.is_set())
+				{
+					try
+					{
+						const auto result = co_await io.curl.transfer(client.prepare_request(build_url()));
+						const auto& response = client.finish_request(result);
+						TraceSampleScope sample;
+						TraceSpan span("chat_poll", room_id_);
+						consume(response);
+						consecutive_failures_ = 0;
+					}
+					catch (const std::exception& ex)
+					{
+						report_failure(ex);
+					}
+					flush_if_due(next_flush);
+					co_await io.runtime.sleep_for(std::chrono::milliseconds(chat_.poll_interval_ms), &stop_signal_);
+				}
+				write_block();
+			}
+			catch (const std::exception& ex)
+			{
+				log_error("直播间消息抓取异常结束", { { "room_id", room_id_ }, { "error", ex.what() } });
+			}
+			log_summary(path);
+			finished_signal_.set();
+		}
+#endif
+
+		void open_output(const fs::path& path)
+		{
+			// 录制续写时消息接在原文件之后，沿用原来的文件头
+			std::optional<ChatResumePoint> resume;
+			if (resume_)
+			{
+				resume = prepare_chat_resume(path);
+			}
+			if (resume)
+			{
+				started_at_ = resume->started_at;
+				output_.open(path, std::ios::binary | std::ios::app);
+			}
+			else
+			{
+				output_.open(path, std::ios::binary | std::ios::trunc);
+			}
+			if (!output_)
+			{
+				throw std::runtime_error("无法创建消息文件: " + path.string());
+			}
+			if (!resume)
+			{
+				write_header();
+			}
+
+			compressor_.reset(ZSTD_createCCtx());
+			if (!compressor_)
+			{
+				throw std::runtime_error("无法初始化 zstd 压缩器");
+			}
+		}
+
+		void report_failure(const std::exception& ex)
+		{
+			// 连续失败时只在开始和每 60 次报告一次，避免刷屏
+			if (consecutive_failures_++ % 60 == 0)
+			{
+				log_warn("拉取直播间消息失败", { { "room_id", room_id_ }, { "error", ex.what() } });
+			}
+		}
+
+		void flush_if_due(std::chrono::steady_clock::time_point& next_flush)
+		{
+			const auto now = std::chrono::steady_clock::now();
+			if (encoder_.size() >= static_cast<std::size_t>(chat_.block_messages) || (now >= next_flush && encoder_.size() > 0))
+			{
+				write_block();
+				next_flush = now + std::chrono::seconds(chat_.flush_seconds);
+			}
+		}
+
+		void log_summary(const fs::path& path) const
+		{
+			log_info("直播间消息抓取结束", {
+				{ "room_id", room_id_ },
+				{ "path", path },
+				{ "messages", messages_ },
+				{ "blocks", blocks_ },
+				{ "raw_kb", raw_bytes_ / 1024 },
+				{ "stored_kb", stored_bytes_ / 1024 } });
+		}
+
+		std::string build_url() const
+		{
+			std::string url = chat_.url_template;
+			const std::pair<std::string_view, std::string> replacements[] = {
+				{ "{room_id}", url_encode_component(room_id_) },
+				{ "{host_id}", url_encode_component(host_id_) },
+				{ "{cursor}", url_encode_component(cursor_) },
+			};
+			for (const auto& [placeholder, value] : replacements)
+			{
+				for (auto pos = url.find(placeholder); pos != std::string::npos; pos = url.find(placeholder, pos + value.size()))
+				{
+					url.replace(pos, placeholder.size(), value);
+				}
+			}
+			return url;
+		}
+
+		void poll(CurlHttpClient& client)
+		{
+			TraceSampleScope sample;
+			TraceSpan span("chat_poll", room_id_);
+			consume(client.perform_request(build_url()));
+		}
+
+		void consume(const HttpResponse& response)
+		{
+			const auto body = json::parse(response.body);
+			const auto received_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - started_at_).count();
+
+			if (body.contains(cursor_pointer_))
+			{
+				const auto& cursor = body.at(cursor_pointer_);
+				cursor_ = cursor.is_string() ? cursor.get<std::string>() : cursor.dump();
+			}
+			if (!body.contains(messages_pointer_) || !body.at(messages_pointer_).is_array())
+			{
+				return;
+			}
+
+			const auto started_ms = std::chrono::duration_cast<std::chrono::milliseconds>(started_at_.time_since_epoch()).count();
+			for (const auto& message : body.at(messages_pointer_))
+			{
+				if (const auto id = chat_field_string(message, id_pointer_); !id.empty())
+				{
+					if (!seen_ids_.insert(id).second)
+					{
+						continue;
+					}
+					seen_order_.push_back(id);
+					if (seen_order_.size() > max_remembered_ids)
+					{
+						seen_ids_.erase(seen_order_.front());
+						seen_order_.pop_front();
+					}
+				}
+
+				// 消息自带时间（秒或毫秒）时按其对齐到录制开始，否则使用收到的时间
+				std::int64_t offset_ms = received_ms;
+				if (auto time = chat_field_integer(message, time_pointer_); time && *time > 0)
+				{
+					offset_ms = (*time < 100000000000ll ? *time * 1000 : *time) - started_ms;
+				}
+				encoder_.add(offset_ms, chat_field_string(message, type_pointer_), chat_field_string(message, user_pointer_),
+					chat_field_string(message, text_pointer_), chat_field_integer(message, value_pointer_).value_or(0));
+				++messages_;
+			}
+			update_memory();
+		}
+
+		// 去重用的 id 按每条约 64 字节估算
+		void update_memory()
+		{
+			memory_.set(encoder_.memory_bytes() + compressed_.capacity() + seen_order_.size() * 64);
+		}
+
+		void write_header()
+		{
+			const json header = {
+				{ "host_id", host_id_ },
+				{ "room_id", room_id_ },
+				{ "video", video_path_.filename().string() },
+				{ "started_at", format_manifest_time(started_at_) },
+				{ "started_at_ms", std::chrono::duration_cast<std::chrono::milliseconds>(started_at_.time_since_epoch()).count() },
+			};
+			const auto header_text = header.dump();
+			std::string out(chat_file_magic);
+			append_le32(out, static_cast<std::uint32_t>(header_text.size()));
+			out.append(header_text);
+			output_.write(out.data(), static_cast<std::streamsize>(out.size()));
+			output_.flush();
+		}
+
+		void write_block()
+		{
+			if (encoder_.size() == 0)
+			{
+				return;
+			}
+
+			const auto count = encoder_.size();
+			const auto raw = encoder_.finish();
+			compressed_.resize(ZSTD_compressBound(raw.size()));
+			const auto compressed_size = ZSTD_compressCCtx(compressor_.get(), compressed_.data(), compressed_.size(), raw.data(), raw.size(), chat_.compression_level);
+			if (ZSTD_isError(compressed_size))
+			{
+				throw std::runtime_error(std::string("压缩消息数据失败: ") + ZSTD_getErrorName(compressed_size));
+			}
+
+			std::string frame(chat_block_magic);
+			append_le32(frame, static_cast<std::uint32_t>(count));
+			append_le32(frame, static_cast<std::uint32_t>(raw.size()));
+			append_le32(frame, static_cast<std::uint32_t>(compressed_size));
+			output_.write(frame.data(), static_cast<std::streamsize>(frame.size()));
+			output_.write(compressed_.data(), static_cast<std::streamsize>(compressed_size));
+			output_.flush();
+			if (!output_)
+			{
+				throw std::runtime_error("写入消息文件失败");
+			}
+
+			++blocks_;
+			raw_bytes_ += raw.size();
+			stored_bytes_ += frame.size() + compressed_size;
+			update_memory();
+		}
+
+		struct ZstdCCtxDeleter
+		{
+			void operator()(ZSTD_CCtx* context) const
+			{
+				ZSTD_freeCCtx(context);
+			}
+		};
+
+		const Config& config_;
+		const ChatConfig& chat_;
+		const std::string host_id_;
+		const std::string room_id_;
+		const fs::path video_path_;
+		const bool resume_;
+		std::chrono::system_clock::time_point started_at_;
+		const json::json_pointer messages_pointer_{ chat_.messages_pointer };
+		const json::json_pointer cursor_pointer_{ chat_.cursor_pointer };
+		const json::json_pointer id_pointer_{ chat_.id_pointer };
+		const json::json_pointer type_pointer_{ chat_.type_pointer };
+		const json::json_pointer user_pointer_{ chat_.user_pointer };
+		const json::json_pointer text_pointer_{ chat_.text_pointer };
+		const json::json_pointer value_pointer_{ chat_.value_pointer };
+		const json::json_pointer time_pointer_{ chat_.time_pointer };
+		std::ofstream output_;
+		std::unique_ptr<ZSTD_CCtx, ZstdCCtxDeleter> compressor_;
+		ChatBlockEncoder encoder_;
+		std::vector<char> compressed_;
+		std::string cursor_;
+		std::unordered_set<std::string> seen_ids_;
+		std::deque<std::string> seen_order_;
+		MemoryCharge memory_{ MemorySubsystem::chat };
+		std::uint64_t messages_ = 0;
+		std::uint64_t blocks_ = 0;
+		std::uint64_t raw_bytes_ = 0;
+		std::uint64_t stored_bytes_ = 0;
+		int consecutive_failures_ = 0;
+		std::mutex mutex_;
+		std::condition_variable cv_;
+		bool stopping_ = false;
+		std::thread thread_;
+#ifdef __linux__
+		AsyncSignal stop_signal_;
+		AsyncSignal finished_signal_;
+#endif
+	};
+
+	// 命令行工具入口：chat-export <消息文件>，逐行输出 JSON，t 为相对录制开始的毫秒数
+	int run_chat_export(int argc, char* argv[])
+	{
+		if (argc < 3)
+		{
+			std::cerr << "用法: " << argv[0] << " chat-export <消息文件>" << std::endl;
+			return 2;
+		}
+
+		const fs::path input = argv[2];
+		const auto content = read_file(input);
+		const auto* bytes = reinterpret_cast<const unsigned char*>(content.data());
+		if (content.size() < chat_file_magic.size() + 4 || std::string_view(content).substr(0, chat_file_magic.size()) != chat_file_magic)
+		{
+			throw std::runtime_error("不是消息文件: " + input.string());
+		}
+		const std::size_t header_size = read_le32(bytes + chat_file_magic.size());
+		std::size_t pos = chat_file_magic.size() + 4 + header_size;
+		if (pos > content.size())
+		{
+			throw std::runtime_error("消息文件头不完整: " + input.string());
+		}
+		std::cout << content.substr(chat_file_magic.size() + 4, header_size) << '\n';
+
+		std::string raw;
+		std::uint64_t messages = 0;
+		constexpr std::size_t frame_size = 16;
+		while (content.size() - pos >= frame_size && std::string_view(content).substr(pos, 4) == chat_block_magic)
+		{
+			const auto raw_size = read_le32(bytes + pos + 8);
+			const auto compressed_size = read_le32(bytes + pos + 12);
+			if (content.size() - pos - frame_size < compressed_size)
+			{
+				break;
+			}
+			if (raw_size > max_chat_block_raw_bytes)
+			{
+				throw std::runtime_error("消息数据块格式错误");
+			}
+			raw.resize(raw_size);
+			const auto result = ZSTD_decompress(raw.data(), raw.size(), content.data() + pos + frame_size, compressed_size);
+			if (ZSTD_isError(result) || result != raw_size)
+			{
+				throw std::runtime_error("消息数据块解压失败");
+			}
+			for (const auto& message : decode_chat_block(raw))
+			{
+				const json line = {
+					{ "t", message.offset_ms },
+					{ "type", message.type },
+					{ "user", message.user },
+					{ "text", message.text },
+					{ "value", message.value },
+				};
+				std::cout << line.dump(-1, ' ', false, json::error_handler_t::replace) << '\n';
+				++messages;
+			}
+			pos += frame_size + compressed_size;
+		}
+
+		if (pos != content.size())
+		{
+			log_warn("消息文件末尾有不完整的数据块，已忽略", { { "path", input.string() }, { "bytes", content.size() - pos } });
+		}
+		log_debug("消息导出完成", { { "messages", messages } });
+		return 0;
+	}
+
+	// 进程内写入的录制在写入时已增量计算哈希；外部录制器直接写的文件在结束后读回计算，此时通常仍在页缓存中
+	void write_capture_manifest(const CaptureContext& context, const CaptureTarget& target, const fs::path& output_path,
+		std::chrono::system_clock::time_point started_at, const Blake3Hasher* hasher = nullptr)
+	{
+		if (!context.config.download.integrity_manifest)
+		{
+			return;
+		}
+
+		try
+		{
+			std::error_code ec;
+			const auto bytes = fs::file_size(output_path, ec);
+			if (ec)
+			{
+				return;
+			}
+
+			RecordingManifest manifest;
+			manifest.host_id = target.host_id;
+			manifest.room_id = target.room_id;
+			manifest.started_at = format_manifest_time(started_at);
+			manifest.finished_at = format_manifest_time(std::chrono::system_clock::now());
+			manifest.bytes = bytes;
+			manifest.blake3 = Blake3Hasher::to_hex(hasher ? hasher->finalize() : hash_file(output_path));
+			write_recording_manifest(output_path, manifest);
+			log_debug("已写入录制清单", { { "path", manifest_path_for(output_path) }, { "blake3", manifest.blake3 } });
+		}
+		catch (const std::exception& ex)
+		{
+			log_warn("写入录制清单失败", { { "path", output_path }, { "error", ex.what() } });
+		}
+	}
+
+	// 目标带有续写路径且能把新数据接到原文件末尾时接管原文件，否则按新录制选盘
+	StorageManager::Placement place_capture(const CaptureContext& context, const CaptureTarget& target, const CaptureControl* control,
+		bool can_append, std::optional<FlvResumePoint>& resume)
+	{
+		if (!target.resume_path.empty())
+		{
+			if (can_append)
+			{
+				try
+				{
+					resume = prepare_flv_resume(target.resume_path);
+				}
+				catch (const std::exception& ex)
+				{
+					log_warn("检查待续写的录制失败", { { "path", target.resume_path }, { "error", ex.what() } });
+				}
+				if (resume)
+				{
+					if (auto placement = context.storage.resume_recording(target.resume_path, control))
+					{
+						// 原文件为空时沿用文件名从头写
+						if (resume->bytes == 0)
+						{
+							resume.reset();
+						}
+						return std::move(*placement);
+					}
+					resume.reset();
+				}
+			}
+			log_warn("无法续写录制，改为新文件", { { "room_id", target.room_id }, { "path", target.resume_path } });
+			context.storage.release_held(target.resume_path);
+		}
+		return context.storage.place_recording(target.room_id, control);
+	}
+
+	std::vector<std::string> build_recorder_command(const ProgramConfig& programs, const CaptureTarget& target, const fs::path& output_path, RecorderKind kind)
+	{
+		switch (kind)
+		{
+		case RecorderKind::ffmpeg:
+			return build_ffmpeg_command(programs, target.stream_url, output_path);
+		case RecorderKind::custom:
+		{
+			const auto& command_template = target.host && !target.host->command_template.empty() ? target.host->command_template : programs.command_template;
+			return build_custom_command(command_template, target.stream_url, output_path, target.room_id, target.host_id);
+		}
+		default:
+			return build_rtmpdump_command(programs, target.stream_url, output_path);
+		}
+	}
+
+	// 调用外部录制器（rtmpdump、ffmpeg 或自定义命令）拉取非 HTTP 的直播流
+	void run_recorder_process(const CaptureContext& context, const CaptureTarget& target, CaptureControl* control = nullptr)
+	{
+		const auto& programs = context.config.programs;
+		const auto& room_id = target.room_id;
+		const auto kind = target.host && target.host->recorder ? *target.host->recorder : programs.recorder;
+		// 续写要经由管道把新数据接到原文件末尾，自定义命令不一定能输出到标准输出
+#ifdef __linux__
+		const bool can_append = kind != RecorderKind::custom;
+#else
+		const bool can_append = false;
+#endif
+		std::optional<FlvResumePoint> resume;
+		const auto placement = place_capture(context, target, control, can_append, resume);
+		const auto& output_path = placement.path();
+		const auto started_at = std::chrono::system_clock::now();
+		RelayPublication relay(context.relay, target.host_id, room_id);
+		std::optional<ChatCapture> chat;
+		if (context.config.chat.enabled)
+		{
+			chat.emplace(context.config, target, output_path);
+		}
+
+#ifdef __linux__
+		const bool pipe_output = (programs.pipe_output || resume) && kind != RecorderKind::custom;
+#else
+		const bool pipe_output = false;
+#endif
+		// 管道模式下转发直接由写入端喂数据，不再跟随读取文件
+		std::optional<FileTailFeeder> relay_feeder;
+		if (!pipe_output)
+		{
+			relay_feeder.emplace(relay, output_path);
+		}
+
+		const auto argv = build_recorder_command(programs, target, pipe_output ? fs::path("-") : output_path, kind);
+		log_info("准备调用录制进程", {
+			{ "room_id", room_id },
+			{ "recorder", recorder_kind_name(kind) },
+			{ "path", output_path },
+			{ "pipe", pipe_output },
+			{ "resume", resume.has_value() },
+			{ "command", format_command(argv) } });
+
+		const auto stall_timeout = std::chrono::seconds(programs.stall_timeout_seconds);
+		const auto max_duration = std::chrono::minutes(programs.max_duration_minutes);
+
+#ifdef _WIN32
+		std::wstring command_line = widen_utf8(format_command(argv));
+		std::vector<wchar_t> command_buffer(command_line.begin(), command_line.end());
+		command_buffer.push_back(L'\0');
+
+		STARTUPINFOW startup_info{};
+		startup_info.cb = sizeof(startup_info);
+		PROCESS_INFORMATION process_info{};
+
+		log_info("开始调用录制进程下载直播流", { { "room_id", room_id } });
+
+		BOOL created = FALSE;
+		{
+			TraceSpan span("spawn", room_id);
+			created = CreateProcessW(
+				nullptr,
+				command_buffer.data(),
+				nullptr,
+				nullptr,
+				FALSE,
+				0,
+				nullptr,
+				nullptr,
+				&startup_info,
+				&process_info);
+		}
+		if (!created)
+		{
+			const DWORD error = GetLastError();
+			std::ostringstream oss;
+			oss << "无法启动 " << recorder_kind_name(kind) << "，错误代码: " << error;
+			if (const auto message = format_windows_error(error); !message.empty())
+			{
+				oss << " (" << message << ')';
+			}
+			throw std::runtime_error(oss.str());
+		}
+
+		// 定期根据输出文件大小统计实际码率，并响应调度器的停止请求与超时
+		const auto started = std::chrono::steady_clock::now();
+		auto last_growth = started;
+		std::uint64_t last_size = 0;
+		while (WaitForSingleObject(process_info.hProcess, 1000) == WAIT_TIMEOUT)
+		{
+			const auto now = std::chrono::steady_clock::now();
+			std::error_code size_ec;
+			const auto size = fs::file_size(output_path, size_ec);
+			if (!size_ec && size != last_size)
+			{
+				last_size = size;
+				last_growth = now;
+			}
+			if (control && !size_ec)
+			{
+				control->bytes_written.store(size, std::memory_order_relaxed);
+			}
+
+			const char* reason = nullptr;
+			if (control && control->stop_requested.load(std::memory_order_relaxed))
+			{
+				reason = "调度要求停止";
+			}
+			else if (stall_timeout.count() > 0 && now - last_growth >= stall_timeout)
+			{
+				reason = "长时间没有进度";
+			}
+			else if (max_duration.count() > 0 && now - started >= max_duration)
+			{
+				reason = "超过最长录制时长";
+			}
+			if (reason)
+			{
+				log_warn("终止录制进程", { { "room_id", room_id }, { "reason", reason } });
+				TerminateProcess(process_info.hProcess, 1);
+			}
+		}
+
+		DWORD exit_code = 0;
+		if (GetExitCodeProcess(process_info.hProcess, &exit_code) && exit_code != 0)
+		{
+			log_error("录制进程执行失败", { { "room_id", room_id }, { "recorder", recorder_kind_name(kind) }, { "exit_code", static_cast<unsigned long>(exit_code) } });
+		}
+
+		CloseHandle(process_info.hThread);
+		CloseHandle(process_info.hProcess);
+		write_capture_manifest(context, target, output_path, started_at);
+#elif defined(__linux__)
+		std::optional<ProcessSupervisor> local_supervisor;
+		ProcessSupervisor* supervisor = context.supervisor;
+		if (!supervisor)
+		{
+			supervisor = &local_supervisor.emplace();
+		}
+
+		std::optional<FlvRemuxWriter> writer;
+		std::function<void(int)> stdout_consumer;
+		if (pipe_output)
+		{
+			const auto buffer_bytes = static_cast<std::size_t>(context.config.footprint.recording_buffer_kb) * 1024;
+			writer.emplace(output_path, buffer_bytes, relay.active() ? &relay : nullptr, resume);
+			stdout_consumer = [&writer, &room_id, buffer_bytes, spawn_started = std::chrono::steady_clock::now()](int fd)
+				{
+					std::vector<char> buffer(buffer_bytes);
+					MemoryCharge memory(MemorySubsystem::recording_buffers);
+					memory.set(buffer.size());
+					bool first_byte_seen = false;
+					while (true)
+					{
+						const auto received = read(fd, buffer.data(), buffer.size());
+						if (received < 0 && errno == EINTR)
+						{
+							continue;
+						}
+						if (received <= 0)
+						{
+							break;
+						}
+						if (!first_byte_seen)
+						{
+							// 握手在录制进程内部完成，以启动进程到读到第一段输出的时间代替
+							first_byte_seen = true;
+							Tracer::instance().record("first_byte", spawn_started, std::chrono::steady_clock::now(), room_id);
+						}
+						writer->feed(buffer.data(), static_cast<std::size_t>(received));
+					}
+					writer->flush();
+				};
+		}
+
+		const auto outcome = supervisor->run(argv, kind, output_path, room_id, control, { stall_timeout, max_duration }, stdout_consumer);
+		if (writer)
+		{
+			log_info("管道录制已写入", { { "room_id", room_id }, { "tags", writer->tags_written() }, { "timestamp_repairs", writer->timestamp_repairs() } });
+		}
+		if (!outcome.kill_reason.empty())
+		{
+			log_info("录制进程已终止", { { "room_id", room_id }, { "reason", outcome.kill_reason } });
+		}
+		else if (outcome.exit_code != 0 || outcome.signal != 0)
+		{
+			log_error("录制进程执行失败", {
+				{ "room_id", room_id },
+				{ "recorder", recorder_kind_name(kind) },
+				{ "exit_code", outcome.exit_code },
+				{ "signal", outcome.signal },
+				{ "message", outcome.last_message } });
+		}
+		write_capture_manifest(context, target, output_path, started_at, writer ? &writer->hasher() : nullptr);
+#else
+		(void)control;
+		(void)started_at;
+		(void)stall_timeout;
+		(void)max_duration;
+		log_warn("当前平台不支持启动录制进程，已输出命令供手动执行", { { "room_id", room_id } });
+#endif
+	}
+
+	enum class StreamVariant
+	{
+		standard,
+		orig,
+	};
+
+	const char* stream_variant_name(StreamVariant variant)
+	{
+		return variant == StreamVariant::orig ? "原画(_orig)" : "标准";
+	}
+
+	std::string build_stream_url(const Config& config, const std::string& room_id, StreamVariant variant)
+	{
+		if (variant == StreamVariant::standard)
+		{
+			return build_rtmp_url(config, room_id);
+		}
+
+		std::string url = config.recording.orig_stream_url_template;
+		const std::string_view placeholder = "{room_id}";
+		for (auto pos = url.find(placeholder); pos != std::string::npos; pos = url.find(placeholder, pos + room_id.size()))
+		{
+			url.replace(pos, placeholder.size(), room_id);
+		}
+		return url;
+	}
+
+	struct CurlEasyDeleter
+	{
+		void operator()(CURL* curl) const
+		{
+			curl_easy_cleanup(curl);
+		}
+	};
+
+	using CurlEasyHandle = std::unique_ptr<CURL, CurlEasyDeleter>;
+
+	struct HttpFlvWriteState
+	{
+		std::ofstream* output = nullptr;
+#ifdef __linux__
+		// 非空时写入 I/O 运行时，output 不使用
+		AsyncFileWriter* async_output = nullptr;
+		// 因写盘积压暂停了传输，待写入回落后恢复
+		bool paused = false;
+#endif
+		CaptureControl* control = nullptr;
+		RelayPublication* relay = nullptr;
+		CURL* curl = nullptr;
+		CdnConnectionWarmer* warmer = nullptr;
+		const std::string* room_id = nullptr;
+		bool first_byte_seen = false;
+		Blake3Hasher* hasher = nullptr;
+		// 续写时把新连接的数据重写后接到原文件末尾
+		FlvTagRewriter* rewriter = nullptr;
+		std::string rewritten;
+		std::chrono::steady_clock::time_point request_started;
+	};
+
+	size_t http_flv_write_callback(char* ptr, size_t size, size_t nmemb, void* userdata)
+	{
+		auto* state = static_cast<HttpFlvWriteState*>(userdata);
+		const auto count = size * nmemb;
+#ifdef __linux__
+		// 暂停时本段数据不算消费，恢复后 libcurl 会重新交付
+		if (state->async_output && state->async_output->backlogged())
+		{
+			state->paused = true;
+			return CURL_WRITEFUNC_PAUSE;
+		}
+#endif
+		std::string_view data(ptr, count);
+		if (state->rewriter)
+		{
+			state->rewritten.clear();
+			state->rewriter->feed(ptr, count, state->rewritten);
+			if (state->rewriter->failed())
+			{
+				return 0;
+			}
+			data = state->rewritten;
+		}
+
+#ifdef __linux__
+		if (state->async_output)
+		{
+			if (!state->async_output->append(data.data(), data.size()))
+			{
+				return 0;
+			}
+		}
+		else
+#endif
+		{
+			state->output->write(data.data(), static_cast<std::streamsize>(data.size()));
+			if (!*state->output)
+			{
+				return 0;
+			}
+		}
+
+		state->control->bytes_written.fetch_add(data.size(), std::memory_order_relaxed);
+		if (state->hasher)
+		{
+			state->hasher->update(data.data(), data.size());
+		}
+		if (!state->first_byte_seen)
+		{
+			state->first_byte_seen = true;
+			if (Tracer::instance().enabled())
+			{
+				// 连接阶段（TCP + TLS）取自 libcurl 的计时，首字节区间覆盖从发起请求到收到第一段数据
+				curl_off_t connect_us = 0;
+				curl_easy_getinfo(state->curl, CURLINFO_APPCONNECT_TIME_T, &connect_us);
+				if (connect_us == 0)
+				{
+					curl_easy_getinfo(state->curl, CURLINFO_CONNECT_TIME_T, &connect_us);
+				}
+				Tracer::instance().record("connect", state->request_started, state->request_started + std::chrono::microseconds(connect_us), *state->room_id);
+				Tracer::instance().record("first_byte", state->request_started, std::chrono::steady_clock::now(), *state->room_id);
+			}
+			if (state->warmer)
+			{
+				// 没有新建连接说明复用了预热好的连接
+				curl_off_t first_byte_us = 0;
+				long new_connections = 0;
+				curl_easy_getinfo(state->curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte_us);
+				curl_easy_getinfo(state->curl, CURLINFO_NUM_CONNECTS, &new_connections);
+				state->warmer->record_first_byte(*state->room_id,
+					std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::microseconds(first_byte_us)),
+					new_connections == 0);
+			}
+		}
+		if (state->relay)
+		{
+			state->relay->feed(ptr, count);
+		}
+		return count;
+	}
+
+	int http_flv_progress_callback(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+	{
+		const auto* control = static_cast<const CaptureControl*>(userdata);
+		return control->stop_requested.load(std::memory_order_relaxed) ? 1 : 0;
+	}
+
+	// 在进程内直接通过 libcurl 拉取 HTTP-FLV 流（_orig 原画流只提供 HTTP 形式）。
+	// 构造时完成选盘、建文件与 libcurl 设置，传输结束后由 finish 收尾；
+	// 同步模式在录制线程上 curl_easy_perform，异步模式把句柄交给 I/O 运行时并以 AsyncFileWriter 写盘
+	class HttpFlvCapture
+	{
+	public:
+		HttpFlvCapture(const CaptureContext& context, const CaptureTarget& target, CaptureControl& control)
+			: context_(context), target_(target), control_(control),
+			placement_(place_capture(context, target, &control, true, resume_)),
+			started_at_(std::chrono::system_clock::now()),
+			curl_(curl_easy_init()),
+			relay_(context.relay, target.host_id, target.room_id)
+		{
+			const auto& output_path = placement_.path();
+			if (resume_)
+			{
+				hash_existing_file(hasher_, output_path);
+				rewriter_.emplace(*resume_);
+				state_.rewriter = &*rewriter_;
+				control.bytes_written.store(resume_->bytes, std::memory_order_relaxed);
+			}
+#ifdef __linux__
+			if (context.io)
+			{
+				async_output_.emplace(context.io->runtime, output_path,
+					static_cast<std::size_t>(context.io->config.write_block_kb) * 1024,
+					static_cast<std::size_t>(context.io->config.max_pending_write_mb) * 1024 * 1024,
+					resume_ ? resume_->bytes : 0);
+				async_output_->set_drain_callback([this]()
+					{
+						if (state_.paused)
+						{
+							state_.paused = false;
+							curl_easy_pause(curl_.get(), CURLPAUSE_CONT);
+						}
+					});
+				state_.async_output = &*async_output_;
+			}
+			else
+#endif
+			{
+				output_.open(output_path, std::ios::binary | (resume_ ? std::ios::app : std::ios::trunc));
+				if (!output_)
+				{
+					throw std::runtime_error("无法创建录制文件: " + output_path.string());
+				}
+				state_.output = &output_;
+			}
+
+			if (!curl_)
+			{
+				throw std::runtime_error("无法初始化 libcurl");
+			}
+
+			state_.control = &control;
+			state_.relay = relay_.active() ? &relay_ : nullptr;
+			state_.curl = curl_.get();
+			state_.warmer = context.warmer;
+			state_.room_id = &target_.room_id;
+			state_.hasher = &hasher_;
+			if (context.warmer)
+			{
+				context.warmer->attach(curl_.get());
+			}
+			curl_easy_setopt(curl_.get(), CURLOPT_URL, target_.stream_url.c_str());
+			curl_easy_setopt(curl_.get(), CURLOPT_WRITEFUNCTION, http_flv_write_callback);
+			curl_easy_setopt(curl_.get(), CURLOPT_WRITEDATA, &state_);
+			curl_easy_setopt(curl_.get(), CURLOPT_NOPROGRESS, 0L);
+			curl_easy_setopt(curl_.get(), CURLOPT_XFERINFOFUNCTION, http_flv_progress_callback);
+			curl_easy_setopt(curl_.get(), CURLOPT_XFERINFODATA, &control);
+			curl_easy_setopt(curl_.get(), CURLOPT_FOLLOWLOCATION, 1L);
+			curl_easy_setopt(curl_.get(), CURLOPT_FAILONERROR, 1L);
+			curl_easy_setopt(curl_.get(), CURLOPT_CONNECTTIMEOUT, 15L);
+			// 连续 30 秒没有数据视为直播已结束或连接卡死
+			curl_easy_setopt(curl_.get(), CURLOPT_LOW_SPEED_LIMIT, 1L);
+			curl_easy_setopt(curl_.get(), CURLOPT_LOW_SPEED_TIME, 30L);
+
+			// 消息抓取最后启动，构造失败时不会留下无人停止的协程
+			if (context.config.chat.enabled)
+			{
+#ifdef __linux__
+				if (context.io)
+				{
+					async_chat_ = ChatCapture::start_async(*context.io, context.config, target_, output_path);
+				}
+				else
+#endif
+				{
+					chat_.emplace(context.config, target_, output_path);
+				}
+			}
+		}
+
+		~HttpFlvCapture()
+		{
+#ifdef __linux__
+			if (async_chat_)
+			{
+				async_chat_->request_stop();
+			}
+#endif
+		}
+
+		HttpFlvCapture(const HttpFlvCapture&) = delete;
+		HttpFlvCapture& operator=(const HttpFlvCapture&) = delete;
+
+		CURL* begin()
+		{
+			log_info("开始通过 HTTP-FLV 下载直播流", {
+				{ "room_id", target_.room_id },
+				{ "url", target_.stream_url },
+				{ "path", placement_.path() },
+				{ "resume_bytes", resume_ ? resume_->bytes : 0 } });
+			state_.request_started = std::chrono::steady_clock::now();
+			return curl_.get();
+		}
+
+#ifdef __linux__
+		// 异步模式下 finish 前须等待剩余数据落盘、消息抓取写完最后一块
+		AsyncFileWriter& async_output()
+		{
+			return *async_output_;
+		}
+
+		ChatCapture* async_chat() const
+		{
+			return async_chat_.get();
+		}
+#endif
+
+		void finish(CURLcode res)
+		{
+			const auto& output_path = placement_.path();
+			const auto& room_id = target_.room_id;
+			if (output_.is_open())
+			{
+				output_.close();
+			}
+#ifdef __linux__
+			if (async_output_ && !async_output_->error().empty())
+			{
+				log_error("HTTP-FLV 录制写盘失败", { { "room_id", room_id }, { "path", output_path }, { "error", async_output_->error() } });
+			}
+#endif
+			write_capture_manifest(context_, target_, output_path, started_at_, &hasher_);
+
+			if (res == CURLE_ABORTED_BY_CALLBACK && control_.stop_requested.load(std::memory_order_relaxed))
+			{
+				log_info("HTTP-FLV 录制已按调度要求停止", { { "room_id", room_id }, { "path", output_path } });
+				return;
+			}
+
+			if (res != CURLE_OK)
+			{
+				log_warn("HTTP-FLV 录制结束", { { "room_id", room_id }, { "reason", curl_easy_strerror(res) } });
+			}
+		}
+
+	private:
+		const CaptureContext& context_;
+		const CaptureTarget& target_;
+		CaptureControl& control_;
+		std::optional<FlvResumePoint> resume_;
+		const StorageManager::Placement placement_;
+		const std::chrono::system_clock::time_point started_at_;
+		std::ofstream output_;
+		CurlEasyHandle curl_;
+		RelayPublication relay_;
+		Blake3Hasher hasher_;
+		std::optional<FlvTagRewriter> rewriter_;
+		HttpFlvWriteState state_;
+#ifdef __linux__
+		std::optional<AsyncFileWriter> async_output_;
+		std::shared_ptr<ChatCapture> async_chat_;
+#endif
+		std::optional<ChatCapture> chat_;
+	};
+
+	void run_http_flv_capture(const CaptureContext& context, const CaptureTarget& target, CaptureControl& control)
+	{
+		HttpFlvCapture capture(context, target, control);
+		capture.finish(curl_easy_perform(capture.begin()));
+	}
+
+#ifdef __linux__
+	// 协程版本：传输与写盘都在 I/O 运行时上进行，结束时设置 finished 供调度器回收
+	DetachedTask run_http_flv_capture_async(const CaptureContext& context, CaptureTarget target, CaptureControl& control)
+	{
+		try
+		{
+			HttpFlvCapture capture(context, target, control);
+			const auto result = co_await context.io->curl.transfer(capture.begin());
+			co_await capture.async_output().flush();
+			if (auto* chat = capture.async_chat())
+			{
+				co_await chat->stop();
+			}
+			capture.finish(result);
+		}
+		catch (const std::exception& ex)
+		{
+			log_error("处理直播间时发生错误", { { "room_id", target.room_id }, { "error", ex.what() } });
+		}
+		control.finished.store(true);
+	}
 #endif
 
-	void trigger_rtmpdump(const Config& config, const std::string& stream_url, const std::string& room_id)
-	{
-		const auto output_path = prepare_download_path(config.download, room_id);
+	void run_capture(const CaptureContext& context, const CaptureTarget& target, CaptureControl& control)
+	{
+		if (is_http_stream_url(target.stream_url))
+		{
+			run_http_flv_capture(context, target, control);
+			return;
+		}
+
+		run_recorder_process(context, target, &control);
+	}
+
+	// 在录制前做准入控制：按优先级分配下行带宽，必要时把低优先级的原画流降级为标准流，其余排队等待
+	class RecordingScheduler
+	{
+	public:
+		explicit RecordingScheduler(const CaptureContext& context)
+			: config_(context.config), context_(context)
+		{
+		}
+
+		RecordingScheduler(const RecordingScheduler&) = delete;
+		RecordingScheduler& operator=(const RecordingScheduler&) = delete;
+
+		~RecordingScheduler()
+		{
+			for (auto& capture : active_)
+			{
+				capture.control->stop_requested.store(true);
+			}
+			for (auto& capture : stopping_)
+			{
+				capture.control->stop_requested.store(true);
+			}
+			for (auto& capture : active_)
+			{
+				join(capture);
+			}
+			for (auto& capture : stopping_)
+			{
+				join(capture);
+			}
+		}
+
+		bool is_recording(const std::string& host_id) const
+		{
+			return std::any_of(active_.begin(), active_.end(), [&](const ActiveCapture& capture)
+				{
+					return capture.host->host_id == host_id;
+				});
+		}
+
+		void submit(const HostConfig& host, const std::string& room_id)
+		{
+			if (is_recording(host.host_id))
+			{
+				return;
+			}
+
+			for (auto& pending : pending_)
+			{
+				if (pending.host->host_id == host.host_id)
+				{
+					pending.room_id = room_id;
+					return;
+				}
+			}
+
+			PendingCapture pending;
+			pending.host = &host;
+			pending.room_id = room_id;
+			pending.queued_at = std::chrono::steady_clock::now();
+			pending_.push_back(std::move(pending));
+		}
+
+		// 主播已下播时撤销尚未开始的录制
+		void withdraw(const std::string& host_id)
+		{
+			pending_.erase(
+				std::remove_if(pending_.begin(), pending_.end(), [&](const PendingCapture& pending)
+					{
+						return pending.host->host_id == host_id;
+					}),
+				pending_.end());
+		}
+
+		// 轮询确认主播已下播；请求失败不算，续写的机会保留到时限
+		void confirm_offline(const std::string& host_id)
+		{
+			drop_resumable(host_id, "主播已下播");
+		}
+
+		void update()
+		{
+			reap_finished();
+			sample_bitrates();
+			expire_resumable();
+			admit_pending();
+		}
+
+		// 登记重启前未完成的录制：主播在 deadline 前再次被检测到同一直播间时续写原文件
+		void restore(const std::vector<RecordingStateSnapshot>& recordings, std::chrono::steady_clock::time_point deadline)
+		{
+			for (const auto& recording : recordings)
+			{
+				const bool known = std::any_of(config_.hosts.begin(), config_.hosts.end(), [&](const HostConfig& host)
+					{
+						return host.host_id == recording.host_id;
+					});
+				if (!known || resumable_.count(recording.host_id) > 0)
+				{
+					context_.storage.release_held(recording.path);
+					continue;
+				}
+
+				log_info("等待续写重启前的录制", { { "host", recording.host_id }, { "room_id", recording.room_id }, { "path", recording.path } });
+				resumable_.emplace(recording.host_id, ResumableRecording{ recording, deadline });
+			}
+		}
+
+		// 正在进行与等待续写的录制，写入状态快照
+		std::vector<RecordingStateSnapshot> snapshot() const
+		{
+			std::vector<RecordingStateSnapshot> recordings;
+			for (const auto& capture : active_)
+			{
+				auto path = context_.storage.active_path(capture.control.get());
+				if (!path)
+				{
+					continue;
+				}
+				RecordingStateSnapshot recording;
+				recording.host_id = capture.host->host_id;
+				recording.room_id = capture.room_id;
+				recording.orig = capture.variant == StreamVariant::orig;
+				recording.path = std::move(*path);
+				recording.bytes = capture.control->bytes_written.load(std::memory_order_relaxed);
+				recordings.push_back(std::move(recording));
+			}
+			for (const auto& [host_id, resumable] : resumable_)
+			{
+				recordings.push_back(resumable.recording);
+			}
+			return recordings;
+		}
+
+	private:
+		struct PendingCapture
+		{
+			const HostConfig* host = nullptr;
+			std::string room_id;
+			std::optional<StreamVariant> forced_variant;
+			std::chrono::steady_clock::time_point queued_at;
+			bool queue_reported = false;
+		};
+
+		struct ActiveCapture
+		{
+			const HostConfig* host = nullptr;
+			std::string room_id;
+			StreamVariant variant = StreamVariant::standard;
+			int reserved_kbps = 0;
+			double measured_kbps = 0.0;
+			std::uint64_t last_bytes = 0;
+			std::chrono::steady_clock::time_point started_at;
+			std::chrono::steady_clock::time_point last_sample_at;
+			std::unique_ptr<CaptureControl> control;
+			std::thread worker;
+		};
+
+		struct ResumableRecording
+		{
+			RecordingStateSnapshot recording;
+			std::chrono::steady_clock::time_point deadline;
+		};
+
+		// 录制稳定前使用配置中的预估码率，之后使用实测码率
+		static constexpr auto measurement_warmup = std::chrono::seconds(15);
+
+		// 运行在 I/O 运行时上的录制没有独立线程，只能等待其结束标志
+		static void join(ActiveCapture& capture)
+		{
+			if (capture.worker.joinable())
+			{
+				capture.worker.join();
+				return;
+			}
+			while (!capture.control->finished.load())
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			}
+		}
+
+		int estimated_kbps(StreamVariant variant) const
+		{
+			return variant == StreamVariant::orig ? config_.recording.orig_stream_kbps : config_.recording.standard_stream_kbps;
+		}
+
+		int usage_kbps(const ActiveCapture& capture) const
+		{
+			if (std::chrono::steady_clock::now() - capture.started_at < measurement_warmup || capture.measured_kbps <= 0.0)
+			{
+				return capture.reserved_kbps;
+			}
+			return static_cast<int>(capture.measured_kbps + 0.5);
+		}
+
+		int committed_kbps() const
+		{
+			int total = 0;
+			for (const auto& capture : active_)
+			{
+				total += usage_kbps(capture);
+			}
+			return total;
+		}
+
+		bool fits(int kbps) const
+		{
+			if (config_.recording.max_ingress_kbps <= 0)
+			{
+				return true;
+			}
+			return committed_kbps() + kbps <= config_.recording.max_ingress_kbps;
+		}
+
+		bool concurrency_available() const
+		{
+			const int limit = config_.recording.max_concurrent_recordings;
+			return limit <= 0 || static_cast<int>(active_.size()) < limit;
+		}
+
+		StreamVariant preferred_variant(const PendingCapture& pending) const
+		{
+			if (pending.forced_variant)
+			{
+				return *pending.forced_variant;
+			}
+			if (pending.host->prefer_orig && !config_.recording.orig_stream_url_template.empty())
+			{
+				return StreamVariant::orig;
+			}
+			return StreamVariant::standard;
+		}
+
+		void reap_finished()
+		{
+			for (auto it = active_.begin(); it != active_.end();)
+			{
+				if (!it->control->finished.load())
+				{
+					++it;
+					continue;
+				}
 
-		std::cout << "下载输出路径: " << output_path << '\n';
+				join(*it);
+				log_info("录制已结束", {
+					{ "host", it->host->host_id },
+					{ "room_id", it->room_id },
+					{ "written_kb", it->control->bytes_written.load() / 1024 } });
+				it = active_.erase(it);
+			}
 
-		const auto command = build_rtmpdump_command(config.programs, stream_url, output_path);
-		std::cout << "rtmpdump 命令: " << command << '\n';
+			for (auto it = stopping_.begin(); it != stopping_.end();)
+			{
+				if (!it->control->finished.load())
+				{
+					++it;
+					continue;
+				}
 
-#ifdef _WIN32
-		std::wostringstream command_line_stream;
-		const std::wstring exe_path = config.programs.rtmpdump_exe.wstring();
-		const std::wstring stream_url_w = widen_utf8(stream_url);
-		const std::wstring output_path_w = output_path.wstring();
-		command_line_stream << L'"' << exe_path << L'"' << L" -r " << L'"' << stream_url_w << L'"' << L" -o " << L'"' << output_path_w << L'"' << L" --live";
-		std::wstring command_line = command_line_stream.str();
+				join(*it);
+				it = stopping_.erase(it);
+			}
+		}
 
-		std::vector<wchar_t> command_buffer(command_line.begin(), command_line.end());
-		command_buffer.push_back(L'\0');
+		void drop_resumable(const std::string& host_id, const char* reason)
+		{
+			const auto it = resumable_.find(host_id);
+			if (it == resumable_.end())
+			{
+				return;
+			}
+			log_info("不再续写重启前的录制", { { "host", host_id }, { "path", it->second.recording.path }, { "reason", reason } });
+			context_.storage.release_held(it->second.recording.path);
+			resumable_.erase(it);
+		}
 
-		STARTUPINFOW startup_info{};
-		startup_info.cb = sizeof(startup_info);
-		PROCESS_INFORMATION process_info{};
+		void expire_resumable()
+		{
+			const auto now = std::chrono::steady_clock::now();
+			for (auto it = resumable_.begin(); it != resumable_.end();)
+			{
+				const auto current = it++;
+				if (now >= current->second.deadline)
+				{
+					drop_resumable(current->first, "超过续写时限");
+				}
+			}
+		}
 
-		std::cout << "开始调用 rtmpdump 下载 RTMP 流...\n";
+		void sample_bitrates()
+		{
+			const auto now = std::chrono::steady_clock::now();
+			for (auto& capture : active_)
+			{
+				const auto elapsed = std::chrono::duration<double>(now - capture.last_sample_at).count();
+				if (elapsed < 1.0)
+				{
+					continue;
+				}
 
-		if (!CreateProcessW(
-			nullptr,
-			command_buffer.data(),
-			nullptr,
-			nullptr,
-			FALSE,
-			0,
-			nullptr,
-			nullptr,
-			&startup_info,
-			&process_info))
+				const auto bytes = capture.control->bytes_written.load(std::memory_order_relaxed);
+				const double instant_kbps = static_cast<double>(bytes - capture.last_bytes) * 8.0 / 1000.0 / elapsed;
+				capture.measured_kbps = capture.measured_kbps <= 0.0
+					? instant_kbps
+					: capture.measured_kbps * 0.8 + instant_kbps * 0.2;
+				capture.last_bytes = bytes;
+				capture.last_sample_at = now;
+			}
+		}
+
+		void start(const PendingCapture& pending, StreamVariant variant)
 		{
-			const DWORD error = GetLastError();
-			std::ostringstream oss;
-			oss << "无法启动 rtmpdump，错误代码: " << error;
-			if (const auto message = format_windows_error(error); !message.empty())
+			ActiveCapture capture;
+			capture.host = pending.host;
+			capture.room_id = pending.room_id;
+			capture.variant = variant;
+			capture.reserved_kbps = estimated_kbps(variant);
+			capture.started_at = std::chrono::steady_clock::now();
+			capture.last_sample_at = capture.started_at;
+			capture.control = std::make_unique<CaptureControl>();
+
+			const auto stream_url = build_stream_url(config_, pending.room_id, variant);
+			log_info("准入录制", {
+				{ "host", pending.host->host_id },
+				{ "room_id", pending.room_id },
+				{ "priority", pending.host->priority },
+				{ "variant", stream_variant_name(variant) },
+				{ "committed_kbps", committed_kbps() },
+				{ "url", stream_url } });
+
+			CaptureTarget target{ pending.host->host_id, pending.room_id, stream_url, pending.host };
+			if (const auto it = resumable_.find(pending.host->host_id); it != resumable_.end())
 			{
-				oss << " (" << message << ')';
+				// 只有同一直播间、同一清晰度的流才接到原文件之后
+				const auto& recording = it->second.recording;
+				if (recording.room_id == pending.room_id && recording.orig == (variant == StreamVariant::orig))
+				{
+					target.resume_path = recording.path;
+					capture.last_bytes = recording.bytes;
+					resumable_.erase(it);
+				}
+				else
+				{
+					drop_resumable(pending.host->host_id, "直播间或清晰度已变化");
+				}
 			}
-			throw std::runtime_error(oss.str());
+#ifdef __linux__
+			if (context_.io && is_http_stream_url(stream_url))
+			{
+				context_.io->runtime.post([this, control = capture.control.get(), target]()
+					{
+						run_http_flv_capture_async(context_, target, *control);
+					});
+				active_.push_back(std::move(capture));
+				return;
+			}
+#endif
+
+			capture.worker = std::thread([this, control = capture.control.get(), target = std::move(target)]()
+				{
+					const auto& room_id = target.room_id;
+					Tracer::instance().set_thread_name("capture-" + target.host_id);
+					try
+					{
+						TraceSpan span("capture", room_id);
+						run_capture(context_, target, *control);
+					}
+					catch (const std::exception& ex)
+					{
+						log_error("处理直播间时发生错误", { { "room_id", room_id }, { "error", ex.what() } });
+					}
+					control->finished.store(true);
+				});
+
+			active_.push_back(std::move(capture));
+		}
+
+		// 尝试通过降级低优先级的原画录制为 required_kbps 腾出带宽
+		bool downgrade_for(int priority, int required_kbps)
+		{
+			if (config_.recording.max_ingress_kbps <= 0)
+			{
+				return false;
+			}
+
+			std::vector<std::size_t> candidates;
+			for (std::size_t i = 0; i < active_.size(); ++i)
+			{
+				if (active_[i].variant == StreamVariant::orig && active_[i].host->priority < priority)
+				{
+					candidates.push_back(i);
+				}
+			}
+			std::sort(candidates.begin(), candidates.end(), [&](std::size_t lhs, std::size_t rhs)
+				{
+					return active_[lhs].host->priority < active_[rhs].host->priority;
+				});
+
+			const int available = config_.recording.max_ingress_kbps - committed_kbps();
+			int freed = 0;
+			std::size_t used = 0;
+			while (available + freed < required_kbps && used < candidates.size())
+			{
+				const auto& capture = active_[candidates[used]];
+				freed += std::max(0, usage_kbps(capture) - estimated_kbps(StreamVariant::standard));
+				++used;
+			}
+
+			if (available + freed < required_kbps)
+			{
+				return false;
+			}
+
+			candidates.resize(used);
+			std::sort(candidates.begin(), candidates.end(), std::greater<>());
+			for (const auto index : candidates)
+			{
+				auto& capture = active_[index];
+				log_info("为更高优先级的录制腾出带宽，降级为标准流", { { "host", capture.host->host_id }, { "room_id", capture.room_id } });
+				capture.control->stop_requested.store(true);
+				PendingCapture pending;
+				pending.host = capture.host;
+				pending.room_id = capture.room_id;
+				pending.forced_variant = StreamVariant::standard;
+				pending.queued_at = capture.started_at;
+				pending_.push_back(std::move(pending));
+				stopping_.push_back(std::move(capture));
+				active_.erase(active_.begin() + static_cast<std::ptrdiff_t>(index));
+			}
+
+			return true;
 		}
 
-		WaitForSingleObject(process_info.hProcess, INFINITE);
+		void admit_pending()
+		{
+			while (concurrency_available() && admit_next())
+			{
+			}
+		}
 
-		DWORD exit_code = 0;
-		if (GetExitCodeProcess(process_info.hProcess, &exit_code) && exit_code != 0)
+		// 按优先级顺序寻找第一个可以准入的录制，成功准入返回 true
+		bool admit_next()
 		{
-			std::cerr << "rtmpdump 执行失败，退出码: " << exit_code << '\n';
+			std::stable_sort(pending_.begin(), pending_.end(), [](const PendingCapture& lhs, const PendingCapture& rhs)
+				{
+					if (lhs.host->priority != rhs.host->priority)
+					{
+						return lhs.host->priority > rhs.host->priority;
+					}
+					return lhs.queued_at < rhs.queued_at;
+				});
+
+			for (std::size_t i = 0; i < pending_.size(); ++i)
+			{
+				const StreamVariant preferred = preferred_variant(pending_[i]);
+				std::optional<StreamVariant> admitted;
+				if (fits(estimated_kbps(preferred)))
+				{
+					admitted = preferred;
+				}
+				else if (preferred == StreamVariant::orig && fits(estimated_kbps(StreamVariant::standard)))
+				{
+					admitted = StreamVariant::standard;
+				}
+				else if (downgrade_for(pending_[i].host->priority, estimated_kbps(StreamVariant::standard)))
+				{
+					admitted = StreamVariant::standard;
+				}
+
+				if (!admitted)
+				{
+					if (!pending_[i].queue_reported)
+					{
+						log_info("下行带宽不足，录制进入排队", {
+							{ "host", pending_[i].host->host_id },
+							{ "room_id", pending_[i].room_id },
+							{ "committed_kbps", committed_kbps() } });
+						pending_[i].queue_reported = true;
+					}
+					continue;
+				}
+
+				// downgrade_for 可能向队列追加条目，先取出再启动
+				const PendingCapture pending = pending_[i];
+				pending_.erase(pending_.begin() + static_cast<std::ptrdiff_t>(i));
+				start(pending, *admitted);
+				return true;
+			}
+
+			return false;
 		}
 
-		CloseHandle(process_info.hThread);
-		CloseHandle(process_info.hProcess);
-#else
-		std::cout << "当前环境不是 Windows，已输出 rtmpdump 命令供手动执行。\n";
-#endif
-	}
+		const Config& config_;
+		const CaptureContext context_;
+		std::vector<ActiveCapture> active_;
+		std::vector<ActiveCapture> stopping_;
+		std::vector<PendingCapture> pending_;
+		std::unordered_map<std::string, ResumableRecording> resumable_;
+	};
 
 } // namespace
 
-
-int main()
+// 测试与基准程序直接包含本文件以使用内部实现，此时由它们提供入口
+#ifndef RN_NO_MAIN
+int main(int argc, char* argv[])
 {
 #ifdef _WIN32
 	SetConsoleOutputCP(CP_UTF8);
 #else
 	std::setlocale(LC_ALL, "");
 #endif
+	LoggerShutdownGuard logger_shutdown;
+	TracerShutdownGuard tracer_shutdown;
 	try
 	{
+		if (argc > 1 && std::string_view(argv[1]) == "repair")
+		{
+			return run_flv_repair(argc, argv);
+		}
+		if (argc > 1 && std::string_view(argv[1]) == "dedup")
+		{
+			return run_flv_dedup(argc, argv);
+		}
+		if (argc > 1 && std::string_view(argv[1]) == "chat-export")
+		{
+			return run_chat_export(argc, argv);
+		}
+
 		const fs::path config_path = "config.json";
 		Config config = parse_config(config_path);
 
-		std::cout << "已定位 rtmpdump 可执行文件: " << config.programs.rtmpdump_exe.string() << '\n';
+		Logger::instance().configure(config.logging);
+		Tracer::instance().configure(config.tracing);
+		Tracer::instance().set_thread_name("main");
+		if (!config.programs.rtmpdump_exe.empty())
+		{
+			log_info("已定位 rtmpdump 可执行文件", { { "path", config.programs.rtmpdump_exe } });
+		}
+#ifndef __linux__
+		if (config.programs.pipe_output)
+		{
+			log_warn("当前平台不支持 pipe_output，录制进程仍直接写入文件");
+		}
+#endif
+		if (config.footprint.low)
+		{
+			log_info("已启用低内存模式", {
+				{ "max_response_kb", config.footprint.max_response_kb },
+				{ "recording_buffer_kb", config.footprint.recording_buffer_kb },
+				{ "rss_ceiling_mb", config.footprint.rss_ceiling_mb } });
+		}
 
 		if (config.test_mode.enabled)
 		{
@@ -1079,71 +11990,405 @@ int main()
 				throw std::runtime_error("测试模式启用但未提供 fake_room_id");
 			}
 
-			std::cout << "测试模式已启用，使用假 room_id=" << config.test_mode.fake_room_id << '\n';
 			const auto stream_url = build_rtmp_url(config, config.test_mode.fake_room_id);
-			std::cout << "测试模式构建的 RTMP 链接: " << stream_url << '\n';
-			trigger_rtmpdump(config, stream_url, config.test_mode.fake_room_id);
+			log_info("测试模式已启用", { { "room_id", config.test_mode.fake_room_id }, { "url", stream_url } });
+			StorageManager storage(config.download);
+			std::optional<StreamRelayHub> relay;
+			if (config.relay.enabled)
+			{
+				relay.emplace(config.relay);
+			}
+			run_recorder_process({ config, storage, relay ? &*relay : nullptr }, { "test_mode", config.test_mode.fake_room_id, stream_url });
 			return 0;
 		}
 
-		CurlHttpClient http_client(config);
+		// 快照过旧时只恢复轮询状态，录制按新文件开始
+		std::optional<RuntimeSnapshot> snapshot;
+		std::vector<fs::path> held_recordings;
+		const auto resume_window = std::chrono::seconds(config.state.resume_window_seconds);
+		std::chrono::steady_clock::time_point resume_deadline;
+		if (config.state.enabled)
+		{
+			snapshot = read_runtime_snapshot(config.state.path);
+		}
+		if (snapshot)
+		{
+			const auto age = std::chrono::system_clock::now() - from_epoch_ms(snapshot->written_at_ms);
+			log_info("读取到状态快照", {
+				{ "path", config.state.path },
+				{ "age_seconds", std::chrono::duration_cast<std::chrono::seconds>(age).count() },
+				{ "hosts", snapshot->hosts.size() },
+				{ "recordings", snapshot->recordings.size() } });
+			if (age < resume_window)
+			{
+				resume_deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(resume_window - age);
+				for (const auto& recording : snapshot->recordings)
+				{
+					held_recordings.push_back(recording.path);
+				}
+			}
+			else
+			{
+				snapshot->recordings.clear();
+			}
+		}
 
-		std::cout << "使用 host_id: " << config.host_id << '\n';
+		CurlHttpClient http_client(config);
+		StorageManager storage(config.download, held_recordings);
+		std::optional<StreamRelayHub> relay;
+		if (config.relay.enabled)
+		{
+			relay.emplace(config.relay);
+		}
+		std::optional<CdnConnectionWarmer> warmer;
+		if (config.prewarm.enabled)
+		{
+			warmer.emplace(config);
+		}
+#ifdef __linux__
+		ProcessSupervisor supervisor;
+		ProcessSupervisor* supervisor_ptr = &supervisor;
+		std::optional<IoServices> io;
+		if (config.io.backend != IoBackendKind::threads)
+		{
+			io.emplace(config.io);
+			log_info("I/O 运行时已启动", { { "backend", io->runtime.backend_name() } });
+		}
+		IoServices* io_ptr = io ? &*io : nullptr;
+#else
+		ProcessSupervisor* supervisor_ptr = nullptr;
+		IoServices* io_ptr = nullptr;
+#endif
+		RecordingScheduler scheduler({ config, storage, relay ? &*relay : nullptr, warmer ? &*warmer : nullptr, supervisor_ptr, io_ptr });
+		PollResultCache poll_cache(config, http_client.base_headers());
+		const PollEndpointSet endpoints(config.request);
+		const PollEndpoint& status_endpoint = endpoints.status_endpoint();
+		ScheduleModel schedule(config);
+		LatencyTracker status_latency(std::string(status_endpoint.name()));
+		RequestBudget budget(config.request.rate_limit);
+		MemoryReporter memory_reporter(config.footprint);
+
+		for (const auto& host : config.hosts)
+		{
+			log_info("监控主播", { { "host", host.host_id }, { "priority", host.priority }, { "endpoint", status_endpoint.name() } });
+		}
 
-		while (true)
+		using clock = std::chrono::steady_clock;
+		using wall_clock = std::chrono::system_clock;
+		clock::time_point next_history_refresh = clock::now();
+		std::size_t next_history_host = 0;
+		clock::time_point next_prewarm_check = clock::now();
+		clock::time_point next_snapshot = clock::now() + std::chrono::seconds(config.state.interval_seconds);
+		wall_clock::time_point history_refreshed_at;
+		// 快照记录的是系统时间，重启后按剩余时长换算回 steady_clock
+		std::vector<std::optional<wall_clock::time_point>> restored_next_poll(config.hosts.size());
+		std::vector<wall_clock::time_point> next_poll_at(config.hosts.size());
+
+		if (snapshot)
 		{
-			std::optional<std::string> room_id;
 			try
 			{
-				const auto response = http_client.perform_request(config);
-				if (config.http_debug_enabled)
+				const auto wall_now = wall_clock::now();
+				const auto refreshed_at = from_epoch_ms(snapshot->history_refreshed_at_ms);
+				const auto history_due = refreshed_at + std::chrono::hours(config.request.history_refresh_hours);
+				const bool history_fresh = snapshot->history_refreshed_at_ms > 0 && history_due > wall_now;
+				std::size_t restored_hosts = 0;
+				for (const auto& host_snapshot : snapshot->hosts)
+				{
+					const auto it = std::find_if(config.hosts.begin(), config.hosts.end(), [&](const HostConfig& host)
+						{
+							return host.host_id == host_snapshot.host_id;
+						});
+					if (it == config.hosts.end())
+					{
+						continue;
+					}
+					const auto host_index = static_cast<std::size_t>(it - config.hosts.begin());
+					poll_cache.restore(host_index, host_snapshot);
+					if (history_fresh)
+					{
+						schedule.restore(host_index, host_snapshot.start_times, config.polling);
+					}
+					if (host_snapshot.next_poll_ms > 0)
+					{
+						restored_next_poll[host_index] = from_epoch_ms(host_snapshot.next_poll_ms);
+					}
+					++restored_hosts;
+				}
+				if (history_fresh)
+				{
+					history_refreshed_at = refreshed_at;
+					next_history_refresh = clock::now() + std::chrono::duration_cast<clock::duration>(history_due - wall_now);
+				}
+				scheduler.restore(snapshot->recordings, resume_deadline);
+				log_info("已从状态快照恢复", { { "hosts", restored_hosts }, { "history_restored", history_fresh } });
+			}
+			catch (const std::exception& ex)
+			{
+				log_warn("恢复状态快照失败，按冷启动继续", { { "error", ex.what() } });
+			}
+		}
+
+		TimerWheel poll_wheel(config.hosts.size(), std::chrono::milliseconds(250), clock::now());
+		const auto schedule_poll = [&](std::size_t host_index, clock::duration delay)
+			{
+				poll_wheel.schedule(host_index, clock::now() + delay);
+				next_poll_at[host_index] = wall_clock::now() + std::chrono::duration_cast<wall_clock::duration>(delay);
+			};
+		for (std::size_t host_index = 0; host_index < config.hosts.size(); ++host_index)
+		{
+			// 快照中的下一次轮询时间仍在未来时按原计划进行，已过期的照常分散在抖动窗口内；有录制待续写的主播立即轮询
+			clock::duration delay = schedule.initial_poll_delay(host_index);
+			if (const auto& next_poll = restored_next_poll[host_index]; next_poll && *next_poll > wall_clock::now())
+			{
+				delay = std::chrono::duration_cast<clock::duration>(*next_poll - wall_clock::now());
+			}
+			if (snapshot && std::any_of(snapshot->recordings.begin(), snapshot->recordings.end(), [&](const RecordingStateSnapshot& recording)
+				{
+					return recording.host_id == config.hosts[host_index].host_id;
+				}))
+			{
+				delay = clock::duration::zero();
+			}
+			schedule_poll(host_index, delay);
+		}
+		snapshot.reset();
+
+		const auto save_snapshot = [&]()
+			{
+				TraceSpan span("state_snapshot");
+				RuntimeSnapshot current;
+				current.written_at_ms = epoch_ms(wall_clock::now());
+				current.history_refreshed_at_ms = history_refreshed_at == wall_clock::time_point{} ? 0 : epoch_ms(history_refreshed_at);
+				current.hosts.resize(config.hosts.size());
+				for (std::size_t host_index = 0; host_index < config.hosts.size(); ++host_index)
+				{
+					auto& host_snapshot = current.hosts[host_index];
+					host_snapshot.host_id = config.hosts[host_index].host_id;
+					host_snapshot.next_poll_ms = epoch_ms(next_poll_at[host_index]);
+					poll_cache.snapshot(host_index, host_snapshot);
+					for (const auto& start_time : schedule.polling(host_index).possible_start_times)
+					{
+						host_snapshot.start_times.push_back(start_time.original);
+					}
+				}
+				current.recordings = scheduler.snapshot();
+				try
+				{
+					write_runtime_snapshot(config.state.path, current);
+				}
+				catch (const std::exception& ex)
+				{
+					log_warn("写入状态快照失败", { { "path", config.state.path }, { "error", ex.what() } });
+				}
+			};
+
+		const auto handle_poll_result = [&](std::size_t host_index, const CurlHttpClient::BatchResult& result)
+			{
+				const auto& host = config.hosts[host_index];
+				TraceSpan span("handle_poll_result", host.host_id);
+				std::optional<std::string> room_id;
+				try
+				{
+					if (!result.error.empty())
+					{
+						throw std::runtime_error(result.error);
+					}
+
+					const auto& response = result.response;
+					if (auto cached = poll_cache.lookup(host_index, response); cached.unchanged)
+					{
+						room_id = std::move(cached.room_id);
+					}
+					else
+					{
+						poll_cache.debug_dump(host_index, response);
+						room_id = status_endpoint.parse_status(response.body);
+						poll_cache.store(host_index, response, cached, room_id);
+
+						if (!room_id)
+						{
+							log_info("主播当前没有直播间", { { "host", host.host_id } });
+							scheduler.confirm_offline(host.host_id);
+						}
+						else
+						{
+							log_info("检测到直播间", { { "host", host.host_id }, { "room_id", *room_id } });
+						}
+					}
+				}
+				catch (const std::exception& ex)
+				{
+					log_error("请求或解析阶段异常", { { "host", host.host_id }, { "error", ex.what() } });
+				}
+
+				if (room_id)
+				{
+					TraceSpan submit_span("scheduler_submit", *room_id);
+					scheduler.submit(host, *room_id);
+				}
+				else
+				{
+					scheduler.withdraw(host.host_id);
+				}
+			};
+
+		std::vector<std::size_t> due_hosts;
+		// 已到期但尚未取得请求预算的主播，按是否处于加速窗口和优先级排队
+		std::vector<std::size_t> waiting_hosts;
+		std::vector<std::size_t> batch_hosts;
+		std::vector<CurlHttpClient::BatchRequest> batch_requests;
+		std::vector<CurlHttpClient::BatchResult> batch_results;
+		const auto flush_batch = [&]()
+			{
+				if (batch_requests.empty())
 				{
-					std::cout << "HTTP 响应头:\n" << response.headers;
-					std::cout << "HTTP 响应体: " << response.body << '\n';
+					return;
 				}
 
-				const auto response_json = json::parse(response.body);
-				room_id = extract_room_id(response_json);
+				TraceSampleScope sample;
+				TraceSpan span("poll_batch");
+				try
+				{
+					http_client.perform_batch(batch_requests, batch_results, &status_latency);
+					for (std::size_t i = 0; i < batch_hosts.size(); ++i)
+					{
+						budget.record(status_endpoint.name(), batch_results[i].response.status_code, batch_results[i].response.headers);
+						handle_poll_result(batch_hosts[i], batch_results[i]);
+					}
+				}
+				catch (const std::exception& ex)
+				{
+					log_error("批量轮询失败", { { "hosts", batch_hosts.size() }, { "error", ex.what() } });
+				}
+				batch_hosts.clear();
+				batch_requests.clear();
+			};
 
-				if (!room_id)
+		while (true)
+		{
+			if (clock::now() >= next_history_refresh)
+			{
+				bool finished = false;
 				{
-					std::cout << '[' << current_timestamp_string() << "] 当前主播没有直播间。\n";
+					TraceSpan span("seed_history");
+					finished = seed_schedule_from_history(config, endpoints, http_client, schedule, budget, next_history_host);
+				}
+				if (finished)
+				{
+					history_refreshed_at = wall_clock::now();
+					next_history_host = 0;
+					next_history_refresh = clock::now() + std::chrono::hours(config.request.history_refresh_hours);
 				}
 				else
 				{
-					std::cout << "检测到直播间 room_id=" << *room_id << '\n';
+					next_history_refresh = std::max(clock::now() + std::chrono::seconds(1), budget.next_available(endpoints.history_endpoint()->name()));
 				}
 			}
-			catch (const std::exception& ex)
+
+			// 任一主播临近可能的开播时间时保持 CDN 连接预热
+			if (warmer && clock::now() >= next_prewarm_check)
 			{
-				std::cerr << "请求或解析阶段异常: " << ex.what() << '\n';
+				const std::tm tm = current_local_tm();
+				const int current_minutes = tm.tm_hour * 60 + tm.tm_min;
+				bool near_start = false;
+				for (std::size_t host_index = 0; host_index < config.hosts.size() && !near_start; ++host_index)
+				{
+					const auto nearest = minutes_to_nearest_start(schedule.polling(host_index), current_minutes);
+					near_start = nearest && *nearest <= config.prewarm.lead_minutes;
+				}
+				warmer->set_active(near_start);
+				next_prewarm_check = clock::now() + std::chrono::seconds(30);
 			}
 
-			if (room_id)
+			due_hosts.clear();
+			poll_wheel.advance(clock::now(), due_hosts);
+			if (!due_hosts.empty())
 			{
-				const auto stream_url = build_rtmp_url(config, *room_id);
-				std::cout << "使用固定 RTMP 模板构建播放链接: " << stream_url << '\n';
+				log_debug("轮询到期", { { "hosts", due_hosts.size() } });
+			}
 
-				try
+			// 正在录制的主播无需轮询，其余主播进入等待队列。
+			// 预算不足时先满足处于加速窗口内的主播，再按优先级从高到低
+			for (const auto host_index : due_hosts)
+			{
+				if (scheduler.is_recording(config.hosts[host_index].host_id))
 				{
-					trigger_rtmpdump(config, stream_url, *room_id);
+					schedule_poll(host_index, schedule.next_poll_delay(host_index));
+					continue;
 				}
-				catch (const std::exception& ex)
+				if (std::find(waiting_hosts.begin(), waiting_hosts.end(), host_index) == waiting_hosts.end())
+				{
+					waiting_hosts.push_back(host_index);
+				}
+			}
+			if (waiting_hosts.size() > 1)
+			{
+				const std::tm tm = current_local_tm();
+				const int current_minutes = tm.tm_hour * 60 + tm.tm_min;
+				std::stable_sort(waiting_hosts.begin(), waiting_hosts.end(), [&](std::size_t lhs, std::size_t rhs)
+					{
+						const bool lhs_window = is_within_accelerated_window(schedule.polling(lhs), current_minutes);
+						const bool rhs_window = is_within_accelerated_window(schedule.polling(rhs), current_minutes);
+						if (lhs_window != rhs_window)
+						{
+							return lhs_window;
+						}
+						return config.hosts[lhs].priority > config.hosts[rhs].priority;
+					});
+			}
+
+			std::size_t kept = 0;
+			for (const auto host_index : waiting_hosts)
+			{
+				const auto& host = config.hosts[host_index];
+				if (!budget.try_acquire(status_endpoint.name()))
+				{
+					waiting_hosts[kept++] = host_index;
+					continue;
+				}
+
+				schedule_poll(host_index, schedule.next_poll_delay(host_index));
+				batch_hosts.push_back(host_index);
+				batch_requests.push_back({ &host.request_url, poll_cache.request_headers(host_index) });
+				if (batch_requests.size() >= static_cast<std::size_t>(config.request.poll_batch_size))
 				{
-					std::cerr << "处理直播间时发生错误: " << ex.what() << '\n';
+					flush_batch();
 				}
 			}
+			waiting_hosts.resize(kept);
+			flush_batch();
+
+			scheduler.update();
+			poll_cache.report_if_due();
+			status_latency.report_if_due();
+			budget.report_if_due();
+			memory_reporter.poll();
+			if (config.state.enabled && clock::now() >= next_snapshot)
+			{
+				save_snapshot();
+				next_snapshot = clock::now() + std::chrono::seconds(config.state.interval_seconds);
+			}
 
-			const int wait_seconds = determine_wait_seconds(config.polling);
-			std::cout << "等待 " << wait_seconds << " 秒后重试...\n";
-			std::this_thread::sleep_for(std::chrono::seconds(wait_seconds));
+			// 等待时间轮上下一个可能到期的刻度，期间至少每秒回收已结束的录制并准入排队中的录制
+			auto next_due = std::min<clock::time_point>(poll_wheel.next_expiry(), clock::now() + std::chrono::seconds(1));
+			if (!waiting_hosts.empty())
+			{
+				next_due = std::min(next_due, budget.next_available(status_endpoint.name()));
+			}
+			const auto now = clock::now();
+			if (next_due > now)
+			{
+				std::this_thread::sleep_for(next_due - now);
+			}
 		}
 	}
 	catch (const std::exception& ex)
 	{
-		std::cerr << "程序异常: " << ex.what() << '\n';
+		log_error("程序异常", { { "error", ex.what() } });
 		return 1;
 	}
 
 	return 0;
 }
+#endif
@@ -0,0 +1,109 @@
+"""user-027：多路录制在下行带宽上限内的准入控制。
+
+替身服务按时间表让 6 个主播先后开播、下播，原画流与标准流按各自的预估码率发送，
+再从主程序的日志与替身服务收到的直播流请求中核对：
+最高优先级的主播录原画；放不下原画的主播回落到标准流；更高优先级的主播到来时低优先级的原画录制降级为标准流；
+仍放不下的主播排队，带宽空出后才开始录制，排队期间下播的主播不再录制。
+用法：python3 admission_load.py <rednote_rtmp_download 路径>
+"""
+
+import sys
+
+import standin
+
+MAX_INGRESS_KBPS = 6000
+ORIG_KBPS = 2500
+STANDARD_KBPS = 1000
+
+# 主播、优先级、是否优先原画、(开播, 下播) 秒数
+HOSTS = [
+    ("top", 10, True, (0, None)),
+    ("low", 1, True, (0, None)),
+    ("late", 5, True, (3, 12)),
+    ("urgent", 7, False, (6, None)),
+    ("queued", 0, False, (8.5, None)),
+    ("gone", 3, False, (8.5, 10.5)),
+]
+
+# 日志中 variant 字段的取值，见 stream_variant_name
+ORIG = "原画(_orig)"
+STANDARD = "标准"
+
+EVENTS = ["准入录制", "为更高优先级的录制腾出带宽，降级为标准流", "下行带宽不足，录制进入排队", "录制已结束"]
+
+
+def index_of(events, message, host, variant=None, after=-1):
+    for index, (event, fields) in enumerate(events):
+        if index > after and event == message and fields.get("host") == host and variant in (None, fields.get("variant")):
+            return index
+    return None
+
+
+def main():
+    binary = sys.argv[1]
+    print("[ RUN  ] admission_load")
+    host_ids = [host_id for host_id, _, _, _ in HOSTS]
+    windows = {host_id: window for host_id, _, _, window in HOSTS}
+    with standin.StandInServer(live_hosts=host_ids, stream_kbps=STANDARD_KBPS, orig_kbps=ORIG_KBPS, windows=windows) as server:
+        config = standin.merge_config(standin.base_config(server, []), {
+            "host_id": [{"host_id": host_id, "priority": priority, "prefer_orig": orig} for host_id, priority, orig, _ in HOSTS],
+            "recording": {
+                "max_ingress_kbps": MAX_INGRESS_KBPS,
+                "standard_stream_kbps": STANDARD_KBPS,
+                "orig_stream_kbps": ORIG_KBPS,
+            },
+        })
+        with standin.Recorder(binary, config) as recorder:
+            # queued 在 late 下播、带宽空出后开始录制
+            if not standin.wait_until(lambda: server.room_id("queued") in server.first_stream_byte_at, 30):
+                print("[ FAIL ] admission_load: 排队的录制没有在带宽空出后开始\n" + recorder.log_text())
+                return 1
+            recorder.stop()
+            events = recorder.log_events(EVENTS)
+            log_text = recorder.log_text()
+        requests = list(server.stream_requests)
+
+    failures = []
+
+    def expect(condition, message):
+        if not condition:
+            failures.append(message)
+
+    expect(index_of(events, "准入录制", "top", ORIG) is not None, "最高优先级的主播没有录原画")
+    expect(index_of(events, "准入录制", "top", STANDARD) is None, "最高优先级的主播被降级")
+    expect((server.room_id("top"), True) in [(room, orig) for room, orig, _ in requests], "替身服务没有收到最高优先级主播的原画流请求")
+
+    expect(index_of(events, "准入录制", "late", STANDARD) is not None, "放不下原画的主播没有回落到标准流")
+    expect(index_of(events, "准入录制", "late", ORIG) is None, "超出带宽上限时仍准入了原画")
+
+    low_orig = index_of(events, "准入录制", "low", ORIG)
+    downgraded = index_of(events, "为更高优先级的录制腾出带宽，降级为标准流", "low")
+    urgent = index_of(events, "准入录制", "urgent", STANDARD)
+    low_standard = index_of(events, "准入录制", "low", STANDARD)
+    expect(low_orig is not None, "低优先级的主播在带宽充足时没有录原画")
+    expect(downgraded is not None and low_orig is not None and downgraded > low_orig, "更高优先级的主播到来时低优先级的原画录制没有降级")
+    expect(urgent is not None and downgraded is not None and urgent > downgraded, "腾出带宽后没有准入更高优先级的主播")
+    expect(low_standard is not None and urgent is not None and low_standard > urgent, "降级后的主播没有改录标准流")
+
+    queued = index_of(events, "下行带宽不足，录制进入排队", "queued")
+    late_finished = index_of(events, "录制已结束", "late")
+    queued_admitted = index_of(events, "准入录制", "queued")
+    expect(queued is not None, "放不下的主播没有进入排队")
+    expect(queued_admitted is not None and late_finished is not None and queued_admitted > late_finished, "排队的主播在带宽空出前就开始了录制")
+
+    # gone 的优先级高于 queued，若仍在队列中会先于 queued 准入
+    expect(index_of(events, "下行带宽不足，录制进入排队", "gone") is not None, "gone 没有进入排队")
+    expect(index_of(events, "准入录制", "gone") is None, "排队期间下播的主播仍被录制")
+    expect(server.room_id("gone") not in [room for room, _, _ in requests], "替身服务收到了已下播主播的直播流请求")
+
+    for failure in failures:
+        print("[ FAIL ] admission_load: " + failure)
+    if failures:
+        print(log_text)
+        return 1
+    print("[  OK  ] admission_load")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,192 @@
+// 直播间消息文件（user-040）：./rn_tests [用例名...]
+// 数据块的编码与解码互逆，finish 之后的下一块重新开始字典与差分基准；损坏的块与文件只报格式错误，不按损坏的长度分配内存
+
+#include "harness.h"
+
+namespace
+{
+	std::vector<ChatMessage> make_messages(std::uint32_t seed, std::size_t count)
+	{
+		std::mt19937 rng(seed);
+		const char* types[] = { "comment", "gift", "like", "enter" };
+		const char* users[] = { "alice", "bob", "用户甲", "", "carol" };
+		std::uniform_int_distribution<int> pick(0, 1 << 20);
+		std::vector<ChatMessage> messages;
+		std::int64_t offset_ms = 0;
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			ChatMessage message;
+			// 自带时间的消息可能早于上一条，差分为负
+			offset_ms += pick(rng) % 5000 - 1000;
+			message.offset_ms = offset_ms;
+			message.type = types[pick(rng) % std::size(types)];
+			message.user = users[pick(rng) % std::size(users)];
+			message.text = std::string(static_cast<std::size_t>(pick(rng) % 40), static_cast<char>('a' + i % 26)) + (i % 3 == 0 ? "你好" : "");
+			message.value = i % 7 == 0 ? std::numeric_limits<std::int64_t>::min()
+				: i % 7 == 1 ? std::numeric_limits<std::int64_t>::max()
+				: static_cast<std::int64_t>(pick(rng)) - (1 << 19);
+			messages.push_back(std::move(message));
+		}
+		return messages;
+	}
+
+	std::string encode_block(ChatBlockEncoder& encoder, const std::vector<ChatMessage>& messages)
+	{
+		for (const auto& message : messages)
+		{
+			encoder.add(message.offset_ms, message.type, message.user, message.text, message.value);
+		}
+		RN_CHECK_EQ(encoder.size(), messages.size());
+		return encoder.finish();
+	}
+
+	void check_messages(const std::vector<ChatMessage>& actual, const std::vector<ChatMessage>& expected)
+	{
+		RN_CHECK_EQ(actual.size(), expected.size());
+		for (std::size_t i = 0; i < actual.size(); ++i)
+		{
+			RN_CHECK_EQ(actual[i].offset_ms, expected[i].offset_ms);
+			RN_CHECK_EQ(actual[i].type, expected[i].type);
+			RN_CHECK_EQ(actual[i].user, expected[i].user);
+			RN_CHECK_EQ(actual[i].text, expected[i].text);
+			RN_CHECK_EQ(actual[i].value, expected[i].value);
+		}
+	}
+
+	bool rejects_block(std::string_view block)
+	{
+		try
+		{
+			decode_chat_block(block);
+		}
+		catch (const std::runtime_error& ex)
+		{
+			return std::string_view(ex.what()) == "消息数据块格式错误";
+		}
+		return false;
+	}
+
+	// 按 ChatWriter 的格式写出文件头与数据块帧
+	std::string chat_file_header(std::int64_t started_at_ms)
+	{
+		const auto header = json{ { "room_id", "100000" }, { "started_at_ms", started_at_ms } }.dump();
+		std::string out(chat_file_magic);
+		append_le32(out, static_cast<std::uint32_t>(header.size()));
+		out.append(header);
+		return out;
+	}
+
+	std::string chat_frame(std::size_t count, const std::string& raw)
+	{
+		std::string compressed(ZSTD_compressBound(raw.size()), '\0');
+		const auto size = ZSTD_compress(compressed.data(), compressed.size(), raw.data(), raw.size(), 3);
+		RN_CHECK(!ZSTD_isError(size));
+		compressed.resize(size);
+		std::string frame(chat_block_magic);
+		append_le32(frame, static_cast<std::uint32_t>(count));
+		append_le32(frame, static_cast<std::uint32_t>(raw.size()));
+		append_le32(frame, static_cast<std::uint32_t>(compressed.size()));
+		return frame + compressed;
+	}
+
+	fs::path write_temp_file(const std::string& name, const std::string& bytes)
+	{
+		const auto path = fs::temp_directory_path() / ("rn_chat_" + std::to_string(::getpid()) + "_" + name);
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+		return path;
+	}
+}
+
+RN_TEST(chat_block_round_trip)
+{
+	ChatBlockEncoder encoder;
+	const auto messages = make_messages(1, 5000);
+	check_messages(decode_chat_block(encode_block(encoder, messages)), messages);
+
+	// finish 之后的块单独可解：字典编号从头开始，第一条的偏移不依赖上一块
+	auto second = make_messages(2, 300);
+	for (auto& message : second)
+	{
+		message.offset_ms += 10'000'000;
+		message.type = "second-" + message.type;
+	}
+	const auto block = encode_block(encoder, second);
+	check_messages(decode_chat_block(block), second);
+
+	ChatBlockEncoder empty;
+	RN_CHECK(decode_chat_block(empty.finish()).empty());
+}
+
+RN_TEST(chat_block_corrupted)
+{
+	ChatBlockEncoder encoder;
+	const auto block = encode_block(encoder, make_messages(3, 200));
+	for (std::size_t size = 0; size < block.size(); ++size)
+	{
+		if (!rejects_block(std::string_view(block).substr(0, size)))
+		{
+			rn_harness::fail_check(__FILE__, __LINE__, "截断到 " + std::to_string(size) + " 字节的数据块没有报格式错误");
+		}
+	}
+
+	// 消息数远超块长度时在分配之前拒绝
+	std::string huge;
+	append_varint(huge, 1ull << 40);
+	huge += block.substr(2);
+	RN_CHECK(rejects_block(huge));
+
+	// 导出时原始长度超出上限的块同样只报格式错误
+	auto frame = chat_frame(200, block);
+	frame[8] = frame[9] = frame[10] = frame[11] = '\xff';
+	const auto path = write_temp_file("huge.chat", chat_file_header(0) + frame);
+	std::string program = "rn";
+	std::string command = "chat-export";
+	std::string input = path.string();
+	char* argv[] = { program.data(), command.data(), input.data() };
+	bool rejected = false;
+	try
+	{
+		run_chat_export(3, argv);
+	}
+	catch (const std::runtime_error& ex)
+	{
+		rejected = std::string_view(ex.what()) == "消息数据块格式错误";
+	}
+	fs::remove(path);
+	RN_CHECK(rejected);
+}
+
+RN_TEST(chat_resume_cuts_torn_block)
+{
+	ChatBlockEncoder encoder;
+	const auto first = make_messages(4, 100);
+	const auto second = make_messages(5, 100);
+	const auto header = chat_file_header(1'700'000'000'123);
+	const auto complete = header + chat_frame(first.size(), encode_block(encoder, first)) + chat_frame(second.size(), encode_block(encoder, second));
+	const auto torn = chat_frame(50, encode_block(encoder, make_messages(6, 50)));
+
+	// 帧头不完整、数据不完整两种撕裂
+	for (const auto cut : { std::size_t{ 7 }, torn.size() - 1 })
+	{
+		const auto path = write_temp_file("torn.chat", complete + torn.substr(0, cut));
+		const auto point = prepare_chat_resume(path);
+		const auto size = fs::file_size(path);
+		fs::remove(path);
+		RN_CHECK(point.has_value());
+		RN_CHECK_EQ(point->bytes, static_cast<std::uint64_t>(complete.size()));
+		RN_CHECK_EQ(size, static_cast<std::uintmax_t>(complete.size()));
+		RN_CHECK_EQ(epoch_ms(point->started_at), std::int64_t{ 1'700'000'000'123 });
+	}
+
+	// 完整的文件保持原样；不是消息文件时不续写也不改动
+	const auto path = write_temp_file("complete.chat", complete);
+	const auto point = prepare_chat_resume(path);
+	fs::remove(path);
+	RN_CHECK(point.has_value());
+	RN_CHECK_EQ(point->bytes, static_cast<std::uint64_t>(complete.size()));
+	const auto other = write_temp_file("other.chat", "not a chat file at all");
+	RN_CHECK(!prepare_chat_resume(other).has_value());
+	RN_CHECK_EQ(fs::file_size(other), std::uintmax_t{ 22 });
+	fs::remove(other);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+// 测试共用的 FLV 语料：按固定种子生成的录制，以及逐个标签校验输出文件结构的解析
+
+#include "harness.h"
+
+namespace
+{
+	struct SourceTag
+	{
+		std::size_t offset = 0;
+		std::size_t end = 0;
+		std::uint8_t type = 0;
+		std::uint32_t timestamp = 0;
+		bool keyframe = false;
+		bool metadata = false;
+		std::string payload;
+	};
+
+	struct SourceFlv
+	{
+		std::string bytes;
+		std::vector<SourceTag> tags;
+	};
+
+	struct OutputTag
+	{
+		std::size_t offset = 0;
+		std::uint8_t type = 0;
+		std::uint32_t timestamp = 0;
+		std::string_view payload;
+	};
+
+	constexpr int frames_per_gop = 25;
+
+	std::string random_bytes(std::mt19937& rng, std::size_t size)
+	{
+		std::uniform_int_distribution<int> byte(0, 255);
+		std::string bytes(size, '\0');
+		for (auto& ch : bytes)
+		{
+			ch = static_cast<char>(byte(rng));
+		}
+		return bytes;
+	}
+
+	// 一段约 tag_count 个标签的 H.264 + AAC 录制：元数据、两个序列头，之后音视频交错，每 25 帧一个关键帧。
+	// 载荷开头写入序号保证互不相同，部分载荷中嵌入形似标签头的字节，用来检验失去同步后的搜索
+	SourceFlv make_source_flv(std::uint32_t seed, int tag_count)
+	{
+		std::mt19937 rng(seed);
+		std::uniform_int_distribution<std::size_t> video_size(200, 3000);
+		std::uniform_int_distribution<std::size_t> audio_size(20, 400);
+
+		SourceFlv flv;
+		append_flv_header(flv.bytes, 0x05);
+		const auto add_tag = [&](std::uint8_t type, std::uint32_t timestamp, std::string payload, bool keyframe, bool metadata)
+			{
+				SourceTag tag;
+				tag.offset = flv.bytes.size();
+				tag.type = type;
+				tag.timestamp = timestamp;
+				tag.keyframe = keyframe;
+				tag.metadata = metadata;
+				append_flv_tag(flv.bytes, type, timestamp, payload);
+				tag.end = flv.bytes.size();
+				tag.payload = std::move(payload);
+				flv.tags.push_back(std::move(tag));
+			};
+
+		std::string metadata;
+		metadata.push_back(0x02);
+		append_amf_string(metadata, "onMetaData");
+		metadata.push_back(0x08);
+		append_be32(metadata, 1);
+		append_amf_string(metadata, "width");
+		append_amf_number(metadata, 1280);
+		metadata.append("\x00\x00\x09", 3);
+		add_tag(flv_tag_script, 0, metadata, false, true);
+		add_tag(flv_tag_video, 0, std::string("\x17\x00\x00\x00\x00avc-config", 15), false, false);
+		add_tag(flv_tag_audio, 0, std::string("\xaf\x00\x12\x10", 4), false, false);
+
+		std::uint32_t video_time = 0;
+		std::uint32_t audio_time = 0;
+		int frame = 0;
+		for (int index = 0; static_cast<int>(flv.tags.size()) < tag_count; ++index)
+		{
+			const bool video = video_time <= audio_time;
+			std::string payload;
+			if (video)
+			{
+				const bool keyframe = frame % frames_per_gop == 0;
+				payload.append(keyframe ? "\x17\x01" : "\x27\x01", 2);
+				payload += random_bytes(rng, video_size(rng));
+			}
+			else
+			{
+				payload.append("\xaf\x01", 2);
+				payload += random_bytes(rng, audio_size(rng));
+			}
+			std::memcpy(payload.data() + 2, &index, sizeof(index));
+			if (index % 7 == 3 && payload.size() > 64)
+			{
+				// 类型、长度、时间戳与 StreamID 都合法，只是 PreviousTagSize 对不上
+				const char fake[] = { 0x09, 0x00, 0x00, 0x10, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00 };
+				std::memcpy(payload.data() + 40, fake, sizeof(fake));
+			}
+
+			if (video)
+			{
+				add_tag(flv_tag_video, video_time, std::move(payload), frame % frames_per_gop == 0, false);
+				video_time += 40;
+				++frame;
+			}
+			else
+			{
+				add_tag(flv_tag_audio, audio_time, std::move(payload), false, false);
+				audio_time += 23;
+			}
+		}
+		return flv;
+	}
+
+	// 逐个解析修复后的文件：文件头完整，每个标签的 StreamID 为 0、PreviousTagSize 与标签长度一致，并恰好在文件末尾结束
+	std::vector<OutputTag> parse_output(const std::string& bytes)
+	{
+		const auto* data = reinterpret_cast<const unsigned char*>(bytes.data());
+		RN_CHECK(bytes.size() >= flv_header_size + 4);
+		RN_CHECK(bytes.compare(0, 3, "FLV") == 0);
+		RN_CHECK_EQ(read_be32(data + 5), static_cast<std::uint32_t>(flv_header_size));
+		RN_CHECK_EQ(read_be32(data + flv_header_size), 0u);
+
+		std::vector<OutputTag> tags;
+		std::size_t pos = flv_header_size + 4;
+		while (pos < bytes.size())
+		{
+			RN_CHECK(bytes.size() - pos >= flv_tag_header_size + 4);
+			OutputTag tag;
+			tag.offset = pos;
+			tag.type = data[pos];
+			RN_CHECK(tag.type == flv_tag_audio || tag.type == flv_tag_video || tag.type == flv_tag_script);
+			const auto size = read_be24(data + pos + 1);
+			tag.timestamp = read_be24(data + pos + 4) | (static_cast<std::uint32_t>(data[pos + 7]) << 24);
+			RN_CHECK_EQ(read_be24(data + pos + 8), 0u);
+			RN_CHECK(bytes.size() - pos >= flv_tag_header_size + size + 4);
+			tag.payload = std::string_view(bytes).substr(pos + flv_tag_header_size, size);
+			RN_CHECK_EQ(read_be32(data + pos + flv_tag_header_size + size), size + static_cast<std::uint32_t>(flv_tag_header_size));
+			pos += flv_tag_header_size + size + 4;
+			tags.push_back(tag);
+		}
+		RN_CHECK_EQ(pos, bytes.size());
+		return tags;
+	}
+}
@@ -0,0 +1,89 @@
+// 重叠录制合并（user-039）：./rn_tests flv_dedup_merge
+// 同一路直播流的两段录制：第一段从头录到中途，第二段从较晚的关键帧开始、时间戳从 0 重新计，并带有自己的元数据与序列头。
+// dedup 按共同关键帧对齐后，输出应恰好是原始流的完整标签序列，时间戳与原始流一致；输入顺序颠倒时结果相同
+
+#include "flv_corpus.h"
+
+namespace
+{
+	// 原始流中的 [begin, end) 标签组成一段录制；时间戳减去 begin 处的时间戳，开头补上元数据和序列头
+	std::string make_recording(const SourceFlv& source, std::size_t begin, std::size_t end)
+	{
+		std::string bytes;
+		append_flv_header(bytes, 0x05);
+		for (std::size_t i = 0; i < 3; ++i)
+		{
+			append_flv_tag(bytes, source.tags[i].type, 0, source.tags[i].payload);
+		}
+		const auto base = source.tags[begin].timestamp;
+		for (std::size_t i = std::max<std::size_t>(begin, 3); i < end; ++i)
+		{
+			append_flv_tag(bytes, source.tags[i].type, source.tags[i].timestamp - base, source.tags[i].payload);
+		}
+		return bytes;
+	}
+
+	std::size_t keyframe_at_or_after(const SourceFlv& source, std::size_t index)
+	{
+		while (!source.tags[index].keyframe)
+		{
+			++index;
+		}
+		return index;
+	}
+
+	void check_dedup(const SourceFlv& source, const std::string& first, const std::string& second, const std::string& label)
+	{
+		const auto directory = fs::temp_directory_path() / ("rn_flv_dedup_" + std::to_string(::getpid()));
+		fs::create_directories(directory);
+		const auto first_path = directory / (label + "_1.flv");
+		const auto second_path = directory / (label + "_2.flv");
+		const auto output_path = directory / (label + ".merged.flv");
+		for (const auto& [path, bytes] : { std::pair{ first_path, &first }, std::pair{ second_path, &second } })
+		{
+			std::ofstream file(path, std::ios::binary | std::ios::trunc);
+			file.write(bytes->data(), static_cast<std::streamsize>(bytes->size()));
+		}
+
+		std::string program = "rn";
+		std::string command = "dedup";
+		std::string output_arg = output_path.string();
+		std::string first_arg = first_path.string();
+		std::string second_arg = second_path.string();
+		char* argv[] = { program.data(), command.data(), output_arg.data(), first_arg.data(), second_arg.data() };
+		RN_CHECK_EQ(run_flv_dedup(5, argv), 0);
+
+		const auto bytes = read_file(output_path);
+		fs::remove_all(directory);
+
+		// 输出为重建的元数据加上原始流中除元数据外的全部标签
+		const auto tags = parse_output(bytes);
+		RN_CHECK(!tags.empty());
+		RN_CHECK(tags[0].type == flv_tag_script && is_flv_metadata(tags[0].payload));
+		RN_CHECK_EQ(tags.size(), source.tags.size());
+		for (std::size_t i = 1; i < tags.size(); ++i)
+		{
+			const auto& expected = source.tags[i];
+			if (tags[i].type != expected.type || tags[i].payload != expected.payload)
+			{
+				rn_harness::fail_check(__FILE__, __LINE__, label + "：第 " + std::to_string(i) + " 个标签与原始流不同");
+			}
+			RN_CHECK_EQ(tags[i].timestamp, expected.timestamp);
+		}
+	}
+}
+
+RN_TEST(flv_dedup_merge)
+{
+	for (std::uint32_t seed = 1; seed <= 3; ++seed)
+	{
+		const auto source = make_source_flv(500 + seed, 600);
+		// 第二段从第一段中途的关键帧开始，两段共有多个关键帧
+		const auto second_begin = keyframe_at_or_after(source, 150 + seed * 20);
+		const auto first_end = 450 + seed * 10;
+		const auto first = make_recording(source, 0, first_end);
+		const auto second = make_recording(source, second_begin, source.tags.size());
+		check_dedup(source, first, second, "ordered_" + std::to_string(seed));
+		check_dedup(source, second, first, "reversed_" + std::to_string(seed));
+	}
+}
@@ -0,0 +1,238 @@
+// FLV 修复（user-038）的损坏语料测试：./rn_tests [用例名...]
+// 语料由固定种子生成：完好的录制分别经过截断、覆写、插入垃圾数据和抹掉文件头，再用 repair 修复。
+// 每个输出都要求标签边界完整、时间戳不回退、关键帧索引指向关键帧，且未受损的标签原样保留
+
+#include "flv_corpus.h"
+
+namespace
+{
+	// 读取 onMetaData 中 keyframes 对象里名为 key 的严格数组
+	std::vector<double> read_keyframe_array(std::string_view metadata, std::string_view key)
+	{
+		std::string marker;
+		append_amf_string(marker, key);
+		marker.push_back(0x0A);
+		const auto found = metadata.find(marker);
+		RN_CHECK(found != std::string_view::npos);
+
+		const auto* data = reinterpret_cast<const unsigned char*>(metadata.data());
+		std::size_t pos = found + marker.size();
+		RN_CHECK(metadata.size() - pos >= 4);
+		const auto count = read_be32(data + pos);
+		pos += 4;
+		RN_CHECK(metadata.size() - pos >= count * 9ull);
+
+		std::vector<double> values;
+		for (std::uint32_t i = 0; i < count; ++i, pos += 9)
+		{
+			RN_CHECK_EQ(static_cast<int>(data[pos]), 0x00);
+			std::uint64_t bits = 0;
+			for (int byte = 1; byte <= 8; ++byte)
+			{
+				bits = (bits << 8) | data[pos + byte];
+			}
+			double value = 0;
+			std::memcpy(&value, &bits, sizeof(value));
+			values.push_back(value);
+		}
+		return values;
+	}
+
+	// 音视频交错时允许的时间戳回退，与 FlvTimestampNormalizer 的容忍范围一致
+	constexpr std::uint32_t max_backward_ms = 1000;
+
+	// 对 damaged 做一次修复并校验输出。[damage_begin, damage_end) 为原文件中受损的字节范围：
+	// 完全在其之前的标签必须原样按序保留；其后的音频标签以及从下一个关键帧开始的视频标签也必须保留。
+	// 覆写只改动载荷时标签本身仍然合法，max_altered 为输出中允许出现的、载荷与原文件不同的标签数
+	void check_repair(const SourceFlv& source, const std::string& damaged, std::size_t damage_begin, std::size_t damage_end, std::size_t max_altered,
+		const std::string& label)
+	{
+		const auto directory = fs::temp_directory_path() / ("rn_flv_corpus_" + std::to_string(::getpid()));
+		fs::create_directories(directory);
+		const auto input = directory / (label + ".flv");
+		const auto output = directory / (label + ".repaired.flv");
+		{
+			std::ofstream file(input, std::ios::binary | std::ios::trunc);
+			file.write(damaged.data(), static_cast<std::streamsize>(damaged.size()));
+		}
+
+		std::string program = "rn";
+		std::string command = "repair";
+		std::string input_arg = input.string();
+		std::string output_arg = output.string();
+		char* argv[] = { program.data(), command.data(), input_arg.data(), output_arg.data() };
+		RN_CHECK_EQ(run_flv_repair(4, argv), 0);
+
+		const auto bytes = read_file(output);
+		fs::remove_all(directory);
+
+		const auto tags = parse_output(bytes);
+		RN_CHECK(!tags.empty());
+		RN_CHECK(tags[0].type == flv_tag_script && is_flv_metadata(tags[0].payload));
+
+		// 载荷在原文件中互不相同，据此找回每个输出标签对应的原始标签
+		std::unordered_map<std::string_view, std::size_t> source_index;
+		for (std::size_t i = 0; i < source.tags.size(); ++i)
+		{
+			source_index.emplace(source.tags[i].payload, i);
+		}
+
+		std::vector<bool> present(source.tags.size(), false);
+		std::unordered_map<std::size_t, const OutputTag*> by_offset;
+		std::optional<std::size_t> previous_index;
+		std::uint32_t latest_timestamp = 0;
+		std::size_t altered = 0;
+		for (std::size_t i = 1; i < tags.size(); ++i)
+		{
+			const auto& tag = tags[i];
+			by_offset.emplace(tag.offset, &tag);
+			RN_CHECK(tag.timestamp + max_backward_ms >= latest_timestamp);
+			latest_timestamp = std::max(latest_timestamp, tag.timestamp);
+
+			const auto found = source_index.find(tag.payload);
+			if (found == source_index.end())
+			{
+				if (++altered > max_altered)
+				{
+					rn_harness::fail_check(__FILE__, __LINE__, label + "：输出中出现了原文件没有的标签，偏移 " + std::to_string(tag.offset));
+				}
+				continue;
+			}
+			RN_CHECK(source.tags[found->second].type == tag.type);
+			RN_CHECK(!previous_index || found->second > *previous_index);
+			previous_index = found->second;
+			present[found->second] = true;
+		}
+
+		bool keyframe_seen = false;
+		for (std::size_t i = 0; i < source.tags.size(); ++i)
+		{
+			const auto& tag = source.tags[i];
+			if (tag.metadata)
+			{
+				continue;
+			}
+			bool required = tag.end <= damage_begin;
+			if (tag.offset >= damage_end)
+			{
+				keyframe_seen = keyframe_seen || tag.keyframe;
+				required = tag.type == flv_tag_audio || keyframe_seen;
+			}
+			if (required && !present[i])
+			{
+				rn_harness::fail_check(__FILE__, __LINE__, label + "：未受损的第 " + std::to_string(i) + " 个标签没有保留");
+			}
+		}
+
+		// 关键帧索引：位置与时间一一对应，每个位置都是输出中一个关键帧标签的起点
+		const auto positions = read_keyframe_array(tags[0].payload, "filepositions");
+		const auto times = read_keyframe_array(tags[0].payload, "times");
+		RN_CHECK_EQ(positions.size(), times.size());
+		const auto keyframes = std::count_if(tags.begin(), tags.end(), [](const OutputTag& tag)
+			{
+				return tag.type == flv_tag_video && !is_sequence_header(tag.type, tag.payload) && is_video_keyframe(tag.payload);
+			});
+		RN_CHECK_EQ(positions.size(), static_cast<std::size_t>(keyframes));
+		RN_CHECK(!positions.empty());
+		for (std::size_t i = 0; i < positions.size(); ++i)
+		{
+			const auto found = by_offset.find(static_cast<std::size_t>(positions[i]));
+			if (found == by_offset.end())
+			{
+				rn_harness::fail_check(__FILE__, __LINE__, label + "：关键帧索引指向的位置不是标签起点: " + std::to_string(positions[i]));
+			}
+			const auto& tag = *found->second;
+			RN_CHECK(tag.type == flv_tag_video);
+			RN_CHECK(is_video_keyframe(tag.payload) && !is_sequence_header(tag.type, tag.payload));
+			RN_CHECK_EQ(static_cast<std::uint32_t>(std::llround(times[i] * 1000)), tag.timestamp);
+		}
+
+		// 修复结果再扫描一遍应当完全干净
+		const auto rescan = FlvTagScanner(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size()).scan();
+		RN_CHECK_EQ(rescan.resyncs, 0u);
+		RN_CHECK_EQ(rescan.skipped_bytes, 0u);
+		RN_CHECK_EQ(rescan.dropped_tags, 0u);
+		RN_CHECK_EQ(rescan.tags.size(), tags.size() - 1);
+	}
+
+	constexpr int corpus_files = 20;
+	constexpr int tags_per_file = 600;
+
+	// 损坏位置避开元数据与序列头，它们缺失时播放器同样无法解码
+	std::size_t damage_offset(std::mt19937& rng, const SourceFlv& source)
+	{
+		std::uniform_int_distribution<std::size_t> offset(source.tags[3].offset, source.bytes.size() - 1);
+		return offset(rng);
+	}
+}
+
+RN_TEST(flv_repair_clean)
+{
+	for (std::uint32_t seed = 1; seed <= 3; ++seed)
+	{
+		const auto source = make_source_flv(seed, tags_per_file);
+		check_repair(source, source.bytes, source.bytes.size(), source.bytes.size(), 0, "clean_" + std::to_string(seed));
+	}
+}
+
+RN_TEST(flv_repair_truncated)
+{
+	for (int file = 0; file < corpus_files; ++file)
+	{
+		const auto source = make_source_flv(100 + file, tags_per_file);
+		std::mt19937 rng(1000 + file);
+		const auto cut = damage_offset(rng, source);
+		check_repair(source, source.bytes.substr(0, cut), cut, source.bytes.size(), 0, "truncated_" + std::to_string(file));
+	}
+}
+
+RN_TEST(flv_repair_overwritten)
+{
+	for (int file = 0; file < corpus_files; ++file)
+	{
+		const auto source = make_source_flv(200 + file, tags_per_file);
+		std::mt19937 rng(2000 + file);
+		const auto begin = damage_offset(rng, source);
+		const auto length = std::min(source.bytes.size() - begin, std::uniform_int_distribution<std::size_t>(1, 8000)(rng));
+		auto damaged = source.bytes;
+		damaged.replace(begin, length, random_bytes(rng, length));
+		const auto overlapping = std::count_if(source.tags.begin(), source.tags.end(), [&](const SourceTag& tag)
+			{
+				return tag.offset < begin + length && tag.end > begin;
+			});
+		check_repair(source, damaged, begin, begin + length, static_cast<std::size_t>(overlapping), "overwritten_" + std::to_string(file));
+	}
+}
+
+RN_TEST(flv_repair_inserted)
+{
+	for (int file = 0; file < corpus_files; ++file)
+	{
+		const auto source = make_source_flv(300 + file, tags_per_file);
+		std::mt19937 rng(3000 + file);
+		const auto at = damage_offset(rng, source);
+		auto damaged = source.bytes;
+		damaged.insert(at, random_bytes(rng, std::uniform_int_distribution<std::size_t>(1, 8000)(rng)));
+		check_repair(source, damaged, at, at, 0, "inserted_" + std::to_string(file));
+	}
+}
+
+RN_TEST(flv_repair_header_wiped)
+{
+	for (int file = 0; file < corpus_files; ++file)
+	{
+		const auto source = make_source_flv(400 + file, tags_per_file);
+		std::mt19937 rng(4000 + file);
+		// 抹掉文件头，部分样本连同元数据与序列头一起抹掉
+		const auto length = std::uniform_int_distribution<std::size_t>(flv_header_size, source.tags[4].offset)(rng);
+		auto damaged = source.bytes;
+		std::fill_n(damaged.begin(), length, '\0');
+		check_repair(source, damaged, 0, length, 0, "header_wiped_" + std::to_string(file));
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	LoggerShutdownGuard logger_shutdown;
+	return rn_harness::run_test_cases(argc, argv);
+}
@@ -0,0 +1,191 @@
+// 重启后续写录制（user-043）：./rn_tests [用例名...]
+// prepare_flv_resume 把文件截到最后一个完整标签之后且不碰不是 FLV 的文件；续写模式的 FlvTagRewriter 接在原文件之后，
+// 拼接结果仍是只有一个文件头、时间戳不回退的 FLV；状态快照写入后能原样读回，损坏的快照被忽略
+
+#include "flv_corpus.h"
+
+namespace
+{
+	fs::path write_temp_flv(const std::string& name, const std::string& bytes)
+	{
+		const auto path = fs::temp_directory_path() / ("rn_resume_" + std::to_string(::getpid()) + "_" + name);
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+		return path;
+	}
+
+	struct PreparedFile
+	{
+		std::optional<FlvResumePoint> point;
+		std::string bytes;
+	};
+
+	PreparedFile prepare(const std::string& name, const std::string& bytes)
+	{
+		const auto path = write_temp_flv(name, bytes);
+		PreparedFile prepared;
+		prepared.point = prepare_flv_resume(path);
+		prepared.bytes = read_file(path);
+		fs::remove(path);
+		return prepared;
+	}
+
+	std::uint32_t max_timestamp_before(const SourceFlv& source, std::size_t end)
+	{
+		std::uint32_t latest = 0;
+		for (const auto& tag : source.tags)
+		{
+			if (tag.end <= end)
+			{
+				latest = std::max(latest, tag.timestamp);
+			}
+		}
+		return latest;
+	}
+}
+
+RN_TEST(flv_resume_prepare)
+{
+	const auto source = make_source_flv(600, 200);
+
+	// 只有文件头：从文件头之后接着写
+	const auto header_only = source.bytes.substr(0, flv_header_size + 4);
+	auto prepared = prepare("header.flv", header_only);
+	RN_CHECK(prepared.point.has_value());
+	RN_CHECK_EQ(prepared.point->bytes, static_cast<std::uint64_t>(header_only.size()));
+	RN_CHECK_EQ(prepared.point->last_timestamp, 0u);
+	RN_CHECK(prepared.bytes == header_only);
+
+	// 末尾标签写了一半：截到上一个完整标签
+	const auto& torn_tag = source.tags[150];
+	for (const auto cut : { torn_tag.offset + 5, torn_tag.offset + flv_tag_header_size + 10, torn_tag.end - 1 })
+	{
+		prepared = prepare("torn.flv", source.bytes.substr(0, cut));
+		RN_CHECK(prepared.point.has_value());
+		RN_CHECK_EQ(prepared.point->bytes, static_cast<std::uint64_t>(torn_tag.offset));
+		RN_CHECK_EQ(prepared.point->last_timestamp, max_timestamp_before(source, torn_tag.offset));
+		RN_CHECK(prepared.bytes == source.bytes.substr(0, torn_tag.offset));
+	}
+
+	// 完整标签之后是垃圾数据：截掉垃圾
+	const auto& last_good = source.tags[120];
+	prepared = prepare("garbage.flv", source.bytes.substr(0, last_good.end) + std::string(300, '\x5a'));
+	RN_CHECK(prepared.point.has_value());
+	RN_CHECK_EQ(prepared.point->bytes, static_cast<std::uint64_t>(last_good.end));
+	RN_CHECK(prepared.bytes == source.bytes.substr(0, last_good.end));
+
+	// 完整的文件保持原样
+	prepared = prepare("complete.flv", source.bytes);
+	RN_CHECK(prepared.point.has_value());
+	RN_CHECK_EQ(prepared.point->bytes, static_cast<std::uint64_t>(source.bytes.size()));
+	RN_CHECK(prepared.bytes == source.bytes);
+
+	// 不是 FLV 的文件不续写，也不截断
+	const std::string other = "#EXTM3U\n" + std::string(4096, 'x');
+	prepared = prepare("other.flv", other);
+	RN_CHECK(!prepared.point.has_value());
+	RN_CHECK(prepared.bytes == other);
+}
+
+RN_TEST(flv_resume_rewriter)
+{
+	const auto before = make_source_flv(601, 300);
+	const auto reconnect = make_source_flv(602, 300);
+
+	// 原文件在某个标签中途被截断，续写时接上一次新连接的完整流（自带文件头、元数据与序列头，时间戳从 0 开始）
+	const auto path = write_temp_flv("rewrite.flv", before.bytes.substr(0, before.tags[200].offset + 7));
+	const auto point = prepare_flv_resume(path);
+	RN_CHECK(point.has_value());
+	auto bytes = read_file(path);
+	fs::remove(path);
+
+	FlvTagRewriter rewriter(point);
+	std::string appended;
+	// 按不规则的分块喂入
+	for (std::size_t pos = 0, step = 1; pos < reconnect.bytes.size(); pos += step, step = step * 7 % 4093 + 1)
+	{
+		rewriter.feed(reconnect.bytes.data() + pos, std::min(step, reconnect.bytes.size() - pos), appended);
+	}
+	RN_CHECK(!rewriter.failed());
+	RN_CHECK(appended.compare(0, 3, "FLV") != 0);
+	bytes += appended;
+
+	const auto tags = parse_output(bytes);
+	const auto metadata_tags = std::count_if(tags.begin(), tags.end(), [](const OutputTag& tag)
+		{
+			return tag.type == flv_tag_script;
+		});
+	RN_CHECK_EQ(metadata_tags, 1);
+	RN_CHECK_EQ(tags.size(), std::size_t{ 200 } + reconnect.tags.size() - 1);
+
+	// 续写部分的每个标签都不早于原文件中最大的时间戳，且内容与新连接一致
+	for (std::size_t i = 200; i < tags.size(); ++i)
+	{
+		RN_CHECK(tags[i].timestamp >= point->last_timestamp);
+		RN_CHECK(tags[i].payload == reconnect.tags[i - 199].payload);
+	}
+	// 新连接的两个序列头沿用原文件末尾的时间戳，之后的第一个媒体标签排在其后
+	RN_CHECK(tags[202].timestamp > point->last_timestamp);
+}
+
+RN_TEST(runtime_snapshot_round_trip)
+{
+	RuntimeSnapshot snapshot;
+	snapshot.written_at_ms = 1'700'000'000'000;
+	snapshot.history_refreshed_at_ms = 1'699'999'000'000;
+	HostStateSnapshot live;
+	live.host_id = "host-a";
+	live.has_result = true;
+	live.room_id = "100000";
+	live.fingerprint = 0xFEDCBA9876543210ull;
+	live.body_size = 321;
+	live.etag = "\"abc\"";
+	live.last_modified = "Wed, 21 Oct 2015 07:28:00 GMT";
+	live.next_poll_ms = 1'700'000'005'000;
+	live.start_times = { "20:00", "21:30" };
+	HostStateSnapshot unknown;
+	unknown.host_id = "host-b";
+	snapshot.hosts = { live, unknown };
+	snapshot.recordings.push_back({ "host-a", "100000", true, fs::path("downloads") / "录制_orig.flv", 123456 });
+
+	const auto directory = fs::temp_directory_path() / ("rn_snapshot_" + std::to_string(::getpid()));
+	const auto path = directory / "state" / "runtime.json";
+	write_runtime_snapshot(path, snapshot);
+	RN_CHECK(!fs::exists(fs::path(path).concat(".part")));
+	const auto restored = read_runtime_snapshot(path);
+	RN_CHECK(restored.has_value());
+	RN_CHECK_EQ(restored->written_at_ms, snapshot.written_at_ms);
+	RN_CHECK_EQ(restored->history_refreshed_at_ms, snapshot.history_refreshed_at_ms);
+	RN_CHECK_EQ(restored->hosts.size(), std::size_t{ 2 });
+	const auto& host = restored->hosts[0];
+	RN_CHECK(host.has_result && host.room_id == live.room_id);
+	RN_CHECK_EQ(host.fingerprint, live.fingerprint);
+	RN_CHECK_EQ(host.body_size, live.body_size);
+	RN_CHECK_EQ(host.etag, live.etag);
+	RN_CHECK_EQ(host.last_modified, live.last_modified);
+	RN_CHECK_EQ(host.next_poll_ms, live.next_poll_ms);
+	RN_CHECK(host.start_times == live.start_times);
+	RN_CHECK(!restored->hosts[1].has_result);
+	RN_CHECK_EQ(restored->recordings.size(), std::size_t{ 1 });
+	const auto& recording = restored->recordings[0];
+	RN_CHECK_EQ(recording.host_id, std::string("host-a"));
+	RN_CHECK_EQ(recording.room_id, std::string("100000"));
+	RN_CHECK(recording.orig);
+	RN_CHECK(recording.path == snapshot.recordings[0].path);
+	RN_CHECK_EQ(recording.bytes, std::uint64_t{ 123456 });
+
+	// 写到一半的快照与未知版本都按冷启动处理
+	auto text = read_file(path);
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << text.substr(0, text.size() / 2);
+	}
+	RN_CHECK(!read_runtime_snapshot(path).has_value());
+	{
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << R"({"version":2,"hosts":[],"recordings":[]})";
+	}
+	RN_CHECK(!read_runtime_snapshot(path).has_value());
+	RN_CHECK(!read_runtime_snapshot(directory / "missing.json").has_value());
+	fs::remove_all(directory);
+}
@@ -0,0 +1,58 @@
+"""user-045：低内存模式下同时监控 100 个主播并录制 4 路直播流，常驻内存应始终低于配置的上限。
+
+用法：python3 footprint_rss.py <rednote_rtmp_download 路径>
+"""
+
+import os
+import sys
+import time
+
+import standin
+
+HOST_COUNT = 100
+STREAMS = 4
+RSS_CEILING_MB = 32
+RECORD_SECONDS = 12
+HOSTS = ["fp%03d" % index for index in range(1, HOST_COUNT + 1)]
+
+
+def main():
+    binary = sys.argv[1]
+    print("[ RUN  ] footprint_rss")
+    failures = []
+    with standin.StandInServer(live_hosts=HOSTS[:STREAMS]) as server:
+        config = standin.merge_config(standin.base_config(server, HOSTS), {
+            "footprint": {"mode": "low", "rss_ceiling_mb": RSS_CEILING_MB},
+        })
+        with standin.Recorder(binary, config) as recorder:
+            if not standin.wait_until(lambda: len(server.first_stream_byte_at) == STREAMS, 30):
+                print("[ FAIL ] footprint_rss: 直播流未在预期时间内全部开始录制\n" + recorder.log_text())
+                return 1
+
+            peak_rss_kb = 0
+            deadline = time.monotonic() + RECORD_SECONDS
+            while time.monotonic() < deadline and recorder.running():
+                peak_rss_kb = max(peak_rss_kb, recorder.rss_kb())
+                time.sleep(0.2)
+            if not recorder.running():
+                failures.append("主程序在录制过程中退出")
+            recorder.stop()
+
+            recorded = [path for path in recorder.recorded_files() if os.path.getsize(path) > 0]
+
+    standin.report("%d hosts, %d streams, low footprint: peak RSS" % (HOST_COUNT, STREAMS), peak_rss_kb / 1024, "MB")
+    if peak_rss_kb >= RSS_CEILING_MB * 1024:
+        failures.append("常驻内存峰值 %.1f MB 超过上限 %d MB" % (peak_rss_kb / 1024, RSS_CEILING_MB))
+    if len(recorded) < STREAMS:
+        failures.append("只有 %d 路录到了数据，预期 %d 路" % (len(recorded), STREAMS))
+
+    for failure in failures:
+        print("[ FAIL ] footprint_rss: " + failure)
+    if failures:
+        return 1
+    print("[  OK  ] footprint_rss")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
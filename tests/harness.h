@@ -0,0 +1,145 @@
+#pragma once
+
+// 测试与基准程序共用的小型运行框架。
+// 程序直接包含 main.cpp 以使用匿名命名空间中的实现；用例按名字注册，命令行给出名字时只运行这些用例
+
+#define RN_NO_MAIN
+// 各程序只用到一部分内部函数，其余未使用的不必告警
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic ignored "-Wunused-function"
+#endif
+#include "../main.cpp"
+
+namespace rn_harness
+{
+	struct TestCase
+	{
+		const char* name;
+		void (*run)();
+	};
+
+	inline std::vector<TestCase>& test_cases()
+	{
+		static std::vector<TestCase> cases;
+		return cases;
+	}
+
+	struct TestRegistrar
+	{
+		TestRegistrar(const char* name, void (*run)())
+		{
+			test_cases().push_back({ name, run });
+		}
+	};
+
+	class CheckFailure : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	[[noreturn]] inline void fail_check(const char* file, int line, const std::string& message)
+	{
+		throw CheckFailure(std::string(file) + ":" + std::to_string(line) + ": " + message);
+	}
+
+	// 防止基准循环中的结果被编译器整体优化掉
+	template <typename T>
+	inline void keep(const T& value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		asm volatile("" : : "r,m"(value) : "memory");
+#else
+		static volatile const void* sink;
+		sink = &value;
+#endif
+	}
+
+	// 运行 iterations 次并返回每次的平均耗时（纳秒）；先预热一轮以排除首次分配与缺页
+	template <typename F>
+	double nanoseconds_per_op(std::size_t iterations, F&& body)
+	{
+		for (std::size_t i = 0; i < std::min<std::size_t>(iterations, 1000); ++i)
+		{
+			body(i);
+		}
+		const auto started = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < iterations; ++i)
+		{
+			body(i);
+		}
+		const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count();
+		return elapsed / static_cast<double>(iterations);
+	}
+
+	inline void report(std::string_view name, double ns_per_op)
+	{
+		std::cout << "  " << std::left << std::setw(44) << name << std::right << std::fixed << std::setprecision(1) << std::setw(12) << ns_per_op << " ns/op\n";
+	}
+
+	inline int run_test_cases(int argc, char* argv[])
+	{
+		int failed = 0;
+		int run = 0;
+		for (const auto& test_case : test_cases())
+		{
+			if (argc > 1 && std::none_of(argv + 1, argv + argc, [&](const char* name)
+				{
+					return std::string_view(name) == test_case.name;
+				}))
+			{
+				continue;
+			}
+
+			++run;
+			std::cout << "[ RUN  ] " << test_case.name << std::endl;
+			try
+			{
+				test_case.run();
+				std::cout << "[  OK  ] " << test_case.name << std::endl;
+			}
+			catch (const std::exception& ex)
+			{
+				++failed;
+				std::cout << "[ FAIL ] " << test_case.name << ": " << ex.what() << std::endl;
+			}
+		}
+
+		if (run == 0)
+		{
+			std::cerr << "没有匹配的用例" << std::endl;
+			return 2;
+		}
+		return failed == 0 ? 0 : 1;
+	}
+}
+
+#define RN_TEST_CONCAT_INNER(a, b) a##b
+#define RN_TEST_CONCAT(a, b) RN_TEST_CONCAT_INNER(a, b)
+
+#define RN_TEST(name) \
+	static void name(); \
+	static const ::rn_harness::TestRegistrar RN_TEST_CONCAT(name, _registrar)(#name, &name); \
+	static void name()
+
+#define RN_CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			::rn_harness::fail_check(__FILE__, __LINE__, "检查失败: " #condition); \
+		} \
+	} while (false)
+
+#define RN_CHECK_EQ(actual, expected) \
+	do \
+	{ \
+		const auto& rn_actual_ = (actual); \
+		const auto& rn_expected_ = (expected); \
+		if (!(rn_actual_ == rn_expected_)) \
+		{ \
+			std::ostringstream rn_message_; \
+			rn_message_ << "检查失败: " #actual " == " #expected "，实际为 " << rn_actual_ << "，期望为 " << rn_expected_; \
+			::rn_harness::fail_check(__FILE__, __LINE__, rn_message_.str()); \
+		} \
+	} while (false)
@@ -0,0 +1,75 @@
+// 异步日志（user-030）的关闭测试：./rn_tests logger_shutdown_keeps_records
+// 多个线程持续写日志时调用 shutdown，关闭前后写入的每一条都必须出现在日志文件中，内存账本中的日志占用归零
+
+#include "harness.h"
+
+RN_TEST(logger_shutdown_keeps_records)
+{
+	const auto path = fs::temp_directory_path() / ("rn_logger_" + std::to_string(::getpid()) + ".log");
+	LoggingConfig config;
+	config.console = false;
+	config.file = path;
+	config.max_file_bytes = 1ull << 40;
+	auto& logger = Logger::instance();
+	logger.configure(config);
+
+	constexpr int thread_count = 8;
+	std::atomic<bool> stop{ false };
+	std::atomic<int> started{ 0 };
+	std::vector<int> written(thread_count, 0);
+	std::vector<std::thread> threads;
+	for (int index = 0; index < thread_count; ++index)
+	{
+		threads.emplace_back([&, index]()
+			{
+				started.fetch_add(1);
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					log_info("日志关闭测试", { { "thread", index }, { "seq", written[index] } });
+					++written[index];
+				}
+			});
+	}
+
+	while (started.load() < thread_count)
+	{
+		std::this_thread::yield();
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	// 关闭期间生产者仍在写，关闭后再写一会儿，走同步写出的路径
+	logger.shutdown();
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	stop.store(true);
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::vector<int> seen(thread_count, 0);
+	std::size_t lines = 0;
+	{
+		std::ifstream file(path, std::ios::binary);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.find("日志关闭测试") == std::string::npos)
+			{
+				continue;
+			}
+			++lines;
+			const auto fields = line.find(" thread=");
+			RN_CHECK(fields != std::string::npos);
+			const int thread = std::stoi(line.substr(fields + 8));
+			RN_CHECK(thread >= 0 && thread < thread_count);
+			++seen[thread];
+		}
+	}
+	fs::remove(path);
+
+	for (int index = 0; index < thread_count; ++index)
+	{
+		RN_CHECK(written[index] > 0);
+		RN_CHECK_EQ(seen[index], written[index]);
+	}
+	RN_CHECK_EQ(MemoryLedger::instance().current(MemorySubsystem::logging), 0);
+}
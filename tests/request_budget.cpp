@@ -0,0 +1,187 @@
+// 接口请求预算（user-044）：./rn_tests [用例名...]
+// Retry-After 的两种写法、decorrelated jitter 退避的区间与复位、后台请求的全局预留，以及 rate_limit 配置的校验
+
+#include "harness.h"
+
+namespace
+{
+	using budget_clock = RequestBudget::clock;
+
+	std::chrono::milliseconds pause_at(RequestBudget& budget, std::string_view endpoint, budget_clock::time_point now)
+	{
+		return std::chrono::duration_cast<std::chrono::milliseconds>(budget.next_available(endpoint, now) - now);
+	}
+
+	std::string http_date(std::chrono::system_clock::time_point at)
+	{
+		const auto time = std::chrono::system_clock::to_time_t(at);
+		std::tm tm{};
+		gmtime_r(&time, &tm);
+		char buffer[64];
+		std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+		return buffer;
+	}
+
+	std::string rate_limit_error(json rate_limit_json)
+	{
+		try
+		{
+			parse_rate_limit(rate_limit_json);
+		}
+		catch (const std::runtime_error& ex)
+		{
+			return ex.what();
+		}
+		return {};
+	}
+}
+
+RN_TEST(retry_after_parsing)
+{
+	const auto numeric = parse_retry_after("120");
+	RN_CHECK(numeric.has_value());
+	RN_CHECK_EQ(numeric->count(), 120);
+	const auto zero = parse_retry_after("0");
+	RN_CHECK(zero.has_value());
+	RN_CHECK_EQ(zero->count(), 0);
+
+	// HTTP 日期换算为距现在的秒数，允许测试本身耗时造成的误差
+	const auto later = parse_retry_after(http_date(std::chrono::system_clock::now() + std::chrono::hours(1)));
+	RN_CHECK(later.has_value());
+	RN_CHECK(later->count() > 3600 - 10 && later->count() <= 3600);
+	const auto past = parse_retry_after(http_date(std::chrono::system_clock::now() - std::chrono::hours(1)));
+	RN_CHECK(past.has_value());
+	RN_CHECK_EQ(past->count(), 0);
+
+	RN_CHECK(!parse_retry_after("").has_value());
+	RN_CHECK(!parse_retry_after("soon").has_value());
+	RN_CHECK(!parse_retry_after("-5").has_value());
+
+	// record 从响应头中取 Retry-After，暂停时长不短于服务端要求
+	RateLimitConfig config;
+	config.backoff_base_seconds = 1;
+	config.backoff_max_seconds = 10;
+	RequestBudget budget(config);
+	const auto now = budget_clock::now();
+	budget.record("host/info", 429, "HTTP/1.1 429 Too Many Requests\r\nRetry-After: 120\r\n\r\n", now);
+	RN_CHECK_EQ(pause_at(budget, "host/info", now).count(), 120000);
+	const auto date_headers = "HTTP/1.1 503 Service Unavailable\r\nretry-after: " + http_date(std::chrono::system_clock::now() + std::chrono::seconds(300)) + "\r\n\r\n";
+	budget.record("overview/list", 503, date_headers, now);
+	const auto date_pause = pause_at(budget, "overview/list", now);
+	RN_CHECK(date_pause >= std::chrono::seconds(290) && date_pause <= std::chrono::seconds(300));
+}
+
+RN_TEST(request_budget_backoff)
+{
+	RateLimitConfig config;
+	config.backoff_base_seconds = 1;
+	config.backoff_max_seconds = 20;
+	RequestBudget budget(config);
+	const std::string endpoint = "host/info";
+	const auto base = std::chrono::milliseconds(1000);
+	const auto cap = std::chrono::milliseconds(20000);
+
+	auto now = budget_clock::now();
+	RN_CHECK(budget.try_acquire(endpoint, false, now));
+
+	// 首次限流从 base 开始；之后每次在 [base, 3 * 上次] 内随机增长并以 backoff_max 封顶
+	budget.record(endpoint, 429, "", now);
+	auto previous = pause_at(budget, endpoint, now);
+	RN_CHECK_EQ(previous.count(), base.count());
+	auto longest = previous;
+	for (int round = 0; round < 30; ++round)
+	{
+		const long status = round % 2 == 0 ? 503 : 429;
+		RN_CHECK(!budget.try_acquire(endpoint, false, now + previous - std::chrono::milliseconds(1)));
+		now += previous;
+		RN_CHECK(budget.try_acquire(endpoint, false, now));
+		budget.record(endpoint, status, "", now);
+		const auto pause = pause_at(budget, endpoint, now);
+		RN_CHECK(pause >= base);
+		RN_CHECK(pause <= cap);
+		RN_CHECK(pause <= previous * 3);
+
+		// 同一批次的其他限流响应不再让退避增长
+		budget.record(endpoint, status, "", now + std::chrono::milliseconds(1));
+		RN_CHECK(pause_at(budget, endpoint, now) == pause);
+
+		previous = pause;
+		longest = std::max(longest, pause);
+	}
+	RN_CHECK(longest > base * 3);
+
+	// 非限流的错误状态与传输层失败不影响退避
+	now += previous;
+	budget.record(endpoint, 404, "", now);
+	budget.record(endpoint, 0, "", now);
+	RN_CHECK(budget.try_acquire(endpoint, false, now));
+
+	// 200 与 304 都让退避回到 base
+	for (const long success : { 200L, 304L })
+	{
+		budget.record(endpoint, 429, "", now);
+		now += pause_at(budget, endpoint, now);
+		budget.record(endpoint, 429, "", now);
+		now += pause_at(budget, endpoint, now);
+		budget.record(endpoint, success, "", now);
+		budget.record(endpoint, 429, "", now);
+		RN_CHECK_EQ(pause_at(budget, endpoint, now).count(), base.count());
+		now += base;
+	}
+}
+
+RN_TEST(request_budget_background_reserve)
+{
+	// global_burst 为 1 时桶装满即可放行后台请求
+	{
+		RateLimitConfig config;
+		config.global_per_minute = 60;
+		config.global_burst = 1;
+		RequestBudget budget(config);
+		const auto now = budget_clock::now();
+		RN_CHECK(budget.try_acquire("overview/list", true, now));
+		RN_CHECK(!budget.try_acquire("overview/list", true, now));
+		RN_CHECK(!budget.try_acquire("host/info", false, now));
+		RN_CHECK(budget.try_acquire("overview/list", true, now + std::chrono::seconds(1)));
+	}
+
+	// 容量较大时后台请求只用掉一半，其余留给状态轮询
+	{
+		RateLimitConfig config;
+		config.global_per_minute = 60;
+		config.global_burst = 4;
+		RequestBudget budget(config);
+		const auto now = budget_clock::now();
+		RN_CHECK(budget.try_acquire("overview/list", true, now));
+		RN_CHECK(budget.try_acquire("overview/list", true, now));
+		RN_CHECK(!budget.try_acquire("overview/list", true, now));
+		RN_CHECK(budget.try_acquire("host/info", false, now));
+		RN_CHECK(budget.try_acquire("host/info", false, now));
+		RN_CHECK(!budget.try_acquire("host/info", false, now));
+	}
+}
+
+RN_TEST(rate_limit_config_validation)
+{
+	auto parsed_json = json{ { "global_per_minute", 120 }, { "global_burst", 0 }, { "backoff_base_seconds", 10 }, { "backoff_max_seconds", 2 },
+		{ "endpoints", { { "host/info", { { "per_minute", 30 } } } } } };
+	const auto parsed = parse_rate_limit(parsed_json);
+	RN_CHECK_EQ(parsed.global_per_minute, 120);
+	RN_CHECK_EQ(parsed.global_burst, 1);
+	RN_CHECK_EQ(parsed.backoff_base_seconds, 10);
+	RN_CHECK_EQ(parsed.backoff_max_seconds, 10);
+	RN_CHECK_EQ(parsed.endpoints.size(), std::size_t(1));
+	RN_CHECK_EQ(parsed.endpoints[0].name, "host/info");
+	RN_CHECK_EQ(parsed.endpoints[0].per_minute, 30);
+	RN_CHECK_EQ(parsed.endpoints[0].burst, 1);
+
+	RN_CHECK_EQ(rate_limit_error({ { "global_burst", 1.5 } }), "配置文件中的 global_burst 字段必须是整数");
+	RN_CHECK_EQ(rate_limit_error({ { "global_per_minute", "60" } }), "配置文件中的 global_per_minute 字段必须是整数");
+	RN_CHECK_EQ(rate_limit_error({ { "endpoints", { { "host/info", { { "burst", true } } } } } }), "配置文件中的 burst 字段必须是整数");
+
+	RN_CHECK_EQ(rate_limit_error({ { "global_per_minute", -1 } }), "配置文件中的 rate_limit.global_per_minute 必须是非负整数");
+	RN_CHECK_EQ(rate_limit_error({ { "backoff_base_seconds", -5 } }), "配置文件中的 rate_limit.backoff_base_seconds 必须是非负整数");
+	RN_CHECK_EQ(rate_limit_error({ { "endpoints", { { "host/info", { { "per_minute", -30 } } } } } }),
+		"配置文件中的 rate_limit.endpoints.host/info.per_minute 必须是非负整数");
+	RN_CHECK_EQ(rate_limit_error(json::array()), "配置文件中的 rate_limit 字段必须是对象");
+}
@@ -0,0 +1,119 @@
+"""user-043：录制中途被 SIGKILL 后重启，应续写同一个文件。
+
+状态快照每秒写一次；重启后主播仍在播同一直播间，录制接在原文件末尾：不产生新的 _N.flv，
+文件中只有一个 FLV 文件头，标签首尾相接，时间戳在接缝处也不回退。
+用法：python3 resume_restart.py <rednote_rtmp_download 路径>
+"""
+
+import json
+import os
+import struct
+import sys
+import time
+
+import standin
+
+HOSTS = ["resume01"]
+
+
+def parse_flv(data):
+    """返回 [(类型, 时间戳)]；标签结构错误时抛出 ValueError。
+
+    主程序收到 SIGINT 时直接退出，尚未写出的缓冲随之丢失，因此允许文件末尾有一个写了一半的标签。
+    """
+    if data[:3] != b"FLV":
+        raise ValueError("文件头不是 FLV")
+    pos = struct.unpack(">I", data[5:9])[0] + 4
+    tags = []
+    while pos < len(data):
+        if len(data) - pos < 15:
+            break
+        tag_type = data[pos]
+        if tag_type not in (8, 9, 18):
+            raise ValueError("偏移 %d 处的标签类型无效: %d" % (pos, tag_type))
+        size = int.from_bytes(data[pos + 1:pos + 4], "big")
+        timestamp = int.from_bytes(data[pos + 4:pos + 7], "big") | (data[pos + 7] << 24)
+        end = pos + 11 + size + 4
+        if end > len(data):
+            break
+        if struct.unpack(">I", data[end - 4:end])[0] != size + 11:
+            raise ValueError("偏移 %d 处的标签长度不一致" % pos)
+        tags.append((tag_type, timestamp))
+        pos = end
+    return tags
+
+
+def snapshot_recordings(recorder):
+    try:
+        with open(os.path.join(recorder.path, "state", "runtime.json"), encoding="utf-8") as state:
+            return json.load(state).get("recordings", [])
+    except (OSError, ValueError):
+        return []
+
+
+def main():
+    binary = sys.argv[1]
+    print("[ RUN  ] resume_restart")
+    failures = []
+    with standin.StandInServer(live_hosts=HOSTS) as server:
+        config = standin.merge_config(standin.base_config(server, HOSTS), {
+            "state": {"enabled": True, "path": "state/runtime.json", "interval_seconds": 1, "resume_window_seconds": 300},
+        })
+        with standin.Recorder(binary, config) as recorder:
+            # 快照中已记下这路录制且文件里有了一些数据再杀掉进程
+            if not standin.wait_until(lambda: snapshot_recordings(recorder) and recorder.recorded_bytes() > 100 * 1024, 30):
+                print("[ FAIL ] resume_restart: 录制或状态快照没有按时出现\n" + recorder.log_text())
+                return 1
+            time.sleep(1.5)
+            recorder.kill()
+            files_before = recorder.recorded_files()
+            bytes_before = recorder.recorded_bytes()
+
+            recorder.start()
+            if not standin.wait_until(lambda: recorder.recorded_bytes() > bytes_before + 100 * 1024, 30):
+                failures.append("重启后录制没有继续")
+            time.sleep(1)
+            recorder.stop()
+
+            files_after = recorder.recorded_files()
+            resumed = recorder.log_records("等待续写重启前的录制")
+            data = b""
+            if len(files_after) == 1:
+                with open(files_after[0], "rb") as recording:
+                    data = recording.read()
+            log_text = recorder.log_text()
+
+    if len(files_before) != 1:
+        failures.append("重启前应只有一个录制文件，实际为 %s" % files_before)
+    elif files_after != files_before:
+        failures.append("重启后没有续写原文件：%s -> %s" % (files_before, files_after))
+    if not resumed:
+        failures.append("重启后没有从状态快照登记待续写的录制")
+    if data:
+        if data.count(b"FLV\x01") != 1:
+            failures.append("文件中有 %d 个 FLV 文件头" % data.count(b"FLV\x01"))
+        try:
+            tags = parse_flv(data)
+            timestamps = [timestamp for _, timestamp in tags]
+            backwards = [i for i in range(1, len(timestamps)) if timestamps[i] < timestamps[i - 1]]
+            if backwards:
+                failures.append("时间戳在第 %d 个标签处回退: %d -> %d" % (backwards[0], timestamps[backwards[0] - 1], timestamps[backwards[0]]))
+            if sum(1 for tag_type, _ in tags if tag_type == 18) != 1:
+                failures.append("续写后出现了多个 onMetaData")
+            if len(data) <= bytes_before:
+                failures.append("续写后的文件没有变长")
+        except ValueError as ex:
+            failures.append("续写后的文件结构损坏: %s" % ex)
+
+    for failure in failures:
+        print("[ FAIL ] resume_restart: " + failure)
+    if failures:
+        print(log_text)
+        return 1
+    standin.report("resumed recording size", len(data) / 1024, "KB")
+    print("[  OK  ] resume_restart")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
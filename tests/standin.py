@@ -0,0 +1,339 @@
+"""测试与基准共用的替身环境。
+
+StandInServer 在本机模拟主播状态接口（/host/info）与 HTTP-FLV CDN（/live/*.flv），
+Recorder 在临时目录中写入 config.json 并运行主程序，同时从 /proc 采样其资源占用。
+只依赖标准库，仅用于 Linux。
+"""
+
+import copy
+import http.server
+import json
+import os
+import re
+import signal
+import struct
+import subprocess
+import tempfile
+import threading
+import time
+
+
+def flv_tag(tag_type, timestamp, data):
+    header = bytes([tag_type]) + len(data).to_bytes(3, "big") + (timestamp & 0xFFFFFF).to_bytes(3, "big")
+    header += bytes([(timestamp >> 24) & 0xFF]) + b"\0\0\0"
+    return header + data + struct.pack(">I", len(data) + 11)
+
+
+FLV_HEADER = b"FLV\x01\x05\0\0\0\x09\0\0\0\0"
+
+
+class StandInServer:
+    """live_hosts 中的主播在启动 live_after 秒后开播，room_id 为 100000 加上其在列表中的序号。
+
+    connect_delay 模拟远端 CDN 的建连耗时（TCP + TLS）：每条新连接在处理第一个请求前等待这么久，
+    复用的连接不受影响。stream_kbps 为每路直播流的码率，orig_kbps 给出时原画流（路径含 _orig）按它发送。
+    windows 按主播给出 (开播时刻, 下播时刻)，均为相对启动的秒数，下播时刻为 None 表示一直在播；
+    下播后状态接口不再返回直播间，正在发送的直播流随之结束。
+    """
+
+    def __init__(self, live_hosts=(), live_after=0.0, connect_delay=0.0, stream_kbps=800, orig_kbps=None, windows=None):
+        self.live_hosts = {host_id: 100000 + index for index, host_id in enumerate(live_hosts)}
+        self.room_hosts = {room_id: host_id for host_id, room_id in self.live_hosts.items()}
+        self.live_after = live_after
+        self.windows = dict(windows or {})
+        self.connect_delay = connect_delay
+        self.stream_kbps = stream_kbps
+        self.orig_kbps = orig_kbps
+        self.started = time.monotonic()
+        self.lock = threading.Lock()
+        # room_id -> 首次返回开播状态的时间 / 首次发出直播流数据的时间
+        self.first_live_at = {}
+        self.first_stream_byte_at = {}
+        self.connections = 0
+        # 收到的直播流请求：(room_id, 是否原画, 时间)
+        self.stream_requests = []
+        self.stopping = threading.Event()
+
+        handler = self._make_handler()
+        self.httpd = http.server.ThreadingHTTPServer(("127.0.0.1", 0), handler)
+        self.httpd.daemon_threads = True
+        self.port = self.httpd.server_address[1]
+        self.thread = threading.Thread(target=self.httpd.serve_forever, daemon=True)
+        self.thread.start()
+
+    def url(self, path):
+        return "http://127.0.0.1:%d%s" % (self.port, path)
+
+    def room_id(self, host_id):
+        return self.live_hosts[host_id]
+
+    def is_live(self, host_id):
+        if host_id not in self.live_hosts:
+            return False
+        start, end = self.windows.get(host_id, (self.live_after, None))
+        elapsed = time.monotonic() - self.started
+        return elapsed >= start and (end is None or elapsed < end)
+
+    def stop(self):
+        self.stopping.set()
+        self.httpd.shutdown()
+        self.httpd.server_close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.stop()
+
+    def _make_handler(self):
+        server = self
+
+        class Handler(http.server.BaseHTTPRequestHandler):
+            protocol_version = "HTTP/1.1"
+
+            def log_message(self, *args):
+                pass
+
+            def handle(self):
+                with server.lock:
+                    server.connections += 1
+                if server.connect_delay > 0:
+                    time.sleep(server.connect_delay)
+                super().handle()
+
+            def send_body(self, status, body, content_type="application/json"):
+                self.send_response(status)
+                self.send_header("Content-Type", content_type)
+                self.send_header("Content-Length", str(len(body)))
+                self.end_headers()
+                self.wfile.write(body)
+
+            def do_HEAD(self):
+                self.send_response(404)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+
+            def do_GET(self):
+                if self.path.startswith("/host/info"):
+                    self.host_info()
+                elif self.path.startswith("/live/"):
+                    self.live_stream()
+                else:
+                    self.send_body(404, b"")
+
+            def host_info(self):
+                host_id = self.path.split("host_id=", 1)[-1]
+                room_id = server.live_hosts.get(host_id)
+                if not server.is_live(host_id):
+                    self.send_body(200, json.dumps({"data": {}}).encode())
+                    return
+                with server.lock:
+                    server.first_live_at.setdefault(room_id, time.monotonic())
+                self.send_body(200, json.dumps({"data": {"room": {"room_id": room_id}}}).encode())
+
+            def live_stream(self):
+                room_id = int(re.match(r"/live/(\d+)", self.path).group(1))
+                host_id = server.room_hosts.get(room_id)
+                orig = "_orig" in self.path
+                with server.lock:
+                    server.stream_requests.append((room_id, orig, time.monotonic()))
+                self.send_response(200)
+                self.send_header("Content-Type", "video/x-flv")
+                self.send_header("Transfer-Encoding", "chunked")
+                self.end_headers()
+
+                def send(data):
+                    self.wfile.write(b"%x\r\n" % len(data) + data + b"\r\n")
+                    self.wfile.flush()
+
+                # 每 100 ms 发出一个关键帧加若干个普通帧，总量与码率相符
+                kbps = server.orig_kbps if orig and server.orig_kbps else server.stream_kbps
+                chunk_bytes = max(1, kbps * 1000 // 8 // 10)
+                frames = 5
+                try:
+                    send(FLV_HEADER + flv_tag(18, 0, b"meta") + flv_tag(9, 0, b"\x17\x00seqhdr") + flv_tag(8, 0, b"\xaf\x00aac"))
+                    with server.lock:
+                        server.first_stream_byte_at.setdefault(room_id, time.monotonic())
+                    timestamp = 0
+                    while not server.stopping.is_set() and server.is_live(host_id):
+                        chunk = b""
+                        for frame in range(frames):
+                            prefix = b"\x17\x01" if frame == 0 else b"\x27\x01"
+                            chunk += flv_tag(9, timestamp, prefix + b"v" * (chunk_bytes // frames))
+                            timestamp += 100 // frames
+                        send(chunk)
+                        time.sleep(0.1)
+                    self.wfile.write(b"0\r\n\r\n")
+                except (BrokenPipeError, ConnectionResetError):
+                    pass
+                self.close_connection = True
+
+        return Handler
+
+
+def merge_config(base, overrides):
+    result = copy.deepcopy(base)
+    for key, value in overrides.items():
+        if isinstance(value, dict) and isinstance(result.get(key), dict):
+            result[key] = merge_config(result[key], value)
+        else:
+            result[key] = copy.deepcopy(value)
+    return result
+
+
+def base_config(server, hosts):
+    """全部录制走 HTTP-FLV，不依赖 rtmpdump；其余可选功能默认关闭，由各用例按需打开。"""
+    return {
+        "host_id": list(hosts),
+        "normal_wait_seconds": 1,
+        "likely_broadcast_times": ["03:00"],
+        "request": {
+            "base_url": server.url("/host/info"),
+            "headers": {"user-agent": "standin"},
+            "timeout_seconds": 5,
+            "history_pages": 0,
+            "rate_limit": {"global_per_minute": 60000, "global_burst": 1000},
+        },
+        "download": {
+            "base_stream_url": server.url("/live/"),
+            "output_roots": [{"path": "out", "tier": "scratch", "min_free_mb": 1}],
+        },
+        "recording": {
+            "prefer_orig": True,
+            "orig_stream_url_template": server.url("/live/{room_id}_orig.flv"),
+        },
+        "logging": {"level": "info"},
+        "prewarm": {"enabled": False},
+        "chat": {"enabled": False},
+        "relay": {"enabled": False},
+        "tracing": {"enabled": False},
+        "state": {"enabled": False},
+    }
+
+
+LOG_FIELD = re.compile(r'(\w+)=("(?:[^"\\]|\\.)*"|\S+)')
+
+
+def parse_log_fields(line):
+    fields = {}
+    for key, value in LOG_FIELD.findall(line):
+        fields[key] = json.loads(value) if value.startswith('"') else value
+    return fields
+
+
+class Recorder:
+    """在临时目录中以给定配置运行主程序；退出时发送 SIGINT 并等待进程结束。
+
+    主程序没有安装 SIGINT 处理，收到后立即退出，录制文件末尾可能留下写了一半的标签。
+    """
+
+    def __init__(self, binary, config):
+        self.binary = os.path.abspath(binary)
+        self.workdir = tempfile.TemporaryDirectory(prefix="rn_standin_")
+        self.path = self.workdir.name
+        config = copy.deepcopy(config)
+        programs = config.setdefault("programs", {})
+        if "rtmpdump_exe" not in programs:
+            # 启动时要求 rtmpdump 存在；替身环境只走 HTTP-FLV，放一个不会被调用的占位程序
+            stub = os.path.join(self.path, "rtmpdump.exe")
+            with open(stub, "w") as stub_file:
+                stub_file.write("#!/bin/sh\nexit 1\n")
+            os.chmod(stub, 0o755)
+            programs["rtmpdump_exe"] = stub
+        with open(os.path.join(self.path, "config.json"), "w", encoding="utf-8") as config_file:
+            json.dump(config, config_file, ensure_ascii=False, indent=1)
+        self.log_path = os.path.join(self.path, "run.log")
+        self.process = None
+
+    def __enter__(self):
+        self.start()
+        return self
+
+    def start(self):
+        """启动主程序；kill 之后再次调用时沿用同一目录，日志接在原日志之后。"""
+        self.log_file = open(self.log_path, "ab")
+        self.process = subprocess.Popen([self.binary], cwd=self.path, stdout=self.log_file, stderr=subprocess.STDOUT)
+
+    def __exit__(self, *exc):
+        self.stop()
+        self.workdir.cleanup()
+
+    def stop(self):
+        if self.process and self.process.poll() is None:
+            self.process.send_signal(signal.SIGINT)
+            try:
+                self.process.wait(timeout=20)
+            except subprocess.TimeoutExpired:
+                self.process.kill()
+                self.process.wait()
+        if not self.log_file.closed:
+            self.log_file.close()
+
+    def kill(self):
+        """模拟异常退出：SIGKILL，不给主程序收尾的机会。"""
+        self.process.kill()
+        self.process.wait()
+        self.log_file.close()
+
+    def running(self):
+        return self.process.poll() is None
+
+    def log_text(self):
+        with open(self.log_path, "rb") as log_file:
+            return log_file.read().decode("utf-8", "replace")
+
+    def log_records(self, message):
+        return [parse_log_fields(line) for line in self.log_text().splitlines() if " %s" % message in line]
+
+    def log_events(self, messages):
+        """按日志顺序返回 (消息, 字段) 列表，只保留 messages 中的消息。"""
+        events = []
+        for line in self.log_text().splitlines():
+            for message in messages:
+                if " %s " % message in line + " ":
+                    events.append((message, parse_log_fields(line)))
+                    break
+        return events
+
+    def proc_status(self, key):
+        with open("/proc/%d/status" % self.process.pid) as status:
+            for line in status:
+                if line.startswith(key + ":"):
+                    return int(line.split()[1])
+        return 0
+
+    def rss_kb(self):
+        return self.proc_status("VmRSS")
+
+    def threads(self):
+        return self.proc_status("Threads")
+
+    def cpu_seconds(self):
+        with open("/proc/%d/stat" % self.process.pid) as stat:
+            fields = stat.read().rsplit(")", 1)[1].split()
+        return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+    def recorded_bytes(self):
+        total = 0
+        for root, _, files in os.walk(os.path.join(self.path, "out")):
+            total += sum(os.path.getsize(os.path.join(root, name)) for name in files if name.endswith(".flv"))
+        return total
+
+    def recorded_files(self):
+        result = []
+        for root, _, files in os.walk(os.path.join(self.path, "out")):
+            result += [os.path.join(root, name) for name in files if name.endswith(".flv")]
+        return result
+
+
+def wait_until(predicate, timeout, interval=0.1):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if predicate():
+            return True
+        time.sleep(interval)
+    return predicate()
+
+
+def report(name, value, unit):
+    print("  %-44s%12.1f %s" % (name, value, unit))